@@ -1,7 +1,7 @@
 #!/bin/bash
 
 idf.py build && \
-scp build/bootloader/bootloader.bin build/partition_table/partition-table.bin build/weather_station.bin CMakeLists.txt michael@usbpi.taco.open0x20.de:/builder/
+scp build/bootloader/bootloader.bin build/partition_table/partition-table.bin build/ota_data_initial.bin build/weather_station.bin CMakeLists.txt michael@usbpi.taco.open0x20.de:/builder/
 
 exit 0
 
@@ -9,5 +9,5 @@ exit 0
 # Afterwards execute the following on the usbpi host:
 python -m esptool --chip esp32 -b 460800 --before default_reset \
 --after hard_reset write_flash --flash_mode dio --flash_size detect \
---flash_freq 40m 0x1000 /builder/bootloader.bin 0x8000 /builder/partition-table.bin 0x10000 /builder/weather_station.bin \
+--flash_freq 40m 0x1000 /builder/bootloader.bin 0x8000 /builder/partition-table.bin 0xf000 /builder/ota_data_initial.bin 0x20000 /builder/weather_station.bin \
 && idf.py monitor
\ No newline at end of file
@@ -0,0 +1,110 @@
+#include <string.h>
+#include <math.h>
+
+#include "aggregator.h"
+
+/**
+ * Returns [reading] of [measurement], see SENSORS_READINGS
+*/
+float aggregator_reading_get(const struct sensor_data_t* measurement, uint8_t reading)
+{
+    switch (reading) {
+    case 0: return measurement->temperature;
+    case 1: return measurement->temperature_inside;
+    case 2: return measurement->humidity;
+    case 3: return measurement->pressure;
+    case 4: return measurement->daylight;
+    case 5: return measurement->uv;
+    case 6: return measurement->battery_voltage;
+    case 7: return measurement->battery_charge;
+    default: return measurement->battery_charge_rate;
+    }
+}
+
+static void aggregator_reading_set(struct sensor_data_t* measurement, uint8_t reading, float value)
+{
+    switch (reading) {
+    case 0: measurement->temperature = value; break;
+    case 1: measurement->temperature_inside = value; break;
+    case 2: measurement->humidity = value; break;
+    case 3: measurement->pressure = value; break;
+    case 4: measurement->daylight = (uint32_t) lroundf(value); break;
+    case 5: measurement->uv = (uint16_t) lroundf(value); break;
+    case 6: measurement->battery_voltage = value; break;
+    case 7: measurement->battery_charge = value; break;
+    default: measurement->battery_charge_rate = value; break;
+    }
+}
+
+void aggregator_reset(struct aggregator_t* aggregator)
+{
+    memset(aggregator, 0, sizeof(struct aggregator_t));
+}
+
+/**
+ * Whether [timestamp] falls into the window the aggregator collects. An
+ * empty aggregator has no window yet.
+*/
+bool aggregator_is_in_window(const struct aggregator_t* aggregator, uint32_t timestamp, uint16_t window)
+{
+    return aggregator->count > 0 && timestamp / window * window == aggregator->window_start;
+}
+
+/**
+ * Adds [sample] to the running statistics. The first sample opens the
+ * window it falls into.
+*/
+void aggregator_add(struct aggregator_t* aggregator, const struct sensor_data_t* sample, uint16_t window)
+{
+    if (aggregator->count == 0) {
+        aggregator->window_start = sample->timestamp / window * window;
+    }
+
+    aggregator->count += 1;
+
+    for (uint8_t i = 0; i < SENSORS_READINGS; i++) {
+        struct aggregator_field_t* field = &aggregator->fields[i];
+        float value = aggregator_reading_get(sample, i);
+
+        if (aggregator->count == 1) {
+            field->min = value;
+            field->max = value;
+            field->mean = value;
+            field->m2 = 0;
+            continue;
+        }
+
+        if (value < field->min) field->min = value;
+        if (value > field->max) field->max = value;
+
+        float delta = value - field->mean;
+        field->mean += delta / aggregator->count;
+        field->m2 += delta * (value - field->mean);
+    }
+}
+
+/**
+ * Writes the mean, min, max and sample standard deviation of the window into
+ * [records], with the start of the window as timestamp. Sequence numbers are
+ * left to the caller.
+*/
+void aggregator_finish(const struct aggregator_t* aggregator, struct sensor_data_t records[AGGREGATOR_RECORDS])
+{
+    static const uint8_t kinds[AGGREGATOR_RECORDS] = {SENSORS_KIND_MEAN, SENSORS_KIND_MIN, SENSORS_KIND_MAX, SENSORS_KIND_STDDEV};
+
+    for (uint8_t r = 0; r < AGGREGATOR_RECORDS; r++) {
+        memset(&records[r], 0, sizeof(struct sensor_data_t));
+        records[r].timestamp = aggregator->window_start;
+        records[r].kind = kinds[r];
+    }
+
+    for (uint8_t i = 0; i < SENSORS_READINGS; i++) {
+        const struct aggregator_field_t* field = &aggregator->fields[i];
+        float variance = aggregator->count > 1 ? field->m2 / (aggregator->count - 1) : 0;
+
+        aggregator_reading_set(&records[0], i, field->mean);
+        aggregator_reading_set(&records[1], i, field->min);
+        aggregator_reading_set(&records[2], i, field->max);
+        aggregator_reading_set(&records[3], i, sqrtf(variance > 0 ? variance : 0));
+    }
+}
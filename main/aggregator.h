@@ -0,0 +1,48 @@
+#ifndef __WEATHER_STATION__AGGREGATOR_H__
+#define __WEATHER_STATION__AGGREGATOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sensors.h"
+
+/**
+ * Records an aggregation window turns into: mean, min, max, stddev
+*/
+#define AGGREGATOR_RECORDS 4
+
+/**
+ * Running statistics of one reading (Welford)
+*/
+struct aggregator_field_t {
+    float min;
+    float max;
+    float mean;
+
+    /**
+     * Sum of squared differences from the mean
+    */
+    float m2;
+};
+
+/**
+ * Statistics of the samples of one aggregation window. Small enough to be
+ * kept in rtc memory, samples are added one per wake.
+*/
+struct aggregator_t {
+    /**
+     * Start of the window as unix timestamp. Windows are aligned to
+     * multiples of their length, e.g. 10:00 to 10:10.
+    */
+    uint32_t window_start;
+    uint16_t count;
+    struct aggregator_field_t fields[SENSORS_READINGS];
+};
+
+float aggregator_reading_get(const struct sensor_data_t* measurement, uint8_t reading);
+void aggregator_reset(struct aggregator_t* aggregator);
+bool aggregator_is_in_window(const struct aggregator_t* aggregator, uint32_t timestamp, uint16_t window);
+void aggregator_add(struct aggregator_t* aggregator, const struct sensor_data_t* sample, uint16_t window);
+void aggregator_finish(const struct aggregator_t* aggregator, struct sensor_data_t records[AGGREGATOR_RECORDS]);
+
+#endif
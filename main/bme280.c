@@ -0,0 +1,128 @@
+#include "bme280.h"
+
+/**
+ * Integer compensation of the BME280 as given by Bosch in the datasheet
+ * (BST-BME280-DS002, 4.2.3). Temperature and humidity use 32 bit
+ * arithmetic, pressure 64 bit.
+*/
+
+static uint16_t bme280_u16(const uint8_t* data)
+{
+    return data[0] | (data[1] << 8);
+}
+
+/**
+ * Decodes the trimming parameters read from [t_p] (0x88..0xA1) and
+ * [h] (0xE1..0xE7)
+*/
+void bme280_parse_calibration(const uint8_t* t_p, const uint8_t* h, struct bme280_calibration_t* calibration)
+{
+    calibration->dig_T1 = bme280_u16(&t_p[0]);
+    calibration->dig_T2 = (int16_t) bme280_u16(&t_p[2]);
+    calibration->dig_T3 = (int16_t) bme280_u16(&t_p[4]);
+    calibration->dig_P1 = bme280_u16(&t_p[6]);
+    calibration->dig_P2 = (int16_t) bme280_u16(&t_p[8]);
+    calibration->dig_P3 = (int16_t) bme280_u16(&t_p[10]);
+    calibration->dig_P4 = (int16_t) bme280_u16(&t_p[12]);
+    calibration->dig_P5 = (int16_t) bme280_u16(&t_p[14]);
+    calibration->dig_P6 = (int16_t) bme280_u16(&t_p[16]);
+    calibration->dig_P7 = (int16_t) bme280_u16(&t_p[18]);
+    calibration->dig_P8 = (int16_t) bme280_u16(&t_p[20]);
+    calibration->dig_P9 = (int16_t) bme280_u16(&t_p[22]);
+    calibration->dig_H1 = t_p[25];
+
+    // dig_H4 and dig_H5 are 12 bit and share 0xE5
+    calibration->dig_H2 = (int16_t) bme280_u16(&h[0]);
+    calibration->dig_H3 = h[2];
+    calibration->dig_H4 = (int16_t) (((int8_t) h[3]) * 16 | (h[4] & 0x0F));
+    calibration->dig_H5 = (int16_t) (((int8_t) h[5]) * 16 | (h[4] >> 4));
+    calibration->dig_H6 = (int8_t) h[6];
+}
+
+/**
+ * Splits the burst read of 0xF7..0xFE into the raw readings. [adc_h] is
+ * only set if not NULL, the humidity bytes may be left out of the read then.
+*/
+void bme280_parse_data(const uint8_t* data, int32_t* adc_p, int32_t* adc_t, int32_t* adc_h)
+{
+    *adc_p = ((int32_t) data[0] << 12) | (data[1] << 4) | (data[2] >> 4);
+    *adc_t = ((int32_t) data[3] << 12) | (data[4] << 4) | (data[5] >> 4);
+    if (adc_h) {
+        *adc_h = (data[6] << 8) | data[7];
+    }
+}
+
+uint8_t bme280_ctrl_meas(uint8_t oversampling_t, uint8_t oversampling_p, uint8_t mode)
+{
+    return (oversampling_t & 0b111) << 5 | (oversampling_p & 0b111) << 2 | (mode & 0b11);
+}
+
+/**
+ * Maximum duration of a forced measurement (datasheet 9.1)
+*/
+uint32_t bme280_measurement_time_us(uint8_t oversampling_t, uint8_t oversampling_p, uint8_t oversampling_h)
+{
+    uint32_t time_us = 1250;
+
+    if (oversampling_t) time_us += 2300 * (1 << (oversampling_t - 1));
+    if (oversampling_p) time_us += 2300 * (1 << (oversampling_p - 1)) + 575;
+    if (oversampling_h) time_us += 2300 * (1 << (oversampling_h - 1)) + 575;
+
+    return time_us;
+}
+
+/**
+ * Returns the temperature in 0.01 °C, [t_fine] carries it on to the
+ * pressure and humidity compensation
+*/
+int32_t bme280_compensate_temperature(const struct bme280_calibration_t* calibration, int32_t adc_t, int32_t* t_fine)
+{
+    int32_t var1 = ((((adc_t >> 3) - ((int32_t) calibration->dig_T1 << 1))) * ((int32_t) calibration->dig_T2)) >> 11;
+    int32_t var2 = (((((adc_t >> 4) - ((int32_t) calibration->dig_T1)) * ((adc_t >> 4) - ((int32_t) calibration->dig_T1))) >> 12) * ((int32_t) calibration->dig_T3)) >> 14;
+
+    *t_fine = var1 + var2;
+    return (*t_fine * 5 + 128) >> 8;
+}
+
+/**
+ * Returns the pressure in Pa as unsigned Q24.8, e.g. 24674867 = 96386.2 Pa
+*/
+uint32_t bme280_compensate_pressure(const struct bme280_calibration_t* calibration, int32_t adc_p, int32_t t_fine)
+{
+    int64_t var1 = ((int64_t) t_fine) - 128000;
+    int64_t var2 = var1 * var1 * (int64_t) calibration->dig_P6;
+    var2 = var2 + ((var1 * (int64_t) calibration->dig_P5) * 131072);
+    var2 = var2 + (((int64_t) calibration->dig_P4) * 34359738368);
+    var1 = ((var1 * var1 * (int64_t) calibration->dig_P3) >> 8) + ((var1 * (int64_t) calibration->dig_P2) * 4096);
+    var1 = ((((int64_t) 1) << 47) + var1) * ((int64_t) calibration->dig_P1) >> 33;
+
+    // Avoid the division by zero of an uncalibrated sensor
+    if (var1 == 0) {
+        return 0;
+    }
+
+    int64_t p = 1048576 - adc_p;
+    p = (((p * 2147483648) - var2) * 3125) / var1;
+    var1 = (((int64_t) calibration->dig_P9) * (p >> 13) * (p >> 13)) >> 25;
+    var2 = (((int64_t) calibration->dig_P8) * p) >> 19;
+    p = ((p + var1 + var2) >> 8) + (((int64_t) calibration->dig_P7) * 16);
+
+    return (uint32_t) p;
+}
+
+/**
+ * Returns the relative humidity in % as unsigned Q22.10, e.g. 47445 = 46.333 %
+*/
+uint32_t bme280_compensate_humidity(const struct bme280_calibration_t* calibration, int32_t adc_h, int32_t t_fine)
+{
+    int32_t v_x1 = t_fine - ((int32_t) 76800);
+
+    v_x1 = (((((adc_h << 14) - (((int32_t) calibration->dig_H4) * 1048576) - (((int32_t) calibration->dig_H5) * v_x1)) + ((int32_t) 16384)) >> 15)
+        * (((((((v_x1 * ((int32_t) calibration->dig_H6)) >> 10) * (((v_x1 * ((int32_t) calibration->dig_H3)) >> 11) + ((int32_t) 32768))) >> 10)
+        + ((int32_t) 2097152)) * ((int32_t) calibration->dig_H2) + 8192) >> 14));
+    v_x1 = (v_x1 - (((((v_x1 >> 15) * (v_x1 >> 15)) >> 7) * ((int32_t) calibration->dig_H1)) >> 4));
+    v_x1 = (v_x1 < 0 ? 0 : v_x1);
+    v_x1 = (v_x1 > 419430400 ? 419430400 : v_x1);
+
+    return (uint32_t) (v_x1 >> 12);
+}
@@ -0,0 +1,76 @@
+#ifndef __WEATHER_STATION__BME280_H__
+#define __WEATHER_STATION__BME280_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define BME280_REGISTER_CALIBRATION_T_P 0x88
+#define BME280_REGISTER_CHIPID          0xD0
+#define BME280_REGISTER_CALIBRATION_H   0xE1
+#define BME280_REGISTER_CTRL_HUM        0xF2
+#define BME280_REGISTER_STATUS          0xF3
+#define BME280_REGISTER_CTRL_MEAS       0xF4
+#define BME280_REGISTER_DATA            0xF7
+
+#define BME280_CHIPID 0x60
+
+/**
+ * 0x88..0xA1: temperature and pressure trimming, dig_H1 at the end
+*/
+#define BME280_CALIBRATION_T_P_SZ 26
+
+/**
+ * 0xE1..0xE7: humidity trimming
+*/
+#define BME280_CALIBRATION_H_SZ 7
+
+/**
+ * 0xF7..0xFE: pressure, temperature (20 bits each), humidity (16 bits)
+*/
+#define BME280_DATA_SZ 8
+#define BME280_DATA_T_P_SZ 6
+
+#define BME280_STATUS_MEASURING 0b00001000
+#define BME280_MODE_FORCED 0b01
+
+/**
+ * Oversampling settings, 0 skips the measurement
+*/
+#define BME280_OVERSAMPLING_SKIPPED 0
+#define BME280_OVERSAMPLING_1X      1
+#define BME280_OVERSAMPLING_2X      2
+#define BME280_OVERSAMPLING_4X      3
+#define BME280_OVERSAMPLING_8X      4
+#define BME280_OVERSAMPLING_16X     5
+
+struct bme280_calibration_t {
+    uint16_t dig_T1;
+    int16_t dig_T2;
+    int16_t dig_T3;
+    uint16_t dig_P1;
+    int16_t dig_P2;
+    int16_t dig_P3;
+    int16_t dig_P4;
+    int16_t dig_P5;
+    int16_t dig_P6;
+    int16_t dig_P7;
+    int16_t dig_P8;
+    int16_t dig_P9;
+    uint8_t dig_H1;
+    int16_t dig_H2;
+    uint8_t dig_H3;
+    int16_t dig_H4;
+    int16_t dig_H5;
+    int8_t dig_H6;
+};
+
+void bme280_parse_calibration(const uint8_t* t_p, const uint8_t* h, struct bme280_calibration_t* calibration);
+void bme280_parse_data(const uint8_t* data, int32_t* adc_p, int32_t* adc_t, int32_t* adc_h);
+uint8_t bme280_ctrl_meas(uint8_t oversampling_t, uint8_t oversampling_p, uint8_t mode);
+uint32_t bme280_measurement_time_us(uint8_t oversampling_t, uint8_t oversampling_p, uint8_t oversampling_h);
+
+int32_t bme280_compensate_temperature(const struct bme280_calibration_t* calibration, int32_t adc_t, int32_t* t_fine);
+uint32_t bme280_compensate_pressure(const struct bme280_calibration_t* calibration, int32_t adc_p, int32_t t_fine);
+uint32_t bme280_compensate_humidity(const struct bme280_calibration_t* calibration, int32_t adc_h, int32_t t_fine);
+
+#endif
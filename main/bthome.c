@@ -0,0 +1,174 @@
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "esp_err.h"
+#include "mbedtls/ccm.h"
+
+#include "sensors.h"
+#include "bthome.h"
+
+/**
+ * Device information byte: BTHome version 2, optionally encrypted
+*/
+#define BTHOME_DEVICE_INFO_VERSION 0x40
+#define BTHOME_DEVICE_INFO_ENCRYPTED 0x01
+
+#define BTHOME_OBJECT_PACKET_ID 0x00
+#define BTHOME_OBJECT_BATTERY 0x01
+#define BTHOME_OBJECT_TEMPERATURE 0x02
+#define BTHOME_OBJECT_HUMIDITY 0x03
+#define BTHOME_OBJECT_PRESSURE 0x04
+#define BTHOME_OBJECT_ILLUMINANCE 0x05
+#define BTHOME_OBJECT_VOLTAGE 0x0C
+#define BTHOME_OBJECT_UV_INDEX 0x46
+
+struct bthome_object_t {
+    uint8_t id;
+    uint8_t size;
+
+    /**
+     * Lower values are kept first when not all objects fit
+    */
+    uint8_t priority;
+    int64_t value;
+
+    /**
+     * Readings that are not a number are left out
+    */
+    bool present;
+};
+
+static int64_t bthome_scale(float value, float factor, int64_t min, int64_t max)
+{
+    float scaled = roundf(value * factor);
+
+    if (isnan(scaled)) return 0;
+    if (scaled < min) return min;
+    if (scaled > max) return max;
+    return (int64_t) scaled;
+}
+
+static esp_err_t bthome_encrypt(const uint8_t* key, const uint8_t* mac, uint8_t device_info, uint32_t counter, const uint8_t* plain, size_t plain_length, uint8_t* cipher, uint8_t* mic)
+{
+    mbedtls_ccm_context ccm;
+    uint8_t nonce[13];
+
+    // Nonce: mac, uuid, device info and counter
+    memcpy(&nonce[0], mac, BTHOME_MAC_SZ);
+    nonce[6] = BTHOME_UUID & 0xFF;
+    nonce[7] = BTHOME_UUID >> 8;
+    nonce[8] = device_info;
+    nonce[9] = counter & 0xFF;
+    nonce[10] = (counter >> 8) & 0xFF;
+    nonce[11] = (counter >> 16) & 0xFF;
+    nonce[12] = (counter >> 24) & 0xFF;
+
+    mbedtls_ccm_init(&ccm);
+    int ret = mbedtls_ccm_setkey(&ccm, MBEDTLS_CIPHER_ID_AES, key, BTHOME_KEY_SZ * 8);
+    if (ret == 0) {
+        ret = mbedtls_ccm_encrypt_and_tag(&ccm, plain_length, nonce, sizeof(nonce), NULL, 0, plain, cipher, mic, BTHOME_MIC_SZ);
+    }
+    mbedtls_ccm_free(&ccm);
+
+    return ret == 0 ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Encodes [measurement] as BTHome v2 service data (uuid, device info and
+ * objects) that fits into a single advertising packet next to the flags.
+ *
+ * Objects are added by priority until the packet is full and written in
+ * ascending object id order. If [key] is set the objects are encrypted with
+ * AES-CCM, using the sequence number as counter and [mac] as part of the
+ * nonce. Encryption takes 8 bytes, so fewer objects fit.
+*/
+esp_err_t bthome_encode_service_data(uint8_t* buffer, size_t buffer_length, const struct sensor_data_t* measurement, const uint8_t* key, const uint8_t* mac, size_t* written_length)
+{
+    struct bthome_object_t objects[] = {
+        { BTHOME_OBJECT_PACKET_ID,   1, 0, measurement->sequence & 0xFF, true },
+        { BTHOME_OBJECT_BATTERY,     1, 3, bthome_scale(measurement->battery_charge, 1.0f, 0, 100), !isnan(measurement->battery_charge) },
+        { BTHOME_OBJECT_TEMPERATURE, 2, 1, bthome_scale(measurement->temperature, 100.0f, INT16_MIN, INT16_MAX), !isnan(measurement->temperature) },
+        { BTHOME_OBJECT_HUMIDITY,    2, 2, bthome_scale(measurement->humidity, 100.0f, 0, UINT16_MAX), !isnan(measurement->humidity) },
+        { BTHOME_OBJECT_PRESSURE,    3, 4, bthome_scale(measurement->pressure, 100.0f, 0, 0xFFFFFF), !isnan(measurement->pressure) },
+        { BTHOME_OBJECT_ILLUMINANCE, 3, 5, bthome_scale(measurement->daylight, 100.0f, 0, 0xFFFFFF), true },
+        { BTHOME_OBJECT_VOLTAGE,     2, 7, bthome_scale(measurement->battery_voltage, 1000.0f, 0, UINT16_MAX), !isnan(measurement->battery_voltage) },
+        { BTHOME_OBJECT_UV_INDEX,    1, 6, bthome_scale(measurement->uv, 10.0f, 0, UINT8_MAX), true },
+    };
+    size_t objects_length = sizeof(objects) / sizeof(objects[0]);
+    bool selected[sizeof(objects) / sizeof(objects[0])] = {0};
+    uint8_t plain[BTHOME_SERVICE_DATA_MAX_SZ];
+    size_t plain_length = 0;
+
+    *written_length = 0;
+
+    if (buffer_length < BTHOME_SERVICE_DATA_MAX_SZ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    // Uuid and device info, followed by counter and mic if encrypted
+    size_t budget = BTHOME_SERVICE_DATA_MAX_SZ - 3;
+    if (key) {
+        budget -= BTHOME_COUNTER_SZ + BTHOME_MIC_SZ;
+    }
+
+    // Select by priority, every object takes its id byte plus its value
+    for (uint8_t priority = 0; priority < objects_length; priority++) {
+        for (size_t i = 0; i < objects_length; i++) {
+            if (objects[i].present && objects[i].priority == priority && plain_length + 1 + objects[i].size <= budget) {
+                selected[i] = true;
+                plain_length += 1 + objects[i].size;
+            }
+        }
+    }
+
+    // Write in ascending object id order, values are little endian
+    plain_length = 0;
+    for (size_t i = 0; i < objects_length; i++) {
+        if (!selected[i]) {
+            continue;
+        }
+
+        plain[plain_length++] = objects[i].id;
+        for (uint8_t b = 0; b < objects[i].size; b++) {
+            plain[plain_length++] = ((uint64_t) objects[i].value >> (8 * b)) & 0xFF;
+        }
+    }
+
+    uint8_t device_info = BTHOME_DEVICE_INFO_VERSION | (key ? BTHOME_DEVICE_INFO_ENCRYPTED : 0);
+    size_t length = 0;
+
+    buffer[length++] = BTHOME_UUID & 0xFF;
+    buffer[length++] = BTHOME_UUID >> 8;
+    buffer[length++] = device_info;
+
+    if (key) {
+        uint32_t counter = measurement->sequence;
+
+        esp_err_t err = bthome_encrypt(key, mac, device_info, counter, plain, plain_length, &buffer[length], &buffer[length + plain_length + BTHOME_COUNTER_SZ]);
+        if (err != ESP_OK) {
+            return err;
+        }
+        length += plain_length;
+
+        buffer[length++] = counter & 0xFF;
+        buffer[length++] = (counter >> 8) & 0xFF;
+        buffer[length++] = (counter >> 16) & 0xFF;
+        buffer[length++] = (counter >> 24) & 0xFF;
+        length += BTHOME_MIC_SZ;
+    } else {
+        memcpy(&buffer[length], plain, plain_length);
+        length += plain_length;
+    }
+
+    *written_length = length;
+    return ESP_OK;
+}
+
+/**
+ * Returns the length of the advertising packet carrying [service_data_length]
+ * bytes of service data
+*/
+size_t bthome_advertisement_length(size_t service_data_length)
+{
+    return BTHOME_ADV_FLAGS_SZ + BTHOME_ADV_STRUCTURE_HEADER_SZ + service_data_length;
+}
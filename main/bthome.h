@@ -0,0 +1,28 @@
+#ifndef __WEATHER_STATION__BTHOME_H__
+#define __WEATHER_STATION__BTHOME_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sensors.h"
+
+#define BTHOME_UUID 0xFCD2
+
+/**
+ * A legacy advertising packet holds 31 bytes. The flags take 3 of them and
+ * the service data structure needs 2 for its length and type.
+*/
+#define BTHOME_ADV_MAX_SZ 31
+#define BTHOME_ADV_FLAGS_SZ 3
+#define BTHOME_ADV_STRUCTURE_HEADER_SZ 2
+#define BTHOME_SERVICE_DATA_MAX_SZ (BTHOME_ADV_MAX_SZ - BTHOME_ADV_FLAGS_SZ - BTHOME_ADV_STRUCTURE_HEADER_SZ)
+
+#define BTHOME_KEY_SZ 16
+#define BTHOME_MAC_SZ 6
+#define BTHOME_COUNTER_SZ 4
+#define BTHOME_MIC_SZ 4
+
+esp_err_t bthome_encode_service_data(uint8_t* buffer, size_t buffer_length, const struct sensor_data_t* measurement, const uint8_t* key, const uint8_t* mac, size_t* written_length);
+size_t bthome_advertisement_length(size_t service_data_length);
+
+#endif
@@ -0,0 +1,135 @@
+#include <string.h>
+
+#include "coap_message.h"
+
+/**
+ * Appends an option with delta encoding (RFC 7252 3.1). Options have to be
+ * appended in ascending order of their numbers. Returns the new length or 0
+ * if the option does not fit.
+*/
+size_t coap_message_put_option(uint8_t* buffer, size_t length, size_t capacity, uint16_t* last_number, uint16_t number, const uint8_t* value, size_t value_length)
+{
+    uint16_t delta = number - *last_number;
+    uint8_t header[5];
+    size_t header_length = 1;
+
+    if (number < *last_number || value_length > 0xFFFF + 269) {
+        return 0;
+    }
+
+    if (delta < 13) {
+        header[0] = delta << 4;
+    } else if (delta < 269) {
+        header[0] = 13 << 4;
+        header[header_length++] = delta - 13;
+    } else {
+        header[0] = 14 << 4;
+        header[header_length++] = (delta - 269) >> 8;
+        header[header_length++] = (delta - 269) & 0xFF;
+    }
+
+    if (value_length < 13) {
+        header[0] |= value_length;
+    } else if (value_length < 269) {
+        header[0] |= 13;
+        header[header_length++] = value_length - 13;
+    } else {
+        header[0] |= 14;
+        header[header_length++] = (value_length - 269) >> 8;
+        header[header_length++] = (value_length - 269) & 0xFF;
+    }
+
+    if (length + header_length + value_length > capacity) {
+        return 0;
+    }
+
+    memcpy(&buffer[length], header, header_length);
+    memcpy(&buffer[length + header_length], value, value_length);
+    *last_number = number;
+
+    return length + header_length + value_length;
+}
+
+/**
+ * Describes block [number] of a payload of [payload_length] bytes. Returns
+ * false once [number] is past the last block. An empty payload is sent as
+ * one empty block.
+*/
+bool coap_message_next_block(size_t payload_length, uint32_t number, struct coap_message_block_t* block)
+{
+    size_t offset = (size_t) number * COAP_MESSAGE_BLOCK_SZ;
+
+    if (offset >= payload_length && !(number == 0 && payload_length == 0)) {
+        return false;
+    }
+
+    block->number = number;
+    block->offset = offset;
+    block->length = payload_length - offset > COAP_MESSAGE_BLOCK_SZ ? COAP_MESSAGE_BLOCK_SZ : payload_length - offset;
+    block->more = offset + block->length < payload_length;
+    block->blockwise = payload_length > COAP_MESSAGE_BLOCK_SZ;
+
+    return true;
+}
+
+/**
+ * Builds a confirmable POST of [block] of [payload] to [path], one Uri-Path
+ * option per path segment. Returns the message length or 0 if it does not
+ * fit.
+*/
+size_t coap_message_build_post(uint8_t* buffer, size_t capacity, uint16_t message_id, const uint8_t token[COAP_MESSAGE_TOKEN_SZ], const char* path, const struct coap_message_block_t* block, const uint8_t* payload)
+{
+    size_t length = 0;
+    uint16_t last_number = 0;
+
+    if (capacity < 4 + COAP_MESSAGE_TOKEN_SZ) {
+        return 0;
+    }
+
+    buffer[length++] = (COAP_MESSAGE_VERSION << 6) | (COAP_MESSAGE_TYPE_CON << 4) | COAP_MESSAGE_TOKEN_SZ;
+    buffer[length++] = COAP_MESSAGE_CODE_POST;
+    buffer[length++] = message_id >> 8;
+    buffer[length++] = message_id & 0xFF;
+    memcpy(&buffer[length], token, COAP_MESSAGE_TOKEN_SZ);
+    length += COAP_MESSAGE_TOKEN_SZ;
+
+    const char* segment = path;
+    while (*segment != '\0') {
+        while (*segment == '/') segment++;
+        const char* end = segment;
+        while (*end != '\0' && *end != '/') end++;
+
+        if (end > segment) {
+            length = coap_message_put_option(buffer, length, capacity, &last_number, COAP_MESSAGE_OPTION_URI_PATH, (const uint8_t*) segment, end - segment);
+            if (length == 0) return 0;
+        }
+        segment = end;
+    }
+
+    uint8_t content_format = COAP_MESSAGE_CONTENT_FORMAT_OCTET_STREAM;
+    length = coap_message_put_option(buffer, length, capacity, &last_number, COAP_MESSAGE_OPTION_CONTENT_FORMAT, &content_format, 1);
+    if (length == 0) return 0;
+
+    // Block1: NUM, M and SZX in the fewest bytes
+    if (block->blockwise) {
+        uint32_t value = (block->number << 4) | (block->more ? 0x08 : 0) | COAP_MESSAGE_BLOCK_SZX;
+        uint8_t value_bytes[3] = {(value >> 16) & 0xFF, (value >> 8) & 0xFF, value & 0xFF};
+        size_t value_length = value > 0xFFFF ? 3 : (value > 0xFF ? 2 : 1);
+
+        length = coap_message_put_option(buffer, length, capacity, &last_number, COAP_MESSAGE_OPTION_BLOCK1, &value_bytes[3 - value_length], value_length);
+        if (length == 0) return 0;
+    }
+
+    // No payload marker without payload
+    if (block->length == 0) {
+        return length;
+    }
+
+    if (length + 1 + block->length > capacity) {
+        return 0;
+    }
+
+    buffer[length++] = COAP_MESSAGE_PAYLOAD_MARKER;
+    memcpy(&buffer[length], &payload[block->offset], block->length);
+    return length + block->length;
+}
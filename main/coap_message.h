@@ -0,0 +1,56 @@
+#ifndef __WEATHER_STATION__COAP_MESSAGE_H__
+#define __WEATHER_STATION__COAP_MESSAGE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define COAP_MESSAGE_VERSION 1
+#define COAP_MESSAGE_TOKEN_SZ 2
+
+#define COAP_MESSAGE_TYPE_CON 0
+#define COAP_MESSAGE_TYPE_NON 1
+#define COAP_MESSAGE_TYPE_ACK 2
+#define COAP_MESSAGE_TYPE_RST 3
+
+#define COAP_MESSAGE_CODE_POST 0x02
+
+#define COAP_MESSAGE_OPTION_URI_PATH 11
+#define COAP_MESSAGE_OPTION_CONTENT_FORMAT 12
+#define COAP_MESSAGE_OPTION_BLOCK1 27
+
+#define COAP_MESSAGE_CONTENT_FORMAT_OCTET_STREAM 42
+
+#define COAP_MESSAGE_PAYLOAD_MARKER 0xFF
+
+/**
+ * Block-wise transfer (RFC 7959) with 512 byte blocks (SZX 5), which keeps
+ * every datagram below the IPv6 minimum MTU
+*/
+#define COAP_MESSAGE_BLOCK_SZX 5
+#define COAP_MESSAGE_BLOCK_SZ (1 << (COAP_MESSAGE_BLOCK_SZX + 4))
+
+/**
+ * One block of a payload, see coap_message_next_block
+*/
+struct coap_message_block_t {
+    uint32_t number;
+    size_t offset;
+    size_t length;
+
+    /**
+     * Whether more blocks follow (the M bit)
+    */
+    bool more;
+
+    /**
+     * Whether the payload exceeds one block and needs the Block1 option
+    */
+    bool blockwise;
+};
+
+size_t coap_message_put_option(uint8_t* buffer, size_t length, size_t capacity, uint16_t* last_number, uint16_t number, const uint8_t* value, size_t value_length);
+bool coap_message_next_block(size_t payload_length, uint32_t number, struct coap_message_block_t* block);
+size_t coap_message_build_post(uint8_t* buffer, size_t capacity, uint16_t message_id, const uint8_t token[COAP_MESSAGE_TOKEN_SZ], const char* path, const struct coap_message_block_t* block, const uint8_t* payload);
+
+#endif
@@ -0,0 +1,231 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "compressor.h"
+
+#define COMPRESSOR_MIN_MATCH 3
+#define COMPRESSOR_MAX_MATCH 258
+#define COMPRESSOR_NIL       0xFFFF
+
+static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+static const uint8_t distance_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+struct compressor_t {
+    uint8_t* output;
+    size_t output_capacity;
+    size_t output_length;
+    uint32_t bit_buffer;
+    uint8_t bit_count;
+    bool overflow;
+
+    uint16_t head[COMPRESSOR_HASH_SZ];
+    uint16_t prev[COMPRESSOR_WINDOW_SZ];
+};
+
+/**
+ * Writes [count] bits of [value], least significant bit first
+*/
+static void compressor_put_bits(struct compressor_t* c, uint32_t value, uint8_t count)
+{
+    c->bit_buffer |= value << c->bit_count;
+    c->bit_count += count;
+
+    while (c->bit_count >= 8) {
+        if (c->output_length < c->output_capacity) {
+            c->output[c->output_length] = c->bit_buffer & 0xFF;
+            c->output_length += 1;
+        } else {
+            c->overflow = true;
+        }
+        c->bit_buffer >>= 8;
+        c->bit_count -= 8;
+    }
+}
+
+/**
+ * Huffman codes are stored most significant bit first
+*/
+static void compressor_put_code(struct compressor_t* c, uint32_t code, uint8_t length)
+{
+    uint32_t reversed = 0;
+
+    for (uint8_t i = 0; i < length; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+
+    compressor_put_bits(c, reversed, length);
+}
+
+/**
+ * Writes a literal/length symbol using the fixed huffman table (RFC 1951 3.2.6)
+*/
+static void compressor_put_symbol(struct compressor_t* c, uint16_t symbol)
+{
+    if (symbol < 144) {
+        compressor_put_code(c, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        compressor_put_code(c, 0x190 + (symbol - 144), 9);
+    } else if (symbol < 280) {
+        compressor_put_code(c, symbol - 256, 7);
+    } else {
+        compressor_put_code(c, 0xC0 + (symbol - 280), 8);
+    }
+}
+
+static void compressor_put_match(struct compressor_t* c, uint16_t length, uint16_t distance)
+{
+    uint8_t code = 0;
+
+    while (code < 28 && length_base[code + 1] <= length) {
+        code += 1;
+    }
+    compressor_put_symbol(c, 257 + code);
+    compressor_put_bits(c, length - length_base[code], length_extra[code]);
+
+    code = 0;
+    while (code < 29 && distance_base[code + 1] <= distance) {
+        code += 1;
+    }
+    compressor_put_code(c, code, 5);
+    compressor_put_bits(c, distance - distance_base[code], distance_extra[code]);
+}
+
+static uint16_t compressor_hash(const uint8_t* data)
+{
+    return ((data[0] << 6) ^ (data[1] << 3) ^ data[2]) & (COMPRESSOR_HASH_SZ - 1);
+}
+
+static uint32_t compressor_adler32(const uint8_t* data, size_t length)
+{
+    uint32_t a = 1;
+    uint32_t b = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        a = (a + data[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+
+    return (b << 16) | a;
+}
+
+/**
+ * Compresses [input] into a zlib stream ("Content-Encoding: deflate") with a
+ * single fixed huffman block.
+ *
+ * Matches are searched within a COMPRESSOR_WINDOW_SZ window which keeps the
+ * working memory at a few kilobytes. The repetitive keys of our formats
+ * compress well even with this small window.
+*/
+esp_err_t compressor_deflate(const uint8_t* input, size_t input_length, uint8_t* output, size_t output_capacity, size_t* output_length)
+{
+    struct compressor_t* c = malloc(sizeof(struct compressor_t));
+    if (c == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    memset(c, 0, sizeof(struct compressor_t));
+    memset(c->head, 0xFF, sizeof(c->head));
+    memset(c->prev, 0xFF, sizeof(c->prev));
+    c->output = output;
+    c->output_capacity = output_capacity;
+
+    // zlib header: deflate with 32K window, fastest compression level
+    compressor_put_bits(c, 0x78, 8);
+    compressor_put_bits(c, 0x01, 8);
+
+    // Final block, fixed huffman codes
+    compressor_put_bits(c, 1, 1);
+    compressor_put_bits(c, 1, 2);
+
+    size_t position = 0;
+    while (position < input_length) {
+        uint16_t best_length = 0;
+        uint16_t best_distance = 0;
+
+        if (position + COMPRESSOR_MIN_MATCH <= input_length) {
+            size_t max_length = input_length - position;
+            if (max_length > COMPRESSOR_MAX_MATCH) {
+                max_length = COMPRESSOR_MAX_MATCH;
+            }
+
+            uint16_t hash = compressor_hash(&input[position]);
+            uint16_t candidate = c->head[hash];
+            uint8_t chain = COMPRESSOR_MAX_CHAIN;
+
+            // Positions are stored modulo 64K, the window check below discards stale ones
+            while (candidate != COMPRESSOR_NIL && chain > 0) {
+                uint16_t distance = (uint16_t) (position - candidate);
+                if (distance == 0 || distance > COMPRESSOR_WINDOW_SZ || distance > position) {
+                    break;
+                }
+
+                const uint8_t* match = &input[position - distance];
+                uint16_t length = 0;
+                while (length < max_length && match[length] == input[position + length]) {
+                    length += 1;
+                }
+
+                if (length > best_length) {
+                    best_length = length;
+                    best_distance = distance;
+                    if (length == max_length) {
+                        break;
+                    }
+                }
+
+                candidate = c->prev[candidate & (COMPRESSOR_WINDOW_SZ - 1)];
+                chain -= 1;
+            }
+        }
+
+        if (best_length < COMPRESSOR_MIN_MATCH) {
+            best_length = 1;
+            compressor_put_symbol(c, input[position]);
+        } else {
+            compressor_put_match(c, best_length, best_distance);
+        }
+
+        // Insert every consumed position into the hash chains
+        for (uint16_t i = 0; i < best_length; i++, position++) {
+            if (position + COMPRESSOR_MIN_MATCH <= input_length) {
+                uint16_t hash = compressor_hash(&input[position]);
+                c->prev[position & (COMPRESSOR_WINDOW_SZ - 1)] = c->head[hash];
+                c->head[hash] = (uint16_t) position;
+            }
+        }
+    }
+
+    // End of block, then align to a full byte
+    compressor_put_symbol(c, 256);
+    compressor_put_bits(c, 0, (8 - c->bit_count) & 7);
+
+    // zlib trailer: adler32 of the uncompressed data, big endian
+    uint32_t adler = compressor_adler32(input, input_length);
+    compressor_put_bits(c, (adler >> 24) & 0xFF, 8);
+    compressor_put_bits(c, (adler >> 16) & 0xFF, 8);
+    compressor_put_bits(c, (adler >> 8) & 0xFF, 8);
+    compressor_put_bits(c, adler & 0xFF, 8);
+
+    bool overflow = c->overflow;
+    *output_length = c->output_length;
+    free(c);
+
+    return overflow ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
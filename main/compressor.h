@@ -0,0 +1,28 @@
+#ifndef __WEATHER_STATION__COMPRESSOR_H__
+#define __WEATHER_STATION__COMPRESSOR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define COMPRESSOR_NONE     0
+#define COMPRESSOR_DEFLATE  1
+
+/**
+ * Size of the LZ77 sliding window. Matches are only searched this far back,
+ * which bounds the RAM used for the hash chains.
+*/
+#define COMPRESSOR_WINDOW_SZ        1024
+#define COMPRESSOR_HASH_SZ          1024
+#define COMPRESSOR_MAX_CHAIN        16
+
+/**
+ * Upper bound of the compressed size for [length] input bytes. Fixed huffman
+ * codes take at most 9 bits per literal, plus zlib header and trailer.
+*/
+#define COMPRESSOR_DEFLATE_BOUND(length) ((length) + ((length) / 8) + 16)
+
+esp_err_t compressor_deflate(const uint8_t* input, size_t input_length, uint8_t* output, size_t output_capacity, size_t* output_length);
+
+#endif
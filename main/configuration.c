@@ -8,6 +8,7 @@
 
 #define CONFIGURATION_NVS_NAMESPACE "cfg_ns"
 #define CONFIGURATION_NVS_KEY "cfg"
+#define CONFIGURATION_NVS_KEY_SEQUENCE "seq"
 
 struct configuration_t default_configuration = {
     "http://configure/",
@@ -16,7 +17,27 @@ struct configuration_t default_configuration = {
     600,
     "configure",
     "configure",
-    false
+    false,
+    0,
+    0,
+    CONFIGURATION_UPLINK_WIFI,
+    {0xff, 0xff, 0xff, 0xff, 0xff, 0xff},
+    1,
+    {0},
+    {"", ""},
+    {0, 0},
+    false,
+    "weather",
+    "",
+    {1, 1, 0},
+    CONFIGURATION_AGGREGATION_RAW,
+    600,
+    0,
+    {0.2f, 0.2f, 1.0f, 0.1f, 100.0f, 1.0f, 0.01f, 0.5f, 0.5f},
+    1800,
+    {0, 300, 0, 600},
+    900,
+    72
 };
 
 RTC_DATA_ATTR struct configuration_t configuration;
@@ -65,8 +86,10 @@ esp_err_t cfg_load()
         if (err != ESP_OK) return err;
     }
 
-    // Read persisted configuration
+    // Read persisted configuration. Start from the defaults, so fields added
+    // after the configuration was persisted keep their default values.
     struct configuration_t* new_configuration = malloc(configure_t_size);
+    memcpy(new_configuration, &default_configuration, configure_t_size);
     err = nvs_get_blob(nvs_handle, CONFIGURATION_NVS_KEY, new_configuration, &configure_t_size);
     if (err != ESP_OK) {
         free(new_configuration);
@@ -112,3 +135,55 @@ esp_err_t cfg_write()
     return ESP_OK;
 }
 
+
+
+/**
+ * Reserves a block of [count] sequence numbers in non-volatile storage (nvs)
+ * and writes the first one into [first_sequence].
+ *
+ * Sequence numbers are handed out from rtc memory. Only when a block is used
+ * up, or after a cold boot, a new block is reserved. Unused numbers of a
+ * block are skipped, so sequence numbers stay monotonic across power loss
+ * while nvs is written only once per block.
+*/
+esp_err_t cfg_reserve_sequence_numbers(uint32_t count, uint32_t* first_sequence)
+{
+    nvs_handle_t nvs_handle;
+    esp_err_t err;
+    uint32_t next_free_sequence = 1;
+
+    // Initialize the nvs library, it is not initialized after deep sleep
+    err = nvs_flash_init();
+    if (err != ESP_OK) return err;
+
+    // Open nvs
+    err = nvs_open(CONFIGURATION_NVS_NAMESPACE, NVS_READWRITE, &nvs_handle);
+    if (err != ESP_OK) return err;
+
+    // Read the first sequence number that was not reserved yet
+    err = nvs_get_u32(nvs_handle, CONFIGURATION_NVS_KEY_SEQUENCE, &next_free_sequence);
+    if (err != ESP_OK && err != ESP_ERR_NVS_NOT_FOUND) {
+        nvs_close(nvs_handle);
+        return err;
+    }
+
+    // Write the end of the reserved block
+    err = nvs_set_u32(nvs_handle, CONFIGURATION_NVS_KEY_SEQUENCE, next_free_sequence + count);
+    if (err != ESP_OK) {
+        nvs_close(nvs_handle);
+        return err;
+    }
+
+    // Commit
+    err = nvs_commit(nvs_handle);
+    if (err != ESP_OK) {
+        nvs_close(nvs_handle);
+        return err;
+    }
+
+    // Close
+    nvs_close(nvs_handle);
+
+    *first_sequence = next_free_sequence;
+    return ESP_OK;
+}
\ No newline at end of file
@@ -4,13 +4,28 @@
 #include <stdint.h>
 #include <string.h>
 #include <esp_attr.h>
+#include "sensors.h"
+
+#define CONFIGURATION_UPLINK_WIFI           0
+#define CONFIGURATION_UPLINK_ESPNOW         1
+#define CONFIGURATION_UPLINK_ESPNOW_GATEWAY 2
+#define CONFIGURATION_UPLINK_BLE_BROADCAST  3
+
+#define CONFIGURATION_AGGREGATION_RAW        0
+#define CONFIGURATION_AGGREGATION_STATISTICS 1
+#define CONFIGURATION_AGGREGATION_BOTH       2
+
+#define CONFIGURATION_ADDITIONAL_DATA_SINKS_MAX 2
+#define CONFIGURATION_DATA_SINKS_MAX (1 + CONFIGURATION_ADDITIONAL_DATA_SINKS_MAX)
 
 esp_err_t cfg_load(void);
 esp_err_t cfg_write(void);
+esp_err_t cfg_reserve_sequence_numbers(uint32_t count, uint32_t* first_sequence);
 
 struct configuration_t {
     /**
-     * Where to push the measurement data. Supports: HTTP, HTTPS.
+     * Where to push the measurement data. Supports: HTTP, HTTPS, MQTT,
+     * MQTTS, COAP. For MQTT the url path is the topic.
      * 
      * Default: "http://configuration/" 
     */
@@ -18,7 +33,10 @@ struct configuration_t {
 
     /**
      * The format in which the data should be pushed to the data sink. Supports
-     * JSON (0), CSV (1).
+     * JSON (0), CSV (1), CBOR (2), columnar (3), line protocol (4). CSV
+     * batches start with a single header line, CBOR batches carry their
+     * schema version and field ids, columnar batches are delta and
+     * run-length encoded per field.
      * 
      * Default: 0
     */
@@ -60,6 +78,179 @@ struct configuration_t {
      * Default: false
     */
     bool subtract_measuring_time;
+
+    /**
+     * Compression applied to the pushed data. Supports: None (0),
+     * Deflate (1). Deflate is announced via "Content-Encoding: deflate".
+     * 
+     * Default: 0
+    */
+    uint8_t data_sink_compression;
+
+    /**
+     * Version of the configuration. Set by configurations delivered by the
+     * data sink and reported with every upload (X-Config-Version).
+     * 
+     * Default: 0
+    */
+    uint32_t config_version;
+
+    /**
+     * How measurements leave the station. Supports: WiFi (0), ESP-NOW to a
+     * gateway (1), BLE broadcast (3). A station set to ESP-NOW gateway (2)
+     * takes no measurements and bridges the frames of its peer to the data
+     * sink. With BLE broadcast every measurement is advertised once as
+     * BTHome service data and never uploaded.
+     * 
+     * Default: 0
+    */
+    uint8_t uplink;
+
+    /**
+     * Mac address of the ESP-NOW peer: the gateway on a station, the
+     * station on a gateway.
+     * 
+     * Default: ff:ff:ff:ff:ff:ff
+    */
+    uint8_t espnow_peer[6];
+
+    /**
+     * WiFi channel used for ESP-NOW. Has to match the channel of the access
+     * point the gateway is connected to.
+     * 
+     * Default: 1
+    */
+    uint8_t espnow_channel;
+
+    /**
+     * AES key for BTHome encryption of BLE broadcasts. All zeros broadcasts
+     * unencrypted.
+     * 
+     * Default: all zeros
+    */
+    uint8_t broadcast_key[16];
+
+    /**
+     * Further data sinks that receive the same measurements, e.g. an
+     * archive. Same url schemes as data_sink, empty entries are unused.
+     * Configurations and firmware updates are only taken from data_sink.
+     * 
+     * Default: ""
+    */
+    char additional_data_sinks[CONFIGURATION_ADDITIONAL_DATA_SINKS_MAX][160];
+
+    /**
+     * The push format of each additional data sink, see
+     * data_sink_push_format.
+     * 
+     * Default: 0
+    */
+    uint8_t additional_data_sinks_push_format[CONFIGURATION_ADDITIONAL_DATA_SINKS_MAX];
+
+    /**
+     * If set: CSV batches carry the absolute timestamp only in the first
+     * row, the following rows the seconds since the first row.
+     * 
+     * Default: false
+    */
+    bool csv_delta_timestamps;
+
+    /**
+     * The measurement name of line protocol batches.
+     * 
+     * Default: "weather"
+    */
+    char line_protocol_measurement[32];
+
+    /**
+     * The value of the station tag of line protocol batches. Empty leaves the
+     * tag out.
+     * 
+     * Default: ""
+    */
+    char line_protocol_station[32];
+
+    /**
+     * Oversampling of the BME280 for temperature, pressure and humidity.
+     * Supports: skipped (0), 1x (1), 2x (2), 4x (3), 8x (4), 16x (5).
+     * Temperature is measured at least once. Every step doubles the
+     * conversion time and lowers the noise.
+     * 
+     * Default: {1, 1, 0}
+    */
+    uint8_t bme280_oversampling[3];
+
+    /**
+     * What is uploaded per aggregation window. Supports: every sample (0),
+     * the mean, min, max and standard deviation of the window (1), both (2).
+     * Statistics are records of their own kind with the start of the window
+     * as timestamp. Not applied to BLE broadcasts.
+     * 
+     * Default: 0
+    */
+    uint8_t aggregation;
+
+    /**
+     * Length of an aggregation window in seconds. Windows are aligned to
+     * multiples of their length.
+     * 
+     * Default: 600
+    */
+    uint16_t aggregation_window;
+
+    /**
+     * Filter that decides which samples are stored. Supports: none (0),
+     * deadband (1), swinging door (2). Deadband stores a sample once a
+     * reading moved further than its tolerance from the last stored one.
+     * Swinging door stores the ends of lines that pass every dropped sample
+     * within tolerance. Not applied to BLE broadcasts and statistics.
+     * 
+     * Default: 0
+    */
+    uint8_t sample_filter;
+
+    /**
+     * Tolerance of the sample filter per reading, in the units of
+     * sensor_data_t and the order of SENSORS_READINGS.
+     * 
+     * Default: {0.2, 0.2, 1, 0.1, 100, 1, 0.01, 0.5, 0.5}
+    */
+    float sample_filter_tolerances[SENSORS_READINGS];
+
+    /**
+     * Longest time in seconds between two samples stored by the sample
+     * filter. Bounds how far the data sink lags behind on calm days.
+     * 
+     * Default: 1800
+    */
+    uint16_t sample_filter_max_interval;
+
+    /**
+     * How often each sensor is read in seconds, indexed by SENSORS_DEVICE_*
+     * (SHT30, BME280, LTR390, MAX17048). 0 reads it on every wake. Readings
+     * of sensors that were not read are left out of the uploads.
+     * 
+     * Default: {0, 300, 0, 600}
+    */
+    uint16_t sensor_rates[SENSORS_DEVICES];
+
+    /**
+     * How often the LTR390 is read in seconds while its last reading was
+     * dark, e.g. at night. 0 keeps its rate.
+     * 
+     * Default: 900
+    */
+    uint16_t sensor_dark_rate;
+
+    /**
+     * Hours the battery charge above the reserve has to last without sun.
+     * The measurement and upload intervals are stretched while the battery
+     * discharges faster than that and tightened once it is full. 0 keeps
+     * measurement_rate and upload_rate as they are.
+     * 
+     * Default: 72
+    */
+    uint16_t energy_autonomy_hours;
 };
 
 /**
@@ -11,6 +11,7 @@
 #include "freertos/event_groups.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "esp_mac.h"
 #include "nvs_flash.h"
 #include "esp_bt.h"
 
@@ -21,6 +22,7 @@
 
 #include "blinker.h"
 #include "configuration.h"
+#include "bthome.h"
 
 #define BT_LOG_TAG                  "BT_STACK"
 
@@ -70,6 +72,11 @@ enum
 
 static uint8_t adv_config_done       = 0;
 
+/**
+ * Set while broadcasting measurements instead of serving the configuration
+*/
+static bool bt_broadcasting         = false;
+
 uint16_t handle_table[TABLE_MAX];
 
 typedef struct {
@@ -79,6 +86,8 @@ typedef struct {
 static prepare_type_env_t prepare_write_env;
 
 esp_err_t cfgmode_start(void);
+esp_err_t bt_start_stack(void);
+esp_err_t bt_broadcast_measurement(const struct sensor_data_t* measurement, uint32_t duration_ms);
 
 void bt_prepare_write_event(esp_gatt_if_t gatts_if, prepare_type_env_t *prepare_write_env, esp_ble_gatts_cb_param_t *param);
 void bt_exec_write_event(prepare_type_env_t *prepare_write_env, esp_ble_gatts_cb_param_t *param);
@@ -136,6 +145,36 @@ static esp_ble_adv_params_t adv_params = {
     .adv_filter_policy   = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
 };
 
+/* BTHome service data of the latest measurement, see bthome.c */
+static uint8_t broadcast_service_data[BTHOME_SERVICE_DATA_MAX_SZ];
+
+/* Only flags and service data, to stay within 31 bytes */
+static esp_ble_adv_data_t broadcast_adv_data = {
+    .set_scan_rsp        = false,
+    .include_name        = false,
+    .include_txpower     = false,
+    .min_interval        = 0x0000,
+    .max_interval        = 0x0000,
+    .appearance          = 0x00,
+    .manufacturer_len    = 0,
+    .p_manufacturer_data = NULL,
+    .service_data_len    = 0,
+    .p_service_data      = broadcast_service_data,
+    .service_uuid_len    = 0,
+    .p_service_uuid      = NULL,
+    .flag = (ESP_BLE_ADV_FLAG_GEN_DISC | ESP_BLE_ADV_FLAG_BREDR_NOT_SPT),
+};
+
+/* Non-connectable, every 20 ms */
+static esp_ble_adv_params_t broadcast_adv_params = {
+    .adv_int_min         = 0x20,
+    .adv_int_max         = 0x20,
+    .adv_type            = ADV_TYPE_NONCONN_IND,
+    .own_addr_type       = BLE_ADDR_TYPE_PUBLIC,
+    .channel_map         = ADV_CHNL_ALL,
+    .adv_filter_policy   = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY,
+};
+
 struct gatts_profile_inst {
     esp_gatts_cb_t gatts_cb;
     uint16_t gatts_if;
@@ -267,7 +306,10 @@ static struct gatts_profile_inst heart_rate_profile_tab[PROFILE_NUM] = {
     },
 };
 
-esp_err_t cfgmode_start(void)
+/**
+ * Brings up the bluetooth controller and the bluedroid stack in BLE mode
+*/
+esp_err_t bt_start_stack(void)
 {
     esp_err_t ret;
 
@@ -307,6 +349,18 @@ esp_err_t cfgmode_start(void)
         return ret;
     }
 
+    return ESP_OK;
+}
+
+esp_err_t cfgmode_start(void)
+{
+    esp_err_t ret;
+
+    ret = bt_start_stack();
+    if (ret) {
+        return ret;
+    }
+
     ret = esp_ble_gatts_register_callback(bt_gatts_event_handler);
     if (ret){
         ESP_LOGE(BT_LOG_TAG, "gatts register error, error code = %x", ret);
@@ -333,6 +387,67 @@ esp_err_t cfgmode_start(void)
     return ESP_OK;
 }
 
+/**
+ * Broadcasts the measurement as BTHome service data in non-connectable
+ * advertisements for [duration_ms], then shuts bluetooth down again. The
+ * data is encrypted if a broadcast key is configured.
+*/
+esp_err_t bt_broadcast_measurement(const struct sensor_data_t* measurement, uint32_t duration_ms)
+{
+    esp_err_t ret;
+    uint8_t mac[6] = {0};
+    size_t service_data_length = 0;
+
+    static const uint8_t no_key[BTHOME_KEY_SZ] = {0};
+    bool encrypted = memcmp(configuration.broadcast_key, no_key, BTHOME_KEY_SZ) != 0;
+
+    esp_read_mac(mac, ESP_MAC_BT);
+    ret = bthome_encode_service_data(
+        broadcast_service_data,
+        sizeof(broadcast_service_data),
+        measurement,
+        encrypted ? configuration.broadcast_key : NULL,
+        mac,
+        &service_data_length
+    );
+    if (ret) {
+        ESP_LOGE(BT_LOG_TAG, "encoding the broadcast failed: %s", esp_err_to_name(ret));
+        return ret;
+    }
+    broadcast_adv_data.service_data_len = service_data_length;
+
+    ret = bt_start_stack();
+    if (ret) {
+        return ret;
+    }
+
+    ret = esp_ble_gap_register_callback(bt_gap_event_handler);
+    if (ret){
+        ESP_LOGE(BT_LOG_TAG, "gap register error, error code = %x", ret);
+        return ret;
+    }
+
+    // Advertising starts once the data is set, see bt_gap_event_handler
+    bt_broadcasting = true;
+    adv_config_done |= ADV_CONFIG_FLAG;
+    ret = esp_ble_gap_config_adv_data(&broadcast_adv_data);
+    if (ret){
+        ESP_LOGE(BT_LOG_TAG, "config adv data failed, error code = %x", ret);
+        return ret;
+    }
+
+    vTaskDelay(duration_ms / portTICK_PERIOD_MS);
+
+    esp_ble_gap_stop_advertising();
+    esp_bluedroid_disable();
+    esp_bluedroid_deinit();
+    esp_bt_controller_disable();
+    esp_bt_controller_deinit();
+
+    ESP_LOGI(BT_LOG_TAG, "broadcasted %d bytes of service data for %lu ms", service_data_length, duration_ms);
+    return ESP_OK;
+}
+
 void bt_prepare_write_event(esp_gatt_if_t gatts_if, prepare_type_env_t *prepare_write_env, esp_ble_gatts_cb_param_t *param)
 {
     ESP_LOGI(BT_LOG_TAG, "prepare write, handle = %d, value len = %d", param->write.handle, param->write.len);
@@ -399,7 +514,7 @@ static void bt_gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_pa
         case ESP_GAP_BLE_ADV_DATA_SET_COMPLETE_EVT:
             adv_config_done &= (~ADV_CONFIG_FLAG);
             if (adv_config_done == 0){
-                esp_ble_gap_start_advertising(&adv_params);
+                esp_ble_gap_start_advertising(bt_broadcasting ? &broadcast_adv_params : &adv_params);
             }
             break;
         case ESP_GAP_BLE_SCAN_RSP_DATA_SET_COMPLETE_EVT:
@@ -414,7 +529,9 @@ static void bt_gap_event_handler(esp_gap_ble_cb_event_t event, esp_ble_gap_cb_pa
                 ESP_LOGE(BT_LOG_TAG, "advertising start failed");
             }else{
                 ESP_LOGI(BT_LOG_TAG, "advertising start successfully");
-                blinker_set_bt_discoverable();
+                if (!bt_broadcasting) {
+                    blinker_set_bt_discoverable();
+                }
             }
             break;
         case ESP_GAP_BLE_ADV_STOP_COMPLETE_EVT:
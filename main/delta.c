@@ -0,0 +1,248 @@
+#include <string.h>
+
+#include "delta.h"
+
+#define DELTA_OPERATION_ESC 0xA7
+#define DELTA_OPERATION_MOD 0xA6
+#define DELTA_OPERATION_INS 0xA5
+#define DELTA_OPERATION_DEL 0xA4
+#define DELTA_OPERATION_EQL 0xA3
+#define DELTA_OPERATION_BKT 0xA2
+
+void delta_patcher_init(struct delta_patcher_t* patcher, delta_read_source_t read_source, delta_write_target_t write_target, void* context)
+{
+    memset(patcher, 0, sizeof(struct delta_patcher_t));
+    patcher->read_source = read_source;
+    patcher->write_target = write_target;
+    patcher->context = context;
+    patcher->state = DELTA_STATE_OPERATION;
+}
+
+static esp_err_t delta_flush(struct delta_patcher_t* patcher)
+{
+    esp_err_t err;
+
+    if (patcher->output_length == 0) {
+        return ESP_OK;
+    }
+
+    err = patcher->write_target(patcher->context, patcher->output, patcher->output_length);
+    patcher->output_length = 0;
+
+    return err;
+}
+
+static esp_err_t delta_emit(struct delta_patcher_t* patcher, uint8_t value)
+{
+    patcher->output[patcher->output_length] = value;
+    patcher->output_length += 1;
+    patcher->target_length += 1;
+
+    if (patcher->output_length == DELTA_BUFFER_SZ) {
+        return delta_flush(patcher);
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * Writes one byte of MOD or INS data. MOD overwrites the source byte, INS
+ * leaves the source position untouched.
+*/
+static esp_err_t delta_emit_data(struct delta_patcher_t* patcher, uint8_t value)
+{
+    if (patcher->operation == DELTA_OPERATION_MOD) {
+        patcher->source_offset += 1;
+    }
+
+    return delta_emit(patcher, value);
+}
+
+/**
+ * Copies [length] unchanged bytes from the source to the target
+*/
+static esp_err_t delta_copy_source(struct delta_patcher_t* patcher, size_t length)
+{
+    esp_err_t err = delta_flush(patcher);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    while (length > 0) {
+        size_t chunk = length > DELTA_BUFFER_SZ ? DELTA_BUFFER_SZ : length;
+
+        err = patcher->read_source(patcher->context, patcher->source_offset, patcher->copy, chunk);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        err = patcher->write_target(patcher->context, patcher->copy, chunk);
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        patcher->source_offset += chunk;
+        patcher->target_length += chunk;
+        length -= chunk;
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * Amount of length bytes following the first one
+*/
+static uint8_t delta_length_bytes_needed(uint8_t first)
+{
+    if (first <= 251) return 0;
+    if (first == 252) return 1;
+    if (first == 253) return 2;
+    if (first == 254) return 4;
+    return 0xFF;
+}
+
+static size_t delta_decode_length(struct delta_patcher_t* patcher)
+{
+    uint8_t* b = patcher->length_bytes;
+
+    switch (b[0]) {
+        case 252:
+            return 253 + b[1];
+        case 253:
+            return (b[1] << 8) + b[2];
+        case 254:
+            return ((size_t) b[1] << 24) + ((size_t) b[2] << 16) + ((size_t) b[3] << 8) + b[4];
+        default:
+            return b[0] + 1;
+    }
+}
+
+static esp_err_t delta_execute_length_operation(struct delta_patcher_t* patcher)
+{
+    size_t length = delta_decode_length(patcher);
+
+    patcher->state = DELTA_STATE_OPERATION;
+
+    switch (patcher->operation) {
+        case DELTA_OPERATION_EQL:
+            return delta_copy_source(patcher, length);
+        case DELTA_OPERATION_DEL:
+            patcher->source_offset += length;
+            return ESP_OK;
+        case DELTA_OPERATION_BKT:
+            if (length > patcher->source_offset) {
+                return ESP_ERR_INVALID_ARG;
+            }
+            patcher->source_offset -= length;
+            return ESP_OK;
+        default:
+            return ESP_ERR_INVALID_STATE;
+    }
+}
+
+static esp_err_t delta_start_operation(struct delta_patcher_t* patcher, uint8_t operation)
+{
+    patcher->operation = operation;
+
+    switch (operation) {
+        case DELTA_OPERATION_MOD:
+        case DELTA_OPERATION_INS:
+            patcher->state = DELTA_STATE_DATA;
+            return ESP_OK;
+        case DELTA_OPERATION_EQL:
+        case DELTA_OPERATION_DEL:
+        case DELTA_OPERATION_BKT:
+            patcher->length_bytes_count = 0;
+            patcher->state = DELTA_STATE_LENGTH;
+            return ESP_OK;
+        default:
+            return ESP_ERR_INVALID_ARG;
+    }
+}
+
+/**
+ * Feeds the next chunk of the patch into the patcher
+*/
+esp_err_t delta_patcher_feed(struct delta_patcher_t* patcher, const uint8_t* data, size_t data_length)
+{
+    esp_err_t err = ESP_OK;
+
+    for (size_t i = 0; i < data_length && err == ESP_OK; i++) {
+        uint8_t c = data[i];
+
+        switch (patcher->state) {
+            case DELTA_STATE_OPERATION:
+                if (c == DELTA_OPERATION_ESC) {
+                    patcher->state = DELTA_STATE_OPERATION_ESC;
+                } else {
+                    // Data without operation is an implicit MOD
+                    patcher->operation = DELTA_OPERATION_MOD;
+                    patcher->state = DELTA_STATE_DATA;
+                    err = delta_emit_data(patcher, c);
+                }
+                break;
+            case DELTA_STATE_OPERATION_ESC:
+                err = delta_start_operation(patcher, c);
+                break;
+            case DELTA_STATE_LENGTH: {
+                patcher->length_bytes[patcher->length_bytes_count] = c;
+                patcher->length_bytes_count += 1;
+
+                uint8_t needed = delta_length_bytes_needed(patcher->length_bytes[0]);
+                if (needed == 0xFF) {
+                    err = ESP_ERR_NOT_SUPPORTED;
+                } else if (patcher->length_bytes_count == needed + 1) {
+                    err = delta_execute_length_operation(patcher);
+                }
+                break;
+            }
+            case DELTA_STATE_DATA:
+                if (c == DELTA_OPERATION_ESC) {
+                    patcher->state = DELTA_STATE_DATA_ESC;
+                } else {
+                    err = delta_emit_data(patcher, c);
+                }
+                break;
+            case DELTA_STATE_DATA_ESC:
+                if (c >= DELTA_OPERATION_BKT && c <= DELTA_OPERATION_MOD) {
+                    // A lone ESC followed by an operation ends the data
+                    err = delta_start_operation(patcher, c);
+                } else if (c == DELTA_OPERATION_ESC) {
+                    // ESC ESC is an escaped ESC within the data
+                    patcher->state = DELTA_STATE_DATA;
+                    err = delta_emit_data(patcher, c);
+                } else {
+                    patcher->state = DELTA_STATE_DATA;
+                    err = delta_emit_data(patcher, DELTA_OPERATION_ESC);
+                    if (err == ESP_OK) {
+                        err = delta_emit_data(patcher, c);
+                    }
+                }
+                break;
+        }
+    }
+
+    return err;
+}
+
+/**
+ * Flushes the remaining output. Fails if the patch ended in the middle of
+ * an operation.
+*/
+esp_err_t delta_patcher_finish(struct delta_patcher_t* patcher)
+{
+    if (patcher->state == DELTA_STATE_DATA_ESC) {
+        // A trailing ESC is data
+        patcher->state = DELTA_STATE_DATA;
+        esp_err_t err = delta_emit_data(patcher, DELTA_OPERATION_ESC);
+        if (err != ESP_OK) {
+            return err;
+        }
+    }
+
+    if (patcher->state != DELTA_STATE_OPERATION && patcher->state != DELTA_STATE_DATA) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return delta_flush(patcher);
+}
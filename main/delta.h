@@ -0,0 +1,67 @@
+#ifndef __WEATHER_STATION__DELTA_H__
+#define __WEATHER_STATION__DELTA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define DELTA_BUFFER_SZ 256
+
+typedef esp_err_t (*delta_read_source_t)(void* context, size_t offset, uint8_t* buffer, size_t length);
+typedef esp_err_t (*delta_write_target_t)(void* context, const uint8_t* data, size_t length);
+
+enum delta_state_t {
+    DELTA_STATE_OPERATION,
+    DELTA_STATE_OPERATION_ESC,
+    DELTA_STATE_LENGTH,
+    DELTA_STATE_DATA,
+    DELTA_STATE_DATA_ESC,
+};
+
+/**
+ * Streaming patcher for binary deltas in the JojoDiff format (as produced by
+ * jdiff and applied by janpatch).
+ *
+ * The patch is fed in chunks as it arrives. The source (the running image)
+ * is read through [read_source], the target is written sequentially through
+ * [write_target], so the patcher only needs two small buffers of RAM.
+*/
+struct delta_patcher_t {
+    delta_read_source_t read_source;
+    delta_write_target_t write_target;
+    void* context;
+
+    enum delta_state_t state;
+
+    /**
+     * The current operation (MOD, INS, EQL, DEL, BKT)
+    */
+    uint8_t operation;
+
+    /**
+     * Length bytes of EQL, DEL and BKT operations
+    */
+    uint8_t length_bytes[5];
+    uint8_t length_bytes_count;
+
+    /**
+     * Current read position in the source
+    */
+    size_t source_offset;
+
+    /**
+     * Amount of bytes written to the target
+    */
+    size_t target_length;
+
+    uint8_t output[DELTA_BUFFER_SZ];
+    size_t output_length;
+    uint8_t copy[DELTA_BUFFER_SZ];
+};
+
+void delta_patcher_init(struct delta_patcher_t* patcher, delta_read_source_t read_source, delta_write_target_t write_target, void* context);
+esp_err_t delta_patcher_feed(struct delta_patcher_t* patcher, const uint8_t* data, size_t data_length);
+esp_err_t delta_patcher_finish(struct delta_patcher_t* patcher);
+
+#endif
@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <stdbool.h>
+
+#include "energy.h"
+
+static const char* const energy_state_names[ENERGY_STATES] = {"off", "unknown", "discharging", "charging", "full", "reserve"};
+
+/**
+ * Returns the scale that spreads the charge above the reserve over the
+ * autonomy. The drain is taken at [scale] and mostly comes from the wakes,
+ * so it shrinks about proportionally when the intervals are stretched.
+ * Repeated updates converge on the budget.
+*/
+static uint32_t energy_discharging_scale(const struct energy_options_t* options, uint16_t scale, float charge, float charge_rate)
+{
+    float allowed_drain = (charge - ENERGY_RESERVE_PERCENT) / options->autonomy_hours;
+    float drain = -charge_rate;
+
+    float target = scale * drain / allowed_drain;
+    if (target > ENERGY_SCALE_MAX) {
+        return ENERGY_SCALE_MAX;
+    }
+
+    return target < ENERGY_SCALE_NOMINAL ? ENERGY_SCALE_NOMINAL : (uint32_t) target;
+}
+
+/**
+ * Adapts the measurement and upload intervals to the battery. They are
+ * stretched while the battery discharges faster than the budget allows,
+ * taken back to the configured rates while it charges and tightened once it
+ * is full. Only samples with a fresh battery reading move the scale, by at
+ * most a factor of 2, so the averaged charge rate of the fuel gauge can
+ * follow.
+*/
+void energy_update(struct energy_t* energy, const struct energy_options_t* options, const struct sensor_data_t* sample)
+{
+    uint16_t scale = energy->scale ? energy->scale : ENERGY_SCALE_NOMINAL;
+    bool has_battery = !(sample->skipped_devices & (1 << SENSORS_DEVICE_MAX17048));
+
+    if (options->autonomy_hours == 0) {
+        energy->state = ENERGY_STATE_OFF;
+        scale = ENERGY_SCALE_NOMINAL;
+    } else if (!has_battery) {
+        if (energy->state == ENERGY_STATE_OFF) {
+            energy->state = ENERGY_STATE_UNKNOWN;
+        }
+    } else {
+        float charge = sample->battery_charge;
+        float charge_rate = sample->battery_charge_rate;
+        uint32_t target;
+
+        if (charge <= ENERGY_RESERVE_PERCENT) {
+            energy->state = ENERGY_STATE_RESERVE;
+            target = ENERGY_SCALE_MAX;
+        } else if (charge >= ENERGY_FULL_PERCENT && charge_rate >= 0) {
+            energy->state = ENERGY_STATE_FULL;
+            target = ENERGY_SCALE_MIN;
+        } else if (charge_rate >= 0) {
+            energy->state = ENERGY_STATE_CHARGING;
+            target = ENERGY_SCALE_NOMINAL;
+        } else {
+            energy->state = ENERGY_STATE_DISCHARGING;
+            target = energy_discharging_scale(options, scale, charge, charge_rate);
+        }
+
+        if (target > 2 * scale) target = 2 * scale;
+        if (target < scale / 2) target = scale / 2;
+        if (target > ENERGY_SCALE_MAX) target = ENERGY_SCALE_MAX;
+        if (target < ENERGY_SCALE_MIN) target = ENERGY_SCALE_MIN;
+        scale = target;
+    }
+
+    energy->scale = scale;
+    energy->measurement_rate = (uint32_t) options->measurement_rate * scale / ENERGY_SCALE_NOMINAL;
+    energy->upload_rate = (uint32_t) options->upload_rate * scale / ENERGY_SCALE_NOMINAL;
+
+    if (energy->measurement_rate == 0) {
+        energy->measurement_rate = 1;
+    }
+    if (energy->upload_rate < energy->measurement_rate) {
+        energy->upload_rate = energy->measurement_rate;
+    }
+}
+
+/**
+ * Writes the X-Energy-Budget header that reports the decision of the energy
+ * budget, e.g. "state=discharging; scale=200; measurement-rate=120;
+ * upload-rate=1200". Returns the length, 0 if the buffer is too small.
+*/
+size_t energy_build_header(char* buffer, size_t buffer_length, const struct energy_t* energy)
+{
+    int length = snprintf(
+        buffer,
+        buffer_length,
+        "X-Energy-Budget: state=%s; scale=%u; measurement-rate=%lu; upload-rate=%lu\r\n",
+        energy_state_names[energy->state < ENERGY_STATES ? energy->state : ENERGY_STATE_UNKNOWN],
+        energy->scale,
+        (unsigned long) energy->measurement_rate,
+        (unsigned long) energy->upload_rate
+    );
+
+    if (length < 0 || (size_t) length >= buffer_length) {
+        return 0;
+    }
+
+    return length;
+}
@@ -0,0 +1,71 @@
+#ifndef __WEATHER_STATION__ENERGY_H__
+#define __WEATHER_STATION__ENERGY_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sensors.h"
+
+/**
+ * Scale of the measurement and upload intervals in % of the configured rates
+*/
+#define ENERGY_SCALE_NOMINAL 100
+#define ENERGY_SCALE_MIN 50
+#define ENERGY_SCALE_MAX 1600
+
+/**
+ * Battery charge in % that is kept for the way out of a long dark period,
+ * and above which the battery counts as full
+*/
+#define ENERGY_RESERVE_PERCENT 10
+#define ENERGY_FULL_PERCENT 95
+
+#define ENERGY_STATE_OFF         0
+#define ENERGY_STATE_UNKNOWN     1
+#define ENERGY_STATE_DISCHARGING 2
+#define ENERGY_STATE_CHARGING    3
+#define ENERGY_STATE_FULL        4
+#define ENERGY_STATE_RESERVE     5
+#define ENERGY_STATES            6
+
+/**
+ * Settings of the energy budget, taken from the configuration
+*/
+struct energy_options_t {
+    uint16_t measurement_rate;
+    uint16_t upload_rate;
+
+    /**
+     * Hours the charge above the reserve has to last without sun, 0 keeps
+     * the configured rates
+    */
+    uint16_t autonomy_hours;
+};
+
+/**
+ * Decision of the energy budget. Small enough to be kept in rtc memory,
+ * updated on every wake.
+*/
+struct energy_t {
+    uint8_t state;
+
+    /**
+     * ENERGY_SCALE_*, 0 until the first update
+    */
+    uint16_t scale;
+
+    /**
+     * The intervals in seconds the station runs at
+    */
+    uint32_t measurement_rate;
+    uint32_t upload_rate;
+};
+
+/**
+ * The energy budget in use
+*/
+extern struct energy_t energy;
+
+void energy_update(struct energy_t* energy, const struct energy_options_t* options, const struct sensor_data_t* sample);
+size_t energy_build_header(char* buffer, size_t buffer_length, const struct energy_t* energy);
+
+#endif
@@ -0,0 +1,264 @@
+#include <string.h>
+#include "esp_err.h"
+
+#include "espnow_frame.h"
+
+/**
+ * Bitmask with one bit set for each fragment of a message
+*/
+static uint32_t espnow_frame_all_fragments(uint8_t fragment_count)
+{
+    if (fragment_count >= ESPNOW_FRAGMENTS_MAX) {
+        return UINT32_MAX;
+    }
+
+    return ((uint32_t) 1 << fragment_count) - 1;
+}
+
+/**
+ * Writes a frame into [frame]. Returns the frame length or 0 if it does not
+ * fit.
+ *
+ * Layout:
+ *   u8  magic (ESPNOW_FRAME_MAGIC)
+ *   u8  version (high nibble) and type (low nibble)
+ *   u16 message id, little endian
+ *   u8  fragment index
+ *   u8  fragment count
+ *   u8  payload length
+ *   u8  flags
+ *   ... payload
+*/
+size_t espnow_frame_encode(uint8_t* frame, size_t frame_capacity, const struct espnow_frame_header_t* header, const uint8_t* payload)
+{
+    size_t length = ESPNOW_FRAME_HEADER_SZ + header->payload_length;
+
+    if (length > frame_capacity || length > ESPNOW_FRAME_MAX_SZ) {
+        return 0;
+    }
+
+    frame[0] = ESPNOW_FRAME_MAGIC;
+    frame[1] = (ESPNOW_FRAME_VERSION << 4) | (header->type & 0x0F);
+    frame[2] = header->message_id & 0xFF;
+    frame[3] = header->message_id >> 8;
+    frame[4] = header->fragment_index;
+    frame[5] = header->fragment_count;
+    frame[6] = header->payload_length;
+    frame[7] = header->flags;
+    memcpy(&frame[ESPNOW_FRAME_HEADER_SZ], payload, header->payload_length);
+
+    return length;
+}
+
+/**
+ * Reads the header of [frame] and points [payload] into the frame
+*/
+esp_err_t espnow_frame_decode(const uint8_t* frame, size_t frame_length, struct espnow_frame_header_t* header, const uint8_t** payload)
+{
+    if (frame_length < ESPNOW_FRAME_HEADER_SZ || frame_length > ESPNOW_FRAME_MAX_SZ || frame[0] != ESPNOW_FRAME_MAGIC) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if ((frame[1] >> 4) != ESPNOW_FRAME_VERSION) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    header->type = frame[1] & 0x0F;
+    header->message_id = frame[2] | (frame[3] << 8);
+    header->fragment_index = frame[4];
+    header->fragment_count = frame[5];
+    header->payload_length = frame[6];
+    header->flags = frame[7];
+
+    if (frame_length != ESPNOW_FRAME_HEADER_SZ + (size_t) header->payload_length) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (header->fragment_count == 0 || header->fragment_count > ESPNOW_FRAGMENTS_MAX || header->fragment_index >= header->fragment_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *payload = &frame[ESPNOW_FRAME_HEADER_SZ];
+    return ESP_OK;
+}
+
+/**
+ * Returns the amount of fragments needed for [message_length] bytes, or 0
+ * if the message is too large
+*/
+uint8_t espnow_frame_fragment_count(size_t message_length)
+{
+    if (message_length == 0 || message_length > ESPNOW_MESSAGE_MAX_SZ) {
+        return 0;
+    }
+
+    return (message_length + ESPNOW_FRAME_PAYLOAD_MAX_SZ - 1) / ESPNOW_FRAME_PAYLOAD_MAX_SZ;
+}
+
+/**
+ * Writes an ack for [message_id] carrying the bitmask of [received]
+ * fragments and the receiver [status]
+*/
+size_t espnow_frame_encode_ack(uint8_t* frame, size_t frame_capacity, uint16_t message_id, uint8_t fragment_count, uint32_t received, uint8_t status)
+{
+    uint8_t payload[ESPNOW_ACK_PAYLOAD_SZ] = {
+        received & 0xFF,
+        (received >> 8) & 0xFF,
+        (received >> 16) & 0xFF,
+        (received >> 24) & 0xFF,
+        status
+    };
+
+    struct espnow_frame_header_t header = {
+        .type = ESPNOW_FRAME_TYPE_ACK,
+        .flags = 0,
+        .message_id = message_id,
+        .fragment_index = 0,
+        .fragment_count = fragment_count,
+        .payload_length = ESPNOW_ACK_PAYLOAD_SZ,
+    };
+
+    return espnow_frame_encode(frame, frame_capacity, &header, payload);
+}
+
+esp_err_t espnow_frame_decode_ack(const struct espnow_frame_header_t* header, const uint8_t* payload, uint32_t* received, uint8_t* status)
+{
+    if (header->type != ESPNOW_FRAME_TYPE_ACK || header->payload_length != ESPNOW_ACK_PAYLOAD_SZ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    *received = payload[0] | (payload[1] << 8) | (payload[2] << 16) | ((uint32_t) payload[3] << 24);
+    *status = payload[4];
+    return ESP_OK;
+}
+
+void espnow_reassembly_init(struct espnow_reassembly_t* reassembly)
+{
+    reassembly->message_id = 0;
+    reassembly->fragment_count = 0;
+    reassembly->received = 0;
+    reassembly->message_length = 0;
+}
+
+/**
+ * Stores the fragment of a data frame. A frame of another message discards
+ * the message collected so far. Duplicates are ignored.
+*/
+esp_err_t espnow_reassembly_feed(struct espnow_reassembly_t* reassembly, const struct espnow_frame_header_t* header, const uint8_t* payload)
+{
+    if (header->type != ESPNOW_FRAME_TYPE_DATA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    // All but the last fragment are filled completely
+    bool is_last = header->fragment_index == header->fragment_count - 1;
+    if (header->payload_length == 0 || header->payload_length > ESPNOW_FRAME_PAYLOAD_MAX_SZ || (!is_last && header->payload_length != ESPNOW_FRAME_PAYLOAD_MAX_SZ)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    if (reassembly->fragment_count == 0 || header->message_id != reassembly->message_id) {
+        reassembly->message_id = header->message_id;
+        reassembly->fragment_count = header->fragment_count;
+        reassembly->received = 0;
+        reassembly->message_length = 0;
+    } else if (header->fragment_count != reassembly->fragment_count) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    uint32_t bit = (uint32_t) 1 << header->fragment_index;
+    if (reassembly->received & bit) {
+        return ESP_OK;
+    }
+
+    size_t offset = (size_t) header->fragment_index * ESPNOW_FRAME_PAYLOAD_MAX_SZ;
+    memcpy(&reassembly->message[offset], payload, header->payload_length);
+    reassembly->received |= bit;
+
+    if (is_last) {
+        reassembly->message_length = offset + header->payload_length;
+    }
+
+    return ESP_OK;
+}
+
+bool espnow_reassembly_is_complete(const struct espnow_reassembly_t* reassembly)
+{
+    return reassembly->fragment_count > 0 && reassembly->received == espnow_frame_all_fragments(reassembly->fragment_count);
+}
+
+esp_err_t espnow_sender_init(struct espnow_sender_t* sender, uint16_t message_id, const uint8_t* message, size_t message_length)
+{
+    uint8_t fragment_count = espnow_frame_fragment_count(message_length);
+    if (fragment_count == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    sender->message = message;
+    sender->message_length = message_length;
+    sender->message_id = message_id;
+    sender->fragment_count = fragment_count;
+    sender->acknowledged = 0;
+    sender->cursor = 0;
+
+    return ESP_OK;
+}
+
+/**
+ * Writes the next fragment of the current round that was not acknowledged
+ * yet. The last one of the round requests an ack. Returns 0 when the round
+ * is over.
+*/
+size_t espnow_sender_next_frame(struct espnow_sender_t* sender, uint8_t* frame, size_t frame_capacity)
+{
+    while (sender->cursor < sender->fragment_count && (sender->acknowledged & ((uint32_t) 1 << sender->cursor))) {
+        sender->cursor += 1;
+    }
+
+    if (sender->cursor >= sender->fragment_count) {
+        return 0;
+    }
+
+    uint8_t index = sender->cursor;
+    sender->cursor += 1;
+
+    // Look ahead whether another fragment follows in this round
+    uint8_t next = sender->cursor;
+    while (next < sender->fragment_count && (sender->acknowledged & ((uint32_t) 1 << next))) {
+        next += 1;
+    }
+
+    size_t offset = (size_t) index * ESPNOW_FRAME_PAYLOAD_MAX_SZ;
+    size_t length = sender->message_length - offset;
+    if (length > ESPNOW_FRAME_PAYLOAD_MAX_SZ) {
+        length = ESPNOW_FRAME_PAYLOAD_MAX_SZ;
+    }
+
+    struct espnow_frame_header_t header = {
+        .type = ESPNOW_FRAME_TYPE_DATA,
+        .flags = next >= sender->fragment_count ? ESPNOW_FRAME_FLAG_ACK_REQUEST : 0,
+        .message_id = sender->message_id,
+        .fragment_index = index,
+        .fragment_count = sender->fragment_count,
+        .payload_length = length,
+    };
+
+    return espnow_frame_encode(frame, frame_capacity, &header, &sender->message[offset]);
+}
+
+/**
+ * Starts a new round over the fragments that were not acknowledged yet
+*/
+void espnow_sender_rewind(struct espnow_sender_t* sender)
+{
+    sender->cursor = 0;
+}
+
+void espnow_sender_on_ack(struct espnow_sender_t* sender, uint32_t received)
+{
+    sender->acknowledged |= received & espnow_frame_all_fragments(sender->fragment_count);
+}
+
+bool espnow_sender_is_complete(const struct espnow_sender_t* sender)
+{
+    return sender->acknowledged == espnow_frame_all_fragments(sender->fragment_count);
+}
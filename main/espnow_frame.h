@@ -0,0 +1,102 @@
+#ifndef __WEATHER_STATION__ESPNOW_FRAME_H__
+#define __WEATHER_STATION__ESPNOW_FRAME_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+/**
+ * Frames are limited by the esp-now payload size of 250 bytes
+*/
+#define ESPNOW_FRAME_MAX_SZ 250
+#define ESPNOW_FRAME_HEADER_SZ 8
+#define ESPNOW_FRAME_PAYLOAD_MAX_SZ (ESPNOW_FRAME_MAX_SZ - ESPNOW_FRAME_HEADER_SZ)
+
+#define ESPNOW_FRAME_MAGIC 0x57
+#define ESPNOW_FRAME_VERSION 1
+
+#define ESPNOW_FRAME_TYPE_DATA 0
+#define ESPNOW_FRAME_TYPE_ACK  1
+
+/**
+ * Set on the last data frame of a sending round, the receiver answers it
+ * with an ack
+*/
+#define ESPNOW_FRAME_FLAG_ACK_REQUEST 0x01
+
+/**
+ * Status carried by an ack
+*/
+#define ESPNOW_ACK_STATUS_OK   0
+#define ESPNOW_ACK_STATUS_BUSY 1
+#define ESPNOW_ACK_PAYLOAD_SZ  5
+
+/**
+ * A message is split into at most 32 fragments, one bit each in the ack
+*/
+#define ESPNOW_FRAGMENTS_MAX 32
+#define ESPNOW_MESSAGE_MAX_SZ (ESPNOW_FRAGMENTS_MAX * ESPNOW_FRAME_PAYLOAD_MAX_SZ)
+
+struct espnow_frame_header_t {
+    uint8_t type;
+    uint8_t flags;
+    uint16_t message_id;
+    uint8_t fragment_index;
+    uint8_t fragment_count;
+    uint8_t payload_length;
+};
+
+/**
+ * Collects the fragments of one message on the receiving side
+*/
+struct espnow_reassembly_t {
+    uint16_t message_id;
+    uint8_t fragment_count;
+
+    /**
+     * Bit n is set once fragment n was received
+    */
+    uint32_t received;
+
+    size_t message_length;
+    uint8_t message[ESPNOW_MESSAGE_MAX_SZ];
+};
+
+/**
+ * Tracks which fragments of one message still need to be sent
+*/
+struct espnow_sender_t {
+    const uint8_t* message;
+    size_t message_length;
+    uint16_t message_id;
+    uint8_t fragment_count;
+
+    /**
+     * Bit n is set once the receiver acknowledged fragment n
+    */
+    uint32_t acknowledged;
+
+    /**
+     * Next fragment to look at in the current sending round
+    */
+    uint8_t cursor;
+};
+
+size_t espnow_frame_encode(uint8_t* frame, size_t frame_capacity, const struct espnow_frame_header_t* header, const uint8_t* payload);
+esp_err_t espnow_frame_decode(const uint8_t* frame, size_t frame_length, struct espnow_frame_header_t* header, const uint8_t** payload);
+uint8_t espnow_frame_fragment_count(size_t message_length);
+size_t espnow_frame_encode_ack(uint8_t* frame, size_t frame_capacity, uint16_t message_id, uint8_t fragment_count, uint32_t received, uint8_t status);
+esp_err_t espnow_frame_decode_ack(const struct espnow_frame_header_t* header, const uint8_t* payload, uint32_t* received, uint8_t* status);
+
+void espnow_reassembly_init(struct espnow_reassembly_t* reassembly);
+esp_err_t espnow_reassembly_feed(struct espnow_reassembly_t* reassembly, const struct espnow_frame_header_t* header, const uint8_t* payload);
+bool espnow_reassembly_is_complete(const struct espnow_reassembly_t* reassembly);
+
+esp_err_t espnow_sender_init(struct espnow_sender_t* sender, uint16_t message_id, const uint8_t* message, size_t message_length);
+size_t espnow_sender_next_frame(struct espnow_sender_t* sender, uint8_t* frame, size_t frame_capacity);
+void espnow_sender_rewind(struct espnow_sender_t* sender);
+void espnow_sender_on_ack(struct espnow_sender_t* sender, uint32_t received);
+bool espnow_sender_is_complete(const struct espnow_sender_t* sender);
+
+#endif
@@ -1,91 +1,1005 @@
 #include "formatter.h"
+#include <stdio.h>
 #include <string.h>
+#include <stdbool.h>
+#include <math.h>
 #include "esp_err.h"
 #include "sensors.h"
 
-esp_err_t formatter_format_measurements_as_json(char* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_length)
+static void formatter_emit(struct formatter_cursor_t* cursor, const char* data, size_t data_length)
 {
-    size_t offset = 0;
+    if (cursor->overflow || cursor->capacity - cursor->offset < data_length) {
+        cursor->overflow = true;
+        return;
+    }
+
+    memcpy(&cursor->buffer[cursor->offset], data, data_length);
+    cursor->offset += data_length;
+}
+
+/**
+ * Emits a string literal without measuring it at runtime
+*/
+#define formatter_emit_literal(cursor, literal) formatter_emit(cursor, literal, sizeof(literal) - 1)
+#define formatter_emit_string(cursor, string) formatter_emit(cursor, string, strlen(string))
+
+static void formatter_emit_uint(struct formatter_cursor_t* cursor, uint32_t value)
+{
+    char digits[10];
+    size_t length = 0;
+
+    // Digits are produced from the back
+    do {
+        digits[sizeof(digits) - 1 - length] = '0' + (value % 10);
+        value /= 10;
+        length += 1;
+    } while (value > 0);
+
+    formatter_emit(cursor, &digits[sizeof(digits) - length], length);
+}
+
+static void formatter_emit_int(struct formatter_cursor_t* cursor, int32_t value)
+{
+    if (value < 0) {
+        formatter_emit_literal(cursor, "-");
+        formatter_emit_uint(cursor, (uint32_t) 0 - (uint32_t) value);
+    } else {
+        formatter_emit_uint(cursor, (uint32_t) value);
+    }
+}
+
+static const uint32_t formatter_decimal_factors[] = {1, 10, 100, 1000};
+
+/**
+ * Scales [value] by 10^[decimals] (at most 3) and rounds half to even, like
+ * printf does, but with integer arithmetic only. The float is split into
+ * mantissa and exponent, the mantissa scaled by 10^decimals fits into 64
+ * bits without loss. Returns the magnitude, clamped to UINT32_MAX, and the
+ * sign bit in [negative]. Not a number and infinity become 0.
+*/
+static uint32_t formatter_scale_exact(float value, uint8_t decimals, bool* negative)
+{
+    uint32_t factor = formatter_decimal_factors[decimals];
+    uint32_t bits;
+
+    memcpy(&bits, &value, sizeof(bits));
+    *negative = bits >> 31;
+
+    int32_t exponent = (bits >> 23) & 0xFF;
+    uint64_t mantissa = bits & 0x7FFFFF;
+
+    if (exponent == 0xFF) {
+        return 0;
+    }
+
+    if (exponent == 0) {
+        exponent = 1;
+    } else {
+        mantissa |= 0x800000;
+    }
+
+    // value * factor = scaled * 2^-shift
+    uint64_t scaled = mantissa * factor;
+    int32_t shift = 150 - exponent;
+
+    if (shift <= 0) {
+        scaled = shift < -30 ? UINT32_MAX : scaled << -shift;
+    } else if (shift < 64) {
+        uint64_t remainder = scaled & (((uint64_t) 1 << shift) - 1);
+        uint64_t half = (uint64_t) 1 << (shift - 1);
+        scaled >>= shift;
+        if (remainder > half || (remainder == half && (scaled & 1))) {
+            scaled += 1;
+        }
+    } else {
+        scaled = 0;
+    }
+
+    return scaled > UINT32_MAX ? UINT32_MAX : (uint32_t) scaled;
+}
+
+/**
+ * Emits [value] with [decimals] fraction digits exactly like "%.2f" does,
+ * without going through the float printf path
+*/
+static void formatter_emit_fixed(struct formatter_cursor_t* cursor, float value, uint8_t decimals)
+{
+    uint32_t factor = formatter_decimal_factors[decimals];
+    bool negative;
+    uint32_t magnitude = formatter_scale_exact(value, decimals, &negative);
+
+    // Like printf, the sign is kept when a negative value rounds to zero
+    if (negative) {
+        formatter_emit_literal(cursor, "-");
+    }
+
+    formatter_emit_uint(cursor, magnitude / factor);
+    if (decimals == 0) {
+        return;
+    }
+
+    // Fraction with leading zeros
+    char fraction[3];
+    uint32_t remainder = magnitude % factor;
+    for (int i = decimals - 1; i >= 0; i--) {
+        fraction[i] = '0' + (remainder % 10);
+        remainder /= 10;
+    }
+
+    formatter_emit_literal(cursor, ".");
+    formatter_emit(cursor, fraction, decimals);
+}
+
+/**
+ * Upper bounds of the emitted numbers, used by the size estimates
+*/
+#define FORMATTER_UINT_MAX_SZ 10
+#define FORMATTER_INT_MAX_SZ 11
+#define FORMATTER_FIXED_MAX_SZ 12
+#define FORMATTER_VARINT_MAX_SZ 10
+
+/**
+ * Names of the SENSORS_KIND_* in the text formats
+*/
+static const char* const formatter_kind_names[SENSORS_KINDS] = {"sample", "mean", "min", "max", "stddev"};
+
+#define FORMATTER_KIND_MAX_SZ (sizeof("stddev") - 1)
+
+static const char* formatter_kind_name(uint8_t kind)
+{
+    return kind < SENSORS_KINDS ? formatter_kind_names[kind] : formatter_kind_names[SENSORS_KIND_SAMPLE];
+}
+
+/**
+ * Whether [measurement] holds the readings of [device], the text formats
+ * leave out the others
+*/
+static bool formatter_has_device(const struct sensor_data_t* measurement, uint8_t device)
+{
+    return !(measurement->skipped_devices & (1 << device));
+}
+
+/**
+ * Formats the measurements as JSON:
+ *
+ *   {"measurements":[{"seq":1,"time":1717200000,"temp":12.34,...},...]}
+ *
+ * Statistics of an aggregation window name their kind after the sequence
+ * number, e.g. {"seq":2,"kind":"mean",...}. Readings of skipped devices are
+ * left out.
+*/
+static void formatter_json_begin(struct formatter_context_t* context)
+{
+    formatter_emit_literal(&context->cursor, "{\"measurements\":[");
+}
+
+static void formatter_json_record(struct formatter_context_t* context, const struct sensor_data_t* m)
+{
+    struct formatter_cursor_t* cursor = &context->cursor;
+
+    // Comma for everything but the first measurement
+    if (context->index > 0) {
+        formatter_emit_literal(cursor, ",");
+    }
+
+    formatter_emit_literal(cursor, "{\"seq\":");
+    formatter_emit_uint(cursor, m->sequence);
+    if (m->kind != SENSORS_KIND_SAMPLE) {
+        formatter_emit_literal(cursor, ",\"kind\":\"");
+        formatter_emit_string(cursor, formatter_kind_name(m->kind));
+        formatter_emit_literal(cursor, "\"");
+    }
+    formatter_emit_literal(cursor, ",\"time\":");
+    formatter_emit_int(cursor, (int32_t) m->timestamp);
+    if (formatter_has_device(m, SENSORS_DEVICE_SHT30)) {
+        formatter_emit_literal(cursor, ",\"temp\":");
+        formatter_emit_fixed(cursor, m->temperature, 2);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_BME280)) {
+        formatter_emit_literal(cursor, ",\"temp_in\":");
+        formatter_emit_fixed(cursor, m->temperature_inside, 2);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_SHT30)) {
+        formatter_emit_literal(cursor, ",\"humd\":");
+        formatter_emit_fixed(cursor, m->humidity, 0);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_BME280)) {
+        formatter_emit_literal(cursor, ",\"pres\":");
+        formatter_emit_fixed(cursor, m->pressure, 2);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_LTR390)) {
+        formatter_emit_literal(cursor, ",\"dayl\":");
+        formatter_emit_int(cursor, (int32_t) m->daylight);
+        formatter_emit_literal(cursor, ",\"uv\":");
+        formatter_emit_uint(cursor, m->uv);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_MAX17048)) {
+        formatter_emit_literal(cursor, ",\"batt\":{\"volt\":");
+        formatter_emit_fixed(cursor, m->battery_voltage, 3);
+        formatter_emit_literal(cursor, ",\"chrg\":");
+        formatter_emit_fixed(cursor, m->battery_charge, 2);
+        formatter_emit_literal(cursor, ",\"chrt\":");
+        formatter_emit_fixed(cursor, m->battery_charge_rate, 2);
+        formatter_emit_literal(cursor, "}");
+    }
+    formatter_emit_literal(cursor, "}");
+}
+
+static void formatter_json_end(struct formatter_context_t* context)
+{
+    formatter_emit_literal(&context->cursor, "]}");
+}
+
+static size_t formatter_json_estimate(const struct formatter_options_t* options, size_t measurements_length)
+{
+    size_t record_length = sizeof(",{\"seq\":,\"kind\":\"\",\"time\":,\"temp\":,\"temp_in\":,\"humd\":,\"pres\":,\"dayl\":,\"uv\":,\"batt\":{\"volt\":,\"chrg\":,\"chrt\":}}") - 1
+        + 2 * FORMATTER_UINT_MAX_SZ + 2 * FORMATTER_INT_MAX_SZ + 7 * FORMATTER_FIXED_MAX_SZ + FORMATTER_KIND_MAX_SZ;
+
+    return sizeof("{\"measurements\":[]}") + measurements_length * record_length;
+}
+
+/**
+ * Formats the measurements as CSV with a single header line. The columns
+ * follow the order of sensor_data_t.
+ *
+ * With csv_delta_timestamps the first row holds the absolute timestamp and
+ * the following rows the seconds since the first row, the time column is
+ * named "dtime" then. Batches with statistics of aggregation windows get a
+ * last column "kind". Readings of skipped devices are left empty.
+*/
+static void formatter_csv_begin(struct formatter_context_t* context)
+{
+    if (context->options->csv_delta_timestamps) {
+        formatter_emit_literal(&context->cursor, "seq,dtime,");
+    } else {
+        formatter_emit_literal(&context->cursor, "seq,time,");
+    }
+    formatter_emit_literal(&context->cursor, "temp,temp_in,humd,pres,dayl,uv,volt,chrg,chrt");
+    if (context->has_statistics) {
+        formatter_emit_literal(&context->cursor, ",kind");
+    }
+    formatter_emit_literal(&context->cursor, "\n");
+}
+
+static void formatter_csv_record(struct formatter_context_t* context, const struct sensor_data_t* m)
+{
+    struct formatter_cursor_t* cursor = &context->cursor;
+    uint32_t time_base = 0;
+
+    if (context->options->csv_delta_timestamps && context->index > 0) {
+        time_base = context->measurements[0].timestamp;
+    }
+
+    bool has_sht30 = formatter_has_device(m, SENSORS_DEVICE_SHT30);
+    bool has_bme280 = formatter_has_device(m, SENSORS_DEVICE_BME280);
+    bool has_ltr390 = formatter_has_device(m, SENSORS_DEVICE_LTR390);
+    bool has_max17048 = formatter_has_device(m, SENSORS_DEVICE_MAX17048);
+
+    formatter_emit_uint(cursor, m->sequence);
+    formatter_emit_literal(cursor, ",");
+    formatter_emit_int(cursor, (int32_t) (m->timestamp - time_base));
+    formatter_emit_literal(cursor, ",");
+    if (has_sht30) formatter_emit_fixed(cursor, m->temperature, 2);
+    formatter_emit_literal(cursor, ",");
+    if (has_bme280) formatter_emit_fixed(cursor, m->temperature_inside, 2);
+    formatter_emit_literal(cursor, ",");
+    if (has_sht30) formatter_emit_fixed(cursor, m->humidity, 2);
+    formatter_emit_literal(cursor, ",");
+    if (has_bme280) formatter_emit_fixed(cursor, m->pressure, 2);
+    formatter_emit_literal(cursor, ",");
+    if (has_ltr390) formatter_emit_uint(cursor, m->daylight);
+    formatter_emit_literal(cursor, ",");
+    if (has_ltr390) formatter_emit_uint(cursor, m->uv);
+    formatter_emit_literal(cursor, ",");
+    if (has_max17048) formatter_emit_fixed(cursor, m->battery_voltage, 3);
+    formatter_emit_literal(cursor, ",");
+    if (has_max17048) formatter_emit_fixed(cursor, m->battery_charge, 2);
+    formatter_emit_literal(cursor, ",");
+    if (has_max17048) formatter_emit_fixed(cursor, m->battery_charge_rate, 2);
+    if (context->has_statistics) {
+        formatter_emit_literal(cursor, ",");
+        formatter_emit_string(cursor, formatter_kind_name(m->kind));
+    }
+    formatter_emit_literal(cursor, "\n");
+}
+
+static size_t formatter_csv_estimate(const struct formatter_options_t* options, size_t measurements_length)
+{
+    size_t record_length = sizeof(",,,,,,,,,,,\n") - 1
+        + 3 * FORMATTER_UINT_MAX_SZ + FORMATTER_INT_MAX_SZ + 7 * FORMATTER_FIXED_MAX_SZ + FORMATTER_KIND_MAX_SZ;
+
+    return sizeof("seq,dtime,temp,temp_in,humd,pres,dayl,uv,volt,chrg,chrt,kind\n") + measurements_length * record_length;
+}
+
+/**
+ * Emits [text] with a backslash in front of every character of [special]
+*/
+static void formatter_emit_escaped(struct formatter_cursor_t* cursor, const char* text, const char* special)
+{
+    for (; *text; text++) {
+        if (strchr(special, *text)) {
+            formatter_emit_literal(cursor, "\\");
+        }
+        formatter_emit(cursor, text, 1);
+    }
+}
+
+/**
+ * Formats the measurements as InfluxDB line protocol, one line per
+ * measurement:
+ *
+ *   <measurement_name>,station=<station> seq=1i,temp=12.34,...,uv=2i 1717200000
+ *
+ * Counts are sent as integers, the readings with the precision of the other
+ * formats. Timestamps are in seconds, so the write endpoint has to be called
+ * with precision=s. The station tag is left out if it is empty. Statistics
+ * of aggregation windows carry a kind tag, e.g. kind=mean. Readings of
+ * skipped devices are left out.
+*/
+static void formatter_line_protocol_record(struct formatter_context_t* context, const struct sensor_data_t* m)
+{
+    struct formatter_cursor_t* cursor = &context->cursor;
+
+    // The measurement name and station tag are the same on every line
+    if (context->index == 0) {
+        formatter_emit_escaped(cursor, context->options->line_protocol_measurement, ", ");
+        if (context->options->line_protocol_station[0] != '\0') {
+            formatter_emit_literal(cursor, ",station=");
+            formatter_emit_escaped(cursor, context->options->line_protocol_station, ",= ");
+        }
+        context->prefix_length = cursor->offset;
+    } else {
+        formatter_emit(cursor, cursor->buffer, context->prefix_length);
+    }
+
+    if (m->kind != SENSORS_KIND_SAMPLE) {
+        formatter_emit_literal(cursor, ",kind=");
+        formatter_emit_string(cursor, formatter_kind_name(m->kind));
+    }
+
+    formatter_emit_literal(cursor, " seq=");
+    formatter_emit_uint(cursor, m->sequence);
+    formatter_emit_literal(cursor, "i");
+    if (formatter_has_device(m, SENSORS_DEVICE_SHT30)) {
+        formatter_emit_literal(cursor, ",temp=");
+        formatter_emit_fixed(cursor, m->temperature, 2);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_BME280)) {
+        formatter_emit_literal(cursor, ",temp_in=");
+        formatter_emit_fixed(cursor, m->temperature_inside, 2);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_SHT30)) {
+        formatter_emit_literal(cursor, ",humd=");
+        formatter_emit_fixed(cursor, m->humidity, 2);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_BME280)) {
+        formatter_emit_literal(cursor, ",pres=");
+        formatter_emit_fixed(cursor, m->pressure, 2);
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_LTR390)) {
+        formatter_emit_literal(cursor, ",dayl=");
+        formatter_emit_uint(cursor, m->daylight);
+        formatter_emit_literal(cursor, "i,uv=");
+        formatter_emit_uint(cursor, m->uv);
+        formatter_emit_literal(cursor, "i");
+    }
+    if (formatter_has_device(m, SENSORS_DEVICE_MAX17048)) {
+        formatter_emit_literal(cursor, ",volt=");
+        formatter_emit_fixed(cursor, m->battery_voltage, 3);
+        formatter_emit_literal(cursor, ",chrg=");
+        formatter_emit_fixed(cursor, m->battery_charge, 2);
+        formatter_emit_literal(cursor, ",chrt=");
+        formatter_emit_fixed(cursor, m->battery_charge_rate, 2);
+    }
+    formatter_emit_literal(cursor, " ");
+    formatter_emit_uint(cursor, m->timestamp);
+    formatter_emit_literal(cursor, "\n");
+}
+
+static size_t formatter_line_protocol_estimate(const struct formatter_options_t* options, size_t measurements_length)
+{
+    // Escaping at most doubles the name and tag
+    size_t prefix_length = 2 * strlen(options->line_protocol_measurement) + sizeof(",kind= seq=") - 1 + FORMATTER_KIND_MAX_SZ;
+    if (options->line_protocol_station[0] != '\0') {
+        prefix_length += sizeof(",station=") - 1 + 2 * strlen(options->line_protocol_station);
+    }
+
+    size_t record_length = prefix_length
+        + sizeof("i,temp=,temp_in=,humd=,pres=,dayl=i,uv=i,volt=,chrg=,chrt= \n") - 1
+        + 4 * FORMATTER_UINT_MAX_SZ + 7 * FORMATTER_FIXED_MAX_SZ;
+
+    return 1 + measurements_length * record_length;
+}
+
+/**
+ * Returns field [field] of [measurement] as integer, scaled to the unit of
+ * its FORMATTER_FIELD_* id
+*/
+int64_t formatter_field_value(const struct sensor_data_t* measurement, uint8_t field)
+{
+    bool negative;
+    uint32_t magnitude;
+
+    switch (field) {
+    case FORMATTER_FIELD_SEQUENCE: return measurement->sequence;
+    case FORMATTER_FIELD_TIMESTAMP: return measurement->timestamp;
+    case FORMATTER_FIELD_TEMPERATURE: magnitude = formatter_scale_exact(measurement->temperature, 2, &negative); break;
+    case FORMATTER_FIELD_TEMPERATURE_INSIDE: magnitude = formatter_scale_exact(measurement->temperature_inside, 2, &negative); break;
+    case FORMATTER_FIELD_HUMIDITY: magnitude = formatter_scale_exact(measurement->humidity, 2, &negative); break;
+    case FORMATTER_FIELD_PRESSURE: magnitude = formatter_scale_exact(measurement->pressure, 2, &negative); break;
+    case FORMATTER_FIELD_DAYLIGHT: return measurement->daylight;
+    case FORMATTER_FIELD_UV: return measurement->uv;
+    case FORMATTER_FIELD_BATTERY_VOLTAGE: magnitude = formatter_scale_exact(measurement->battery_voltage, 3, &negative); break;
+    case FORMATTER_FIELD_BATTERY_CHARGE: magnitude = formatter_scale_exact(measurement->battery_charge, 2, &negative); break;
+    case FORMATTER_FIELD_BATTERY_CHARGE_RATE: magnitude = formatter_scale_exact(measurement->battery_charge_rate, 2, &negative); break;
+    case FORMATTER_FIELD_KIND: return measurement->kind;
+    case FORMATTER_FIELD_SKIPPED_DEVICES: return measurement->skipped_devices;
+    default: return 0;
+    }
+
+    return negative ? -(int64_t) magnitude : (int64_t) magnitude;
+}
+
+/**
+ * The device of every field id, SENSORS_DEVICES for fields every record has
+*/
+static const uint8_t formatter_field_devices[FORMATTER_FIELDS] = {
+    [FORMATTER_FIELD_SEQUENCE] = SENSORS_DEVICES,
+    [FORMATTER_FIELD_TIMESTAMP] = SENSORS_DEVICES,
+    [FORMATTER_FIELD_TEMPERATURE] = SENSORS_DEVICE_SHT30,
+    [FORMATTER_FIELD_TEMPERATURE_INSIDE] = SENSORS_DEVICE_BME280,
+    [FORMATTER_FIELD_HUMIDITY] = SENSORS_DEVICE_SHT30,
+    [FORMATTER_FIELD_PRESSURE] = SENSORS_DEVICE_BME280,
+    [FORMATTER_FIELD_DAYLIGHT] = SENSORS_DEVICE_LTR390,
+    [FORMATTER_FIELD_UV] = SENSORS_DEVICE_LTR390,
+    [FORMATTER_FIELD_BATTERY_VOLTAGE] = SENSORS_DEVICE_MAX17048,
+    [FORMATTER_FIELD_BATTERY_CHARGE] = SENSORS_DEVICE_MAX17048,
+    [FORMATTER_FIELD_BATTERY_CHARGE_RATE] = SENSORS_DEVICE_MAX17048,
+    [FORMATTER_FIELD_KIND] = SENSORS_DEVICES,
+    [FORMATTER_FIELD_SKIPPED_DEVICES] = SENSORS_DEVICES,
+};
+
+/**
+ * Whether [measurement] holds field [field], readings of skipped devices it
+ * does not
+*/
+bool formatter_field_is_present(const struct sensor_data_t* measurement, uint8_t field)
+{
+    uint8_t device = field < FORMATTER_FIELDS ? formatter_field_devices[field] : SENSORS_DEVICES;
+    return device == SENSORS_DEVICES || formatter_has_device(measurement, device);
+}
+
+/**
+ * Emits a CBOR data item head (RFC 8949): major type and argument
+*/
+static void formatter_emit_cbor_head(struct formatter_cursor_t* cursor, uint8_t major_type, uint32_t argument)
+{
+    uint8_t head[5];
+    size_t length;
+
+    if (argument < 24) {
+        head[0] = (major_type << 5) | argument;
+        length = 1;
+    } else if (argument <= UINT8_MAX) {
+        head[0] = (major_type << 5) | 24;
+        head[1] = argument;
+        length = 2;
+    } else if (argument <= UINT16_MAX) {
+        head[0] = (major_type << 5) | 25;
+        head[1] = argument >> 8;
+        head[2] = argument & 0xFF;
+        length = 3;
+    } else {
+        head[0] = (major_type << 5) | 26;
+        head[1] = argument >> 24;
+        head[2] = (argument >> 16) & 0xFF;
+        head[3] = (argument >> 8) & 0xFF;
+        head[4] = argument & 0xFF;
+        length = 5;
+    }
+
+    formatter_emit(cursor, (const char*) head, length);
+}
+
+static void formatter_emit_cbor_uint(struct formatter_cursor_t* cursor, uint32_t value)
+{
+    formatter_emit_cbor_head(cursor, 0, value);
+}
+
+static void formatter_emit_cbor_int(struct formatter_cursor_t* cursor, int64_t value)
+{
+    if (value < 0) {
+        // Negative integers are encoded as -1 - argument
+        formatter_emit_cbor_head(cursor, 1, (uint32_t) (-1 - value));
+    } else {
+        formatter_emit_cbor_head(cursor, 0, (uint32_t) value);
+    }
+}
+
+/**
+ * Formats the measurements as CBOR, with integer-scaled values instead of
+ * floats.
+ *
+ * The batch is a map of:
+ *   0: schema version (FORMATTER_CBOR_SCHEMA_VERSION)
+ *   1: array of the field ids, in the order of the record columns
+ *   2: array of records, each an array of integers
+ *
+ * See FORMATTER_FIELD_* for the field ids and units. Readings of skipped
+ * devices are null.
+*/
+static void formatter_cbor_begin(struct formatter_context_t* context)
+{
+    struct formatter_cursor_t* cursor = &context->cursor;
+
+    formatter_emit_cbor_head(cursor, 5, 3);
+
+    formatter_emit_cbor_uint(cursor, 0);
+    formatter_emit_cbor_uint(cursor, FORMATTER_CBOR_SCHEMA_VERSION);
+
+    formatter_emit_cbor_uint(cursor, 1);
+    formatter_emit_cbor_head(cursor, 4, FORMATTER_FIELDS);
+    for (uint32_t field = 0; field < FORMATTER_FIELDS; field++) {
+        formatter_emit_cbor_uint(cursor, field);
+    }
+
+    formatter_emit_cbor_uint(cursor, 2);
+    formatter_emit_cbor_head(cursor, 4, context->measurements_length);
+}
+
+static void formatter_cbor_record(struct formatter_context_t* context, const struct sensor_data_t* m)
+{
+    formatter_emit_cbor_head(&context->cursor, 4, FORMATTER_FIELDS);
+    for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+        if (formatter_field_is_present(m, field)) {
+            formatter_emit_cbor_int(&context->cursor, formatter_field_value(m, field));
+        } else {
+            formatter_emit_cbor_head(&context->cursor, 7, 22);
+        }
+    }
+}
+
+static size_t formatter_cbor_estimate(const struct formatter_options_t* options, size_t measurements_length)
+{
+    // Heads take at most 5 bytes, field ids 1
+    return 1 + 2 + 2 + FORMATTER_FIELDS + 6 + measurements_length * (1 + FORMATTER_FIELDS * 5);
+}
+
+static uint64_t formatter_zigzag(int64_t value)
+{
+    return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static size_t formatter_varint_length(uint64_t value)
+{
+    size_t length = 1;
+
+    while (value >= 0x80) {
+        value >>= 7;
+        length += 1;
+    }
+
+    return length;
+}
+
+/**
+ * Emits [value] as LEB128 varint, 7 bits per byte with the lowest bits first
+*/
+static void formatter_emit_varint(struct formatter_cursor_t* cursor, uint64_t value)
+{
+    char bytes[10];
+    size_t length = 0;
+
+    while (value >= 0x80) {
+        bytes[length++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    bytes[length++] = value;
+
+    formatter_emit(cursor, bytes, length);
+}
+
+/**
+ * Measures column [field] of the measurements in every encoding in a single
+ * pass, [lengths] is indexed by FORMATTER_COLUMNAR_ENCODING_*
+*/
+static void formatter_measure_column(const struct sensor_data_t* measurements, size_t measurements_length, uint8_t field, size_t* lengths)
+{
+    int64_t previous = 0;
+    int64_t previous_delta = 0;
+    size_t run_length = 0;
+
+    lengths[FORMATTER_COLUMNAR_ENCODING_DELTA] = 0;
+    lengths[FORMATTER_COLUMNAR_ENCODING_DELTA_OF_DELTA] = 0;
+    lengths[FORMATTER_COLUMNAR_ENCODING_RUN_LENGTH] = 0;
+
+    for (size_t i = 0; i < measurements_length; i++) {
+        int64_t value = formatter_field_is_present(&measurements[i], field) ? formatter_field_value(&measurements[i], field) : previous;
+        int64_t delta = value - previous;
+        size_t delta_length = formatter_varint_length(formatter_zigzag(delta));
+
+        lengths[FORMATTER_COLUMNAR_ENCODING_DELTA] += delta_length;
+        lengths[FORMATTER_COLUMNAR_ENCODING_DELTA_OF_DELTA] += i >= 2 ? formatter_varint_length(formatter_zigzag(delta - previous_delta)) : delta_length;
+
+        if (i > 0 && delta != 0) {
+            lengths[FORMATTER_COLUMNAR_ENCODING_RUN_LENGTH] += formatter_varint_length(formatter_zigzag(previous)) + formatter_varint_length(run_length);
+            run_length = 0;
+        }
+        run_length += 1;
+
+        previous = value;
+        previous_delta = delta;
+    }
+
+    lengths[FORMATTER_COLUMNAR_ENCODING_RUN_LENGTH] += formatter_varint_length(formatter_zigzag(previous)) + formatter_varint_length(run_length);
+}
+
+/**
+ * Emits column [field] of the measurements with [encoding]
+*/
+static void formatter_emit_column(struct formatter_cursor_t* cursor, const struct sensor_data_t* measurements, size_t measurements_length, uint8_t field, uint8_t encoding)
+{
+    int64_t previous = 0;
+    int64_t previous_delta = 0;
+    size_t run_length = 0;
+
+    for (size_t i = 0; i < measurements_length; i++) {
+        int64_t value = formatter_field_is_present(&measurements[i], field) ? formatter_field_value(&measurements[i], field) : previous;
+        int64_t delta = value - previous;
+
+        if (encoding == FORMATTER_COLUMNAR_ENCODING_RUN_LENGTH) {
+            // Runs of (value, length)
+            if (i > 0 && delta != 0) {
+                formatter_emit_varint(cursor, formatter_zigzag(previous));
+                formatter_emit_varint(cursor, run_length);
+                run_length = 0;
+            }
+            run_length += 1;
+        } else if (encoding == FORMATTER_COLUMNAR_ENCODING_DELTA_OF_DELTA && i >= 2) {
+            formatter_emit_varint(cursor, formatter_zigzag(delta - previous_delta));
+        } else {
+            formatter_emit_varint(cursor, formatter_zigzag(delta));
+        }
+
+        previous = value;
+        previous_delta = delta;
+    }
+
+    if (encoding == FORMATTER_COLUMNAR_ENCODING_RUN_LENGTH) {
+        formatter_emit_varint(cursor, formatter_zigzag(previous));
+        formatter_emit_varint(cursor, run_length);
+    }
+}
+
+/**
+ * Formats the measurements column by column. Meant for long backlogs, slowly
+ * changing values shrink to a byte per sample or less.
+ *
+ * Layout: version byte, varint record count, then for every field id (see
+ * FORMATTER_FIELD_*) an encoding byte followed by the column:
+ *   DELTA: the first value, then the difference to the previous value
+ *   DELTA_OF_DELTA: like DELTA, but from the third value on the difference
+ *     to the previous difference, e.g. for evenly spaced timestamps
+ *   RUN_LENGTH: (value, run length) pairs, e.g. for uv at night
+ *
+ * Values are zig-zag encoded varints, run lengths plain varints. Every column
+ * uses the encoding that turns out smallest. Readings of skipped devices
+ * repeat the previous value, the skipped devices column tells them apart.
+*/
+static void formatter_columnar_begin(struct formatter_context_t* context)
+{
+    struct formatter_cursor_t* cursor = &context->cursor;
+    char version = FORMATTER_COLUMNAR_VERSION;
+
+    formatter_emit(cursor, &version, 1);
+    formatter_emit_varint(cursor, context->measurements_length);
+
+    for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+        size_t lengths[3];
+        char encoding = FORMATTER_COLUMNAR_ENCODING_DELTA;
+
+        formatter_measure_column(context->measurements, context->measurements_length, field, lengths);
+        for (uint8_t candidate = FORMATTER_COLUMNAR_ENCODING_DELTA_OF_DELTA; candidate <= FORMATTER_COLUMNAR_ENCODING_RUN_LENGTH; candidate++) {
+            if (lengths[candidate] < lengths[(uint8_t) encoding]) {
+                encoding = candidate;
+            }
+        }
+
+        formatter_emit(cursor, &encoding, 1);
+        formatter_emit_column(cursor, context->measurements, context->measurements_length, field, encoding);
+    }
+}
+
+static size_t formatter_columnar_estimate(const struct formatter_options_t* options, size_t measurements_length)
+{
+    // Deltas of the scaled values stay below 2^34, 5 varint bytes. The
+    // chosen encoding is never longer than DELTA.
+    return 1 + FORMATTER_VARINT_MAX_SZ + FORMATTER_FIELDS * (1 + measurements_length * 5);
+}
+
+static const struct formatter_t formatter_json = {
+    FORMATTER_FORMAT_JSON, "json", "application/json", true,
+    formatter_json_begin, formatter_json_record, formatter_json_end, formatter_json_estimate
+};
+
+static const struct formatter_t formatter_csv = {
+    FORMATTER_FORMAT_CSV, "csv", "text/csv", true,
+    formatter_csv_begin, formatter_csv_record, NULL, formatter_csv_estimate
+};
+
+static const struct formatter_t formatter_cbor = {
+    FORMATTER_FORMAT_CBOR, "cbor", "application/cbor", false,
+    formatter_cbor_begin, formatter_cbor_record, NULL, formatter_cbor_estimate
+};
+
+static const struct formatter_t formatter_columnar = {
+    FORMATTER_FORMAT_COLUMNAR, "columnar", "application/vnd.weather-station.columnar", false,
+    formatter_columnar_begin, NULL, NULL, formatter_columnar_estimate
+};
+
+static const struct formatter_t formatter_line_protocol = {
+    FORMATTER_FORMAT_LINE_PROTOCOL, "line_protocol", "text/plain; charset=utf-8", true,
+    NULL, formatter_line_protocol_record, NULL, formatter_line_protocol_estimate
+};
+
+/**
+ * All push formats, indexed by their data_sink_push_format value
+*/
+const struct formatter_t* const formatter_formats[FORMATTER_FORMATS] = {
+    &formatter_json,
+    &formatter_csv,
+    &formatter_cbor,
+    &formatter_columnar,
+    &formatter_line_protocol,
+};
+
+/**
+ * Returns the formatter of [push_format], JSON for unknown formats
+*/
+const struct formatter_t* formatter_get(uint8_t push_format)
+{
+    if (push_format >= FORMATTER_FORMATS) {
+        return &formatter_json;
+    }
+
+    return formatter_formats[push_format];
+}
+
+/**
+ * Formats the measurements with [formatter] into [buffer]. Text formats are
+ * NUL terminated, the terminator is not part of [written_length].
+ *
+ * Returns ESP_ERR_INVALID_SIZE if the measurements do not fit into the
+ * buffer. The buffer content is undefined in that case.
+*/
+esp_err_t formatter_format(const struct formatter_t* formatter, const struct formatter_options_t* options, void* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_length, size_t* written_length)
+{
+    struct formatter_context_t context = {
+        { (char*) buffer, buffer_length, 0, false },
+        options,
+        measurements,
+        measurements_length,
+        0,
+        0,
+        false
+    };
+
+    *written_length = 0;
+
+    for (size_t i = 0; i < measurements_length; i++) {
+        if (measurements[i].kind != SENSORS_KIND_SAMPLE) {
+            context.has_statistics = true;
+            break;
+        }
+    }
+
+    if (measurements_length > 0) {
+        if (formatter->begin) {
+            formatter->begin(&context);
+        }
+        if (formatter->record) {
+            for (context.index = 0; context.index < measurements_length; context.index++) {
+                formatter->record(&context, &measurements[context.index]);
+            }
+        }
+        if (formatter->end) {
+            formatter->end(&context);
+        }
+    }
+
+    size_t length = context.cursor.offset;
+    if (formatter->text) {
+        formatter_emit(&context.cursor, "", 1);
+    }
+
+    if (context.cursor.overflow) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    *written_length = length;
+    return ESP_OK;
+}
+
+/**
+ * Returns how many measurements, at most [measurements_max], [formatter]
+ * fits into [buffer_length] bytes for sure. At least 1.
+*/
+size_t formatter_fitting_length(const struct formatter_t* formatter, const struct formatter_options_t* options, size_t buffer_length, size_t measurements_max)
+{
+    size_t measurements_length = measurements_max;
+
+    while (measurements_length > 1 && formatter->estimate(options, measurements_length) > buffer_length) {
+        measurements_length -= 1;
+    }
+
+    return measurements_length;
+}
+
+static void formatter_put_u16(uint8_t* buffer, uint16_t value)
+{
+    buffer[0] = value & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+}
+
+static void formatter_put_u32(uint8_t* buffer, uint32_t value)
+{
+    buffer[0] = value & 0xFF;
+    buffer[1] = (value >> 8) & 0xFF;
+    buffer[2] = (value >> 16) & 0xFF;
+    buffer[3] = (value >> 24) & 0xFF;
+}
+
+static uint16_t formatter_get_u16(const uint8_t* buffer)
+{
+    return buffer[0] | (buffer[1] << 8);
+}
+
+static uint32_t formatter_get_u32(const uint8_t* buffer)
+{
+    return buffer[0] | (buffer[1] << 8) | (buffer[2] << 16) | ((uint32_t) buffer[3] << 24);
+}
+
+/**
+ * Scales [value] by [factor] and rounds it into the range [min, max]
+*/
+static int32_t formatter_scale(float value, float factor, int32_t min, int32_t max)
+{
+    float scaled = roundf(value * factor);
+
+    if (scaled < min) return min;
+    if (scaled > max) return max;
+    return (int32_t) scaled;
+}
+
+/**
+ * Formats the measurements in a compact little endian binary encoding.
+ *
+ * Header (10 bytes):
+ *   u8  version (FORMATTER_BINARY_VERSION)
+ *   u8  amount of records
+ *   u32 sequence number of the first record
+ *   u32 timestamp of the first record
+ *
+ * Record (29 bytes, 28 in version 1 which has no kind):
+ *   u16 sequence number delta to the first record
+ *   u32 timestamp delta to the first record in seconds
+ *   i16 temperature in 0.01 °C
+ *   i16 temperature inside in 0.01 °C
+ *   u16 humidity in 0.01 %
+ *   u32 pressure in Pa
+ *   u32 daylight in lux
+ *   u16 uv
+ *   u16 battery voltage in mV
+ *   u16 battery charge in 0.01 %
+ *   i16 battery charge rate in 0.01 %/h
+ *   u8  kind (SENSORS_KIND_*) in the low, skipped devices (bits of
+ *       SENSORS_DEVICE_*) in the high nibble
+*/
+esp_err_t formatter_format_measurements_as_binary(uint8_t* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_length, size_t* written_length)
+{
+    *written_length = 0;
 
     if (measurements_length == 0) {
         return ESP_OK;
     }
 
-    memset(buffer, 0, buffer_length);
-
-    // Write the first part of the JSON
-    sprintf(
-        &buffer[offset],
-        "{\"measurements\":["
-    ); 
-
-    // Write everything but the last measurement (with trailing comma)
-    for (size_t i = 0; i < (measurements_length - 1); i++) {
-        offset = strlen(buffer);
-        sprintf(
-            &buffer[offset],
-            "{"
-                "\"time\":%li,"
-                "\"temp\":%.2f,"
-                "\"humd\":%.0f,"
-                "\"dayl\":%li,"
-                "\"uv\":%d,"
-                "\"batt\":{"
-                    "\"volt\":%.3f,"
-                    "\"chrg\":%.2f,"
-                    "\"chrt\":%.2f"
-                "}"
-            "},", // With comma
-            measurements[i].timestamp,
-            measurements[i].temperature,
-            measurements[i].humidity,
-            measurements[i].daylight,
-            measurements[i].uv,
-            measurements[i].battery_voltage,
-            measurements[i].battery_charge,
-            measurements[i].battery_charge_rate
-        );   
-    }
-
-    // Write the last measurement (without trailing comma)
-    offset = strlen(buffer);
-    sprintf(
-        &buffer[offset],
-        "{"
-            "\"time\":%li,"
-            "\"temp\":%.2f," // 47-57 letters
-            "\"humd\":%.0f,"
-            "\"dayl\":%li,"
-            "\"uv\":%d,"
-            "\"batt\":{"
-                "\"volt\":%.3f,"
-                "\"chrg\":%.2f,"
-                "\"chrt\":%.2f"
-            "}"
-        "}", // Without comma
-        measurements[measurements_length - 1].timestamp,
-        measurements[measurements_length - 1].temperature,
-        measurements[measurements_length - 1].humidity,
-        measurements[measurements_length - 1].daylight,
-        measurements[measurements_length - 1].uv,
-        measurements[measurements_length - 1].battery_voltage,
-        measurements[measurements_length - 1].battery_charge,
-        measurements[measurements_length - 1].battery_charge_rate
-    );
-
-    // Write the last part of the JSON
-    offset = strlen(buffer);
-    sprintf(
-        &buffer[offset],
-        "]}"
-    ); 
+    if (measurements_length > UINT8_MAX) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t length = FORMATTER_BINARY_HEADER_SZ + measurements_length * FORMATTER_BINARY_RECORD_SZ;
+    if (length > buffer_length) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint32_t first_sequence = measurements[0].sequence;
+    uint32_t first_timestamp = measurements[0].timestamp;
+
+    buffer[0] = FORMATTER_BINARY_VERSION;
+    buffer[1] = (uint8_t) measurements_length;
+    formatter_put_u32(&buffer[2], first_sequence);
+    formatter_put_u32(&buffer[6], first_timestamp);
+
+    uint8_t* record = &buffer[FORMATTER_BINARY_HEADER_SZ];
+    for (size_t i = 0; i < measurements_length; i++) {
+        struct sensor_data_t* m = &measurements[i];
 
+        formatter_put_u16(&record[0], (uint16_t) (m->sequence - first_sequence));
+        formatter_put_u32(&record[2], m->timestamp - first_timestamp);
+        formatter_put_u16(&record[6], (uint16_t) formatter_scale(m->temperature, 100.0f, INT16_MIN, INT16_MAX));
+        formatter_put_u16(&record[8], (uint16_t) formatter_scale(m->temperature_inside, 100.0f, INT16_MIN, INT16_MAX));
+        formatter_put_u16(&record[10], (uint16_t) formatter_scale(m->humidity, 100.0f, 0, UINT16_MAX));
+        formatter_put_u32(&record[12], (uint32_t) formatter_scale(m->pressure, 100.0f, 0, 10000000));
+        formatter_put_u32(&record[16], m->daylight);
+        formatter_put_u16(&record[20], m->uv);
+        formatter_put_u16(&record[22], (uint16_t) formatter_scale(m->battery_voltage, 1000.0f, 0, UINT16_MAX));
+        formatter_put_u16(&record[24], (uint16_t) formatter_scale(m->battery_charge, 100.0f, 0, UINT16_MAX));
+        formatter_put_u16(&record[26], (uint16_t) formatter_scale(m->battery_charge_rate, 100.0f, INT16_MIN, INT16_MAX));
+        record[28] = (m->kind & 0x0F) | (m->skipped_devices << 4);
+
+        record += FORMATTER_BINARY_RECORD_SZ;
+    }
+
+    *written_length = length;
     return ESP_OK;
 }
-
-esp_err_t formatter_format_measurements_as_csv(char* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_length)
+/**
+ * Parses measurements in the binary encoding written by
+ * formatter_format_measurements_as_binary into [measurements]. Also reads
+ * version 1, whose records are samples.
+ *
+ * Returns ESP_ERR_INVALID_SIZE if the buffer is truncated or holds more than
+ * [measurements_capacity] records.
+*/
+esp_err_t formatter_parse_measurements_from_binary(const uint8_t* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_capacity, size_t* measurements_length)
 {
-    //sprintf(buffer, "%f,%f", (sensor_data->temperature / 100.0), (sensor_data->humidity / 100.0));
+    *measurements_length = 0;
+
+    if (buffer_length < FORMATTER_BINARY_HEADER_SZ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    size_t record_length;
+    if (buffer[0] == FORMATTER_BINARY_VERSION) {
+        record_length = FORMATTER_BINARY_RECORD_SZ;
+    } else if (buffer[0] == 1) {
+        record_length = FORMATTER_BINARY_V1_RECORD_SZ;
+    } else {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
 
+    size_t count = buffer[1];
+    if (count > measurements_capacity || buffer_length < FORMATTER_BINARY_HEADER_SZ + count * record_length) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    uint32_t first_sequence = formatter_get_u32(&buffer[2]);
+    uint32_t first_timestamp = formatter_get_u32(&buffer[6]);
+
+    const uint8_t* record = &buffer[FORMATTER_BINARY_HEADER_SZ];
+    for (size_t i = 0; i < count; i++) {
+        struct sensor_data_t* m = &measurements[i];
+
+        memset(m, 0, sizeof(struct sensor_data_t));
+        m->sequence = first_sequence + formatter_get_u16(&record[0]);
+        m->timestamp = first_timestamp + formatter_get_u32(&record[2]);
+        m->temperature = (int16_t) formatter_get_u16(&record[6]) / 100.0f;
+        m->temperature_inside = (int16_t) formatter_get_u16(&record[8]) / 100.0f;
+        m->humidity = formatter_get_u16(&record[10]) / 100.0f;
+        m->pressure = formatter_get_u32(&record[12]) / 100.0f;
+        m->daylight = formatter_get_u32(&record[16]);
+        m->uv = formatter_get_u16(&record[20]);
+        m->battery_voltage = formatter_get_u16(&record[22]) / 1000.0f;
+        m->battery_charge = formatter_get_u16(&record[24]) / 100.0f;
+        m->battery_charge_rate = (int16_t) formatter_get_u16(&record[26]) / 100.0f;
+        if (record_length > FORMATTER_BINARY_V1_RECORD_SZ) {
+            m->kind = (record[28] & 0x0F) < SENSORS_KINDS ? record[28] & 0x0F : SENSORS_KIND_SAMPLE;
+            m->skipped_devices = record[28] >> 4;
+        }
+
+        record += record_length;
+    }
+
+    *measurements_length = count;
     return ESP_OK;
-}
\ No newline at end of file
+}
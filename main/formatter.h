@@ -1,10 +1,124 @@
 #ifndef __WEATHER_STATION__FORMATTER_H__
 #define __WEATHER_STATION__FORMATTER_H__
 
+#include <stdbool.h>
 #include "esp_err.h"
 #include "sensors.h"
 
-esp_err_t formatter_format_measurements_as_json(char* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_length);
-esp_err_t formatter_format_measurements_as_csv(char* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_length);
+#define FORMATTER_FORMAT_JSON 0
+#define FORMATTER_FORMAT_CSV 1
+#define FORMATTER_FORMAT_CBOR 2
+#define FORMATTER_FORMAT_COLUMNAR 3
+#define FORMATTER_FORMAT_LINE_PROTOCOL 4
+#define FORMATTER_FORMATS 5
+
+/**
+ * Field ids of the binary formats, values are scaled to integers
+*/
+#define FORMATTER_FIELD_SEQUENCE 0
+#define FORMATTER_FIELD_TIMESTAMP 1
+#define FORMATTER_FIELD_TEMPERATURE 2               /*!< 0.01 °C */
+#define FORMATTER_FIELD_TEMPERATURE_INSIDE 3        /*!< 0.01 °C */
+#define FORMATTER_FIELD_HUMIDITY 4                  /*!< 0.01 % */
+#define FORMATTER_FIELD_PRESSURE 5                  /*!< Pa */
+#define FORMATTER_FIELD_DAYLIGHT 6                  /*!< lux */
+#define FORMATTER_FIELD_UV 7
+#define FORMATTER_FIELD_BATTERY_VOLTAGE 8           /*!< mV */
+#define FORMATTER_FIELD_BATTERY_CHARGE 9            /*!< 0.01 % */
+#define FORMATTER_FIELD_BATTERY_CHARGE_RATE 10      /*!< 0.01 %/h */
+#define FORMATTER_FIELD_KIND 11                     /*!< SENSORS_KIND_* */
+#define FORMATTER_FIELD_SKIPPED_DEVICES 12          /*!< bits of SENSORS_DEVICE_* */
+#define FORMATTER_FIELDS 13
+
+#define FORMATTER_CBOR_SCHEMA_VERSION 2
+
+#define FORMATTER_COLUMNAR_VERSION 3
+#define FORMATTER_COLUMNAR_ENCODING_DELTA 0
+#define FORMATTER_COLUMNAR_ENCODING_DELTA_OF_DELTA 1
+#define FORMATTER_COLUMNAR_ENCODING_RUN_LENGTH 2
+
+#define FORMATTER_BINARY_VERSION 2
+#define FORMATTER_BINARY_HEADER_SZ 10
+#define FORMATTER_BINARY_RECORD_SZ 29
+#define FORMATTER_BINARY_V1_RECORD_SZ 28
+
+/**
+ * Output cursor of the formatters. Emitting past [capacity] sets [overflow]
+ * instead of writing, so callers check once at the end.
+*/
+struct formatter_cursor_t {
+    char* buffer;
+    size_t capacity;
+    size_t offset;
+    bool overflow;
+};
+
+/**
+ * Settings of the formatters, taken from the configuration
+*/
+struct formatter_options_t {
+    bool csv_delta_timestamps;
+    const char* line_protocol_measurement;
+    const char* line_protocol_station;
+};
+
+/**
+ * State of the batch that is being formatted
+*/
+struct formatter_context_t {
+    struct formatter_cursor_t cursor;
+    const struct formatter_options_t* options;
+    struct sensor_data_t* measurements;
+    size_t measurements_length;
+
+    /**
+     * Index of the measurement passed to record
+    */
+    size_t index;
+
+    /**
+     * Length of the line prefix that repeats on every line
+    */
+    size_t prefix_length;
+
+    /**
+     * Whether the batch holds statistics of aggregation windows, text formats
+     * only name the kind of a record then
+    */
+    bool has_statistics;
+};
+
+/**
+ * A push format. begin and end frame the batch, record is called for every
+ * measurement in order. Each of them may be NULL, e.g. formats that encode
+ * the batch as a whole do so in begin. estimate returns the buffer size that
+ * is enough for [measurements_length] measurements, including the NUL of
+ * text formats.
+*/
+struct formatter_t {
+    uint8_t push_format;
+    const char* name;
+    const char* content_type;
+
+    /**
+     * If set the output is NUL terminated text
+    */
+    bool text;
+
+    void (*begin)(struct formatter_context_t* context);
+    void (*record)(struct formatter_context_t* context, const struct sensor_data_t* measurement);
+    void (*end)(struct formatter_context_t* context);
+    size_t (*estimate)(const struct formatter_options_t* options, size_t measurements_length);
+};
+
+extern const struct formatter_t* const formatter_formats[FORMATTER_FORMATS];
+
+const struct formatter_t* formatter_get(uint8_t push_format);
+esp_err_t formatter_format(const struct formatter_t* formatter, const struct formatter_options_t* options, void* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_length, size_t* written_length);
+size_t formatter_fitting_length(const struct formatter_t* formatter, const struct formatter_options_t* options, size_t buffer_length, size_t measurements_max);
+int64_t formatter_field_value(const struct sensor_data_t* measurement, uint8_t field);
+bool formatter_field_is_present(const struct sensor_data_t* measurement, uint8_t field);
+esp_err_t formatter_format_measurements_as_binary(uint8_t* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_length, size_t* written_length);
+esp_err_t formatter_parse_measurements_from_binary(const uint8_t* buffer, size_t buffer_length, struct sensor_data_t* measurements, size_t measurements_capacity, size_t* measurements_length);
 
 #endif
\ No newline at end of file
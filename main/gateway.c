@@ -0,0 +1,256 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+
+#include "sensors.h"
+#include "configuration.h"
+#include "formatter.h"
+#include "espnow_frame.h"
+#include "wifi.h"
+#include "ota.h"
+#include "gateway.h"
+
+/**
+ * Measurements buffered until the data sink acknowledged them
+*/
+#define GATEWAY_MEASUREMENTS_MAX 500
+
+#define GATEWAY_FORWARD_INTERVAL_MS 1000
+#define GATEWAY_FORWARD_RETRY_MS 30000
+#define GATEWAY_QUEUE_LENGTH 16
+
+static const char *GATEWAY_LOG_TAG = "GATEWAY";
+
+struct gateway_frame_t {
+    uint8_t data[ESPNOW_FRAME_MAX_SZ];
+    size_t length;
+};
+
+struct gateway_state_t {
+    gateway_forward_t forward;
+    QueueHandle_t frames;
+    SemaphoreHandle_t lock;
+
+    struct espnow_reassembly_t reassembly;
+
+    /**
+     * Highest sequence number taken over from the station. Retransmitted
+     * messages are acknowledged again but not buffered twice.
+    */
+    uint32_t last_sequence;
+
+    /**
+     * Highest sequence number acknowledged by each data sink
+    */
+    uint32_t acknowledged_sequences[CONFIGURATION_DATA_SINKS_MAX];
+
+    /**
+     * Guarded by [lock]
+    */
+    struct sensor_data_t measurements[GATEWAY_MEASUREMENTS_MAX];
+    size_t measurement_count;
+};
+
+static struct gateway_state_t* gateway = NULL;
+
+static void gateway_receive_callback(const esp_now_recv_info_t* info, const uint8_t* data, int data_length)
+{
+    struct gateway_frame_t frame;
+
+    if (memcmp(info->src_addr, configuration.espnow_peer, ESP_NOW_ETH_ALEN) != 0 || data_length <= 0 || data_length > ESPNOW_FRAME_MAX_SZ) {
+        return;
+    }
+
+    memcpy(frame.data, data, data_length);
+    frame.length = data_length;
+    xQueueSend(gateway->frames, &frame, 0);
+}
+
+/**
+ * Moves the measurements of a complete message into the forward buffer.
+ * Returns false if they do not fit.
+*/
+static bool gateway_take_over(const uint8_t* message, size_t message_length)
+{
+    struct sensor_data_t* received = (struct sensor_data_t*) malloc(sizeof(struct sensor_data_t) * UINT8_MAX);
+    size_t received_length = 0;
+    bool accepted = false;
+
+    if (!received) {
+        return false;
+    }
+
+    esp_err_t err = formatter_parse_measurements_from_binary(message, message_length, received, UINT8_MAX, &received_length);
+    if (err != ESP_OK) {
+        ESP_LOGE(GATEWAY_LOG_TAG, "Malformed message: %s", esp_err_to_name(err));
+        free(received);
+        // Acknowledge anyway, resending it would not help
+        return true;
+    }
+
+    xSemaphoreTake(gateway->lock, portMAX_DELAY);
+
+    size_t new_count = 0;
+    for (size_t i = 0; i < received_length; i++) {
+        if (received[i].sequence > gateway->last_sequence) {
+            new_count += 1;
+        }
+    }
+
+    if (gateway->measurement_count + new_count <= GATEWAY_MEASUREMENTS_MAX) {
+        for (size_t i = 0; i < received_length; i++) {
+            if (received[i].sequence > gateway->last_sequence) {
+                gateway->measurements[gateway->measurement_count++] = received[i];
+                gateway->last_sequence = received[i].sequence;
+            }
+        }
+        accepted = true;
+    }
+
+    xSemaphoreGive(gateway->lock);
+
+    if (new_count > 0) {
+        ESP_LOGI(GATEWAY_LOG_TAG, "Received %d measurements, %d buffered", new_count, gateway->measurement_count);
+    }
+
+    free(received);
+    return accepted;
+}
+
+static void gateway_handle_frame(const struct gateway_frame_t* frame)
+{
+    struct espnow_frame_header_t header;
+    const uint8_t* payload;
+    uint8_t ack[ESPNOW_FRAME_MAX_SZ];
+    uint8_t status = ESPNOW_ACK_STATUS_OK;
+
+    if (espnow_frame_decode(frame->data, frame->length, &header, &payload) != ESP_OK || header.type != ESPNOW_FRAME_TYPE_DATA) {
+        return;
+    }
+
+    bool was_complete = espnow_reassembly_is_complete(&gateway->reassembly) && header.message_id == gateway->reassembly.message_id;
+    if (espnow_reassembly_feed(&gateway->reassembly, &header, payload) != ESP_OK) {
+        return;
+    }
+
+    bool is_complete = espnow_reassembly_is_complete(&gateway->reassembly);
+    if (is_complete && !was_complete) {
+        if (!gateway_take_over(gateway->reassembly.message, gateway->reassembly.message_length)) {
+            // Forget the message, the station keeps it and retries later
+            status = ESPNOW_ACK_STATUS_BUSY;
+            espnow_reassembly_init(&gateway->reassembly);
+        }
+    }
+
+    if ((header.flags & ESPNOW_FRAME_FLAG_ACK_REQUEST) || (is_complete && !was_complete)) {
+        size_t ack_length = espnow_frame_encode_ack(ack, sizeof(ack), header.message_id, header.fragment_count, gateway->reassembly.received, status);
+        esp_now_send(configuration.espnow_peer, ack, ack_length);
+    }
+}
+
+/**
+ * Pushes the buffered measurements to the data sinks and drops what all of
+ * them acknowledged
+*/
+static void gateway_forward_task(void* arg)
+{
+    struct sensor_data_t* pending = (struct sensor_data_t*) malloc(sizeof(struct sensor_data_t) * GATEWAY_MEASUREMENTS_MAX);
+
+    while (1) {
+        xSemaphoreTake(gateway->lock, portMAX_DELAY);
+        size_t pending_length = gateway->measurement_count;
+        memcpy(pending, gateway->measurements, sizeof(struct sensor_data_t) * pending_length);
+        xSemaphoreGive(gateway->lock);
+
+        if (pending_length == 0) {
+            vTaskDelay(pdMS_TO_TICKS(GATEWAY_FORWARD_INTERVAL_MS));
+            continue;
+        }
+
+        esp_err_t err = gateway->forward(pending, pending_length, gateway->acknowledged_sequences);
+
+        // Keep what any of the data sinks still misses
+        uint32_t acknowledged_sequence = gateway->acknowledged_sequences[0];
+        for (size_t i = 1; i < CONFIGURATION_DATA_SINKS_MAX; i++) {
+            if (gateway->acknowledged_sequences[i] < acknowledged_sequence) {
+                acknowledged_sequence = gateway->acknowledged_sequences[i];
+            }
+        }
+
+        // New measurements are only appended meanwhile, so the acknowledged ones are still in front
+        xSemaphoreTake(gateway->lock, portMAX_DELAY);
+        size_t acknowledged_count = 0;
+        while (acknowledged_count < gateway->measurement_count && gateway->measurements[acknowledged_count].sequence <= acknowledged_sequence) {
+            acknowledged_count += 1;
+        }
+        memmove(&gateway->measurements[0], &gateway->measurements[acknowledged_count], sizeof(struct sensor_data_t) * (gateway->measurement_count - acknowledged_count));
+        gateway->measurement_count -= acknowledged_count;
+        xSemaphoreGive(gateway->lock);
+
+        // Boot into a firmware update downloaded while forwarding
+        if (ota_is_restart_pending()) {
+            esp_restart();
+        }
+
+        if (err != ESP_OK) {
+            ESP_LOGE(GATEWAY_LOG_TAG, "Forwarding failed (%s), %d measurements remain buffered", esp_err_to_name(err), pending_length - acknowledged_count);
+            vTaskDelay(pdMS_TO_TICKS(GATEWAY_FORWARD_RETRY_MS));
+        }
+    }
+}
+
+/**
+ * Runs the station as ESP-NOW gateway: stays connected to the access point,
+ * receives the messages of the station configured as espnow_peer and
+ * bridges them to the data sink via [forward]. Never returns.
+*/
+void gateway_run(gateway_forward_t forward)
+{
+    gateway = (struct gateway_state_t*) calloc(1, sizeof(struct gateway_state_t));
+    gateway->forward = forward;
+    gateway->frames = xQueueCreate(GATEWAY_QUEUE_LENGTH, sizeof(struct gateway_frame_t));
+    gateway->lock = xSemaphoreCreateMutex();
+    espnow_reassembly_init(&gateway->reassembly);
+
+    ESP_ERROR_CHECK(connect_to_wifi());
+
+    // Keep the radio listening, frames sent while it dozes are lost
+    ESP_ERROR_CHECK(esp_wifi_set_ps(WIFI_PS_NONE));
+
+    uint8_t channel = 0;
+    wifi_second_chan_t second_channel;
+    esp_wifi_get_channel(&channel, &second_channel);
+    if (channel != configuration.espnow_channel) {
+        ESP_LOGW(GATEWAY_LOG_TAG, "Access point uses channel %d, the station is configured for channel %d", channel, configuration.espnow_channel);
+    }
+
+    ESP_ERROR_CHECK(esp_now_init());
+    ESP_ERROR_CHECK(esp_now_register_recv_cb(gateway_receive_callback));
+
+    esp_now_peer_info_t peer = {
+        .channel = 0,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, configuration.espnow_peer, ESP_NOW_ETH_ALEN);
+    ESP_ERROR_CHECK(esp_now_add_peer(&peer));
+
+    ESP_LOGI(GATEWAY_LOG_TAG, "Listening on channel %d", channel);
+
+    xTaskCreate(gateway_forward_task, "gateway_forward", 8192, NULL, 5, NULL);
+
+    struct gateway_frame_t frame;
+    while (1) {
+        if (xQueueReceive(gateway->frames, &frame, portMAX_DELAY) == pdTRUE) {
+            gateway_handle_frame(&frame);
+        }
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef __WEATHER_STATION__GATEWAY_H__
+#define __WEATHER_STATION__GATEWAY_H__
+
+#include "esp_err.h"
+#include "sensors.h"
+
+/**
+ * Forwards measurements to the data sinks, e.g. pusher_push. Updates the
+ * sequence number acknowledged by each of the CONFIGURATION_DATA_SINKS_MAX
+ * data sinks.
+*/
+typedef esp_err_t (*gateway_forward_t)(struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequences);
+
+void gateway_run(gateway_forward_t forward);
+
+#endif
@@ -0,0 +1,269 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <ctype.h>
+
+#include "http.h"
+
+/**
+ * Writes the request line and headers of a HTTP/1.1 request into [buffer].
+ * The Content-Type and Content-Encoding headers are omitted if
+ * [content_type] or [content_encoding] are NULL.
+ * [extra_headers] are appended as is and have to end with CRLF, if set.
+ *
+ * Returns the length of the head or 0 if it did not fit into the buffer.
+*/
+size_t http_build_request_head(char* buffer, size_t buffer_length, const char* method, const char* host, const char* path, const char* content_type, const char* content_encoding, const char* extra_headers, size_t content_length, bool keep_alive)
+{
+    int length = snprintf(
+        buffer,
+        buffer_length,
+        "%s %s HTTP/1.1\r\n"
+        "Host: %s\r\n"
+        "User-Agent: esp-idf/1.0 esp32\r\n"
+        "Connection: %s\r\n"
+        "%s%s%s"
+        "%s%s%s"
+        "%s"
+        "Content-Length: %u\r\n"
+        "\r\n",
+        method,
+        path[0] == '\0' ? "/" : path,
+        host,
+        keep_alive ? "keep-alive" : "close",
+        content_type ? "Content-Type: " : "",
+        content_type ? content_type : "",
+        content_type ? "\r\n" : "",
+        content_encoding ? "Content-Encoding: " : "",
+        content_encoding ? content_encoding : "",
+        content_encoding ? "\r\n" : "",
+        extra_headers ? extra_headers : "",
+        (unsigned int) content_length
+    );
+
+    if (length < 0 || (size_t) length >= buffer_length) {
+        return 0;
+    }
+
+    return (size_t) length;
+}
+
+void http_response_init(struct http_response_t* response, char* body, size_t body_capacity)
+{
+    memset(response, 0, sizeof(struct http_response_t));
+    response->state = HTTP_RESPONSE_STATE_HEAD;
+    response->body = body;
+    response->body_capacity = body_capacity;
+
+    if (body != NULL && body_capacity > 0) {
+        body[0] = '\0';
+    }
+}
+
+bool http_response_is_complete(struct http_response_t* response)
+{
+    return response->state == HTTP_RESPONSE_STATE_DONE;
+}
+
+/**
+ * Passes a span of body bytes to the body callback or appends them to the
+ * body buffer
+*/
+static esp_err_t http_response_append_body(struct http_response_t* response, const char* data, size_t data_length)
+{
+    if (response->on_body != NULL) {
+        return response->on_body(response->on_body_context, data, data_length);
+    }
+
+    if (response->body == NULL || response->body_capacity == 0) {
+        return ESP_OK;
+    }
+
+    size_t free_space = response->body_capacity - response->body_length - 1;
+    if (data_length > free_space) {
+        data_length = free_space;
+        response->body_truncated = true;
+    }
+
+    memcpy(&response->body[response->body_length], data, data_length);
+    response->body_length += data_length;
+    response->body[response->body_length] = '\0';
+
+    return ESP_OK;
+}
+
+/**
+ * Handles one complete line of the response head. An empty line terminates
+ * the head and decides how the body is framed.
+*/
+static esp_err_t http_response_parse_head_line(struct http_response_t* response)
+{
+    char* line = response->line;
+
+    if (!response->status_line_parsed) {
+        // "HTTP/1.1 200 OK"
+        if (strncmp(line, "HTTP/1.", 7) != 0 || strlen(line) < 12) {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+
+        response->status = atoi(&line[9]);
+        response->connection_close = line[7] == '0';
+        response->status_line_parsed = true;
+        return ESP_OK;
+    }
+
+    // End of head
+    if (response->line_length == 0) {
+        if (response->chunked) {
+            response->state = HTTP_RESPONSE_STATE_CHUNK_SIZE;
+        } else if (response->content_length > 0) {
+            response->remaining = response->content_length;
+            response->state = HTTP_RESPONSE_STATE_BODY;
+        } else {
+            response->state = HTTP_RESPONSE_STATE_DONE;
+        }
+        return ESP_OK;
+    }
+
+    char* value = strchr(line, ':');
+    if (value == NULL) {
+        return ESP_OK;
+    }
+
+    *value = '\0';
+    value += 1;
+    while (*value == ' ' || *value == '\t') {
+        value += 1;
+    }
+
+    if (strcasecmp(line, "Content-Length") == 0) {
+        response->content_length = strtoul(value, NULL, 10);
+    } else if (strcasecmp(line, "Transfer-Encoding") == 0) {
+        response->chunked = strcasestr(value, "chunked") != NULL;
+    } else if (strcasecmp(line, "Connection") == 0) {
+        if (strcasestr(value, "close") != NULL) {
+            response->connection_close = true;
+        } else if (strcasestr(value, "keep-alive") != NULL) {
+            response->connection_close = false;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * Collects characters into the line buffer. Returns true once a complete
+ * line (terminated by LF, the CR is dropped) is available.
+*/
+static bool http_response_collect_line(struct http_response_t* response, char c)
+{
+    if (c == '\n') {
+        if (response->line_length > 0 && response->line[response->line_length - 1] == '\r') {
+            response->line_length -= 1;
+        }
+        response->line[response->line_length] = '\0';
+        return true;
+    }
+
+    // Overlong header lines are truncated, we only care about a few short ones
+    if (response->line_length + 1 < HTTP_RESPONSE_LINE_MAX_SZ) {
+        response->line[response->line_length] = c;
+        response->line_length += 1;
+    }
+
+    return false;
+}
+
+/**
+ * Feeds received bytes into the parser.
+ *
+ * Stops at the end of the response and reports the amount of bytes used in
+ * [consumed]. Remaining bytes belong to the next (pipelined) response.
+*/
+esp_err_t http_response_feed(struct http_response_t* response, const char* data, size_t data_length, size_t* consumed)
+{
+    size_t i = 0;
+    size_t span = 0;
+    esp_err_t err;
+
+    for (; i < data_length && response->state != HTTP_RESPONSE_STATE_DONE; i++) {
+        char c = data[i];
+
+        switch (response->state) {
+            case HTTP_RESPONSE_STATE_HEAD:
+                if (http_response_collect_line(response, c)) {
+                    err = http_response_parse_head_line(response);
+                    if (err != ESP_OK) {
+                        *consumed = i + 1;
+                        return err;
+                    }
+                    response->line_length = 0;
+                }
+                break;
+            case HTTP_RESPONSE_STATE_BODY:
+                span = data_length - i;
+                if (span > response->remaining) {
+                    span = response->remaining;
+                }
+                err = http_response_append_body(response, &data[i], span);
+                if (err != ESP_OK) {
+                    *consumed = i + span;
+                    return err;
+                }
+                i += span - 1;
+                response->remaining -= span;
+                if (response->remaining == 0) {
+                    response->state = HTTP_RESPONSE_STATE_DONE;
+                }
+                break;
+            case HTTP_RESPONSE_STATE_CHUNK_SIZE:
+                if (http_response_collect_line(response, c)) {
+                    response->remaining = strtoul(response->line, NULL, 16);
+                    response->line_length = 0;
+                    response->state = response->remaining > 0
+                        ? HTTP_RESPONSE_STATE_CHUNK_DATA
+                        : HTTP_RESPONSE_STATE_CHUNK_TRAILER;
+                }
+                break;
+            case HTTP_RESPONSE_STATE_CHUNK_DATA:
+                span = data_length - i;
+                if (span > response->remaining) {
+                    span = response->remaining;
+                }
+                err = http_response_append_body(response, &data[i], span);
+                if (err != ESP_OK) {
+                    *consumed = i + span;
+                    return err;
+                }
+                i += span - 1;
+                response->remaining -= span;
+                if (response->remaining == 0) {
+                    response->state = HTTP_RESPONSE_STATE_CHUNK_DATA_END;
+                }
+                break;
+            case HTTP_RESPONSE_STATE_CHUNK_DATA_END:
+                // CRLF after the chunk data
+                if (http_response_collect_line(response, c)) {
+                    response->line_length = 0;
+                    response->state = HTTP_RESPONSE_STATE_CHUNK_SIZE;
+                }
+                break;
+            case HTTP_RESPONSE_STATE_CHUNK_TRAILER:
+                // Trailers end with an empty line
+                if (http_response_collect_line(response, c)) {
+                    bool empty = response->line_length == 0;
+                    response->line_length = 0;
+                    if (empty) {
+                        response->state = HTTP_RESPONSE_STATE_DONE;
+                    }
+                }
+                break;
+            case HTTP_RESPONSE_STATE_DONE:
+                break;
+        }
+    }
+
+    *consumed = i;
+    return ESP_OK;
+}
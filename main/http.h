@@ -0,0 +1,88 @@
+#ifndef __WEATHER_STATION__HTTP_H__
+#define __WEATHER_STATION__HTTP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+#define HTTP_RESPONSE_LINE_MAX_SZ 256
+
+typedef esp_err_t (*http_body_callback_t)(void* context, const char* data, size_t data_length);
+
+enum http_response_state_t {
+    HTTP_RESPONSE_STATE_HEAD,
+    HTTP_RESPONSE_STATE_BODY,
+    HTTP_RESPONSE_STATE_CHUNK_SIZE,
+    HTTP_RESPONSE_STATE_CHUNK_DATA,
+    HTTP_RESPONSE_STATE_CHUNK_DATA_END,
+    HTTP_RESPONSE_STATE_CHUNK_TRAILER,
+    HTTP_RESPONSE_STATE_DONE,
+};
+
+/**
+ * Incremental parser state for a single HTTP/1.1 response.
+ *
+ * Responses are fed in byte-wise as they arrive from the connection. The
+ * parser stops at the end of the message, so several pipelined responses
+ * can be read from the same stream one after another.
+*/
+struct http_response_t {
+    enum http_response_state_t state;
+
+    /**
+     * The status code of the response, e.g. 200
+    */
+    int status;
+
+    /**
+     * The announced length of the body (Content-Length)
+    */
+    size_t content_length;
+
+    /**
+     * Amount of body bytes left in the current body or chunk
+    */
+    size_t remaining;
+
+    /**
+     * Set if the body is sent with Transfer-Encoding: chunked
+    */
+    bool chunked;
+
+    /**
+     * Set if the server closes the connection after this response
+    */
+    bool connection_close;
+
+    /**
+     * Optional buffer receiving the (dechunked) body. Bodies longer than the
+     * buffer are truncated. The body is always null terminated.
+    */
+    char* body;
+    size_t body_capacity;
+    size_t body_length;
+
+    /**
+     * Set if the body did not fit into the buffer
+    */
+    bool body_truncated;
+
+    /**
+     * Optional callback receiving the (dechunked) body as it arrives. Used
+     * for bodies too large to be buffered.
+    */
+    http_body_callback_t on_body;
+    void* on_body_context;
+
+    char line[HTTP_RESPONSE_LINE_MAX_SZ];
+    size_t line_length;
+    bool status_line_parsed;
+};
+
+size_t http_build_request_head(char* buffer, size_t buffer_length, const char* method, const char* host, const char* path, const char* content_type, const char* content_encoding, const char* extra_headers, size_t content_length, bool keep_alive);
+void http_response_init(struct http_response_t* response, char* body, size_t body_capacity);
+esp_err_t http_response_feed(struct http_response_t* response, const char* data, size_t data_length, size_t* consumed);
+bool http_response_is_complete(struct http_response_t* response);
+
+#endif
@@ -5,6 +5,7 @@
 #include "driver/gpio.h"
 #include "driver/rtc_io.h"
 #include "esp_sleep.h"
+#include "esp_timer.h"
 #include "esp_attr.h"
 #include "esp_netif.h"
 #include "esp_netif_sntp.h"
@@ -15,23 +16,51 @@
 #include "configuration.h"
 #include "configuration_mode.c"
 #include "pusher.h"
+#include "pusher_espnow.h"
+#include "gateway.h"
+#include "ota.h"
+#include "aggregator.h"
+#include "sample_filter.h"
+#include "energy.h"
 
 void app_main(void);
 esp_err_t main_fetch_device_configuration(void);
 bool main_is_configuration_button_pressed(void);
 void main_configuration_mode_loop(void);
+void main_gateway_mode_loop(void);
 void main_normal_mode_loop(void);
+uint32_t main_next_sequence_number(void);
+void main_discard_acknowledged_measurements(uint32_t acknowledged_sequence);
+void main_store_measurement(struct sensor_data_t* measurement);
+void main_store_statistics(void);
+void main_store_sample(struct sensor_data_t* sample, uint8_t filter_mode);
+uint8_t main_due_sensors(uint32_t now);
+
+#define MEASUREMENTS_MAX 100
+#define SEQUENCE_BLOCK_SIZE 1024
+#define BROADCAST_DURATION_MS 300
 
 RTC_DATA_ATTR static uint32_t boot_count = 0;
 RTC_DATA_ATTR static uint8_t measurement_count = 0;
 RTC_DATA_ATTR static uint32_t last_upload_timestamp = 0;
-RTC_DATA_ATTR static struct sensor_data_t measurements[100];
+RTC_DATA_ATTR static struct sensor_data_t measurements[MEASUREMENTS_MAX];
+RTC_DATA_ATTR static uint32_t next_sequence = 1;
+RTC_DATA_ATTR static uint32_t reserved_sequence_end = 1;
+RTC_DATA_ATTR static uint32_t sink_acknowledged_sequences[CONFIGURATION_DATA_SINKS_MAX];
+RTC_DATA_ATTR static struct aggregator_t aggregator;
+RTC_DATA_ATTR static struct sample_filter_t sample_filter;
+RTC_DATA_ATTR static struct sensor_data_t last_sample;
+RTC_DATA_ATTR static uint32_t sensor_read_timestamps[SENSORS_DEVICES];
+RTC_DATA_ATTR struct energy_t energy;
 
 void app_main(void)
 {
     boot_count += 1;
     bool isColdBoot = boot_count == 1;
 
+    // Roll back a firmware update that crashed before it got confirmed
+    ota_check_boot();
+
     // 1. Fetch device configuration once into RTC memory on cold boot
     if (isColdBoot) {
         main_fetch_device_configuration();
@@ -44,6 +73,11 @@ void app_main(void)
             "wifi_ssid=%s\n"
             "wifi_password=%s\n"
             "subtract_measuring_time=%s\n"
+            "data_sink_compression=%i\n"
+            "config_version=%lu\n"
+            "uplink=%i\n"
+            "espnow_peer=%02x:%02x:%02x:%02x:%02x:%02x\n"
+            "espnow_channel=%i\n"
             "sleeping for %i us\n",
             configuration.data_sink,
             configuration.data_sink_push_format,
@@ -52,6 +86,12 @@ void app_main(void)
             configuration.wifi_ssid,
             configuration.wifi_password,
             configuration.subtract_measuring_time ? "true" : "false",
+            configuration.data_sink_compression,
+            configuration.config_version,
+            configuration.uplink,
+            configuration.espnow_peer[0], configuration.espnow_peer[1], configuration.espnow_peer[2],
+            configuration.espnow_peer[3], configuration.espnow_peer[4], configuration.espnow_peer[5],
+            configuration.espnow_channel,
             configuration.measurement_rate * 1000 * 1000
         );
         fflush(stdout);
@@ -65,6 +105,11 @@ void app_main(void)
         main_configuration_mode_loop();
     }
 
+    // A gateway stays awake and bridges the frames of its station
+    if (configuration.uplink == CONFIGURATION_UPLINK_ESPNOW_GATEWAY) {
+        main_gateway_mode_loop();
+    }
+
     // Update the system time once on cold boot
     if (isColdBoot && false) {
         ESP_ERROR_CHECK(connect_to_wifi());
@@ -132,25 +177,195 @@ void main_configuration_mode_loop(void)
     esp_restart();
 }
 
+void main_gateway_mode_loop(void)
+{
+    // Confirm a freshly updated firmware, the gateway does not upload on its own
+    ota_confirm_running_image(true);
+
+    gateway_run(pusher_push);
+}
+
+/**
+ * Hands out the next sequence number from the block reserved in nvs. A new
+ * block is reserved when the current one is used up or after a cold boot.
+*/
+uint32_t main_next_sequence_number(void)
+{
+    if (next_sequence == reserved_sequence_end) {
+        uint32_t first_sequence = 0;
+        esp_err_t err = cfg_reserve_sequence_numbers(SEQUENCE_BLOCK_SIZE, &first_sequence);
+        if (err == ESP_OK && first_sequence >= next_sequence) {
+            next_sequence = first_sequence;
+            reserved_sequence_end = first_sequence + SEQUENCE_BLOCK_SIZE;
+        } else {
+            // Keep counting in rtc memory and retry the reservation next time
+            printf("Error (%s) reserving sequence numbers!\n", esp_err_to_name(err));
+            fflush(stdout);
+            reserved_sequence_end = next_sequence + 1;
+        }
+    }
+
+    next_sequence += 1;
+    return next_sequence - 1;
+}
+
+/**
+ * Removes all measurements up to and including [acknowledged_sequence] from
+ * rtc memory. Unacknowledged measurements stay for the next upload.
+*/
+void main_discard_acknowledged_measurements(uint32_t acknowledged_sequence)
+{
+    uint8_t acknowledged_count = 0;
+
+    while (acknowledged_count < measurement_count && measurements[acknowledged_count].sequence <= acknowledged_sequence) {
+        acknowledged_count += 1;
+    }
+
+    memmove(&measurements[0], &measurements[acknowledged_count], sizeof(struct sensor_data_t) * (measurement_count - acknowledged_count));
+    measurement_count -= acknowledged_count;
+    memset(&measurements[measurement_count], 0, sizeof(struct sensor_data_t) * (MEASUREMENTS_MAX - measurement_count));
+}
+
+/**
+ * Appends [measurement] to the measurements in rtc memory with the next
+ * sequence number. Numbers are only handed out to what is uploaded, so the
+ * data sink sees no gaps.
+*/
+void main_store_measurement(struct sensor_data_t* measurement)
+{
+    measurement->sequence = main_next_sequence_number();
+
+    // If the sink was unreachable for too long, drop the oldest measurement
+    if (measurement_count == MEASUREMENTS_MAX) {
+        memmove(&measurements[0], &measurements[1], sizeof(struct sensor_data_t) * (MEASUREMENTS_MAX - 1));
+        measurement_count -= 1;
+    }
+
+    memcpy(&measurements[measurement_count], measurement, sizeof(struct sensor_data_t));
+    measurement_count += 1;
+}
+
+/**
+ * Closes the aggregation window and stores its statistics
+*/
+void main_store_statistics(void)
+{
+    struct sensor_data_t records[AGGREGATOR_RECORDS];
+    aggregator_finish(&aggregator, records);
+
+    for (uint8_t i = 0; i < AGGREGATOR_RECORDS; i++) {
+        main_store_measurement(&records[i]);
+    }
+
+    aggregator_reset(&aggregator);
+}
+
+/**
+ * Stores [sample] and what the sample filter released with it. Samples the
+ * data sink can reconstruct within tolerance are dropped.
+*/
+void main_store_sample(struct sensor_data_t* sample, uint8_t filter_mode)
+{
+    struct sample_filter_options_t options = {
+        filter_mode,
+        configuration.sample_filter_tolerances,
+        configuration.sample_filter_max_interval
+    };
+
+    struct sensor_data_t stored[SAMPLE_FILTER_STORED_MAX];
+    size_t stored_length = sample_filter_add(&sample_filter, &options, sample, stored);
+
+    for (size_t i = 0; i < stored_length; i++) {
+        main_store_measurement(&stored[i]);
+    }
+}
+
+/**
+ * Returns the sensors to read on this wake, bits of SENSORS_DEVICE_*. A
+ * sensor is due once its rate passed since it was last read, rounded to the
+ * nearest wake. The LTR390 is read at the dark rate while it saw no light.
+*/
+uint8_t main_due_sensors(uint32_t now)
+{
+    uint8_t due_devices = 0;
+
+    for (uint8_t i = 0; i < SENSORS_DEVICES; i++) {
+        uint16_t rate = configuration.sensor_rates[i];
+        if (i == SENSORS_DEVICE_LTR390 && sensor_read_timestamps[i] != 0 && last_sample.daylight == 0 && configuration.sensor_dark_rate > rate) {
+            rate = configuration.sensor_dark_rate;
+        }
+
+        uint32_t elapsed = now - sensor_read_timestamps[i];
+        if (rate == 0 || sensor_read_timestamps[i] == 0 || now < sensor_read_timestamps[i] || elapsed + energy.measurement_rate / 2 >= rate) {
+            due_devices |= 1 << i;
+        }
+    }
+
+    return due_devices;
+}
+
 void main_normal_mode_loop(void)
 {
     struct sensor_data_t* current_measurement = malloc(sizeof(struct sensor_data_t));
-    memset(current_measurement, 0, sizeof(struct sensor_data_t));
+
+    // Sensors that are not read keep their last reading
+    memcpy(current_measurement, &last_sample, sizeof(struct sensor_data_t));
+    current_measurement->sequence = 0;
+    current_measurement->kind = SENSORS_KIND_SAMPLE;
+    current_measurement->skipped_devices = SENSORS_DEVICES_ALL;
 
     struct timeval tv_now;
     gettimeofday(&tv_now, NULL);
     current_measurement->timestamp = tv_now.tv_sec;
 
-    sensors_init();
-    sensors_read_temperature_and_humidity_outside(current_measurement);
-    sensors_read_daylight_and_uv(current_measurement);
-    sensors_read_battery_status(current_measurement);
-    sensors_read_temperature_and_pressure_inside(current_measurement);
-    sensors_deinit();
+    // Only bring up the bus if a sensor is due, missing or failing ones are skipped
+    uint8_t due_devices = main_due_sensors(current_measurement->timestamp);
+    if (due_devices != 0) {
+        if (sensors_init() == ESP_OK) {
+            sensors_read(current_measurement, due_devices);
+        }
+        sensors_deinit();
+    }
+
+    for (uint8_t i = 0; i < SENSORS_DEVICES; i++) {
+        if (!(current_measurement->skipped_devices & (1 << i))) {
+            sensor_read_timestamps[i] = current_measurement->timestamp;
+        }
+    }
+    memcpy(&last_sample, current_measurement, sizeof(struct sensor_data_t));
+
+    // Stretch or tighten the intervals to what the battery affords
+    struct energy_options_t energy_options = {
+        configuration.measurement_rate,
+        configuration.upload_rate,
+        configuration.energy_autonomy_hours
+    };
+    energy_update(&energy, &energy_options, current_measurement);
+
+    // Broadcasts advertise every sample, there is nothing to aggregate or filter
+    bool is_broadcast = configuration.uplink == CONFIGURATION_UPLINK_BLE_BROADCAST;
+    uint8_t aggregation = is_broadcast ? CONFIGURATION_AGGREGATION_RAW : configuration.aggregation;
+    uint8_t filter_mode = is_broadcast || aggregation == CONFIGURATION_AGGREGATION_STATISTICS ? SAMPLE_FILTER_NONE : configuration.sample_filter;
+    uint16_t window = configuration.aggregation_window;
+
+    // A window whose last sample was missed, e.g. after a changed rate
+    if (aggregation != CONFIGURATION_AGGREGATION_RAW && aggregator.count > 0 && !aggregator_is_in_window(&aggregator, current_measurement->timestamp, window)) {
+        main_store_statistics();
+    }
+
+    if (aggregation != CONFIGURATION_AGGREGATION_STATISTICS) {
+        main_store_sample(current_measurement, filter_mode);
+    }
+
+    // Close the window with its last sample instead of waiting for the next wake
+    if (aggregation != CONFIGURATION_AGGREGATION_RAW) {
+        aggregator_add(&aggregator, current_measurement, window);
+        if (!aggregator_is_in_window(&aggregator, current_measurement->timestamp + energy.measurement_rate, window)) {
+            main_store_statistics();
+        }
+    }
 
-    memcpy(&measurements[measurement_count], current_measurement, sizeof(struct sensor_data_t));
     free(current_measurement);
-    measurement_count += 1;
 
     // Upon cold boot set the last_upload_timestamp to now
     if (last_upload_timestamp == 0) {
@@ -160,24 +375,70 @@ void main_normal_mode_loop(void)
     printf("measurement          : %i\n",   measurement_count);
     printf("tv_now.tv_sec        : %lli\n", tv_now.tv_sec);
     printf("last_upload_timestamp: %li\n",  last_upload_timestamp);
+    printf("energy scale         : %i%% (state %i)\n", energy.scale, energy.state);
     fflush(stdout);
 
-    // Check if enough time has past to trigger an upload
-    if ((last_upload_timestamp + configuration.upload_rate) < tv_now.tv_sec) {
-        ESP_ERROR_CHECK(connect_to_wifi());
-        ESP_ERROR_CHECK(pusher_http_push(measurements, measurement_count));
-        last_upload_timestamp = tv_now.tv_sec;
-
-        // Since we uploaded the data we can discard it from rtc memory now
+    // Check if enough time has past to trigger an upload. A freshly updated
+    // firmware uploads right away to prove it reaches the network before it
+    // gets confirmed.
+    bool is_pending_verify = ota_is_pending_verify();
+    if (configuration.uplink == CONFIGURATION_UPLINK_BLE_BROADCAST) {
+        // Advertise the latest readings for a short burst instead of bringing up wifi
+        esp_err_t err = bt_broadcast_measurement(&measurements[measurement_count - 1], BROADCAST_DURATION_MS);
+        if (is_pending_verify) {
+            ota_confirm_running_image(err == ESP_OK);
+        }
+
+        // Broadcasts are not acknowledged, there is nothing to keep for a later upload
         measurement_count = 0;
-        memset(&measurements, 0, sizeof(struct sensor_data_t) * 100);
+        memset(&measurements[0], 0, sizeof(measurements));
+    } else if ((last_upload_timestamp + energy.upload_rate) < tv_now.tv_sec || is_pending_verify) {
+        uint32_t acknowledged_sequence = 0;
+        esp_err_t err;
+        if (configuration.uplink == CONFIGURATION_UPLINK_ESPNOW) {
+            // Hand the measurements to the gateway without associating with the access point
+            err = pusher_espnow_push(measurements, measurement_count, &acknowledged_sequence);
+            if (is_pending_verify) {
+                ota_confirm_running_image(err == ESP_OK);
+            }
+        } else {
+            err = connect_to_wifi();
+            if (is_pending_verify) {
+                ota_confirm_running_image(err == ESP_OK);
+            }
+            if (err == ESP_OK) {
+                err = pusher_push(measurements, measurement_count, sink_acknowledged_sequences);
+            }
+            acknowledged_sequence = pusher_lowest_acknowledged_sequence(sink_acknowledged_sequences);
+        }
+
+        // Discard what all data sinks acknowledged, the rest is resent next time
+        main_discard_acknowledged_measurements(acknowledged_sequence);
+
+        // On failure we retry with the next upload instead of on every wake
+        last_upload_timestamp = tv_now.tv_sec;
+        if (err != ESP_OK) {
+            printf("Error (%s) uploading measurements, %i remain buffered\n", esp_err_to_name(err), measurement_count);
+            fflush(stdout);
+        }
     }
 
     disconnect_from_wifi();
     blinker_set_disabled();
 
-    //esp_sleep_enable_timer_wakeup(configuration.measurement_rate * 1000 * 1000);
-    esp_sleep_enable_timer_wakeup(10 * 1000 * 1000);
+    // Boot into a firmware update downloaded during the upload
+    if (ota_is_restart_pending()) {
+        esp_restart();
+    }
+
+    // Sleep for one interval, optionally minus the time we were awake but at least a second
+    uint64_t sleep_us = (uint64_t) energy.measurement_rate * 1000 * 1000;
+    uint64_t awake_us = esp_timer_get_time();
+    if (configuration.subtract_measuring_time) {
+        sleep_us = awake_us + 1000 * 1000 < sleep_us ? sleep_us - awake_us : 1000 * 1000;
+    }
+
+    esp_sleep_enable_timer_wakeup(sleep_us);
     esp_deep_sleep_start();
 
     // 1. Initialize values in static rtc ram depending on configuration
@@ -0,0 +1,245 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+
+#include "ota.h"
+
+static const char* OTA_LOG_TAG = "OTA";
+
+/**
+ * Set once a new image got written and activated, it is booted with the
+ * next restart
+*/
+static bool ota_restart_pending = false;
+
+/**
+ * Failed verifications of an updated image before we roll back to the
+ * previous one, a single failure may just be a busy access point
+*/
+#define OTA_VERIFY_ATTEMPTS_MAX 3
+
+#define OTA_TRIAL_MAGIC 0x4F544131
+
+/**
+ * Verification of an updated image that outlived its first wake. Kept in
+ * memory that survives deep sleep, panics and watchdog resets, the magic
+ * tells it apart from what a power on leaves behind.
+*/
+struct ota_trial_t {
+    uint32_t magic;
+    uint32_t partition_address;
+    uint8_t failures;
+};
+
+RTC_NOINIT_ATTR static struct ota_trial_t ota_trial;
+
+static esp_err_t ota_read_source(void* context, size_t offset, uint8_t* buffer, size_t length)
+{
+    struct ota_update_t* update = (struct ota_update_t*) context;
+
+    if (offset + length > update->source_partition->size) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return esp_partition_read(update->source_partition, offset, buffer, length);
+}
+
+static esp_err_t ota_write_target(void* context, const uint8_t* data, size_t length)
+{
+    struct ota_update_t* update = (struct ota_update_t*) context;
+
+    return esp_ota_write(update->handle, data, length);
+}
+
+/**
+ * Starts writing a new image into the inactive ota slot. If [delta] is set
+ * the written data is a patch against the running image.
+*/
+esp_err_t ota_begin(struct ota_update_t* update, bool delta)
+{
+    memset(update, 0, sizeof(struct ota_update_t));
+    update->delta = delta;
+    update->source_partition = esp_ota_get_running_partition();
+    update->target_partition = esp_ota_get_next_update_partition(NULL);
+
+    if (update->target_partition == NULL) {
+        ESP_LOGE(OTA_LOG_TAG, "No ota slot available");
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    ESP_LOGI(OTA_LOG_TAG, "Writing %s image into %s", delta ? "delta" : "full", update->target_partition->label);
+
+    esp_err_t err = esp_ota_begin(update->target_partition, OTA_WITH_SEQUENTIAL_WRITES, &update->handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(OTA_LOG_TAG, "esp_ota_begin failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    delta_patcher_init(&update->patcher, ota_read_source, ota_write_target, update);
+    return ESP_OK;
+}
+
+/**
+ * Writes the next chunk of the download. Signature matches
+ * http_body_callback_t, so the download can be streamed straight from the
+ * http response.
+*/
+esp_err_t ota_write(void* context, const char* data, size_t data_length)
+{
+    struct ota_update_t* update = (struct ota_update_t*) context;
+
+    if (update->delta) {
+        return delta_patcher_feed(&update->patcher, (const uint8_t*) data, data_length);
+    }
+
+    return esp_ota_write(update->handle, data, data_length);
+}
+
+/**
+ * Validates the written image and makes it the boot image
+*/
+esp_err_t ota_end(struct ota_update_t* update)
+{
+    esp_err_t err;
+
+    if (update->delta) {
+        err = delta_patcher_finish(&update->patcher);
+        if (err != ESP_OK) {
+            ESP_LOGE(OTA_LOG_TAG, "Applying delta failed: %s", esp_err_to_name(err));
+            esp_ota_abort(update->handle);
+            return err;
+        }
+    }
+
+    // Verifies the image checksum and hash
+    err = esp_ota_end(update->handle);
+    if (err != ESP_OK) {
+        ESP_LOGE(OTA_LOG_TAG, "esp_ota_end failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    err = esp_ota_set_boot_partition(update->target_partition);
+    if (err != ESP_OK) {
+        ESP_LOGE(OTA_LOG_TAG, "esp_ota_set_boot_partition failed: %s", esp_err_to_name(err));
+        return err;
+    }
+
+    ESP_LOGI(OTA_LOG_TAG, "New image written to %s, restart pending", update->target_partition->label);
+    ota_restart_pending = true;
+    return ESP_OK;
+}
+
+void ota_abort(struct ota_update_t* update)
+{
+    esp_ota_abort(update->handle);
+}
+
+/**
+ * Returns true if the running image failed a verification before and was
+ * not confirmed since
+*/
+static bool ota_is_on_trial(void)
+{
+    return ota_trial.magic == OTA_TRIAL_MAGIC
+        && ota_trial.partition_address == esp_ota_get_running_partition()->address;
+}
+
+static void ota_rollback(void)
+{
+    memset(&ota_trial, 0, sizeof(ota_trial));
+
+    // Only returns if there is no previous image, keep the running one then
+    esp_err_t err = esp_ota_mark_app_invalid_rollback_and_reboot();
+    ESP_LOGE(OTA_LOG_TAG, "Error (%s) rolling back, keeping the running image", esp_err_to_name(err));
+    esp_ota_mark_app_valid_cancel_rollback();
+}
+
+/**
+ * Rolls back an updated image that crashed while it was verified. Crashes
+ * during its first wake are already rolled back by the bootloader. Called
+ * once on boot.
+*/
+void ota_check_boot(void)
+{
+    if (!ota_is_on_trial()) {
+        memset(&ota_trial, 0, sizeof(ota_trial));
+        return;
+    }
+
+    switch (esp_reset_reason()) {
+    case ESP_RST_PANIC:
+    case ESP_RST_INT_WDT:
+    case ESP_RST_TASK_WDT:
+    case ESP_RST_WDT:
+        ESP_LOGE(OTA_LOG_TAG, "Running image crashed while being verified, rolling back");
+        ota_rollback();
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * True while a freshly updated image is not confirmed yet, either pending
+ * verification by the bootloader or on trial after failed verifications
+*/
+bool ota_is_pending_verify(void)
+{
+    esp_ota_img_states_t state;
+
+    if (ota_is_on_trial()) {
+        return true;
+    }
+
+    if (esp_ota_get_state_partition(esp_ota_get_running_partition(), &state) != ESP_OK) {
+        return false;
+    }
+
+    return state == ESP_OTA_IMG_PENDING_VERIFY;
+}
+
+/**
+ * Verifies a freshly updated image, [healthy] once it reached the network. A
+ * healthy image is confirmed. Failures may be transient, the image is only
+ * marked invalid and we reboot into the previous one after
+ * OTA_VERIFY_ATTEMPTS_MAX of them.
+*/
+void ota_confirm_running_image(bool healthy)
+{
+    if (!ota_is_pending_verify()) {
+        return;
+    }
+
+    if (healthy) {
+        ESP_LOGI(OTA_LOG_TAG, "Running image confirmed");
+        memset(&ota_trial, 0, sizeof(ota_trial));
+        esp_ota_mark_app_valid_cancel_rollback();
+        return;
+    }
+
+    if (!ota_is_on_trial()) {
+        ota_trial.magic = OTA_TRIAL_MAGIC;
+        ota_trial.partition_address = esp_ota_get_running_partition()->address;
+        ota_trial.failures = 0;
+    }
+    ota_trial.failures += 1;
+
+    if (ota_trial.failures >= OTA_VERIFY_ATTEMPTS_MAX) {
+        ESP_LOGE(OTA_LOG_TAG, "Running image failed %u verifications, rolling back", ota_trial.failures);
+        ota_rollback();
+        return;
+    }
+
+    // The bootloader rolls back an image still pending verification on any
+    // reset including deep sleep wakes, the trial counts from here on
+    ESP_LOGW(OTA_LOG_TAG, "Running image failed verification %u of %u, retrying with the next upload", ota_trial.failures, OTA_VERIFY_ATTEMPTS_MAX);
+    esp_ota_mark_app_valid_cancel_rollback();
+}
+
+bool ota_is_restart_pending(void)
+{
+    return ota_restart_pending;
+}
@@ -0,0 +1,36 @@
+#ifndef __WEATHER_STATION__OTA_H__
+#define __WEATHER_STATION__OTA_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_ota_ops.h"
+
+#include "delta.h"
+
+/**
+ * State of one firmware update written into the inactive ota slot
+*/
+struct ota_update_t {
+    /**
+     * If set, the download is a delta against the running image
+    */
+    bool delta;
+
+    const esp_partition_t* source_partition;
+    const esp_partition_t* target_partition;
+    esp_ota_handle_t handle;
+    struct delta_patcher_t patcher;
+};
+
+esp_err_t ota_begin(struct ota_update_t* update, bool delta);
+esp_err_t ota_write(void* update, const char* data, size_t data_length);
+esp_err_t ota_end(struct ota_update_t* update);
+void ota_abort(struct ota_update_t* update);
+void ota_check_boot(void);
+bool ota_is_pending_verify(void);
+void ota_confirm_running_image(bool healthy);
+bool ota_is_restart_pending(void);
+
+#endif
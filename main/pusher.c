@@ -5,6 +5,7 @@
 #include <sys/time.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "freertos/event_groups.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
@@ -17,45 +18,634 @@
 #include "esp_netif.h"
 #include "esp_tls.h"
 #include "esp_crt_bundle.h"
+#include "esp_app_desc.h"
 #include "lwip/err.h"
 #include "lwip/sockets.h"
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 #include "lwip/dns.h"
 #include "http_parser.h"
+#include "cJSON.h"
 #include "sdkconfig.h"
 
 #include "sensors.h"
 #include "configuration.h"
 #include "formatter.h"
+#include "http.h"
+#include "compressor.h"
+#include "ota.h"
+#include "pusher_mqtt.h"
+#include "pusher_coap.h"
+#include "pusher_request.h"
+#include "sample_filter.h"
+#include "energy.h"
 
 #define SERVER_URL_MAX_SZ 256
 
+/**
+ * Holds the largest remote configuration, about 1.7 KiB with every value at
+ * its longest, next to an acknowledgement and a firmware update. A larger
+ * response body fails the upload.
+*/
+#define PUSHER_RESPONSE_BODY_BUFFER_SZ 4096
+#define PUSHER_FIRMWARE_PATH_MAX_SZ 256
+#define PUSHER_RECEIVE_BUFFER_SZ 256
+#define PUSHER_CONNECT_ATTEMPTS_MAX 3
+
+/**
+ * Amount of requests sent before waiting for their responses (HTTP/1.1
+ * pipelining). A depth of 1 disables pipelining.
+*/
+#define PUSHER_HTTP_PIPELINE_DEPTH 1
+
+/**
+ * Stack of the tasks delivering to the additional data sinks, large enough
+ * for a TLS handshake
+*/
+#define PUSHER_SINK_TASK_STACK_SZ 10240
+
+/**
+ * After the primary data sink finished, the additional ones get as long as
+ * the primary one took, but at least this long. Later ones are left behind
+ * and retry with the next upload.
+*/
+#define PUSHER_SINK_GRACE_MS 5000
+
 static const char *LOG_TAG = "PUSHER";
 
-esp_err_t pusher_http_push(struct sensor_data_t* measurements, size_t measurements_length)
+/**
+ * A firmware update requested by the data sink
+*/
+struct pusher_firmware_t {
+    bool requested;
+
+    /**
+     * If set, the firmware is a delta against the running image
+    */
+    bool delta;
+
+    /**
+     * Path of the firmware on the data sink host
+    */
+    char path[PUSHER_FIRMWARE_PATH_MAX_SZ];
+};
+
+/**
+ * A data sink the measurements are delivered to
+*/
+struct pusher_sink_t {
+    const char* url;
+    uint8_t push_format;
+
+    /**
+     * Only the primary data sink delivers configurations and firmware
+     * updates
+    */
+    bool primary;
+
+    /**
+     * Configuration the deliveries started with. The sink tasks read it
+     * instead of the global one, which is only replaced after all of them
+     * finished.
+    */
+    const struct configuration_t* configuration;
+
+    /**
+     * Receives a newer configuration delivered by the primary data sink,
+     * NULL for the other sinks
+    */
+    struct configuration_t* pending_configuration;
+};
+
+/**
+ * Delivery of the measurements to one data sink. Additional data sinks are
+ * delivered to from their own task, which works on its own copies of the
+ * configuration and the measurements. A delivery that misses the deadline
+ * is abandoned and freed by its task once it finished.
+*/
+struct pusher_delivery_t {
+    struct pusher_sink_t sink;
+    struct configuration_t configuration;
+    struct sensor_data_t* measurements;
+    size_t measurements_length;
+    uint32_t acknowledged_sequence;
+    esp_err_t result;
+    SemaphoreHandle_t done;
+    bool abandoned;
+};
+
+/**
+ * Guards handing a delivery over between its task and pusher_push
+*/
+static SemaphoreHandle_t pusher_delivery_lock = NULL;
+
+/**
+ * State of one keep-alive upload session
+*/
+struct pusher_session_t {
+    esp_tls_t* tls;
+    char receive_buffer[PUSHER_RECEIVE_BUFFER_SZ];
+    size_t receive_offset;
+    size_t receive_length;
+};
+
+static esp_err_t pusher_tls_write_all(esp_tls_t* tls, const char* data, size_t data_length)
+{
+    size_t written_bytes = 0;
+    int ret;
+
+    while (written_bytes < data_length) {
+        ret = esp_tls_conn_write(tls, data + written_bytes, data_length - written_bytes);
+        if (ret >= 0) {
+            written_bytes += ret;
+        } else if (ret != ESP_TLS_ERR_SSL_WANT_READ && ret != ESP_TLS_ERR_SSL_WANT_WRITE) {
+            ESP_LOGE(LOG_TAG, "esp_tls_conn_write  returned: [0x%02X](%s)", ret, esp_err_to_name(ret));
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * Reads exactly one response from the session. Bytes received past the end
+ * of the response stay in the receive buffer for the next one.
+*/
+static esp_err_t pusher_read_response(struct pusher_session_t* session, struct http_response_t* response)
+{
+    esp_err_t err;
+    size_t consumed;
+    int ret;
+
+    while (!http_response_is_complete(response)) {
+        if (session->receive_offset == session->receive_length) {
+            ret = esp_tls_conn_read(session->tls, session->receive_buffer, sizeof(session->receive_buffer));
+
+            if (ret == ESP_TLS_ERR_SSL_WANT_WRITE || ret == ESP_TLS_ERR_SSL_WANT_READ) {
+                continue;
+            } else if (ret < 0) {
+                ESP_LOGE(LOG_TAG, "esp_tls_conn_read  returned [-0x%02X](%s)", -ret, esp_err_to_name(ret));
+                return ESP_FAIL;
+            } else if (ret == 0) {
+                ESP_LOGW(LOG_TAG, "connection closed before the response was complete");
+                return ESP_FAIL;
+            }
+
+            session->receive_offset = 0;
+            session->receive_length = ret;
+        }
+
+        err = http_response_feed(
+            response,
+            &session->receive_buffer[session->receive_offset],
+            session->receive_length - session->receive_offset,
+            &consumed
+        );
+        session->receive_offset += consumed;
+
+        if (err != ESP_OK) {
+            ESP_LOGE(LOG_TAG, "malformed http response");
+            return err;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * Returns the formatter settings of [config]
+*/
+static struct formatter_options_t pusher_formatter_options(const struct configuration_t* config)
+{
+    struct formatter_options_t options = {
+        config->csv_delta_timestamps,
+        config->line_protocol_measurement,
+        config->line_protocol_station
+    };
+
+    return options;
+}
+
+/**
+ * Returns the sample filter settings of [config]
+*/
+static struct sample_filter_options_t pusher_sample_filter_options(const struct configuration_t* config)
+{
+    struct sample_filter_options_t options = {
+        config->sample_filter,
+        config->sample_filter_tolerances,
+        config->sample_filter_max_interval
+    };
+
+    return options;
+}
+
+/**
+ * Copies the values of a configuration delivered by the data sink into
+ * [pending_configuration]. Unknown or invalid values are ignored.
+*/
+static void pusher_parse_remote_configuration(cJSON* remote, struct configuration_t* pending_configuration)
+{
+    cJSON* item;
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "data_sink");
+    if (cJSON_IsString(item) && strlen(item->valuestring) > 0 && strlen(item->valuestring) < sizeof(pending_configuration->data_sink)) {
+        strcpy(pending_configuration->data_sink, item->valuestring);
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "data_sink_push_format");
+    if (cJSON_IsNumber(item) && item->valueint >= 0 && item->valueint <= UINT8_MAX) {
+        pending_configuration->data_sink_push_format = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "csv_delta_timestamps");
+    if (cJSON_IsBool(item)) {
+        pending_configuration->csv_delta_timestamps = cJSON_IsTrue(item);
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "line_protocol_measurement");
+    if (cJSON_IsString(item) && strlen(item->valuestring) > 0 && strlen(item->valuestring) < sizeof(pending_configuration->line_protocol_measurement)) {
+        strcpy(pending_configuration->line_protocol_measurement, item->valuestring);
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "line_protocol_station");
+    if (cJSON_IsString(item) && strlen(item->valuestring) < sizeof(pending_configuration->line_protocol_station)) {
+        strcpy(pending_configuration->line_protocol_station, item->valuestring);
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "bme280_oversampling");
+    if (cJSON_IsArray(item) && cJSON_GetArraySize(item) == 3) {
+        for (int i = 0; i < 3; i++) {
+            cJSON* oversampling = cJSON_GetArrayItem(item, i);
+            if (cJSON_IsNumber(oversampling) && oversampling->valueint >= 0 && oversampling->valueint <= 5) {
+                pending_configuration->bme280_oversampling[i] = oversampling->valueint;
+            }
+        }
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "aggregation");
+    if (cJSON_IsNumber(item) && item->valueint >= CONFIGURATION_AGGREGATION_RAW && item->valueint <= CONFIGURATION_AGGREGATION_BOTH) {
+        pending_configuration->aggregation = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "aggregation_window");
+    if (cJSON_IsNumber(item) && item->valueint > 0 && item->valueint <= UINT16_MAX) {
+        pending_configuration->aggregation_window = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "sample_filter");
+    if (cJSON_IsNumber(item) && item->valueint >= SAMPLE_FILTER_NONE && item->valueint <= SAMPLE_FILTER_SWINGING_DOOR) {
+        pending_configuration->sample_filter = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "sample_filter_tolerances");
+    if (cJSON_IsArray(item) && cJSON_GetArraySize(item) == SENSORS_READINGS) {
+        for (int i = 0; i < SENSORS_READINGS; i++) {
+            cJSON* tolerance = cJSON_GetArrayItem(item, i);
+            if (cJSON_IsNumber(tolerance) && tolerance->valuedouble >= 0) {
+                pending_configuration->sample_filter_tolerances[i] = tolerance->valuedouble;
+            }
+        }
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "sample_filter_max_interval");
+    if (cJSON_IsNumber(item) && item->valueint > 0 && item->valueint <= UINT16_MAX) {
+        pending_configuration->sample_filter_max_interval = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "sensor_rates");
+    if (cJSON_IsArray(item) && cJSON_GetArraySize(item) == SENSORS_DEVICES) {
+        for (int i = 0; i < SENSORS_DEVICES; i++) {
+            cJSON* rate = cJSON_GetArrayItem(item, i);
+            if (cJSON_IsNumber(rate) && rate->valueint >= 0 && rate->valueint <= UINT16_MAX) {
+                pending_configuration->sensor_rates[i] = rate->valueint;
+            }
+        }
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "sensor_dark_rate");
+    if (cJSON_IsNumber(item) && item->valueint >= 0 && item->valueint <= UINT16_MAX) {
+        pending_configuration->sensor_dark_rate = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "energy_autonomy_hours");
+    if (cJSON_IsNumber(item) && item->valueint >= 0 && item->valueint <= UINT16_MAX) {
+        pending_configuration->energy_autonomy_hours = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "data_sink_compression");
+    if (cJSON_IsNumber(item) && item->valueint >= 0 && item->valueint <= UINT8_MAX) {
+        pending_configuration->data_sink_compression = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "measurement_rate");
+    if (cJSON_IsNumber(item) && item->valueint > 0 && item->valueint <= UINT16_MAX) {
+        pending_configuration->measurement_rate = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "upload_rate");
+    if (cJSON_IsNumber(item) && item->valueint > 0 && item->valueint <= UINT16_MAX) {
+        pending_configuration->upload_rate = item->valueint;
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "subtract_measuring_time");
+    if (cJSON_IsBool(item)) {
+        pending_configuration->subtract_measuring_time = cJSON_IsTrue(item);
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "uplink");
+    if (cJSON_IsNumber(item) && item->valueint >= CONFIGURATION_UPLINK_WIFI && item->valueint <= CONFIGURATION_UPLINK_BLE_BROADCAST) {
+        pending_configuration->uplink = item->valueint;
+    }
+
+    unsigned int mac[6];
+    item = cJSON_GetObjectItemCaseSensitive(remote, "espnow_peer");
+    if (cJSON_IsString(item) && sscanf(item->valuestring, "%x:%x:%x:%x:%x:%x", &mac[0], &mac[1], &mac[2], &mac[3], &mac[4], &mac[5]) == 6) {
+        for (int i = 0; i < 6; i++) {
+            pending_configuration->espnow_peer[i] = mac[i];
+        }
+    }
+
+    item = cJSON_GetObjectItemCaseSensitive(remote, "espnow_channel");
+    if (cJSON_IsNumber(item) && item->valueint >= 1 && item->valueint <= 14) {
+        pending_configuration->espnow_channel = item->valueint;
+    }
+
+    // The list replaces all additional sinks, e.g. [{"url":"https://archive/","push_format":0}]
+    item = cJSON_GetObjectItemCaseSensitive(remote, "additional_data_sinks");
+    if (cJSON_IsArray(item) && cJSON_GetArraySize(item) <= CONFIGURATION_ADDITIONAL_DATA_SINKS_MAX) {
+        memset(pending_configuration->additional_data_sinks, 0, sizeof(pending_configuration->additional_data_sinks));
+        memset(pending_configuration->additional_data_sinks_push_format, 0, sizeof(pending_configuration->additional_data_sinks_push_format));
+
+        for (int i = 0; i < cJSON_GetArraySize(item); i++) {
+            cJSON* sink = cJSON_GetArrayItem(item, i);
+            cJSON* sink_url = cJSON_GetObjectItemCaseSensitive(sink, "url");
+            cJSON* sink_push_format = cJSON_GetObjectItemCaseSensitive(sink, "push_format");
+
+            if (cJSON_IsString(sink_url) && strlen(sink_url->valuestring) < sizeof(pending_configuration->additional_data_sinks[i])) {
+                strcpy(pending_configuration->additional_data_sinks[i], sink_url->valuestring);
+            }
+            if (cJSON_IsNumber(sink_push_format) && sink_push_format->valueint >= 0 && sink_push_format->valueint <= UINT8_MAX) {
+                pending_configuration->additional_data_sinks_push_format[i] = sink_push_format->valueint;
+            }
+        }
+    }
+
+    // 32 hex characters, all zeros disables encryption
+    item = cJSON_GetObjectItemCaseSensitive(remote, "broadcast_key");
+    if (cJSON_IsString(item) && strlen(item->valuestring) == 2 * sizeof(pending_configuration->broadcast_key)) {
+        uint8_t key[sizeof(pending_configuration->broadcast_key)];
+        bool valid = true;
+        for (size_t i = 0; i < sizeof(key) && valid; i++) {
+            valid = sscanf(&item->valuestring[2 * i], "%2hhx", &key[i]) == 1;
+        }
+        if (valid) {
+            memcpy(pending_configuration->broadcast_key, key, sizeof(key));
+        }
+    }
+}
+
+/**
+ * Parses a response body like {"ack":1234,"config":{"version":3,...}}.
+ *
+ * Writes the acknowledged sequence number into [sequence] and returns true
+ * if the body carries one. A configuration with a version newer than the
+ * active one is merged into [pending_configuration]. A firmware update like
+ * "firmware":{"path":"/fw/1.2.1.jdiff","delta":true} is noted in [firmware].
+ * Both are ignored if NULL.
+*/
+static bool pusher_parse_response_body(const char* body, uint32_t* sequence, struct configuration_t* pending_configuration, struct pusher_firmware_t* firmware)
+{
+    bool found = false;
+    cJSON* root = cJSON_Parse(body);
+
+    if (root == NULL) {
+        return false;
+    }
+
+    cJSON* ack = cJSON_GetObjectItemCaseSensitive(root, "ack");
+    if (cJSON_IsNumber(ack) && ack->valuedouble >= 0) {
+        *sequence = (uint32_t) ack->valuedouble;
+        found = true;
+    }
+
+    cJSON* remote = cJSON_GetObjectItemCaseSensitive(root, "config");
+    cJSON* version = cJSON_GetObjectItemCaseSensitive(remote, "version");
+    if (pending_configuration && cJSON_IsObject(remote) && cJSON_IsNumber(version) && version->valuedouble > pending_configuration->config_version) {
+        ESP_LOGI(LOG_TAG, "Received configuration version %lu", (uint32_t) version->valuedouble);
+        pusher_parse_remote_configuration(remote, pending_configuration);
+        pending_configuration->config_version = (uint32_t) version->valuedouble;
+    }
+
+    cJSON* update = cJSON_GetObjectItemCaseSensitive(root, "firmware");
+    cJSON* path = cJSON_GetObjectItemCaseSensitive(update, "path");
+    if (firmware && cJSON_IsObject(update) && cJSON_IsString(path) && path->valuestring[0] == '/'
+        && strlen(path->valuestring) < sizeof(firmware->path)) {
+        strcpy(firmware->path, path->valuestring);
+        firmware->delta = cJSON_IsTrue(cJSON_GetObjectItemCaseSensitive(update, "delta"));
+        firmware->requested = true;
+    }
+
+    cJSON_Delete(root);
+    return found;
+}
+
+static void pusher_disconnect(struct pusher_session_t* session)
+{
+    if (session->tls) {
+        esp_tls_conn_destroy(session->tls);
+        session->tls = NULL;
+    }
+
+    session->receive_offset = 0;
+    session->receive_length = 0;
+}
+
+static esp_err_t pusher_connect(struct pusher_session_t* session, const char* url)
+{
+    esp_tls_cfg_t cfg = {
+        .crt_bundle_attach = esp_crt_bundle_attach,
+        .timeout_ms = 10000,
+    };
+
+    pusher_disconnect(session);
+
+    session->tls = esp_tls_init();
+    if (!session->tls) {
+        ESP_LOGE(LOG_TAG, "Failed to allocate esp_tls handle!");
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (esp_tls_conn_http_new_sync(url, &cfg, session->tls) != 1) {
+        ESP_LOGE(LOG_TAG, "Connection failed...");
+        pusher_disconnect(session);
+        return ESP_FAIL;
+    }
+
+    ESP_LOGI(LOG_TAG, "Connection established...");
+    return ESP_OK;
+}
+
+/**
+ * Downloads a firmware update over the upload session and streams it into
+ * the inactive ota slot
+*/
+static esp_err_t pusher_download_firmware(struct pusher_session_t* session, const char* url, const char* host, struct pusher_firmware_t* firmware, char* request_head, struct http_response_t* response)
+{
+    esp_err_t err;
+    struct ota_update_t* update = (struct ota_update_t*) malloc(sizeof(struct ota_update_t));
+    if (!update) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    ESP_LOGI(LOG_TAG, "Downloading %s firmware %s", firmware->delta ? "delta" : "full", firmware->path);
+
+    if (session->tls == NULL) {
+        err = pusher_connect(session, url);
+        if (err != ESP_OK) {
+            free(update);
+            return err;
+        }
+    }
+
+    size_t head_length = http_build_request_head(request_head, PUSHER_REQUEST_HEAD_BUFFER_SZ, "GET", host, firmware->path, NULL, NULL, NULL, 0, false);
+    if (head_length == 0) {
+        free(update);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    err = pusher_tls_write_all(session->tls, request_head, head_length);
+    if (err != ESP_OK) {
+        free(update);
+        return err;
+    }
+
+    err = ota_begin(update, firmware->delta);
+    if (err != ESP_OK) {
+        free(update);
+        return err;
+    }
+
+    http_response_init(response, NULL, 0);
+    response->on_body = ota_write;
+    response->on_body_context = update;
+
+    err = pusher_read_response(session, response);
+    if (err == ESP_OK && response->status != 200) {
+        ESP_LOGE(LOG_TAG, "Firmware download failed with HTTP %d", response->status);
+        err = ESP_FAIL;
+    }
+
+    if (err == ESP_OK) {
+        err = ota_end(update);
+    } else {
+        ota_abort(update);
+    }
+
+    free(update);
+    return err;
+}
+
+/**
+ * Pushes the measurements to the configured data sink.
+ *
+ * The measurements are split into batches which are sent as sequential
+ * requests over one keep-alive connection. If the server closes the
+ * connection in between, we reconnect and continue with the first batch
+ * that has not been answered yet.
+ *
+ * The data sink acknowledges the highest contiguous sequence number it has
+ * stored with a {"ack":<sequence>} response body. A 2xx response without
+ * acknowledgement counts for the whole batch. The highest acknowledged
+ * sequence number is written to [acknowledged_sequence], also if the push
+ * failed part way, so the caller only has to keep the unacknowledged tail.
+ *
+ * The response may also carry a newer configuration. It is staged in
+ * [sink->pending_configuration] for the caller to apply, the configuration
+ * version the push started with is reported with every request.
+ *
+ * If the response requests a firmware update, it is downloaded over the same
+ * session after all measurements got acknowledged. The running firmware is
+ * reported with every request, so the data sink can serve a matching delta.
+ * Configurations and firmware updates are only taken from the primary sink.
+*/
+esp_err_t pusher_http_push(const struct pusher_sink_t* sink, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence)
 {
-    char* url = &configuration.data_sink[0];
-    char* http_request = (char*) malloc(10240);
+    const char* url = sink->url;
+    const struct configuration_t* config = sink->configuration;
+    char* http_request_head = (char*) malloc(PUSHER_REQUEST_HEAD_BUFFER_SZ);
     char* http_host = (char*) malloc(128);
     char* http_path = (char*) malloc(512);
-    esp_tls_t *tls = NULL;
+    char* measurements_formatted_buffer = (char*) malloc(PUSHER_BATCH_BUFFER_SZ);
+    uint8_t* measurements_compressed_buffer = NULL;
+    char* response_body = (char*) malloc(PUSHER_RESPONSE_BODY_BUFFER_SZ);
+    struct http_parser_url* url_parse_result = (struct http_parser_url*) malloc(sizeof(struct http_parser_url));
+    struct pusher_session_t* session = (struct pusher_session_t*) calloc(1, sizeof(struct pusher_session_t));
+    struct http_response_t* response = (struct http_response_t*) malloc(sizeof(struct http_response_t));
+    char* extra_headers = (char*) malloc(PUSHER_EXTRA_HEADERS_BUFFER_SZ);
+    struct pusher_firmware_t* firmware = (struct pusher_firmware_t*) calloc(1, sizeof(struct pusher_firmware_t));
+    char firmware_sha256[PUSHER_FIRMWARE_SHA256_SZ] = {0};
+
+    struct formatter_options_t formatter_options = pusher_formatter_options(config);
+    struct pusher_request_t request = {
+        .formatter = formatter_get(sink->push_format),
+        .formatter_options = &formatter_options,
+        .host = http_host,
+        .path = http_path,
+        .extra_headers = extra_headers,
+        .head = http_request_head,
+        .head_capacity = PUSHER_REQUEST_HEAD_BUFFER_SZ,
+        .formatted = measurements_formatted_buffer,
+        .formatted_capacity = PUSHER_BATCH_BUFFER_SZ,
+    };
+
+    int64_t started_at = esp_timer_get_time();
+    esp_err_t esp_ret = ESP_OK;
+
+    *acknowledged_sequence = 0;
+
+    if (!http_request_head || !http_host || !http_path || !measurements_formatted_buffer || !response_body
+        || !url_parse_result || !session || !response || !extra_headers || !firmware) {
+        ESP_LOGE(LOG_TAG, "Failed to allocate pusher buffers");
+        esp_ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    if (config->data_sink_compression == COMPRESSOR_DEFLATE) {
+        measurements_compressed_buffer = (uint8_t*) malloc(COMPRESSOR_DEFLATE_BOUND(PUSHER_BATCH_BUFFER_SZ));
+        if (!measurements_compressed_buffer) {
+            ESP_LOGE(LOG_TAG, "Failed to allocate compression buffer");
+            esp_ret = ESP_ERR_NO_MEM;
+            goto cleanup;
+        }
+        request.compressed = measurements_compressed_buffer;
+        request.compressed_capacity = COMPRESSOR_DEFLATE_BOUND(PUSHER_BATCH_BUFFER_SZ);
+    }
 
-    memset(http_request, 0, 10240);
     memset(http_host, 0, 128);
     memset(http_path, 0, 512);
 
-    esp_err_t esp_ret = ESP_OK;
+    esp_app_get_elf_sha256(firmware_sha256, sizeof(firmware_sha256));
+    size_t extra_headers_length = pusher_request_build_extra_headers(
+        extra_headers,
+        PUSHER_EXTRA_HEADERS_BUFFER_SZ,
+        config->config_version,
+        esp_app_get_description()->version,
+        firmware_sha256
+    );
 
-    esp_tls_cfg_t cfg = {
-        .crt_bundle_attach = esp_crt_bundle_attach,
-    };
+    // Tell the data sink how to reconstruct the filtered samples and at which
+    // rates the station runs. A gateway forwards for a station whose filter
+    // and battery it does not know.
+    if (config->uplink == CONFIGURATION_UPLINK_WIFI) {
+        struct sample_filter_options_t sample_filter_options = pusher_sample_filter_options(config);
+        extra_headers_length += sample_filter_build_header(extra_headers + extra_headers_length, PUSHER_EXTRA_HEADERS_BUFFER_SZ - extra_headers_length, &sample_filter_options);
+        energy_build_header(extra_headers + extra_headers_length, PUSHER_EXTRA_HEADERS_BUFFER_SZ - extra_headers_length, &energy);
+    }
 
-    printf("url: %s", url);
-    fflush(stdout);
+    ESP_LOGI(LOG_TAG, "url: %s", url);
 
     // Parse the url to extract HOST, PATH, QUERY and FRAGMENT
-    struct http_parser_url* url_parse_result = (struct http_parser_url*) malloc(sizeof(struct http_parser_url));
     http_parser_url_init(url_parse_result);
     if (http_parser_parse_url(url, strlen(url), 0, url_parse_result) != 0) {
         ESP_LOGE(LOG_TAG, "http_parser_parse_url failed");
@@ -64,109 +654,401 @@ esp_err_t pusher_http_push(struct sensor_data_t* measurements, size_t measuremen
     }
 
     // Write the hostname into [http_host]
-    memset(http_host, 0, 128);
     strncpy(
         http_host,
         url + url_parse_result->field_data[UF_HOST].off,
         url_parse_result->field_data[UF_HOST].len
     );
 
-    // Write the path, query and fragment part into [http_path]
-    memset(http_path, 0, 512);
-    strncpy(
+    // Write the path and query part into [http_path]. The parser leaves out
+    // the '?' of the query, the fragment is not sent.
+    snprintf(
         http_path,
+        512,
+        "%s%.*s%s%.*s",
+        url_parse_result->field_data[UF_PATH].len == 0 ? "/" : "",
+        url_parse_result->field_data[UF_PATH].len,
         url + url_parse_result->field_data[UF_PATH].off,
-        url_parse_result->field_data[UF_PATH].len
-    );
-    strncpy(
-        http_path + url_parse_result->field_data[UF_PATH].len,
-        url + url_parse_result->field_data[UF_QUERY].off,
-        url_parse_result->field_data[UF_QUERY].len
-    );
-    strncpy(
-        http_path + url_parse_result->field_data[UF_PATH].len + url_parse_result->field_data[UF_QUERY].len,
-        url + url_parse_result->field_data[UF_FRAGMENT].off,
-        url_parse_result->field_data[UF_FRAGMENT].len
+        (url_parse_result->field_set & (1 << UF_QUERY)) ? "?" : "",
+        url_parse_result->field_data[UF_QUERY].len,
+        url + url_parse_result->field_data[UF_QUERY].off
     );
 
-    // Format the measurements as configured
-    char* measurements_formatted_buffer = malloc(5120);
-    formatter_format_measurements_as_json(measurements_formatted_buffer, 5120, measurements, measurements_length);
-
-    sprintf(
-        http_request,
-        "POST %s HTTP/1.1\r\n"
-        "Host: %s\r\n"
-        "User-Agent: esp-idf/1.0 esp32\r\n"
-        "Connection: close\r\n"
-        "Content-Length: %d\r\n"
-        "\r\n"
-        "%s",
-        http_path, http_host,
-        strlen(measurements_formatted_buffer),
-        measurements_formatted_buffer
-    );
+    // Amount of measurements that got answered by the server
+    size_t acknowledged_count = 0;
+    // Amount of measurements that got sent to the server
+    size_t sent_count = 0;
+    // Batch sizes of the requests waiting for a response
+    size_t in_flight[PUSHER_HTTP_PIPELINE_DEPTH] = {0};
+    size_t in_flight_length = 0;
+    int connect_attempts = 0;
 
-    free(measurements_formatted_buffer);
+    while (acknowledged_count < measurements_length) {
+        if (session->tls == NULL) {
+            if (connect_attempts >= PUSHER_CONNECT_ATTEMPTS_MAX) {
+                esp_ret = ESP_FAIL;
+                goto cleanup;
+            }
+            connect_attempts += 1;
 
-    tls = esp_tls_init();
-    if (!tls) {
-        ESP_LOGE(LOG_TAG, "Failed to allocate esp_tls handle!");
-        esp_ret = ESP_FAIL;
-        goto cleanup;
-    }
+            esp_ret = pusher_connect(session, url);
+            if (esp_ret != ESP_OK) {
+                continue;
+            }
 
-    if (esp_tls_conn_http_new_sync(url, &cfg, tls) == 1) {
-        ESP_LOGI(LOG_TAG, "Connection established...");
-    } else {
-        ESP_LOGE(LOG_TAG, "Connection failed...");
-        esp_ret = ESP_FAIL;
-        goto cleanup;
-    }
+            // Everything that was not answered yet has to be sent again
+            sent_count = acknowledged_count;
+            in_flight_length = 0;
+        }
 
-    size_t written_bytes = 0;
-    size_t received_bytes = 0;
-    int ret;
-    char buf[64];
+        // Fill the pipeline
+        while (sent_count < measurements_length && in_flight_length < PUSHER_HTTP_PIPELINE_DEPTH) {
+            size_t batch_length = pusher_request_batch_length(&request, measurements_length - sent_count);
 
-    // Send our http request
-    do {
-        ret = esp_tls_conn_write(tls, http_request + written_bytes, strlen(http_request) - written_bytes);
-        if (ret >= 0) {
-            ESP_LOGI(LOG_TAG, "%d bytes written", ret);
-            written_bytes += ret;
-        } else if (ret != ESP_TLS_ERR_SSL_WANT_READ  && ret != ESP_TLS_ERR_SSL_WANT_WRITE) {
-            ESP_LOGE(LOG_TAG, "esp_tls_conn_write  returned: [0x%02X](%s)", ret, esp_err_to_name(ret));
+            esp_ret = pusher_request_build(&request, &measurements[sent_count], batch_length);
+            if (esp_ret != ESP_OK) {
+                ESP_LOGE(LOG_TAG, "Failed to build the request for %d measurements", batch_length);
+                goto cleanup;
+            }
+
+            if (request.compressed) {
+                ESP_LOGI(LOG_TAG, "Compressed %d bytes to %d bytes", request.formatted_length, request.body_length);
+            }
+
+            if (pusher_tls_write_all(session->tls, request.head, request.head_length) != ESP_OK
+                || pusher_tls_write_all(session->tls, request.body, request.body_length) != ESP_OK) {
+                pusher_disconnect(session);
+                break;
+            }
+
+            ESP_LOGI(LOG_TAG, "%d measurements sent (%d bytes)", batch_length, request.head_length + request.body_length);
+            in_flight[in_flight_length] = batch_length;
+            in_flight_length += 1;
+            sent_count += batch_length;
+        }
+
+        if (session->tls == NULL) {
+            continue;
+        }
+
+        // Wait for the response of the oldest request
+        http_response_init(response, response_body, PUSHER_RESPONSE_BODY_BUFFER_SZ);
+        if (pusher_read_response(session, response) != ESP_OK) {
+            pusher_disconnect(session);
+            continue;
+        }
+
+        ESP_LOGI(LOG_TAG, "HTTP %d for %d measurements", response->status, in_flight[0]);
+        if (response->status < 200 || response->status >= 300) {
+            ESP_LOGE(LOG_TAG, "Data sink rejected the measurements: %s", response_body);
             esp_ret = ESP_FAIL;
             goto cleanup;
         }
-    } while (written_bytes < strlen(http_request));
 
-    // Receive the response. We ignore the contents.
-    do {
-        memset(buf, 0x00, sizeof(buf));
-        ret = esp_tls_conn_read(tls, (char *)buf, sizeof(buf)-1);
+        // A cut off body would read as unparsable, acknowledge the whole
+        // batch and lose the configuration it carries
+        if (response->body_truncated) {
+            ESP_LOGE(LOG_TAG, "Response body exceeds %d bytes, the batch is resent", PUSHER_RESPONSE_BODY_BUFFER_SZ - 1);
+            esp_ret = ESP_ERR_INVALID_SIZE;
+            goto cleanup;
+        }
 
-        if (ret == ESP_TLS_ERR_SSL_WANT_WRITE  || ret == ESP_TLS_ERR_SSL_WANT_READ) {
-            continue;
-        } else if (ret < 0) {
-            ESP_LOGE(LOG_TAG, "esp_tls_conn_read  returned [-0x%02X](%s)", -ret, esp_err_to_name(ret));
-            break;
-        } else if (ret == 0) {
-            ESP_LOGI(LOG_TAG, "connection closed");
-            break;
+        // Count the measurements of the batch covered by the acknowledgement
+        size_t batch_acknowledged = in_flight[0];
+        uint32_t sequence = 0;
+        if (pusher_parse_response_body(response_body, &sequence, sink->pending_configuration, sink->primary ? firmware : NULL)) {
+            batch_acknowledged = 0;
+            while (batch_acknowledged < in_flight[0]
+                && measurements[acknowledged_count + batch_acknowledged].sequence <= sequence) {
+                batch_acknowledged += 1;
+            }
+        }
+
+        if (acknowledged_count + batch_acknowledged > 0) {
+            *acknowledged_sequence = measurements[acknowledged_count + batch_acknowledged - 1].sequence;
+        }
+
+        if (batch_acknowledged < in_flight[0]) {
+            ESP_LOGE(LOG_TAG, "Data sink stored only %d of %d measurements", batch_acknowledged, in_flight[0]);
+            esp_ret = ESP_FAIL;
+            goto cleanup;
+        }
+
+        acknowledged_count += in_flight[0];
+        in_flight_length -= 1;
+        connect_attempts = 0;
+        memmove(&in_flight[0], &in_flight[1], in_flight_length * sizeof(size_t));
+
+        if (response->connection_close) {
+            pusher_disconnect(session);
         }
+    }
+
+    ESP_LOGI(LOG_TAG, "%d measurements delivered in %lld ms", measurements_length, (esp_timer_get_time() - started_at) / 1000);
+    esp_ret = ESP_OK;
 
-        received_bytes += ret;
-    } while (1);
-    ESP_LOGI(LOG_TAG, "%d bytes received", received_bytes);
+    // A failed firmware update does not fail the upload, it is requested again
+    if (firmware->requested) {
+        esp_err_t err = pusher_download_firmware(session, url, http_host, firmware, http_request_head, response);
+        if (err != ESP_OK) {
+            ESP_LOGE(LOG_TAG, "Firmware update failed: %s", esp_err_to_name(err));
+        }
+    }
 
 cleanup:
-    free(http_request);
+    if (session) pusher_disconnect(session);
+
+    free(http_request_head);
     free(http_host);
     free(http_path);
+    free(measurements_formatted_buffer);
+    free(measurements_compressed_buffer);
+    free(response_body);
+    free(url_parse_result);
+    free(session);
+    free(response);
+    free(extra_headers);
+    free(firmware);
+
+    return esp_ret;
+}
 
-    if (tls) esp_tls_conn_destroy(tls);
+/**
+ * Delivers to one data sink, using the protocol given by its url scheme:
+ * mqtt(s)://, coap:// or http(s)://.
+*/
+static esp_err_t pusher_deliver(struct pusher_delivery_t* delivery)
+{
+    const char* url = delivery->sink.url;
+
+    if (strncmp(url, "mqtt://", 7) == 0 || strncmp(url, "mqtts://", 8) == 0) {
+        struct formatter_options_t formatter_options = pusher_formatter_options(delivery->sink.configuration);
+        return pusher_mqtt_push(url, formatter_get(delivery->sink.push_format), &formatter_options, delivery->measurements, delivery->measurements_length, &delivery->acknowledged_sequence);
+    }
+
+    if (strncmp(url, "coap://", 7) == 0) {
+        return pusher_coap_push(url, delivery->measurements, delivery->measurements_length, &delivery->acknowledged_sequence);
+    }
+
+    return pusher_http_push(&delivery->sink, delivery->measurements, delivery->measurements_length, &delivery->acknowledged_sequence);
+}
+
+static void pusher_delivery_free(struct pusher_delivery_t* delivery)
+{
+    if (delivery->done) {
+        vSemaphoreDelete(delivery->done);
+    }
+    if (!delivery->sink.primary) {
+        free(delivery->measurements);
+    }
+    free(delivery);
+}
+
+static void pusher_delivery_task(void* arg)
+{
+    struct pusher_delivery_t* delivery = (struct pusher_delivery_t*) arg;
+
+    delivery->result = pusher_deliver(delivery);
+
+    xSemaphoreTake(pusher_delivery_lock, portMAX_DELAY);
+    bool abandoned = delivery->abandoned;
+    if (!abandoned) {
+        xSemaphoreGive(delivery->done);
+    }
+    xSemaphoreGive(pusher_delivery_lock);
+
+    if (abandoned) {
+        ESP_LOGW(LOG_TAG, "Late delivery to %s finished: %s", delivery->sink.url, esp_err_to_name(delivery->result));
+        pusher_delivery_free(delivery);
+    }
+    vTaskDelete(NULL);
+}
+
+/**
+ * Waits until [deadline] (esp_timer_get_time) for the task of [delivery].
+ * Returns false if it is still running, it is abandoned then.
+*/
+static bool pusher_delivery_join(struct pusher_delivery_t* delivery, int64_t deadline)
+{
+    int64_t remaining_ms = (deadline - esp_timer_get_time()) / 1000;
+
+    if (xSemaphoreTake(delivery->done, pdMS_TO_TICKS(remaining_ms > 0 ? remaining_ms : 0)) == pdTRUE) {
+        return true;
+    }
+
+    // It may finish while we give up on it
+    xSemaphoreTake(pusher_delivery_lock, portMAX_DELAY);
+    bool finished = xSemaphoreTake(delivery->done, 0) == pdTRUE;
+    delivery->abandoned = !finished;
+    xSemaphoreGive(pusher_delivery_lock);
+
+    return finished;
+}
+
+/**
+ * Pushes the measurements to the data sink and all additional data sinks
+ * within the current wifi session.
+ *
+ * [acknowledged_sequences] holds the highest sequence number acknowledged
+ * by each sink (CONFIGURATION_DATA_SINKS_MAX entries) and is updated. A sink
+ * only receives the measurements it did not acknowledge yet. Unused sinks
+ * count as having acknowledged everything.
+ *
+ * The additional data sinks are delivered to concurrently from their own
+ * tasks, so the radio is on for the slowest sink instead of for all of them
+ * in turn. Once the primary data sink finished they get as long as it took,
+ * at least PUSHER_SINK_GRACE_MS. A sink that is not done by then keeps its
+ * acknowledged sequence number and gets the measurements again with the
+ * next upload.
+ *
+ * All deliveries work on a snapshot of the configuration. A newer
+ * configuration delivered by the primary data sink is applied and persisted
+ * after the join. Returns the result of the primary data sink.
+*/
+esp_err_t pusher_push(struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequences)
+{
+    struct pusher_delivery_t* deliveries[CONFIGURATION_DATA_SINKS_MAX] = {0};
+    struct configuration_t* pending_configuration = (struct configuration_t*) malloc(sizeof(struct configuration_t));
+    bool started[CONFIGURATION_DATA_SINKS_MAX] = {0};
+    bool allocated = pending_configuration != NULL;
+
+    if (pusher_delivery_lock == NULL) {
+        pusher_delivery_lock = xSemaphoreCreateMutex();
+    }
+
+    for (size_t i = 0; i < CONFIGURATION_DATA_SINKS_MAX; i++) {
+        deliveries[i] = (struct pusher_delivery_t*) calloc(1, sizeof(struct pusher_delivery_t));
+        allocated = allocated && deliveries[i] != NULL;
+    }
+
+    if (!allocated || pusher_delivery_lock == NULL) {
+        ESP_LOGE(LOG_TAG, "Failed to allocate pusher buffers");
+        for (size_t i = 0; i < CONFIGURATION_DATA_SINKS_MAX; i++) {
+            free(deliveries[i]);
+        }
+        free(pending_configuration);
+        return ESP_ERR_NO_MEM;
+    }
+
+    memcpy(pending_configuration, &configuration, sizeof(struct configuration_t));
+
+    for (size_t i = 0; i < CONFIGURATION_DATA_SINKS_MAX; i++) {
+        struct pusher_delivery_t* delivery = deliveries[i];
+
+        memcpy(&delivery->configuration, &configuration, sizeof(struct configuration_t));
+        if (i == 0) {
+            delivery->sink.url = delivery->configuration.data_sink;
+            delivery->sink.push_format = delivery->configuration.data_sink_push_format;
+            delivery->sink.primary = true;
+            delivery->sink.pending_configuration = pending_configuration;
+        } else {
+            delivery->sink.url = delivery->configuration.additional_data_sinks[i - 1];
+            delivery->sink.push_format = delivery->configuration.additional_data_sinks_push_format[i - 1];
+            delivery->sink.primary = false;
+            delivery->sink.pending_configuration = NULL;
+        }
+        delivery->sink.configuration = &delivery->configuration;
+        delivery->result = ESP_OK;
+
+        // Skip what this sink acknowledged before
+        size_t first = 0;
+        while (first < measurements_length && measurements[first].sequence <= acknowledged_sequences[i]) {
+            first += 1;
+        }
+
+        if (delivery->sink.url[0] == '\0') {
+            if (measurements_length > 0) {
+                acknowledged_sequences[i] = measurements[measurements_length - 1].sequence;
+            }
+            continue;
+        }
+
+        delivery->measurements_length = measurements_length - first;
+        if (delivery->measurements_length == 0) {
+            continue;
+        }
+
+        if (i == 0) {
+            delivery->measurements = &measurements[first];
+            continue;
+        }
+
+        // The task may outlive this call, it gets its own measurements
+        delivery->measurements = (struct sensor_data_t*) malloc(delivery->measurements_length * sizeof(struct sensor_data_t));
+        delivery->done = xSemaphoreCreateBinary();
+        if (delivery->measurements && delivery->done) {
+            memcpy(delivery->measurements, &measurements[first], delivery->measurements_length * sizeof(struct sensor_data_t));
+            started[i] = xTaskCreate(pusher_delivery_task, "pusher_sink", PUSHER_SINK_TASK_STACK_SZ, delivery, 5, NULL) == pdPASS;
+        }
+        if (!started[i]) {
+            ESP_LOGE(LOG_TAG, "Failed to start delivery to %s", delivery->sink.url);
+            delivery->result = ESP_ERR_NO_MEM;
+        }
+    }
+
+    // Deliver to the primary sink meanwhile
+    int64_t primary_started_at = esp_timer_get_time();
+    if (deliveries[0]->measurements_length > 0) {
+        deliveries[0]->result = pusher_deliver(deliveries[0]);
+    }
+    int64_t primary_finished_at = esp_timer_get_time();
+    int64_t grace = primary_finished_at - primary_started_at;
+    if (grace < PUSHER_SINK_GRACE_MS * 1000LL) {
+        grace = PUSHER_SINK_GRACE_MS * 1000LL;
+    }
+
+    for (size_t i = 0; i < CONFIGURATION_DATA_SINKS_MAX; i++) {
+        struct pusher_delivery_t* delivery = deliveries[i];
+
+        if (started[i] && !pusher_delivery_join(delivery, primary_finished_at + grace)) {
+            ESP_LOGW(LOG_TAG, "Delivery to %s did not finish in time, it is retried with the next upload", delivery->sink.url);
+            deliveries[i] = NULL;
+            continue;
+        }
+
+        if (delivery->acknowledged_sequence > acknowledged_sequences[i]) {
+            acknowledged_sequences[i] = delivery->acknowledged_sequence;
+        }
+
+        if (i > 0 && delivery->result != ESP_OK) {
+            ESP_LOGE(LOG_TAG, "Delivery to %s failed: %s", delivery->sink.url, esp_err_to_name(delivery->result));
+        }
+    }
+
+    // Apply and persist a configuration delivered by the primary data sink
+    if (pending_configuration->config_version != configuration.config_version) {
+        configuration = *pending_configuration;
+        esp_err_t err = cfg_write();
+        if (err != ESP_OK) {
+            ESP_LOGE(LOG_TAG, "Failed to persist configuration version %lu: %s", configuration.config_version, esp_err_to_name(err));
+        } else {
+            ESP_LOGI(LOG_TAG, "Applied configuration version %lu", configuration.config_version);
+        }
+    }
+
+    esp_err_t esp_ret = deliveries[0]->result;
+    for (size_t i = 0; i < CONFIGURATION_DATA_SINKS_MAX; i++) {
+        if (deliveries[i]) {
+            pusher_delivery_free(deliveries[i]);
+        }
+    }
+    free(pending_configuration);
 
     return esp_ret;
-}
\ No newline at end of file
+}
+
+/**
+ * Returns the highest sequence number acknowledged by every data sink
+*/
+uint32_t pusher_lowest_acknowledged_sequence(const uint32_t* acknowledged_sequences)
+{
+    uint32_t lowest = acknowledged_sequences[0];
+
+    for (size_t i = 1; i < CONFIGURATION_DATA_SINKS_MAX; i++) {
+        if (acknowledged_sequences[i] < lowest) {
+            lowest = acknowledged_sequences[i];
+        }
+    }
+
+    return lowest;
+}
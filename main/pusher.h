@@ -5,6 +5,8 @@
 #include "sensors.h"
 #include "pusher.c"
 
-esp_err_t pusher_http_push(struct sensor_data_t* measurements, size_t measurements_length);
+esp_err_t pusher_push(struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequences);
+esp_err_t pusher_http_push(const struct pusher_sink_t* sink, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence);
+uint32_t pusher_lowest_acknowledged_sequence(const uint32_t* acknowledged_sequences);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,277 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+#include "http_parser.h"
+
+#include "sensors.h"
+#include "formatter.h"
+#include "pusher_coap.h"
+#include "coap_message.h"
+
+#define PUSHER_COAP_DEFAULT_PORT "5683"
+#define PUSHER_COAP_BATCH_MAX_MEASUREMENTS 50
+#define PUSHER_COAP_PAYLOAD_BUFFER_SZ (FORMATTER_BINARY_HEADER_SZ + PUSHER_COAP_BATCH_MAX_MEASUREMENTS * FORMATTER_BINARY_RECORD_SZ)
+
+#define PUSHER_COAP_MESSAGE_BUFFER_SZ (COAP_MESSAGE_BLOCK_SZ + 256)
+
+/**
+ * Transmission parameters (RFC 7252 4.8)
+*/
+#define PUSHER_COAP_ACK_TIMEOUT_MS 2000
+#define PUSHER_COAP_MAX_RETRANSMIT 4
+
+static const char *COAP_LOG_TAG = "PUSHER_COAP";
+
+/**
+ * State of one CoAP upload session
+*/
+struct pusher_coap_session_t {
+    int socket;
+    uint16_t message_id;
+    uint8_t token[COAP_MESSAGE_TOKEN_SZ];
+    char path[256];
+
+    uint8_t request[PUSHER_COAP_MESSAGE_BUFFER_SZ];
+    uint8_t response[PUSHER_COAP_MESSAGE_BUFFER_SZ];
+
+    /**
+     * Message id of the last separate response, to tell repeats of it
+    */
+    bool has_separate_response;
+    uint16_t separate_response_id;
+
+    /**
+     * Statistics for comparison with the other sinks
+    */
+    size_t exchanges;
+    size_t bytes_sent;
+};
+
+/**
+ * Sends the request until it gets acknowledged, with exponential back-off.
+ * Returns the response code or a negative value on failure.
+*/
+static int pusher_coap_exchange(struct pusher_coap_session_t* session, size_t request_length)
+{
+    uint32_t timeout_ms = PUSHER_COAP_ACK_TIMEOUT_MS + (esp_random() % (PUSHER_COAP_ACK_TIMEOUT_MS / 2));
+    bool acknowledged = false;
+
+    session->exchanges += 1;
+
+    for (int attempt = 0; attempt <= PUSHER_COAP_MAX_RETRANSMIT; attempt++) {
+        if (!acknowledged) {
+            if (send(session->socket, session->request, request_length, 0) < 0) {
+                ESP_LOGE(COAP_LOG_TAG, "send failed: errno %d", errno);
+                return -1;
+            }
+            session->bytes_sent += request_length;
+        }
+
+        struct timeval tv = { .tv_sec = timeout_ms / 1000, .tv_usec = (timeout_ms % 1000) * 1000 };
+        setsockopt(session->socket, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+        while (1) {
+            int received = recv(session->socket, session->response, sizeof(session->response), 0);
+            if (received < 0) {
+                // Timeout, retransmit
+                break;
+            }
+
+            uint8_t* r = session->response;
+            if (received < 4 || (r[0] >> 6) != 1) {
+                continue;
+            }
+
+            uint8_t type = (r[0] >> 4) & 0x03;
+            uint8_t token_length = r[0] & 0x0F;
+            uint8_t code = r[1];
+            uint16_t message_id = (r[2] << 8) | r[3];
+
+            if ((type == COAP_MESSAGE_TYPE_ACK || type == COAP_MESSAGE_TYPE_RST) && message_id == session->message_id) {
+                if (type == COAP_MESSAGE_TYPE_RST) {
+                    return -1;
+                }
+                if (code != 0) {
+                    // Piggybacked response
+                    return code;
+                }
+                // Empty ACK, the response follows separately
+                acknowledged = true;
+                continue;
+            }
+
+            if (type == COAP_MESSAGE_TYPE_ACK || type == COAP_MESSAGE_TYPE_RST || code == 0) {
+                continue;
+            }
+
+            // Separate response, matched by token. A confirmable one is
+            // acknowledged, also when the data sink repeats it because our ACK
+            // got lost, and rejected if it belongs to no request of ours.
+            bool matched = token_length == sizeof(session->token)
+                && received >= 4 + token_length && memcmp(&r[4], session->token, token_length) == 0;
+            if (type == COAP_MESSAGE_TYPE_CON) {
+                uint8_t reply[4] = {(1 << 6) | ((matched ? COAP_MESSAGE_TYPE_ACK : COAP_MESSAGE_TYPE_RST) << 4), 0, r[2], r[3]};
+                send(session->socket, reply, sizeof(reply), 0);
+            }
+
+            // All blocks of a payload share the token, a repeated response
+            // to an earlier block must not be taken for this one's
+            if (!matched || (session->has_separate_response && message_id == session->separate_response_id)) {
+                continue;
+            }
+            session->has_separate_response = true;
+            session->separate_response_id = message_id;
+            return code;
+        }
+
+        timeout_ms *= 2;
+    }
+
+    return -1;
+}
+
+/**
+ * Sends one payload as confirmable POST, block-wise if it exceeds a block
+*/
+static esp_err_t pusher_coap_post(struct pusher_coap_session_t* session, const uint8_t* payload, size_t payload_length)
+{
+    struct coap_message_block_t block;
+
+    session->token[0] = esp_random() & 0xFF;
+    session->token[1] = esp_random() & 0xFF;
+
+    for (uint32_t block_number = 0; coap_message_next_block(payload_length, block_number, &block); block_number++) {
+        session->message_id += 1;
+        size_t request_length = coap_message_build_post(session->request, sizeof(session->request), session->message_id, session->token, session->path, &block, payload);
+        if (request_length == 0) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+
+        int code = pusher_coap_exchange(session, request_length);
+        if (code < 0) {
+            ESP_LOGE(COAP_LOG_TAG, "No response for block %lu", block_number);
+            return ESP_ERR_TIMEOUT;
+        }
+
+        // Only 2.xx codes are a success, 2.31 (Continue) for intermediate blocks
+        if ((code >> 5) != 2) {
+            ESP_LOGE(COAP_LOG_TAG, "Data sink rejected block %lu with %d.%02d", block_number, code >> 5, code & 0x1F);
+            return ESP_FAIL;
+        }
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * Pushes the measurements to the coap:// data sink at [url] as
+ * confirmable POSTs of the binary format. Large batches are sent block-wise.
+ * A 2.xx response to the last block acknowledges the whole batch.
+*/
+esp_err_t pusher_coap_push(const char* url, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence)
+{
+    char* host = (char*) calloc(1, 128);
+    char* port = (char*) calloc(1, 8);
+    uint8_t* payload = (uint8_t*) malloc(PUSHER_COAP_PAYLOAD_BUFFER_SZ);
+    struct http_parser_url* url_parse_result = (struct http_parser_url*) malloc(sizeof(struct http_parser_url));
+    struct pusher_coap_session_t* session = (struct pusher_coap_session_t*) calloc(1, sizeof(struct pusher_coap_session_t));
+    struct addrinfo* address = NULL;
+    int64_t started_at = esp_timer_get_time();
+
+    esp_err_t esp_ret = ESP_OK;
+
+    *acknowledged_sequence = 0;
+
+    if (!host || !port || !payload || !url_parse_result || !session) {
+        ESP_LOGE(COAP_LOG_TAG, "Failed to allocate pusher buffers");
+        esp_ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    session->socket = -1;
+    session->message_id = esp_random() & 0xFFFF;
+
+    // Parse the url to extract HOST, PORT and PATH
+    http_parser_url_init(url_parse_result);
+    if (http_parser_parse_url(url, strlen(url), 0, url_parse_result) != 0
+        || url_parse_result->field_data[UF_HOST].len >= 128
+        || url_parse_result->field_data[UF_PATH].len >= sizeof(session->path)) {
+        ESP_LOGE(COAP_LOG_TAG, "http_parser_parse_url failed");
+        esp_ret = ESP_FAIL;
+        goto cleanup;
+    }
+
+    strncpy(host, url + url_parse_result->field_data[UF_HOST].off, url_parse_result->field_data[UF_HOST].len);
+    strncpy(session->path, url + url_parse_result->field_data[UF_PATH].off, url_parse_result->field_data[UF_PATH].len);
+    if (url_parse_result->field_set & (1 << UF_PORT)) {
+        snprintf(port, 8, "%u", url_parse_result->port);
+    } else {
+        strcpy(port, PUSHER_COAP_DEFAULT_PORT);
+    }
+
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_DGRAM,
+    };
+    if (getaddrinfo(host, port, &hints, &address) != 0 || address == NULL) {
+        ESP_LOGE(COAP_LOG_TAG, "DNS lookup for %s failed", host);
+        esp_ret = ESP_FAIL;
+        goto cleanup;
+    }
+
+    session->socket = socket(address->ai_family, address->ai_socktype, 0);
+    if (session->socket < 0 || connect(session->socket, address->ai_addr, address->ai_addrlen) != 0) {
+        ESP_LOGE(COAP_LOG_TAG, "Failed to create socket: errno %d", errno);
+        esp_ret = ESP_FAIL;
+        goto cleanup;
+    }
+
+    size_t acknowledged_count = 0;
+    while (acknowledged_count < measurements_length) {
+        size_t batch_length = measurements_length - acknowledged_count;
+        if (batch_length > PUSHER_COAP_BATCH_MAX_MEASUREMENTS) {
+            batch_length = PUSHER_COAP_BATCH_MAX_MEASUREMENTS;
+        }
+
+        size_t payload_length = 0;
+        esp_ret = formatter_format_measurements_as_binary(payload, PUSHER_COAP_PAYLOAD_BUFFER_SZ, &measurements[acknowledged_count], batch_length, &payload_length);
+        if (esp_ret != ESP_OK) {
+            ESP_LOGE(COAP_LOG_TAG, "Failed to format %d measurements", batch_length);
+            goto cleanup;
+        }
+
+        esp_ret = pusher_coap_post(session, payload, payload_length);
+        if (esp_ret != ESP_OK) {
+            goto cleanup;
+        }
+
+        acknowledged_count += batch_length;
+        *acknowledged_sequence = measurements[acknowledged_count - 1].sequence;
+    }
+
+    ESP_LOGI(
+        COAP_LOG_TAG,
+        "%d measurements delivered in %lld ms, %d exchanges, %d bytes sent",
+        measurements_length,
+        (esp_timer_get_time() - started_at) / 1000,
+        session->exchanges,
+        session->bytes_sent
+    );
+
+cleanup:
+    if (session && session->socket >= 0) close(session->socket);
+    if (address) freeaddrinfo(address);
+
+    free(host);
+    free(port);
+    free(payload);
+    free(url_parse_result);
+    free(session);
+
+    return esp_ret;
+}
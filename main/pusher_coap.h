@@ -0,0 +1,9 @@
+#ifndef __WEATHER_STATION__PUSHER_COAP_H__
+#define __WEATHER_STATION__PUSHER_COAP_H__
+
+#include "esp_err.h"
+#include "sensors.h"
+
+esp_err_t pusher_coap_push(const char* url, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence);
+
+#endif
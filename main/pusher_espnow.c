@@ -0,0 +1,263 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "esp_event.h"
+#include "esp_wifi.h"
+#include "esp_now.h"
+#include "nvs_flash.h"
+
+#include "sensors.h"
+#include "configuration.h"
+#include "formatter.h"
+#include "espnow_frame.h"
+#include "pusher_espnow.h"
+
+/**
+ * Records of the binary format that fit into one message
+*/
+#define PUSHER_ESPNOW_BATCH_MAX_MEASUREMENTS ((ESPNOW_MESSAGE_MAX_SZ - FORMATTER_BINARY_HEADER_SZ) / FORMATTER_BINARY_RECORD_SZ)
+
+#define PUSHER_ESPNOW_SEND_TIMEOUT_MS 50
+#define PUSHER_ESPNOW_ACK_TIMEOUT_MS 100
+#define PUSHER_ESPNOW_ROUNDS_MAX 5
+#define PUSHER_ESPNOW_QUEUE_LENGTH 8
+
+static const char *ESPNOW_LOG_TAG = "PUSHER_ESPNOW";
+
+/**
+ * Continues across deep sleep, so the gateway can tell a new message from a
+ * retransmitted one
+*/
+RTC_DATA_ATTR static uint16_t pusher_espnow_message_id = 0;
+
+struct pusher_espnow_frame_t {
+    uint8_t data[ESPNOW_FRAME_MAX_SZ];
+    size_t length;
+};
+
+/**
+ * The esp-now callbacks take no context, they forward into these queues
+*/
+static QueueHandle_t pusher_espnow_sent = NULL;
+static QueueHandle_t pusher_espnow_received = NULL;
+
+static void pusher_espnow_send_callback(const uint8_t* mac_addr, esp_now_send_status_t status)
+{
+    xQueueSend(pusher_espnow_sent, &status, 0);
+}
+
+static void pusher_espnow_receive_callback(const esp_now_recv_info_t* info, const uint8_t* data, int data_length)
+{
+    struct pusher_espnow_frame_t frame;
+
+    if (memcmp(info->src_addr, configuration.espnow_peer, ESP_NOW_ETH_ALEN) != 0 || data_length <= 0 || data_length > ESPNOW_FRAME_MAX_SZ) {
+        return;
+    }
+
+    memcpy(frame.data, data, data_length);
+    frame.length = data_length;
+    xQueueSend(pusher_espnow_received, &frame, 0);
+}
+
+/**
+ * Starts the radio on the configured channel without associating with an
+ * access point
+*/
+static esp_err_t pusher_espnow_start(void)
+{
+    esp_err_t err = nvs_flash_init();
+    if (err != ESP_OK) return err;
+
+    // Already created if the station connected to wifi before
+    err = esp_event_loop_create_default();
+    if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) return err;
+
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    err = esp_wifi_init(&cfg);
+    if (err != ESP_OK) return err;
+
+    err = esp_wifi_set_storage(WIFI_STORAGE_RAM);
+    if (err != ESP_OK) return err;
+
+    err = esp_wifi_set_mode(WIFI_MODE_STA);
+    if (err != ESP_OK) return err;
+
+    err = esp_wifi_start();
+    if (err != ESP_OK) return err;
+
+    err = esp_wifi_set_channel(configuration.espnow_channel, WIFI_SECOND_CHAN_NONE);
+    if (err != ESP_OK) return err;
+
+    err = esp_now_init();
+    if (err != ESP_OK) return err;
+
+    err = esp_now_register_send_cb(pusher_espnow_send_callback);
+    if (err != ESP_OK) return err;
+
+    err = esp_now_register_recv_cb(pusher_espnow_receive_callback);
+    if (err != ESP_OK) return err;
+
+    esp_now_peer_info_t peer = {
+        .channel = configuration.espnow_channel,
+        .ifidx = WIFI_IF_STA,
+        .encrypt = false,
+    };
+    memcpy(peer.peer_addr, configuration.espnow_peer, ESP_NOW_ETH_ALEN);
+
+    return esp_now_add_peer(&peer);
+}
+
+static void pusher_espnow_stop(void)
+{
+    esp_now_deinit();
+    esp_wifi_stop();
+    esp_wifi_deinit();
+}
+
+/**
+ * Sends one message in rounds: every round sends the fragments the gateway
+ * did not acknowledge yet, the last one requesting an ack.
+*/
+static esp_err_t pusher_espnow_send_message(const uint8_t* message, size_t message_length, size_t* frames_sent)
+{
+    struct espnow_sender_t sender;
+    uint8_t frame[ESPNOW_FRAME_MAX_SZ];
+    size_t frame_length;
+
+    pusher_espnow_message_id += 1;
+    esp_err_t err = espnow_sender_init(&sender, pusher_espnow_message_id, message, message_length);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    for (int round = 0; round < PUSHER_ESPNOW_ROUNDS_MAX && !espnow_sender_is_complete(&sender); round++) {
+        espnow_sender_rewind(&sender);
+
+        while ((frame_length = espnow_sender_next_frame(&sender, frame, sizeof(frame))) > 0) {
+            err = esp_now_send(configuration.espnow_peer, frame, frame_length);
+            if (err != ESP_OK) {
+                ESP_LOGE(ESPNOW_LOG_TAG, "esp_now_send failed: %s", esp_err_to_name(err));
+                return err;
+            }
+            *frames_sent += 1;
+
+            // Wait until the frame left, a failed mac layer ack is repaired by the next round
+            esp_now_send_status_t status;
+            xQueueReceive(pusher_espnow_sent, &status, pdMS_TO_TICKS(PUSHER_ESPNOW_SEND_TIMEOUT_MS));
+        }
+
+        struct pusher_espnow_frame_t received;
+        while (xQueueReceive(pusher_espnow_received, &received, pdMS_TO_TICKS(PUSHER_ESPNOW_ACK_TIMEOUT_MS)) == pdTRUE) {
+            struct espnow_frame_header_t header;
+            const uint8_t* payload;
+            uint32_t received_fragments;
+            uint8_t status;
+
+            if (espnow_frame_decode(received.data, received.length, &header, &payload) != ESP_OK
+                || espnow_frame_decode_ack(&header, payload, &received_fragments, &status) != ESP_OK
+                || header.message_id != sender.message_id) {
+                continue;
+            }
+
+            if (status == ESPNOW_ACK_STATUS_BUSY) {
+                ESP_LOGW(ESPNOW_LOG_TAG, "Gateway is busy");
+                return ESP_ERR_NO_MEM;
+            }
+
+            espnow_sender_on_ack(&sender, received_fragments);
+            break;
+        }
+    }
+
+    return espnow_sender_is_complete(&sender) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+/**
+ * Sends the measurements in the binary format to the gateway configured as
+ * espnow_peer, without associating with an access point. Measurements are
+ * acknowledged once the gateway received the complete message, it forwards
+ * them to its data sink on its own.
+*/
+esp_err_t pusher_espnow_push(struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence)
+{
+    uint8_t* message = (uint8_t*) malloc(ESPNOW_MESSAGE_MAX_SZ);
+    int64_t started_at = esp_timer_get_time();
+    size_t frames_sent = 0;
+
+    esp_err_t esp_ret = ESP_OK;
+
+    *acknowledged_sequence = 0;
+
+    pusher_espnow_sent = xQueueCreate(PUSHER_ESPNOW_QUEUE_LENGTH, sizeof(esp_now_send_status_t));
+    pusher_espnow_received = xQueueCreate(PUSHER_ESPNOW_QUEUE_LENGTH, sizeof(struct pusher_espnow_frame_t));
+
+    if (!message || !pusher_espnow_sent || !pusher_espnow_received) {
+        ESP_LOGE(ESPNOW_LOG_TAG, "Failed to allocate pusher buffers");
+        esp_ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    // Tell our messages apart from those sent before the last cold boot
+    if (pusher_espnow_message_id == 0) {
+        pusher_espnow_message_id = esp_random() & 0xFFFF;
+    }
+
+    esp_ret = pusher_espnow_start();
+    if (esp_ret != ESP_OK) {
+        ESP_LOGE(ESPNOW_LOG_TAG, "Failed to start esp-now: %s", esp_err_to_name(esp_ret));
+        goto cleanup;
+    }
+
+    size_t acknowledged_count = 0;
+    while (acknowledged_count < measurements_length) {
+        size_t batch_length = measurements_length - acknowledged_count;
+        if (batch_length > PUSHER_ESPNOW_BATCH_MAX_MEASUREMENTS) {
+            batch_length = PUSHER_ESPNOW_BATCH_MAX_MEASUREMENTS;
+        }
+        if (batch_length > UINT8_MAX) {
+            batch_length = UINT8_MAX;
+        }
+
+        size_t message_length = 0;
+        esp_ret = formatter_format_measurements_as_binary(message, ESPNOW_MESSAGE_MAX_SZ, &measurements[acknowledged_count], batch_length, &message_length);
+        if (esp_ret != ESP_OK) {
+            ESP_LOGE(ESPNOW_LOG_TAG, "Failed to format %d measurements", batch_length);
+            goto cleanup;
+        }
+
+        esp_ret = pusher_espnow_send_message(message, message_length, &frames_sent);
+        if (esp_ret != ESP_OK) {
+            ESP_LOGE(ESPNOW_LOG_TAG, "Message %u was not acknowledged: %s", pusher_espnow_message_id, esp_err_to_name(esp_ret));
+            goto cleanup;
+        }
+
+        acknowledged_count += batch_length;
+        *acknowledged_sequence = measurements[acknowledged_count - 1].sequence;
+    }
+
+    ESP_LOGI(
+        ESPNOW_LOG_TAG,
+        "%d measurements delivered in %lld ms, %d frames sent",
+        measurements_length,
+        (esp_timer_get_time() - started_at) / 1000,
+        frames_sent
+    );
+
+cleanup:
+    pusher_espnow_stop();
+
+    if (pusher_espnow_sent) vQueueDelete(pusher_espnow_sent);
+    if (pusher_espnow_received) vQueueDelete(pusher_espnow_received);
+    pusher_espnow_sent = NULL;
+    pusher_espnow_received = NULL;
+
+    free(message);
+
+    return esp_ret;
+}
@@ -0,0 +1,9 @@
+#ifndef __WEATHER_STATION__PUSHER_ESPNOW_H__
+#define __WEATHER_STATION__PUSHER_ESPNOW_H__
+
+#include "esp_err.h"
+#include "sensors.h"
+
+esp_err_t pusher_espnow_push(struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence);
+
+#endif
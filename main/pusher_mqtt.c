@@ -0,0 +1,248 @@
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "esp_crt_bundle.h"
+#include "mqtt_client.h"
+#include "http_parser.h"
+
+#include "sensors.h"
+#include "formatter.h"
+#include "pusher_mqtt.h"
+
+#define PUSHER_MQTT_BATCH_MAX_MEASUREMENTS 25
+#define PUSHER_MQTT_BATCH_BUFFER_SZ 4608
+#define PUSHER_MQTT_TOPIC_MAX_SZ 128
+
+/**
+ * Amount of publishes sent before waiting for their PUBACKs
+*/
+#define PUSHER_MQTT_INFLIGHT_MAX 4
+#define PUSHER_MQTT_TIMEOUT_MS 10000
+
+/**
+ * Events forwarded from the mqtt task to the pushing task
+*/
+#define PUSHER_MQTT_EVENT_CONNECTED     -1
+#define PUSHER_MQTT_EVENT_DISCONNECTED  -2
+
+static const char *MQTT_LOG_TAG = "PUSHER_MQTT";
+
+/**
+ * Forwards connection state changes and PUBACKs (as message id) into the
+ * queue passed as handler argument
+*/
+static void pusher_mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data)
+{
+    QueueHandle_t events = (QueueHandle_t) handler_args;
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t) event_data;
+    int value;
+
+    switch ((esp_mqtt_event_id_t) event_id) {
+        case MQTT_EVENT_CONNECTED:
+            ESP_LOGI(MQTT_LOG_TAG, "connected, session present: %d", event->session_present);
+            value = PUSHER_MQTT_EVENT_CONNECTED;
+            xQueueSend(events, &value, 0);
+            break;
+        case MQTT_EVENT_DISCONNECTED:
+        case MQTT_EVENT_ERROR:
+            value = PUSHER_MQTT_EVENT_DISCONNECTED;
+            xQueueSend(events, &value, 0);
+            break;
+        case MQTT_EVENT_PUBLISHED:
+            value = event->msg_id;
+            xQueueSend(events, &value, 0);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * Builds the client id from the station mac. A stable client id is required
+ * for the broker to resume the persistent session.
+*/
+static void pusher_mqtt_client_id(char* client_id, size_t client_id_length)
+{
+    uint8_t mac[6] = {0};
+    esp_efuse_mac_get_default(mac);
+    snprintf(client_id, client_id_length, "weather-station-%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+/**
+ * Publishes the measurements with QoS 1 to the mqtt(s):// data sink at
+ * [url]. The url path is used as topic, e.g. mqtt://broker:1883/station/1.
+ *
+ * The session is persistent (clean session off), so reconnecting only costs
+ * the CONNECT exchange. Up to PUSHER_MQTT_INFLIGHT_MAX batches are published
+ * before we wait for their PUBACKs. A PUBACK acknowledges the whole batch.
+ * Every publish carries one batch formatted with [formatter].
+*/
+esp_err_t pusher_mqtt_push(const char* url, const struct formatter_t* formatter, const struct formatter_options_t* formatter_options, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence)
+{
+    char* host = (char*) calloc(1, 128);
+    char* topic = (char*) calloc(1, PUSHER_MQTT_TOPIC_MAX_SZ);
+    char* client_id = (char*) calloc(1, 32);
+    char* measurements_formatted_buffer = (char*) malloc(PUSHER_MQTT_BATCH_BUFFER_SZ);
+    struct http_parser_url* url_parse_result = (struct http_parser_url*) malloc(sizeof(struct http_parser_url));
+    QueueHandle_t events = xQueueCreate(PUSHER_MQTT_INFLIGHT_MAX + 4, sizeof(int));
+    esp_mqtt_client_handle_t client = NULL;
+    int64_t started_at = esp_timer_get_time();
+    size_t batch_max_length = formatter_fitting_length(formatter, formatter_options, PUSHER_MQTT_BATCH_BUFFER_SZ, PUSHER_MQTT_BATCH_MAX_MEASUREMENTS);
+
+    esp_err_t esp_ret = ESP_OK;
+
+    *acknowledged_sequence = 0;
+
+    if (!host || !topic || !client_id || !measurements_formatted_buffer || !url_parse_result || !events) {
+        ESP_LOGE(MQTT_LOG_TAG, "Failed to allocate pusher buffers");
+        esp_ret = ESP_ERR_NO_MEM;
+        goto cleanup;
+    }
+
+    // Parse the url to extract HOST, PORT and the topic
+    http_parser_url_init(url_parse_result);
+    if (http_parser_parse_url(url, strlen(url), 0, url_parse_result) != 0
+        || url_parse_result->field_data[UF_HOST].len >= 128) {
+        ESP_LOGE(MQTT_LOG_TAG, "http_parser_parse_url failed");
+        esp_ret = ESP_FAIL;
+        goto cleanup;
+    }
+
+    strncpy(host, url + url_parse_result->field_data[UF_HOST].off, url_parse_result->field_data[UF_HOST].len);
+    pusher_mqtt_client_id(client_id, 32);
+
+    // Topic is the path without the leading slash
+    if (url_parse_result->field_data[UF_PATH].len > 1 && url_parse_result->field_data[UF_PATH].len < PUSHER_MQTT_TOPIC_MAX_SZ) {
+        strncpy(topic, url + url_parse_result->field_data[UF_PATH].off + 1, url_parse_result->field_data[UF_PATH].len - 1);
+    } else {
+        snprintf(topic, PUSHER_MQTT_TOPIC_MAX_SZ, "weather_station/%s/measurements", client_id);
+    }
+
+    bool secure = strncmp(url, "mqtts://", 8) == 0;
+    uint16_t port = (url_parse_result->field_set & (1 << UF_PORT)) ? url_parse_result->port : (secure ? 8883 : 1883);
+
+    esp_mqtt_client_config_t mqtt_cfg = {
+        .broker.address.hostname = host,
+        .broker.address.port = port,
+        .broker.address.transport = secure ? MQTT_TRANSPORT_OVER_SSL : MQTT_TRANSPORT_OVER_TCP,
+        .broker.verification.crt_bundle_attach = secure ? esp_crt_bundle_attach : NULL,
+        .credentials.client_id = client_id,
+        .session.disable_clean_session = true,
+        .network.disable_auto_reconnect = true,
+        .network.timeout_ms = PUSHER_MQTT_TIMEOUT_MS,
+    };
+
+    client = esp_mqtt_client_init(&mqtt_cfg);
+    if (!client) {
+        esp_ret = ESP_FAIL;
+        goto cleanup;
+    }
+
+    esp_mqtt_client_register_event(client, ESP_EVENT_ANY_ID, pusher_mqtt_event_handler, events);
+    esp_ret = esp_mqtt_client_start(client);
+    if (esp_ret != ESP_OK) {
+        goto cleanup;
+    }
+
+    // Wait for the connection
+    int event = 0;
+    if (xQueueReceive(events, &event, pdMS_TO_TICKS(PUSHER_MQTT_TIMEOUT_MS)) != pdTRUE || event != PUSHER_MQTT_EVENT_CONNECTED) {
+        ESP_LOGE(MQTT_LOG_TAG, "Connection to %s:%d failed", host, port);
+        esp_ret = ESP_FAIL;
+        goto cleanup;
+    }
+
+    // Message ids and batch lengths of the publishes waiting for a PUBACK
+    int in_flight_msg_ids[PUSHER_MQTT_INFLIGHT_MAX] = {0};
+    size_t in_flight[PUSHER_MQTT_INFLIGHT_MAX] = {0};
+    bool in_flight_acked[PUSHER_MQTT_INFLIGHT_MAX] = {0};
+    size_t in_flight_length = 0;
+    size_t acknowledged_count = 0;
+    size_t sent_count = 0;
+
+    while (acknowledged_count < measurements_length) {
+        // Fill the window
+        while (sent_count < measurements_length && in_flight_length < PUSHER_MQTT_INFLIGHT_MAX) {
+            size_t batch_length = measurements_length - sent_count;
+            if (batch_length > batch_max_length) {
+                batch_length = batch_max_length;
+            }
+
+            size_t payload_length = 0;
+            esp_ret = formatter_format(
+                formatter,
+                formatter_options,
+                measurements_formatted_buffer,
+                PUSHER_MQTT_BATCH_BUFFER_SZ,
+                &measurements[sent_count],
+                batch_length,
+                &payload_length
+            );
+            if (esp_ret != ESP_OK) {
+                ESP_LOGE(MQTT_LOG_TAG, "Failed to format %d measurements", batch_length);
+                goto cleanup;
+            }
+
+            int msg_id = esp_mqtt_client_publish(client, topic, measurements_formatted_buffer, payload_length, 1, 0);
+            if (msg_id < 0) {
+                ESP_LOGE(MQTT_LOG_TAG, "Publish failed");
+                esp_ret = ESP_FAIL;
+                goto cleanup;
+            }
+
+            in_flight_msg_ids[in_flight_length] = msg_id;
+            in_flight[in_flight_length] = batch_length;
+            in_flight_acked[in_flight_length] = false;
+            in_flight_length += 1;
+            sent_count += batch_length;
+        }
+
+        // Wait for the next PUBACK
+        if (xQueueReceive(events, &event, pdMS_TO_TICKS(PUSHER_MQTT_TIMEOUT_MS)) != pdTRUE || event == PUSHER_MQTT_EVENT_DISCONNECTED) {
+            ESP_LOGE(MQTT_LOG_TAG, "No PUBACK received");
+            esp_ret = ESP_FAIL;
+            goto cleanup;
+        }
+
+        for (size_t i = 0; i < in_flight_length; i++) {
+            if (in_flight_msg_ids[i] == event) {
+                in_flight_acked[i] = true;
+            }
+        }
+
+        // PUBACKs may arrive out of order, only a contiguous prefix is acknowledged
+        while (in_flight_length > 0 && in_flight_acked[0]) {
+            acknowledged_count += in_flight[0];
+            *acknowledged_sequence = measurements[acknowledged_count - 1].sequence;
+
+            in_flight_length -= 1;
+            memmove(&in_flight_msg_ids[0], &in_flight_msg_ids[1], in_flight_length * sizeof(int));
+            memmove(&in_flight[0], &in_flight[1], in_flight_length * sizeof(size_t));
+            memmove(&in_flight_acked[0], &in_flight_acked[1], in_flight_length * sizeof(bool));
+        }
+    }
+
+    ESP_LOGI(MQTT_LOG_TAG, "%d measurements delivered in %lld ms", measurements_length, (esp_timer_get_time() - started_at) / 1000);
+    esp_ret = ESP_OK;
+
+cleanup:
+    if (client) {
+        esp_mqtt_client_disconnect(client);
+        esp_mqtt_client_destroy(client);
+    }
+
+    if (events) vQueueDelete(events);
+
+    free(host);
+    free(topic);
+    free(client_id);
+    free(measurements_formatted_buffer);
+    free(url_parse_result);
+
+    return esp_ret;
+}
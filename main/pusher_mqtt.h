@@ -0,0 +1,10 @@
+#ifndef __WEATHER_STATION__PUSHER_MQTT_H__
+#define __WEATHER_STATION__PUSHER_MQTT_H__
+
+#include "esp_err.h"
+#include "sensors.h"
+#include "formatter.h"
+
+esp_err_t pusher_mqtt_push(const char* url, const struct formatter_t* formatter, const struct formatter_options_t* formatter_options, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence);
+
+#endif
@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "pusher_request.h"
+#include "http.h"
+#include "compressor.h"
+
+/**
+ * Writes the headers every upload request carries. They let the data sink
+ * serve configurations and firmware updates matching the station.
+ * Returns the length, 0 if the buffer is too small.
+*/
+size_t pusher_request_build_extra_headers(char* buffer, size_t buffer_length, uint32_t config_version, const char* firmware_version, const char* firmware_sha256)
+{
+    int length = snprintf(
+        buffer,
+        buffer_length,
+        "X-Config-Version: %lu\r\n"
+        "X-Firmware-Version: %s\r\n"
+        "X-Firmware-Sha256: %s\r\n",
+        (unsigned long) config_version,
+        firmware_version,
+        firmware_sha256
+    );
+
+    if (length < 0 || (size_t) length >= buffer_length) {
+        return 0;
+    }
+
+    return length;
+}
+
+/**
+ * Returns how many of the [measurements_length] pending measurements go into
+ * the next request
+*/
+size_t pusher_request_batch_length(const struct pusher_request_t* request, size_t measurements_length)
+{
+    size_t batch_max_length = formatter_fitting_length(request->formatter, request->formatter_options, request->formatted_capacity, PUSHER_BATCH_MAX_MEASUREMENTS);
+
+    return measurements_length < batch_max_length ? measurements_length : batch_max_length;
+}
+
+/**
+ * Builds the POST request for [measurements]: formats them, deflates the
+ * body if a compression buffer is set and writes the request head.
+ *
+ * Returns ESP_ERR_INVALID_SIZE if the body or the head do not fit into
+ * their buffers.
+*/
+esp_err_t pusher_request_build(struct pusher_request_t* request, struct sensor_data_t* measurements, size_t measurements_length)
+{
+    const char* content_encoding = NULL;
+    esp_err_t err;
+
+    request->head_length = 0;
+    request->body = request->formatted;
+    request->body_length = 0;
+
+    err = formatter_format(
+        request->formatter,
+        request->formatter_options,
+        request->formatted,
+        request->formatted_capacity,
+        measurements,
+        measurements_length,
+        &request->formatted_length
+    );
+    if (err != ESP_OK) {
+        return err;
+    }
+    request->body_length = request->formatted_length;
+
+    // Compress the formatted batch if configured
+    if (request->compressed) {
+        size_t compressed_length = 0;
+        err = compressor_deflate(
+            (const uint8_t*) request->formatted,
+            request->formatted_length,
+            request->compressed,
+            request->compressed_capacity,
+            &compressed_length
+        );
+        if (err != ESP_OK) {
+            return err;
+        }
+
+        request->body = (const char*) request->compressed;
+        request->body_length = compressed_length;
+        content_encoding = "deflate";
+    }
+
+    request->head_length = http_build_request_head(
+        request->head,
+        request->head_capacity,
+        "POST",
+        request->host,
+        request->path,
+        request->formatter->content_type,
+        content_encoding,
+        request->extra_headers,
+        request->body_length,
+        true
+    );
+    if (request->head_length == 0) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    return ESP_OK;
+}
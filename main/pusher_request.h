@@ -0,0 +1,61 @@
+#ifndef __WEATHER_STATION__PUSHER_REQUEST_H__
+#define __WEATHER_STATION__PUSHER_REQUEST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "sensors.h"
+#include "formatter.h"
+
+/**
+ * Maximum amount of measurements sent within one HTTP request. The backlog
+ * is split into batches of this size which keeps the format buffer bounded.
+ * Formats whose worst case does not fit into the buffer send fewer, see
+ * formatter_fitting_length. The buffer holds 25 measurements as JSON.
+*/
+#define PUSHER_BATCH_MAX_MEASUREMENTS 25
+#define PUSHER_BATCH_BUFFER_SZ 4608
+#define PUSHER_REQUEST_HEAD_BUFFER_SZ 1152
+#define PUSHER_EXTRA_HEADERS_BUFFER_SZ 640
+
+/**
+ * SHA-256 of the running image as hex, with the terminator
+*/
+#define PUSHER_FIRMWARE_SHA256_SZ 65
+
+/**
+ * Builds the upload requests of one session. Holds no platform specifics, so
+ * the host tools send exactly what the stations send.
+*/
+struct pusher_request_t {
+    const struct formatter_t* formatter;
+    const struct formatter_options_t* formatter_options;
+    const char* host;
+    const char* path;
+    const char* extra_headers;
+
+    char* head;
+    size_t head_capacity;
+    char* formatted;
+    size_t formatted_capacity;
+
+    /**
+     * Buffer for the deflated body, NULL sends the body uncompressed
+    */
+    uint8_t* compressed;
+    size_t compressed_capacity;
+
+    /**
+     * The last built request
+    */
+    size_t head_length;
+    const char* body;
+    size_t body_length;
+    size_t formatted_length;
+};
+
+size_t pusher_request_build_extra_headers(char* buffer, size_t buffer_length, uint32_t config_version, const char* firmware_version, const char* firmware_sha256);
+size_t pusher_request_batch_length(const struct pusher_request_t* request, size_t measurements_length);
+esp_err_t pusher_request_build(struct pusher_request_t* request, struct sensor_data_t* measurements, size_t measurements_length);
+
+#endif
@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "sample_filter.h"
+#include "aggregator.h"
+
+static const char* const sample_filter_names[] = {"none", "deadband", "swinging-door"};
+
+void sample_filter_reset(struct sample_filter_t* filter)
+{
+    memset(filter, 0, sizeof(struct sample_filter_t));
+}
+
+/**
+ * Releases [sample] for storing and starts the next line at it
+*/
+static void sample_filter_store(struct sample_filter_t* filter, const struct sensor_data_t* sample, struct sensor_data_t* stored, size_t* stored_length)
+{
+    memcpy(&stored[*stored_length], sample, sizeof(struct sensor_data_t));
+    *stored_length += 1;
+
+    filter->has_stored = true;
+    filter->has_held = false;
+    filter->stored_timestamp = sample->timestamp;
+
+    for (uint8_t i = 0; i < SENSORS_READINGS; i++) {
+        filter->stored[i] = aggregator_reading_get(sample, i);
+        filter->slope_min[i] = -INFINITY;
+        filter->slope_max[i] = INFINITY;
+    }
+}
+
+/**
+ * Whether the line from the stored sample to [sample] passes every sample
+ * since within its tolerance
+*/
+static bool sample_filter_is_in_door(const struct sample_filter_t* filter, const struct sensor_data_t* sample, uint32_t elapsed)
+{
+    for (uint8_t i = 0; i < SENSORS_READINGS; i++) {
+        float slope = (aggregator_reading_get(sample, i) - filter->stored[i]) / elapsed;
+        if (slope < filter->slope_min[i] || slope > filter->slope_max[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * Narrows the door by the tolerance band around [sample]
+*/
+static void sample_filter_narrow_door(struct sample_filter_t* filter, const struct sample_filter_options_t* options, const struct sensor_data_t* sample, uint32_t elapsed)
+{
+    for (uint8_t i = 0; i < SENSORS_READINGS; i++) {
+        float difference = aggregator_reading_get(sample, i) - filter->stored[i];
+        float slope_min = (difference - options->tolerances[i]) / elapsed;
+        float slope_max = (difference + options->tolerances[i]) / elapsed;
+
+        if (slope_min > filter->slope_min[i]) filter->slope_min[i] = slope_min;
+        if (slope_max < filter->slope_max[i]) filter->slope_max[i] = slope_max;
+    }
+}
+
+/**
+ * Deadband: [sample] is stored once a reading left the tolerance around the
+ * last stored sample. Holding the last stored value reconstructs every
+ * dropped sample within tolerance.
+*/
+static void sample_filter_add_deadband(struct sample_filter_t* filter, const struct sample_filter_options_t* options, const struct sensor_data_t* sample, bool is_forced, struct sensor_data_t* stored, size_t* stored_length)
+{
+    bool is_in_band = !is_forced
+        && filter->has_stored
+        && sample->timestamp > filter->stored_timestamp
+        && sample->timestamp - filter->stored_timestamp < options->max_interval;
+
+    for (uint8_t i = 0; i < SENSORS_READINGS && is_in_band; i++) {
+        is_in_band = fabsf(aggregator_reading_get(sample, i) - filter->stored[i]) <= options->tolerances[i];
+    }
+
+    if (!is_in_band) {
+        sample_filter_store(filter, sample, stored, stored_length);
+    }
+}
+
+/**
+ * Swinging door: [sample] is held back as end of a line from the last stored
+ * sample as long as that line passes every sample in between within its
+ * tolerance. Once the next sample does not fit, the held sample is stored
+ * and starts the next line. Unlike the classic algorithm the held sample is
+ * only taken if its own line fits, so linear interpolation between stored
+ * samples reconstructs every dropped sample within tolerance.
+*/
+static void sample_filter_add_swinging_door(struct sample_filter_t* filter, const struct sample_filter_options_t* options, const struct sensor_data_t* sample, bool is_forced, struct sensor_data_t* stored, size_t* stored_length)
+{
+    // New readings of rarely read devices and clock jumps break the line, keep both ends
+    if (is_forced || !filter->has_stored || sample->timestamp <= filter->stored_timestamp) {
+        if (filter->has_held) {
+            sample_filter_store(filter, &filter->held, stored, stored_length);
+        }
+
+        sample_filter_store(filter, sample, stored, stored_length);
+        return;
+    }
+
+    uint32_t elapsed = sample->timestamp - filter->stored_timestamp;
+    if (elapsed <= options->max_interval && sample_filter_is_in_door(filter, sample, elapsed)) {
+        memcpy(&filter->held, sample, sizeof(struct sensor_data_t));
+        filter->has_held = true;
+        sample_filter_narrow_door(filter, options, sample, elapsed);
+        return;
+    }
+
+    if (!filter->has_held) {
+        sample_filter_store(filter, sample, stored, stored_length);
+        return;
+    }
+
+    // The held sample ends the line and starts the next one
+    struct sensor_data_t held = filter->held;
+    sample_filter_store(filter, &held, stored, stored_length);
+
+    elapsed = sample->timestamp - filter->stored_timestamp;
+    if (elapsed <= options->max_interval) {
+        memcpy(&filter->held, sample, sizeof(struct sensor_data_t));
+        filter->has_held = true;
+        sample_filter_narrow_door(filter, options, sample, elapsed);
+    } else {
+        sample_filter_store(filter, sample, stored, stored_length);
+    }
+}
+
+/**
+ * Passes [sample] through the filter. Writes the samples to store, in order,
+ * into [stored] and returns how many. A changed mode releases a held sample
+ * first.
+ *
+ * Readings of skipped devices repeat the last reading and are compared as
+ * such. A sample that holds a reading the previous sample skipped is always
+ * stored, so readings of rarely read devices are never dropped.
+*/
+size_t sample_filter_add(struct sample_filter_t* filter, const struct sample_filter_options_t* options, const struct sensor_data_t* sample, struct sensor_data_t stored[SAMPLE_FILTER_STORED_MAX])
+{
+    size_t stored_length = 0;
+    bool is_forced = (filter->skipped_devices & ~sample->skipped_devices) != 0;
+
+    if (filter->mode != options->mode) {
+        if (filter->has_held) {
+            memcpy(&stored[stored_length], &filter->held, sizeof(struct sensor_data_t));
+            stored_length += 1;
+        }
+
+        sample_filter_reset(filter);
+        filter->mode = options->mode;
+    }
+
+    switch (options->mode) {
+    case SAMPLE_FILTER_DEADBAND:
+        sample_filter_add_deadband(filter, options, sample, is_forced, stored, &stored_length);
+        break;
+    case SAMPLE_FILTER_SWINGING_DOOR:
+        sample_filter_add_swinging_door(filter, options, sample, is_forced, stored, &stored_length);
+        break;
+    default:
+        memcpy(&stored[stored_length], sample, sizeof(struct sensor_data_t));
+        stored_length += 1;
+        break;
+    }
+
+    filter->skipped_devices = sample->skipped_devices;
+    return stored_length;
+}
+
+/**
+ * Writes the X-Sample-Filter header that tells the data sink how to
+ * reconstruct the series: holding the last value (deadband) or linear
+ * interpolation (swinging-door), within the tolerances in the order of
+ * SENSORS_READINGS. Returns the length, 0 without filter or if the buffer is
+ * too small.
+*/
+size_t sample_filter_build_header(char* buffer, size_t buffer_length, const struct sample_filter_options_t* options)
+{
+    if (options->mode != SAMPLE_FILTER_DEADBAND && options->mode != SAMPLE_FILTER_SWINGING_DOOR) {
+        return 0;
+    }
+
+    int length = snprintf(buffer, buffer_length, "X-Sample-Filter: %s; max-interval=%u; tolerances=", sample_filter_names[options->mode], options->max_interval);
+
+    for (uint8_t i = 0; i < SENSORS_READINGS && length >= 0 && (size_t) length < buffer_length; i++) {
+        length += snprintf(buffer + length, buffer_length - length, i == 0 ? "%g" : ",%g", options->tolerances[i]);
+    }
+
+    if (length >= 0 && (size_t) length < buffer_length) {
+        length += snprintf(buffer + length, buffer_length - length, "\r\n");
+    }
+
+    if (length < 0 || (size_t) length >= buffer_length) {
+        return 0;
+    }
+
+    return length;
+}
@@ -0,0 +1,76 @@
+#ifndef __WEATHER_STATION__SAMPLE_FILTER_H__
+#define __WEATHER_STATION__SAMPLE_FILTER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "sensors.h"
+
+#define SAMPLE_FILTER_NONE          0
+#define SAMPLE_FILTER_DEADBAND      1
+#define SAMPLE_FILTER_SWINGING_DOOR 2
+
+/**
+ * Samples a single call to sample_filter_add can release
+*/
+#define SAMPLE_FILTER_STORED_MAX 2
+
+/**
+ * Settings of the sample filter, taken from the configuration
+*/
+struct sample_filter_options_t {
+    uint8_t mode;
+
+    /**
+     * Allowed deviation per reading, see SENSORS_READINGS
+    */
+    const float* tolerances;
+
+    /**
+     * Longest time in seconds between two stored samples
+    */
+    uint16_t max_interval;
+};
+
+/**
+ * State of the sample filter. Small enough to be kept in rtc memory, samples
+ * are added one per wake.
+*/
+struct sample_filter_t {
+    /**
+     * The mode the state belongs to
+    */
+    uint8_t mode;
+
+    /**
+     * Devices the previous sample skipped
+    */
+    uint8_t skipped_devices;
+
+    /**
+     * The last stored sample, the start of the current line
+    */
+    bool has_stored;
+    uint32_t stored_timestamp;
+    float stored[SENSORS_READINGS];
+
+    /**
+     * Swinging door only: the last sample that was not stored yet, the end
+     * of the current line
+    */
+    bool has_held;
+    struct sensor_data_t held;
+
+    /**
+     * Swinging door only: the slopes from the start of the line in per
+     * second that keep every sample since within its tolerance
+    */
+    float slope_min[SENSORS_READINGS];
+    float slope_max[SENSORS_READINGS];
+};
+
+void sample_filter_reset(struct sample_filter_t* filter);
+size_t sample_filter_add(struct sample_filter_t* filter, const struct sample_filter_options_t* options, const struct sensor_data_t* sample, struct sensor_data_t stored[SAMPLE_FILTER_STORED_MAX]);
+size_t sample_filter_build_header(char* buffer, size_t buffer_length, const struct sample_filter_options_t* options);
+
+#endif
@@ -4,117 +4,191 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "driver/i2c_master.h"
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "esp_err.h"
-
-i2c_master_bus_handle_t i2c_bus_handle;
-i2c_master_dev_handle_t sht30_dev_handle = NULL;
-i2c_master_dev_handle_t bme280_dev_handle = NULL;
-i2c_master_dev_handle_t ltr390_dev_handle = NULL;
-i2c_master_dev_handle_t max17048_dev_handle = NULL;
-
-esp_err_t sensors_init(void)
+#include "esp_timer.h"
+#include "esp_cpu.h"
+
+#include "configuration.h"
+#include "energy.h"
+#include "bme280.h"
+
+/**
+ * Bounds the cost of a sensor that does not answer
+*/
+#define SENSORS_PROBE_TIMEOUT_MS 50
+#define SENSORS_READY_TIMEOUT_MS 500
+#define SENSORS_READY_POLL_MS 10
+
+/**
+ * Supply current of the station while awake with the radio off
+*/
+#define SENSORS_AWAKE_UA 35000
+
+#define SHT30_ADDRESS 0x44
+#define SHT30_STATUS_SZ 3
+#define SHT30_CONVERSION_MS 16
+
+#define BME280_ADDRESS 0x76
+
+#define LTR390_ADDRESS 0x53
+#define LTR390_MAIN_CTRL 0x00
+#define LTR390_ALS_UVS_MEAS_RATE 0x04
+#define LTR390_ALS_UVS_GAIN 0x05
+#define LTR390_PART_ID 0x06
+#define LTR390_MAIN_STATUS 0x07
+#define LTR390_ALS_DATA_0 0x0D
+#define LTR390_UVS_DATA_0 0x10
+#define LTR390_DATA_SZ 3
+#define LTR390_MAIN_CTRL_ALS 0b00000010
+#define LTR390_MAIN_CTRL_UVS 0b00001010
+#define LTR390_MAIN_STATUS_DATA_READY 0b00001000
+#define LTR390_PART_NUMBER 0xB
+#define LTR390_CONVERSION_MS 100
+#define LTR390_ACTIVE_UA 110
+
+#define MAX17048_ADDRESS 0x36
+#define MAX17048_VCELL_REG 0x02
+#define MAX17048_VERSION_REG 0x08
+#define MAX17048_CRATE_REG 0x16
+
+static const char *SENSORS_LOG_TAG = "SENSORS";
+
+/**
+ * A device on the i2c bus. Every callback but read may be NULL.
+*/
+struct sensors_driver_t {
+    const char* name;
+    uint8_t address;
+
+    /**
+     * Fastest clock the part supports. Falls back to I2C_MASTER_FREQ_HZ if
+     * the device does not answer the probe at this speed, e.g. with weak
+     * pull-ups.
+    */
+    uint32_t scl_speed_hz;
+
+    /**
+     * Time from trigger until ready is first asked
+    */
+    uint16_t conversion_ms;
+
+    /**
+     * Replaces conversion_ms for devices whose conversion time depends on
+     * their settings, in microseconds
+    */
+    uint32_t (*conversion_us)(void);
+
+    /**
+     * Checks the device answering on the address is the expected part and
+     * returns its chip id
+    */
+    esp_err_t (*probe)(i2c_master_dev_handle_t device, uint8_t* chip_id);
+
+    /**
+     * Starts a conversion, all devices convert at the same time
+    */
+    esp_err_t (*trigger)(i2c_master_dev_handle_t device);
+
+    /**
+     * Asked every SENSORS_READY_POLL_MS after the conversion time passed
+    */
+    esp_err_t (*ready)(i2c_master_dev_handle_t device, bool* is_ready);
+
+    esp_err_t (*read)(i2c_master_dev_handle_t device, struct sensor_data_t* measurement);
+
+    /**
+     * Leaves the device in its low power state before deep sleep
+    */
+    esp_err_t (*deinit)(i2c_master_dev_handle_t device);
+};
+
+/**
+ * What is known about a device. Lives in rtc memory, so the bus is only
+ * probed on cold boot and after a failed read.
+*/
+struct sensors_device_t {
+    bool probed;
+    bool present;
+    uint8_t chip_id;
+    uint32_t scl_speed_hz;
+};
+
+RTC_DATA_ATTR static struct sensors_device_t sensors_devices[SENSORS_DEVICES];
+
+static i2c_master_bus_handle_t i2c_bus_handle;
+static i2c_master_dev_handle_t sensors_handles[SENSORS_DEVICES];
+
+#define SENSORS_REGISTER_BLOCK_MAX 8
+
+/**
+ * Reads [length] consecutive registers starting at [reg] in one transaction,
+ * relying on the register address auto-increment of the part
+*/
+static esp_err_t sensors_register_read_block(i2c_master_dev_handle_t device, uint8_t reg, uint8_t* values, size_t length)
 {
-    int i2c_master_port = I2C_MASTER_NUM;
-
-    i2c_master_bus_config_t i2c_mst_config = {
-        .clk_source = I2C_CLK_SRC_DEFAULT,
-        .i2c_port = i2c_master_port,
-        .scl_io_num = I2C_MASTER_SCL_IO,
-        .sda_io_num = I2C_MASTER_SDA_IO,
-        .glitch_ignore_cnt = 7,
-        .flags.enable_internal_pullup = true,
-    };
-
-    ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_mst_config, &i2c_bus_handle));
-
-    // Register SHT30 (Temperature, Humidity)
-    i2c_device_config_t sht30_dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = 0x44,
-        .scl_speed_hz = 100000,
-    };
-    i2c_master_bus_add_device(i2c_bus_handle, &sht30_dev_cfg, &sht30_dev_handle);
-
-    // Register BME280 (Temperature, Pressure)
-    i2c_device_config_t bme280_dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = 0x76,
-        .scl_speed_hz = 100000,
-    };
-    i2c_master_bus_add_device(i2c_bus_handle, &bme280_dev_cfg, &bme280_dev_handle);
+    return i2c_master_transmit_receive(device, &reg, 1, values, length, I2C_MASTER_TIMEOUT_MS);
+}
 
-    // Register LTR390 (Light, UV)
-    i2c_device_config_t ltr390_dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = 0x53, // 53
-        .scl_speed_hz = 100000,
-    };
-    i2c_master_bus_add_device(i2c_bus_handle, &ltr390_dev_cfg, &ltr390_dev_handle);
+/**
+ * Writes [length] consecutive registers starting at [reg] in one transaction
+*/
+static esp_err_t sensors_register_write_block(i2c_master_dev_handle_t device, uint8_t reg, const uint8_t* values, size_t length)
+{
+    uint8_t write_buf[1 + SENSORS_REGISTER_BLOCK_MAX];
 
-    // Register MAX17048 (Battery)
-    i2c_device_config_t max17048_dev_cfg = {
-        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
-        .device_address = 0x36,
-        .scl_speed_hz = 100000,
-    };
-    i2c_master_bus_add_device(i2c_bus_handle, &max17048_dev_cfg, &max17048_dev_handle);
+    if (length > SENSORS_REGISTER_BLOCK_MAX) return ESP_ERR_INVALID_SIZE;
 
-    // Let the sensors power up
-    vTaskDelay(1 / portTICK_PERIOD_MS);
-    
-    return ESP_OK;
+    write_buf[0] = reg;
+    memcpy(&write_buf[1], values, length);
+    return i2c_master_transmit(device, write_buf, 1 + length, I2C_MASTER_TIMEOUT_MS);
 }
 
-esp_err_t sensors_deinit(void)
+static esp_err_t sensors_register_read(i2c_master_dev_handle_t device, uint8_t reg, uint8_t* value)
 {
-    i2c_master_bus_rm_device(sht30_dev_handle);
-    i2c_master_bus_rm_device(bme280_dev_handle);
-    i2c_master_bus_rm_device(ltr390_dev_handle);
-    i2c_master_bus_rm_device(max17048_dev_handle);
-    i2c_del_master_bus(i2c_bus_handle);
+    return sensors_register_read_block(device, reg, value, 1);
+}
 
-    return ESP_OK;
+static esp_err_t sensors_register_write(i2c_master_dev_handle_t device, uint8_t reg, uint8_t value)
+{
+    return sensors_register_write_block(device, reg, &value, 1);
 }
 
-esp_err_t sensors_read_temperature_and_humidity_outside(struct sensor_data_t * measurement)
+/**
+ * SHT30 (Temperature, Humidity)
+*/
+static esp_err_t sht30_probe(i2c_master_dev_handle_t device, uint8_t* chip_id)
 {
-    char* LOGTAG = "I2C-SHT30";
-
-    // Check if the sensor is on the bus.
-    // If not: use dummy values and log as error
-    if (ESP_OK != i2c_master_probe(i2c_bus_handle, 0x44, 5000)) {
-        ESP_LOGE(LOGTAG, "Could not find sensor on bus. Using dummy values instead.");
-        measurement->temperature = 0.0;
-        measurement->humidity = 0.0;
-        return ESP_OK;
-    } else {
-        ESP_LOGI(LOGTAG, "Found sensor on bus!");
-    }
+    // The status register, the part has no chip id
+    uint8_t write_buf[2] = {0xF3, 0x2D};
+    uint8_t read_buf[SHT30_STATUS_SZ] = {0};
 
-    // Start measuring command
-    uint8_t write_buf[3] = {0x24, 0x00};
-    ESP_ERROR_CHECK(i2c_master_transmit(sht30_dev_handle, write_buf, sizeof(write_buf), I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    vTaskDelay(50 / portTICK_PERIOD_MS);
+    *chip_id = 0;
+    return i2c_master_transmit_receive(device, write_buf, sizeof(write_buf), read_buf, sizeof(read_buf), I2C_MASTER_TIMEOUT_MS);
+}
 
+static esp_err_t sht30_trigger(i2c_master_dev_handle_t device)
+{
+    // Single shot, high repeatability, no clock stretching
+    uint8_t write_buf[2] = {0x24, 0x00};
+    return i2c_master_transmit(device, write_buf, sizeof(write_buf), I2C_MASTER_TIMEOUT_MS);
+}
 
+static esp_err_t sht30_read(i2c_master_dev_handle_t device, struct sensor_data_t* measurement)
+{
     uint8_t read_buf[6] = {0};
-    ESP_ERROR_CHECK(i2c_master_receive(sht30_dev_handle, read_buf, sizeof(read_buf), I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-
-
-    ESP_LOG_BUFFER_HEX(LOGTAG, read_buf, sizeof(read_buf));
+    esp_err_t err = i2c_master_receive(device, read_buf, sizeof(read_buf), I2C_MASTER_TIMEOUT_MS);
+    if (err != ESP_OK) return err;
 
     uint16_t temperature_raw = (read_buf[0] << 8) + read_buf[1];
     uint16_t humidity_raw = (read_buf[3] << 8) + read_buf[4];
 
-    double temp_f = temperature_raw / 65534.0f;
-    double humd_f = humidity_raw / 65534.0f;
+    double temperature = -45.0 + 175.0 * (temperature_raw / 65535.0);
+    double humidity = 100.0 * (humidity_raw / 65535.0);
 
-    double temperature = -45.0f + 175.0f * temp_f;
-    double humidity = 100.0f * humd_f;
-
-    ESP_LOGI(LOGTAG, "Temperature: %.1f°C", temperature);
-    ESP_LOGI(LOGTAG, "Humidity: %.0f%%", humidity);
+    ESP_LOGI("I2C-SHT30", "Temperature: %.1f°C", temperature);
+    ESP_LOGI("I2C-SHT30", "Humidity: %.0f%%", humidity);
 
     measurement->temperature = (float) temperature;
     measurement->humidity = (float) humidity;
@@ -122,260 +196,550 @@ esp_err_t sensors_read_temperature_and_humidity_outside(struct sensor_data_t * m
     return ESP_OK;
 }
 
-esp_err_t sensors_read_temperature_and_pressure_inside(struct sensor_data_t* measurement)
+/**
+ * BME280 (Temperature, Pressure). Converts once per trigger in forced mode
+ * and sleeps in between. The trimming parameters are read on probe and kept
+ * in rtc memory.
+*/
+RTC_DATA_ATTR static struct bme280_calibration_t bme280_calibration;
+
+struct bme280_shadow_t {
+    bool valid;
+    uint8_t ctrl_hum;
+};
+
+RTC_DATA_ATTR static struct bme280_shadow_t bme280_shadow;
+
+/**
+ * Oversampling of temperature, pressure and humidity. Temperature can not be
+ * skipped, the other compensations depend on it.
+*/
+static void bme280_oversampling(uint8_t* oversampling_t, uint8_t* oversampling_p, uint8_t* oversampling_h)
 {
-    char* LOGTAG = "I2C-BME280";
-    
-    uint8_t BME280_REGISTER_CHIPID = 0xD0;
-
-    // Check if the sensor is on the bus.
-    // If not: use dummy values and log as error
-    if (ESP_OK != i2c_master_probe(i2c_bus_handle, 0x76, 5000)) {
-        ESP_LOGE(LOGTAG, "Could not find sensor on bus. Using dummy values instead.");
-        measurement->temperature_inside = 0.0;
-        return ESP_OK;
-    } else {
-        ESP_LOGI(LOGTAG, "Found sensor on bus!");
-    }
+    *oversampling_t = configuration.bme280_oversampling[0];
+    *oversampling_p = configuration.bme280_oversampling[1];
+    *oversampling_h = configuration.bme280_oversampling[2];
 
-    // Read the chipid
-    uint8_t write_buf1[1] = {BME280_REGISTER_CHIPID};
-    uint8_t read_buf1[1] = {0};
-    ESP_ERROR_CHECK(i2c_master_transmit_receive(bme280_dev_handle, write_buf1, sizeof(write_buf1), read_buf1, sizeof(read_buf1), I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    ESP_LOG_BUFFER_HEX(LOGTAG, read_buf1, sizeof(read_buf1));
+    if (*oversampling_t == BME280_OVERSAMPLING_SKIPPED || *oversampling_t > BME280_OVERSAMPLING_16X) *oversampling_t = BME280_OVERSAMPLING_1X;
+    if (*oversampling_p > BME280_OVERSAMPLING_16X) *oversampling_p = BME280_OVERSAMPLING_1X;
+    if (*oversampling_h > BME280_OVERSAMPLING_16X) *oversampling_h = BME280_OVERSAMPLING_SKIPPED;
+}
 
+static esp_err_t bme280_probe(i2c_master_dev_handle_t device, uint8_t* chip_id)
+{
+    uint8_t t_p[BME280_CALIBRATION_T_P_SZ] = {0};
+    uint8_t h[BME280_CALIBRATION_H_SZ] = {0};
+
+    bme280_shadow.valid = false;
+
+    esp_err_t err = sensors_register_read(device, BME280_REGISTER_CHIPID, chip_id);
+    if (err != ESP_OK) return err;
+    if (*chip_id != BME280_CHIPID) return ESP_ERR_NOT_FOUND;
+
+    err = sensors_register_read_block(device, BME280_REGISTER_CALIBRATION_T_P, t_p, sizeof(t_p));
+    if (err == ESP_OK) err = sensors_register_read_block(device, BME280_REGISTER_CALIBRATION_H, h, sizeof(h));
+    if (err != ESP_OK) return err;
+
+    bme280_parse_calibration(t_p, h, &bme280_calibration);
     return ESP_OK;
 }
 
-esp_err_t sensors_read_daylight_and_uv(struct sensor_data_t * measurement)
+static esp_err_t bme280_trigger(i2c_master_dev_handle_t device)
 {
-    char* LOGTAG = "I2C-LTR390";
-
-    uint8_t wbuffer[8] = {0};
-    uint8_t rbuffer[8] = {0};
-
-    uint8_t LTR390_MAIN_CTRL = 0x00;
-    uint8_t LTR390_ALS_UVS_MEAS_RATE = 0x04;
-    uint8_t LTR390_ALS_UVS_GAIN = 0x05;
-    uint8_t LTR390_PART_ID = 0x06;
-    uint8_t LTR390_MAIN_STATUS = 0x07;
-    uint8_t LTR390_ALS_DATA_0 = 0x0D;
-    uint8_t LTR390_ALS_DATA_1 = 0x0E;
-    uint8_t LTR390_ALS_DATA_2 = 0x0F;
-    uint8_t LTR390_UVS_DATA_0 = 0x10;
-    uint8_t LTR390_UVS_DATA_1 = 0x11;
-    uint8_t LTR390_UVS_DATA_2 = 0x12;
-
-    // Check if the sensor is on the bus.
-    // If not: use dummy values and log as error
-    if (ESP_OK != i2c_master_probe(i2c_bus_handle, 0x53, 5000)) {
-        ESP_LOGE(LOGTAG, "Could not find sensor on bus. Using dummy values instead.");
-        measurement->daylight = 0;
-        measurement->uv = 0;
-        return ESP_OK;
-    } else {
-        ESP_LOGI(LOGTAG, "Found sensor on bus!");
+    uint8_t oversampling_t, oversampling_p, oversampling_h;
+    bme280_oversampling(&oversampling_t, &oversampling_p, &oversampling_h);
+
+    // Takes effect with the following write of ctrl_meas
+    if (!bme280_shadow.valid || bme280_shadow.ctrl_hum != oversampling_h) {
+        esp_err_t err = sensors_register_write(device, BME280_REGISTER_CTRL_HUM, oversampling_h);
+        if (err != ESP_OK) {
+            bme280_shadow.valid = false;
+            return err;
+        }
+
+        bme280_shadow.valid = true;
+        bme280_shadow.ctrl_hum = oversampling_h;
     }
 
+    return sensors_register_write(device, BME280_REGISTER_CTRL_MEAS, bme280_ctrl_meas(oversampling_t, oversampling_p, BME280_MODE_FORCED));
+}
 
-    
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_PART_ID;
-    _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, 50000 / portTICK_PERIOD_MS));
+/**
+ * Longest conversion with the configured oversampling, so the first status
+ * poll finds the measurement done
+*/
+static uint32_t bme280_conversion_us(void)
+{
+    uint8_t oversampling_t, oversampling_p, oversampling_h;
+    bme280_oversampling(&oversampling_t, &oversampling_p, &oversampling_h);
 
+    return bme280_measurement_time_us(oversampling_t, oversampling_p, oversampling_h);
+}
 
+static esp_err_t bme280_ready(i2c_master_dev_handle_t device, bool* is_ready)
+{
+    uint8_t status = 0;
+    esp_err_t err = sensors_register_read(device, BME280_REGISTER_STATUS, &status);
+    *is_ready = !(status & BME280_STATUS_MEASURING);
+    return err;
+}
 
+static esp_err_t bme280_read(i2c_master_dev_handle_t device, struct sensor_data_t* measurement)
+{
+    uint8_t oversampling_t, oversampling_p, oversampling_h;
+    uint8_t data[BME280_DATA_SZ] = {0};
+    int32_t adc_p, adc_t, adc_h;
+    int32_t t_fine;
+
+    bme280_oversampling(&oversampling_t, &oversampling_p, &oversampling_h);
+
+    // Pressure, temperature and humidity if measured in one burst
+    esp_err_t err = sensors_register_read_block(device, BME280_REGISTER_DATA, data, oversampling_h ? BME280_DATA_SZ : BME280_DATA_T_P_SZ);
+    if (err != ESP_OK) return err;
+
+    uint32_t started_cycles = esp_cpu_get_cycle_count();
+    bme280_parse_data(data, &adc_p, &adc_t, &adc_h);
+    int32_t temperature = bme280_compensate_temperature(&bme280_calibration, adc_t, &t_fine);
+    uint32_t pressure = oversampling_p ? bme280_compensate_pressure(&bme280_calibration, adc_p, t_fine) : 0;
+    uint32_t humidity = oversampling_h ? bme280_compensate_humidity(&bme280_calibration, adc_h, t_fine) : 0;
+    ESP_LOGD("I2C-BME280", "Compensation took %lu cycles", (unsigned long) (esp_cpu_get_cycle_count() - started_cycles));
+
+    ESP_LOGI("I2C-BME280", "Temperature: %.2f°C", temperature / 100.0);
+    measurement->temperature_inside = temperature / 100.0f;
+
+    if (oversampling_p) {
+        ESP_LOGI("I2C-BME280", "Pressure: %.2fhPa", pressure / 25600.0);
+        measurement->pressure = pressure / 25600.0f;
+    }
 
+    // There is no field for the humidity inside, it is only logged
+    if (oversampling_h) {
+        ESP_LOGI("I2C-BME280", "Humidity: %.1f%%", humidity / 1024.0);
+    }
 
+    return ESP_OK;
+}
 
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_MAIN_STATUS;
-    _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
+/**
+ * LTR390 (Light, UV). Measures ambient light first, then switches to UV.
+ *
+ * The sensor stays powered in deep sleep and keeps its registers, they are
+ * only written when they differ from the shadow. If the station wakes often
+ * enough, the sensor keeps measuring UV while the station sleeps, so the UV
+ * result is waiting at wakeup and only the light conversion is waited for.
+*/
+struct ltr390_shadow_t {
+    bool valid;
+    uint8_t main_ctrl;
+    uint8_t rate_and_gain[2];
+};
+
+RTC_DATA_ATTR static struct ltr390_shadow_t ltr390_shadow;
+
+/**
+ * UV result read at trigger when the sensor measured during deep sleep
+*/
+static bool ltr390_has_uvs;
+static uint32_t ltr390_uvs;
+
+/**
+ * Measuring continuously draws LTR390_ACTIVE_UA for the whole measurement
+ * interval, saves LTR390_CONVERSION_MS of the station being awake
+ * (SENSORS_AWAKE_UA) on every wake. Pays off for intervals below
+ * 100 ms * 35 mA / 110 uA = ~32 s. Takes the interval the energy budget
+ * runs the station at.
+*/
+static bool ltr390_is_continuous(void)
+{
+    uint32_t measurement_rate = energy.measurement_rate ? energy.measurement_rate : configuration.measurement_rate;
+    return measurement_rate * LTR390_ACTIVE_UA < LTR390_CONVERSION_MS * SENSORS_AWAKE_UA / 1000;
+}
 
+/**
+ * Writes the registers only if they differ from what the shadow says the
+ * sensor holds
+*/
+static esp_err_t ltr390_update(i2c_master_dev_handle_t device, uint8_t reg, const uint8_t* values, uint8_t* shadow, size_t length)
+{
+    if (ltr390_shadow.valid && memcmp(shadow, values, length) == 0) {
+        return ESP_OK;
+    }
 
+    esp_err_t err = sensors_register_write_block(device, reg, values, length);
+    if (err != ESP_OK) {
+        ltr390_shadow.valid = false;
+        return err;
+    }
 
-    // Put the sensor into enabled ALS mode
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_MAIN_CTRL;
-    wbuffer[1] = 0b00000010;
-    _i2c_error_check(i2c_master_transmit(ltr390_dev_handle, wbuffer, 2, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
+    memcpy(shadow, values, length);
+    return ESP_OK;
+}
 
-    // Set the measurement resolution and rate
-    // resolution: 18 bits
-    // rate: every 100ms
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_ALS_UVS_MEAS_RATE;
-    wbuffer[1] = 0b00100010;
-    _i2c_error_check(i2c_master_transmit(ltr390_dev_handle, wbuffer, 2, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
+static esp_err_t ltr390_set_mode(i2c_master_dev_handle_t device, uint8_t main_ctrl)
+{
+    return ltr390_update(device, LTR390_MAIN_CTRL, &main_ctrl, &ltr390_shadow.main_ctrl, 1);
+}
 
-    // Set the gain to 3
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_ALS_UVS_GAIN;
-    wbuffer[1] = 0b00000001;
-    _i2c_error_check(i2c_master_transmit(ltr390_dev_handle, wbuffer, 2, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
+static esp_err_t ltr390_probe(i2c_master_dev_handle_t device, uint8_t* chip_id)
+{
+    // Unknown state, e.g. after a cold boot or a failed read
+    ltr390_shadow.valid = false;
 
-    // Wait 100ms for the first measurement and then continiously ask if the data is ready
-    // with a delay of 10ms in between
-    vTaskDelay(10 / portTICK_PERIOD_MS);
-    int timeout_als = 10;
-    while (timeout_als > 0) {
-        _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-        wbuffer[0] = LTR390_MAIN_STATUS;
-        _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
+    esp_err_t err = sensors_register_read(device, LTR390_PART_ID, chip_id);
+    if (err != ESP_OK) return err;
 
-        if (rbuffer[0] & 0b1000) {
-            break;
-        }
+    return (*chip_id >> 4) == LTR390_PART_NUMBER ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+static esp_err_t ltr390_ready(i2c_master_dev_handle_t device, bool* is_ready)
+{
+    uint8_t status = 0;
+    esp_err_t err = sensors_register_read(device, LTR390_MAIN_STATUS, &status);
+    *is_ready = status & LTR390_MAIN_STATUS_DATA_READY;
+    return err;
+}
+
+/**
+ * Reads the 20 bit result of the last conversion
+*/
+static esp_err_t ltr390_read_data(i2c_master_dev_handle_t device, uint8_t data_0, uint32_t* value)
+{
+    uint8_t data[LTR390_DATA_SZ] = {0};
+    esp_err_t err = sensors_register_read_block(device, data_0, data, sizeof(data));
+
+    *value = data[0] + (data[1] << 8) + ((data[2] & 0x0F) << 16);
+    return err;
+}
 
-        timeout_als -= 1;
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+static esp_err_t ltr390_trigger(i2c_master_dev_handle_t device)
+{
+    esp_err_t err = ESP_OK;
+    bool is_ready = false;
+
+    // Take the UV result measured during deep sleep
+    ltr390_has_uvs = false;
+    if (ltr390_shadow.valid && ltr390_shadow.main_ctrl == LTR390_MAIN_CTRL_UVS) {
+        err = ltr390_ready(device, &is_ready);
+        if (err == ESP_OK && is_ready) {
+            err = ltr390_read_data(device, LTR390_UVS_DATA_0, &ltr390_uvs);
+            ltr390_has_uvs = err == ESP_OK;
+        }
+        if (err != ESP_OK) return err;
     }
 
-    // Read the ALS
-    uint32_t als_measurement = 0;
+    // Resolution 18 bits, rate every 100ms and gain 3
+    uint8_t rate_and_gain[2] = {0b00100010, 0b00000001};
+    err = ltr390_update(device, LTR390_ALS_UVS_MEAS_RATE, rate_and_gain, ltr390_shadow.rate_and_gain, sizeof(rate_and_gain));
+    if (err != ESP_OK) return err;
 
-    // Read the lower 8 bits
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_ALS_DATA_0;
-    _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    als_measurement = als_measurement + (rbuffer[0]);
+    err = ltr390_set_mode(device, LTR390_MAIN_CTRL_ALS);
+    if (err != ESP_OK) return err;
 
-    // Read the middle 8 bits
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_ALS_DATA_1;
-    _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    als_measurement = als_measurement + (rbuffer[0] << 8);
+    ltr390_shadow.valid = true;
+    return ESP_OK;
+}
 
-    // Read the upper 4 bits
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_ALS_DATA_2;
-    _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    als_measurement = als_measurement + (rbuffer[0] << 12);
+static esp_err_t ltr390_read(i2c_master_dev_handle_t device, struct sensor_data_t* measurement)
+{
+    uint32_t als_measurement = 0;
+    esp_err_t err = ltr390_read_data(device, LTR390_ALS_DATA_0, &als_measurement);
+    if (err != ESP_OK) return err;
 
     float lux = (0.6f * als_measurement) / (3 * 1);
     ESP_LOGI("I2C-LTR390", "lux: %.2f", lux);
     measurement->daylight = lux;
 
-    // Put the sensor into enabled UVS mode
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_MAIN_CTRL;
-    wbuffer[1] = 0b00000000;
-    _i2c_error_check(i2c_master_transmit(ltr390_dev_handle, wbuffer, 2, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-
-    // Wait 100ms for the first measurement and then continiously ask if the data is ready
-    // with a delay of 10ms in between
-    vTaskDelay(10 / portTICK_PERIOD_MS);
-    int timeout_uvs = 10;
-    while (timeout_uvs > 0) {
-        _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-        wbuffer[0] = LTR390_MAIN_STATUS;
-        _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-
-        if (rbuffer[0] & 0b1000) {
-            break;
+    // Switch to UV and wait for its conversion, unless it was measured in deep sleep
+    err = ltr390_set_mode(device, LTR390_MAIN_CTRL_UVS);
+    if (err != ESP_OK) return err;
+
+    if (!ltr390_has_uvs) {
+        vTaskDelay(pdMS_TO_TICKS(LTR390_CONVERSION_MS));
+        bool is_ready = false;
+        for (int waited_ms = 0; !is_ready && waited_ms <= SENSORS_READY_TIMEOUT_MS; waited_ms += SENSORS_READY_POLL_MS) {
+            err = ltr390_ready(device, &is_ready);
+            if (err != ESP_OK) return err;
+            if (!is_ready) vTaskDelay(pdMS_TO_TICKS(SENSORS_READY_POLL_MS));
         }
+        if (!is_ready) return ESP_ERR_TIMEOUT;
 
-        timeout_uvs -= 1;
-        vTaskDelay(10 / portTICK_PERIOD_MS);
+        err = ltr390_read_data(device, LTR390_UVS_DATA_0, &ltr390_uvs);
+        if (err != ESP_OK) return err;
     }
 
-    // Read the UVS
-    uint32_t uvs_measurement = 0;
+    double uvi = ltr390_uvs / ((double) ((3.0f/18.0f) * (1.0f/4.0f) * 2300.0f));
+    ESP_LOGI("I2C-LTR390", "uvi: %.2f", uvi);
+    measurement->uv = (float) uvi;
+
+    return ESP_OK;
+}
+
+static esp_err_t ltr390_deinit(i2c_master_dev_handle_t device)
+{
+    // Keep measuring UV or standby until the next wake
+    return ltr390_set_mode(device, ltr390_is_continuous() ? LTR390_MAIN_CTRL_UVS : 0);
+}
 
-    // Read the lower 8 bits
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_UVS_DATA_0;
-    _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    uvs_measurement = uvs_measurement + (rbuffer[0]);
+/**
+ * MAX17048 (Battery). Measures continuously, there is nothing to trigger.
+*/
+static esp_err_t max17048_probe(i2c_master_dev_handle_t device, uint8_t* chip_id)
+{
+    uint8_t version[2] = {0};
+    esp_err_t err = sensors_register_read_block(device, MAX17048_VERSION_REG, version, sizeof(version));
+    *chip_id = version[1];
+    return err;
+}
 
-    // Read the middle 8 bits
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_UVS_DATA_1;
-    _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    uvs_measurement = uvs_measurement + (rbuffer[0] << 8);
+static esp_err_t max17048_read(i2c_master_dev_handle_t device, struct sensor_data_t* measurement)
+{
+    // VCELL and SOC are neighbours, CRATE is far off
+    uint8_t vcell_and_soc[4] = {0};
+    uint8_t crate[2] = {0};
 
-    // Read the upper 4 bits
-    _clear_buffers(rbuffer, wbuffer, sizeof(rbuffer), sizeof(wbuffer));
-    wbuffer[0] = LTR390_UVS_DATA_2;
-    _i2c_error_check(i2c_master_transmit_receive(ltr390_dev_handle, wbuffer, 1, rbuffer, 1, I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    uvs_measurement = uvs_measurement + (rbuffer[0] << 12);
+    esp_err_t err = sensors_register_read_block(device, MAX17048_VCELL_REG, vcell_and_soc, sizeof(vcell_and_soc));
+    if (err == ESP_OK) err = sensors_register_read_block(device, MAX17048_CRATE_REG, crate, sizeof(crate));
+    if (err != ESP_OK) return err;
 
-    double uvi = uvs_measurement / ((double) ((3.0f/18.0f) * (1.0f/4.0f) * 2300.0f));
-    ESP_LOGI("I2C-LTR390", "uvi: %.2f", uvi);
-    measurement->uv = (float) uvi;
+    uint16_t voltage_raw = (vcell_and_soc[0] << 8) + vcell_and_soc[1];
+    uint16_t soc_raw = (vcell_and_soc[2] << 8) + vcell_and_soc[3];
+    uint16_t crate_raw = (crate[0] << 8) + crate[1];
+
+    double voltage = voltage_raw * 78.125 / 1000000.0;
+    double charge = soc_raw / 256.0;
+    double charge_rate = ((int16_t) crate_raw) * 0.208;
+
+    ESP_LOGI("I2C-MAX17048", "Voltage: %0.3fV", voltage);
+    ESP_LOGI("I2C-MAX17048", "Charge: %0.1f%%", charge);
+    ESP_LOGI("I2C-MAX17048", "Charge rate: %0.1f%%/h", charge_rate);
+
+    measurement->battery_voltage = (float) voltage;
+    measurement->battery_charge = (float) charge;
+    measurement->battery_charge_rate = (float) charge_rate;
 
     return ESP_OK;
 }
 
-// TODO error handling
-// TODO smoothen the code
-// TODO comments
-esp_err_t sensors_read_battery_status(struct sensor_data_t * measurement)
+/**
+ * Indexed by SENSORS_DEVICE_*
+*/
+static const struct sensors_driver_t sensors_drivers[SENSORS_DEVICES] = {
+    [SENSORS_DEVICE_SHT30] = {
+        .name = "SHT30",
+        .address = SHT30_ADDRESS,
+        .scl_speed_hz = I2C_MASTER_FAST_FREQ_HZ, // up to 1 MHz
+        .conversion_ms = SHT30_CONVERSION_MS,
+        .probe = sht30_probe,
+        .trigger = sht30_trigger,
+        .read = sht30_read,
+    },
+    [SENSORS_DEVICE_BME280] = {
+        .name = "BME280",
+        .address = BME280_ADDRESS,
+        .scl_speed_hz = I2C_MASTER_FAST_FREQ_HZ, // up to 3.4 MHz
+        .conversion_us = bme280_conversion_us,
+        .probe = bme280_probe,
+        .trigger = bme280_trigger,
+        .ready = bme280_ready,
+        .read = bme280_read,
+    },
+    [SENSORS_DEVICE_LTR390] = {
+        .name = "LTR390",
+        .address = LTR390_ADDRESS,
+        .scl_speed_hz = I2C_MASTER_FAST_FREQ_HZ,
+        .conversion_ms = LTR390_CONVERSION_MS,
+        .probe = ltr390_probe,
+        .trigger = ltr390_trigger,
+        .ready = ltr390_ready,
+        .read = ltr390_read,
+        .deinit = ltr390_deinit,
+    },
+    [SENSORS_DEVICE_MAX17048] = {
+        .name = "MAX17048",
+        .address = MAX17048_ADDRESS,
+        .scl_speed_hz = I2C_MASTER_FAST_FREQ_HZ,
+        .probe = max17048_probe,
+        .read = max17048_read,
+    },
+};
+
+/**
+ * (Re-)registers the device on the bus with the given clock
+*/
+static esp_err_t sensors_add_device(uint8_t index, uint32_t scl_speed_hz)
 {
-    char* LOGTAG = "I2C-MAX17048";
-
-    uint8_t wbuffer[8] = {0};
-    uint8_t rbuffer[8] = {0};
-
-    uint8_t MAX17048_VCELL_REG = 0x02;
-    uint8_t MAX17048_SOC_REG = 0x04;
-    uint8_t MAX17048_CRATE_REG = 0x16;
-
-    // Check if the sensor is on the bus.
-    // If not: use dummy values and log as error
-    if (ESP_OK != i2c_master_probe(i2c_bus_handle, 0x36, 5000)) {
-        ESP_LOGE(LOGTAG, "Could not find sensor on bus. Using dummy values instead.");
-        measurement->battery_voltage = 0.0;
-        measurement->battery_charge = 0.0f;
-        measurement->battery_charge_rate = 0.0;
-        return ESP_OK;
-    } else {
-        ESP_LOGI(LOGTAG, "Found sensor on bus!");
+    i2c_device_config_t dev_cfg = {
+        .dev_addr_length = I2C_ADDR_BIT_LEN_7,
+        .device_address = sensors_drivers[index].address,
+        .scl_speed_hz = scl_speed_hz,
+    };
+
+    if (sensors_handles[index]) {
+        i2c_master_bus_rm_device(sensors_handles[index]);
+        sensors_handles[index] = NULL;
     }
 
-    // Read voltage
-    uint8_t write_buf1[1] = {MAX17048_VCELL_REG};
-    uint8_t read_buf1[2] = {0};
-    ESP_ERROR_CHECK(i2c_master_transmit_receive(max17048_dev_handle, write_buf1, sizeof(write_buf1), read_buf1, sizeof(read_buf1), I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    uint16_t voltage_raw = read_buf1[1] + (read_buf1[0] << 8);
-    double voltage = voltage_raw * 78.125 / 1000000.0;
-    ESP_LOG_BUFFER_HEX(LOGTAG, read_buf1, sizeof(read_buf1));
-    ESP_LOGI(LOGTAG, "Voltage: %0.3fV", voltage);
-    measurement->battery_voltage = (float) voltage;
+    sensors_devices[index].scl_speed_hz = scl_speed_hz;
+    return i2c_master_bus_add_device(i2c_bus_handle, &dev_cfg, &sensors_handles[index]);
+}
 
-    // Read percent
-    uint8_t write_buf2[1] = {MAX17048_SOC_REG};
-    uint8_t read_buf2[2] = {0};
-    ESP_ERROR_CHECK(i2c_master_transmit_receive(max17048_dev_handle, write_buf2, sizeof(write_buf2), read_buf2, sizeof(read_buf2), I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    uint16_t soc_raw = read_buf2[1] + (read_buf2[0] << 8);
-    double charge = soc_raw / 256.0;
-    ESP_LOG_BUFFER_HEX(LOGTAG, read_buf2, sizeof(read_buf2));
-    ESP_LOGI(LOGTAG, "Charge: %0.1f%%", charge);
-    measurement->battery_charge = (float) charge;
+/**
+ * Looks for the device on the bus and remembers the result and the bus speed
+ * it answered at until the next cold boot or failed read
+*/
+static void sensors_probe(uint8_t index)
+{
+    const struct sensors_driver_t* driver = &sensors_drivers[index];
+    struct sensors_device_t* device = &sensors_devices[index];
+    esp_err_t err = ESP_OK;
 
-    // Read charge rate
-    uint8_t write_buf3[1] = {MAX17048_CRATE_REG};
-    uint8_t read_buf3[2] = {0};
-    ESP_ERROR_CHECK(i2c_master_transmit_receive(max17048_dev_handle, write_buf3, sizeof(write_buf3), read_buf3, sizeof(read_buf3), I2C_MASTER_TIMEOUT_MS / portTICK_PERIOD_MS));
-    uint16_t crate_raw = read_buf3[1] + (read_buf3[0] << 8);
-    double charge_rate = ((int16_t) crate_raw) * 0.208;
-    ESP_LOG_BUFFER_HEX(LOGTAG, read_buf3, sizeof(read_buf3));
-    ESP_LOGI(LOGTAG, "Charge rate: %0.1f%%/h", charge_rate);
-    measurement->battery_charge_rate = (float) charge_rate;
+    device->probed = true;
+    device->present = false;
+    device->chip_id = 0;
+
+    if (i2c_master_probe(i2c_bus_handle, driver->address, SENSORS_PROBE_TIMEOUT_MS) != ESP_OK) {
+        ESP_LOGE(SENSORS_LOG_TAG, "Could not find %s on bus. Using dummy values instead.", driver->name);
+        return;
+    }
+
+    // Start at the fastest clock of the part and fall back to standard mode
+    if (driver->probe) {
+        if (device->scl_speed_hz != driver->scl_speed_hz) {
+            err = sensors_add_device(index, driver->scl_speed_hz);
+        }
+        if (err == ESP_OK) {
+            err = driver->probe(sensors_handles[index], &device->chip_id);
+        }
+        if (err != ESP_OK && driver->scl_speed_hz != I2C_MASTER_FREQ_HZ) {
+            ESP_LOGW(SENSORS_LOG_TAG, "%s did not answer at %lu Hz (%s)", driver->name, (unsigned long) driver->scl_speed_hz, esp_err_to_name(err));
+            err = sensors_add_device(index, I2C_MASTER_FREQ_HZ);
+            if (err == ESP_OK) {
+                err = driver->probe(sensors_handles[index], &device->chip_id);
+            }
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(SENSORS_LOG_TAG, "Unexpected device at the address of %s (%s, chip id 0x%02x)", driver->name, esp_err_to_name(err), device->chip_id);
+            return;
+        }
+    }
+
+    device->present = true;
+    ESP_LOGI(SENSORS_LOG_TAG, "Found %s on bus at %lu Hz, chip id 0x%02x", driver->name, (unsigned long) device->scl_speed_hz, device->chip_id);
+}
+
+/**
+ * Forgets a device after an error, so it is probed again on the next wake
+*/
+static void sensors_fail(uint8_t index, const char* step, esp_err_t err)
+{
+    ESP_LOGE(SENSORS_LOG_TAG, "%s of %s failed (%s)", step, sensors_drivers[index].name, esp_err_to_name(err));
+    sensors_devices[index].probed = false;
+    sensors_devices[index].present = false;
+}
+
+esp_err_t sensors_init(void)
+{
+    int i2c_master_port = I2C_MASTER_NUM;
+
+    i2c_master_bus_config_t i2c_mst_config = {
+        .clk_source = I2C_CLK_SRC_DEFAULT,
+        .i2c_port = i2c_master_port,
+        .scl_io_num = I2C_MASTER_SCL_IO,
+        .sda_io_num = I2C_MASTER_SDA_IO,
+        .glitch_ignore_cnt = 7,
+        .flags.enable_internal_pullup = true,
+    };
+
+    esp_err_t err = i2c_new_master_bus(&i2c_mst_config, &i2c_bus_handle);
+    if (err != ESP_OK) return err;
+
+    // At the speed negotiated by the last probe
+    for (uint8_t i = 0; i < SENSORS_DEVICES; i++) {
+        uint32_t scl_speed_hz = sensors_devices[i].scl_speed_hz ? sensors_devices[i].scl_speed_hz : sensors_drivers[i].scl_speed_hz;
+        err = sensors_add_device(i, scl_speed_hz);
+        if (err != ESP_OK) return err;
+    }
+
+    // Let the sensors power up
+    vTaskDelay(1 / portTICK_PERIOD_MS);
+
+    for (uint8_t i = 0; i < SENSORS_DEVICES; i++) {
+        if (!sensors_devices[i].probed) {
+            sensors_probe(i);
+        }
+    }
 
     return ESP_OK;
 }
 
-void _clear_buffers(uint8_t* buffer1, uint8_t* buffer2, size_t buffer1_size, size_t buffer2_size) {
-    memset(&buffer1, 0, buffer1_size);
-    memset(&buffer2, 0, buffer2_size);
+esp_err_t sensors_deinit(void)
+{
+    for (uint8_t i = 0; i < SENSORS_DEVICES; i++) {
+        if (sensors_devices[i].present && sensors_drivers[i].deinit) {
+            esp_err_t err = sensors_drivers[i].deinit(sensors_handles[i]);
+            if (err != ESP_OK) {
+                sensors_fail(i, "Deinit", err);
+            }
+        }
+
+        i2c_master_bus_rm_device(sensors_handles[i]);
+        sensors_handles[i] = NULL;
+    }
+
+    return i2c_del_master_bus(i2c_bus_handle);
 }
 
-void _i2c_error_check(uint8_t esp_result_code) {
+/**
+ * Triggers the conversions of the present devices in [devices] (bits of
+ * SENSORS_DEVICE_*) at once, then waits for and reads each of them. The bits
+ * of the devices that were read are cleared in skipped_devices. Other
+ * devices leave their fields untouched.
+*/
+esp_err_t sensors_read(struct sensor_data_t* measurement, uint8_t devices)
+{
+    int64_t triggered_us[SENSORS_DEVICES] = {0};
+
+    for (uint8_t i = 0; i < SENSORS_DEVICES; i++) {
+        if (!(devices & (1 << i)) || !sensors_devices[i].present || !sensors_drivers[i].trigger) continue;
+
+        esp_err_t err = sensors_drivers[i].trigger(sensors_handles[i]);
+        if (err != ESP_OK) {
+            sensors_fail(i, "Trigger", err);
+        }
+        triggered_us[i] = esp_timer_get_time();
+    }
+
+    for (uint8_t i = 0; i < SENSORS_DEVICES; i++) {
+        const struct sensors_driver_t* driver = &sensors_drivers[i];
+        if (!(devices & (1 << i)) || !sensors_devices[i].present || !driver->read) continue;
+
+        // Sleep through the remaining conversion time
+        int64_t conversion_us = driver->conversion_us ? driver->conversion_us() : driver->conversion_ms * 1000;
+        int64_t remaining_us = triggered_us[i] + conversion_us - esp_timer_get_time();
+        if (driver->trigger && remaining_us > 0) {
+            vTaskDelay(pdMS_TO_TICKS((remaining_us + 999) / 1000));
+        }
+
+        esp_err_t err = ESP_OK;
+        bool is_ready = driver->ready == NULL;
+        for (int waited_ms = 0; !is_ready && waited_ms <= SENSORS_READY_TIMEOUT_MS; waited_ms += SENSORS_READY_POLL_MS) {
+            err = driver->ready(sensors_handles[i], &is_ready);
+            if (err != ESP_OK) break;
+            if (!is_ready) vTaskDelay(pdMS_TO_TICKS(SENSORS_READY_POLL_MS));
+        }
+        if (err == ESP_OK && !is_ready) {
+            err = ESP_ERR_TIMEOUT;
+        }
 
-    if (esp_result_code != ESP_OK) {
-        ESP_LOGE("I2C", "Error: %i", esp_result_code);
-        sensors_deinit();
-        ESP_ERROR_CHECK(esp_result_code);
+        if (err == ESP_OK) {
+            err = driver->read(sensors_handles[i], measurement);
+        }
+        if (err != ESP_OK) {
+            sensors_fail(i, "Read", err);
+        } else {
+            measurement->skipped_devices &= ~(1 << i);
+        }
     }
-}
\ No newline at end of file
+
+    return ESP_OK;
+}
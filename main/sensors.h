@@ -8,11 +8,46 @@
 #define I2C_MASTER_SDA_IO                   GPIO_NUM_21    /*!< GPIO number used for I2C master data  */
 #define I2C_MASTER_NUM                      0              /*!< I2C master i2c port number, the number of i2c peripheral interfaces available will depend on the chip */
 #define I2C_MASTER_FREQ_HZ                  100000         /*!< I2C master clock frequency */
+#define I2C_MASTER_FAST_FREQ_HZ             400000         /*!< I2C fast mode clock frequency, used by devices that support it */
 #define I2C_MASTER_TX_BUF_DISABLE           0              /*!< I2C master doesn't need buffer */
 #define I2C_MASTER_RX_BUF_DISABLE           0              /*!< I2C master doesn't need buffer */
 #define I2C_MASTER_TIMEOUT_MS               1000
 
+/**
+ * Devices of the sensor driver registry
+*/
+#define SENSORS_DEVICE_SHT30    0
+#define SENSORS_DEVICE_BME280   1
+#define SENSORS_DEVICE_LTR390   2
+#define SENSORS_DEVICE_MAX17048 3
+#define SENSORS_DEVICES         4
+#define SENSORS_DEVICES_ALL     ((1 << SENSORS_DEVICES) - 1)
+
+/**
+ * What a record holds: a single sample or a statistic over an aggregation
+ * window
+*/
+#define SENSORS_KIND_SAMPLE 0
+#define SENSORS_KIND_MEAN   1
+#define SENSORS_KIND_MIN    2
+#define SENSORS_KIND_MAX    3
+#define SENSORS_KIND_STDDEV 4
+#define SENSORS_KINDS       5
+
+/**
+ * Readings of a record that are filtered and aggregated, in this order:
+ * temperature, temperature inside, humidity, pressure, daylight, uv, battery
+ * voltage, charge and charge rate
+*/
+#define SENSORS_READINGS 9
+
 struct sensor_data_t {
+    /**
+     * Monotonic per-station sequence number. Used by the data sink to
+     * acknowledge what it has stored.
+    */
+    uint32_t sequence;
+
     /**
      * Time of measurement as unix timestamp
     */
@@ -34,7 +69,7 @@ struct sensor_data_t {
     float humidity;
 
     /**
-     * Pressure in 
+     * Pressure in hPa
     */
     float pressure;
 
@@ -48,6 +83,18 @@ struct sensor_data_t {
     */
     uint16_t uv;
 
+    /**
+     * SENSORS_KIND_*. Statistics carry the start of their window as
+     * timestamp.
+    */
+    uint8_t kind;
+
+    /**
+     * Devices whose readings the record does not hold, bit
+     * SENSORS_DEVICE_*. Their fields keep the last reading.
+    */
+    uint8_t skipped_devices;
+
     /**
      * Battery voltage in V
     */
@@ -66,12 +113,6 @@ struct sensor_data_t {
 
 esp_err_t sensors_init(void);
 esp_err_t sensors_deinit(void);
-esp_err_t sensors_read_temperature_and_humidity_outside(struct sensor_data_t* measurement);
-esp_err_t sensors_read_temperature_and_pressure_inside(struct sensor_data_t* measurement);
-esp_err_t sensors_read_daylight_and_uv(struct sensor_data_t * measurement);
-esp_err_t sensors_read_battery_status(struct sensor_data_t * measurement);
-
-void _clear_buffers(uint8_t* buffer1, uint8_t* buffer2, size_t buffer1_size, size_t buffer2_size);
-void _i2c_error_check(uint8_t esp_result_code);
+esp_err_t sensors_read(struct sensor_data_t* measurement, uint8_t devices);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,221 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "aggregator.h"
+#include "samples.h"
+
+#define TEST_RECORDS 10080         /*!< One week at the default measurement rate */
+#define TEST_MEASUREMENT_RATE 60
+#define TEST_SEED 1
+
+/**
+ * Deviation of the float statistics from the double reference, relative to
+ * the largest magnitude in the window
+*/
+#define TEST_EPSILON 1e-5
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+/**
+ * Aggregates [measurements] the way main.c does on every wake: a window
+ * whose last sample was missed is closed by the first sample of another
+ * window, otherwise a window is closed by its last sample. Writes the
+ * statistics into [records] and returns how many.
+*/
+static size_t test_aggregate(const struct sensor_data_t* measurements, size_t measurements_length, uint32_t measurement_rate, uint16_t window, struct sensor_data_t* records)
+{
+    struct aggregator_t aggregator;
+    size_t records_length = 0;
+
+    aggregator_reset(&aggregator);
+    for (size_t i = 0; i < measurements_length; i++) {
+        const struct sensor_data_t* sample = &measurements[i];
+
+        if (aggregator.count > 0 && !aggregator_is_in_window(&aggregator, sample->timestamp, window)) {
+            aggregator_finish(&aggregator, &records[records_length]);
+            records_length += AGGREGATOR_RECORDS;
+            aggregator_reset(&aggregator);
+        }
+
+        aggregator_add(&aggregator, sample, window);
+        if (!aggregator_is_in_window(&aggregator, sample->timestamp + measurement_rate, window)) {
+            aggregator_finish(&aggregator, &records[records_length]);
+            records_length += AGGREGATOR_RECORDS;
+            aggregator_reset(&aggregator);
+        }
+    }
+
+    return records_length;
+}
+
+/**
+ * Whether [actual] is [expected] within TEST_EPSILON of [magnitude].
+ * Daylight and uv are rounded to integers in the records.
+*/
+static bool test_close(float actual, double expected, double magnitude, uint8_t reading)
+{
+    if (reading == 4 || reading == 5) {
+        return fabs(actual - expected) <= 0.5 + TEST_EPSILON * magnitude;
+    }
+
+    return fabs(actual - expected) <= TEST_EPSILON * magnitude;
+}
+
+/**
+ * Compares [records] with a two-pass mean and sample standard deviation in
+ * double over the samples of every window. Checks that every window is
+ * aligned to a multiple of [window], closed once and holds mean, min, max
+ * and stddev in that order.
+*/
+static int test_compare(const struct sensor_data_t* measurements, size_t measurements_length, uint16_t window, const struct sensor_data_t* records, size_t records_length)
+{
+    static const uint8_t kinds[AGGREGATOR_RECORDS] = {SENSORS_KIND_MEAN, SENSORS_KIND_MIN, SENSORS_KIND_MAX, SENSORS_KIND_STDDEV};
+    size_t first = 0;
+    size_t r = 0;
+
+    while (first < measurements_length) {
+        uint32_t window_start = measurements[first].timestamp / window * window;
+        size_t end = first;
+        while (end < measurements_length && measurements[end].timestamp / window * window == window_start) {
+            end += 1;
+        }
+        size_t count = end - first;
+
+        if (r + AGGREGATOR_RECORDS > records_length) {
+            fprintf(stderr, "Window %" PRIu32 " was not closed\n", window_start);
+            return -1;
+        }
+
+        for (uint8_t k = 0; k < AGGREGATOR_RECORDS; k++) {
+            if (records[r + k].timestamp != window_start || records[r + k].kind != kinds[k]) {
+                fprintf(stderr, "Window %" PRIu32 " record %u: timestamp %" PRIu32 " kind %u\n", window_start, k, records[r + k].timestamp, records[r + k].kind);
+                return -1;
+            }
+        }
+
+        for (uint8_t reading = 0; reading < SENSORS_READINGS; reading++) {
+            double sum = 0;
+            double min = INFINITY;
+            double max = -INFINITY;
+            double magnitude = 0;
+
+            for (size_t i = first; i < end; i++) {
+                double value = aggregator_reading_get(&measurements[i], reading);
+                sum += value;
+                if (value < min) min = value;
+                if (value > max) max = value;
+                if (fabs(value) > magnitude) magnitude = fabs(value);
+            }
+
+            double mean = sum / count;
+            double squares = 0;
+            for (size_t i = first; i < end; i++) {
+                double difference = aggregator_reading_get(&measurements[i], reading) - mean;
+                squares += difference * difference;
+            }
+            double stddev = count > 1 ? sqrt(squares / (count - 1)) : 0;
+
+            if (!test_close(aggregator_reading_get(&records[r], reading), mean, magnitude, reading)
+                || !test_close(aggregator_reading_get(&records[r + 1], reading), min, magnitude, reading)
+                || !test_close(aggregator_reading_get(&records[r + 2], reading), max, magnitude, reading)
+                || !test_close(aggregator_reading_get(&records[r + 3], reading), stddev, magnitude, reading)) {
+                fprintf(stderr, "Window %" PRIu32 " reading %u: mean %f min %f max %f stddev %f, expected %f %f %f %f\n", window_start, reading,
+                    aggregator_reading_get(&records[r], reading), aggregator_reading_get(&records[r + 1], reading),
+                    aggregator_reading_get(&records[r + 2], reading), aggregator_reading_get(&records[r + 3], reading),
+                    mean, min, max, stddev);
+                return -1;
+            }
+        }
+
+        r += AGGREGATOR_RECORDS;
+        first = end;
+    }
+
+    if (r != records_length) {
+        fprintf(stderr, "%zu records more than windows\n", records_length - r);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_week(const char* name, const struct sensor_data_t* measurements, size_t measurements_length, uint32_t measurement_rate, uint16_t window)
+{
+    // At most one window per sample
+    struct sensor_data_t* records = calloc(measurements_length * AGGREGATOR_RECORDS, sizeof(struct sensor_data_t));
+    char label[64];
+
+    if (!records) {
+        return 1;
+    }
+
+    size_t records_length = test_aggregate(measurements, measurements_length, measurement_rate, window, records);
+    snprintf(label, sizeof(label), "%s, %zu windows of %us", name, records_length / AGGREGATOR_RECORDS, window);
+    int failures = test_check(label, test_compare(measurements, measurements_length, window, records, records_length) == 0);
+
+    free(records);
+    return failures;
+}
+
+int main(void)
+{
+    int failures = 0;
+    struct sensor_data_t* measurements = calloc(TEST_RECORDS, sizeof(struct sensor_data_t));
+    struct sensor_data_t* gaps = calloc(TEST_RECORDS, sizeof(struct sensor_data_t));
+
+    if (!measurements || !gaps) {
+        return 1;
+    }
+
+    // A synthetic week at the default window, hourly and at a rate the
+    // window is no multiple of
+    samples_generate(measurements, TEST_RECORDS, TEST_MEASUREMENT_RATE, TEST_SEED);
+    failures += test_week("synthetic week", measurements, TEST_RECORDS, TEST_MEASUREMENT_RATE, 600);
+    failures += test_week("synthetic week", measurements, TEST_RECORDS, TEST_MEASUREMENT_RATE, 3600);
+    failures += test_week("synthetic week, single samples", measurements, TEST_RECORDS, TEST_MEASUREMENT_RATE, TEST_MEASUREMENT_RATE);
+    samples_generate(measurements, TEST_RECORDS, 90, TEST_SEED);
+    failures += test_week("every 90s", measurements, TEST_RECORDS, 90, 600);
+
+    // Windows whose last sample was missed are closed by the next sample in
+    // another window. The week ends with a sample that closes its window.
+    samples_generate(measurements, TEST_RECORDS, TEST_MEASUREMENT_RATE, TEST_SEED);
+    size_t gaps_length = 0;
+    for (size_t i = 0; i < TEST_RECORDS; i++) {
+        if ((rand() % 4 != 0 && (i / 60) % 7 != 3) || i == TEST_RECORDS - 1) {
+            gaps[gaps_length++] = measurements[i];
+        }
+    }
+    failures += test_week("missed wakes and hours", gaps, gaps_length, TEST_MEASUREMENT_RATE, 600);
+
+    // Constant readings have no deviation, Welford does not drift off it
+    for (size_t i = 0; i < TEST_RECORDS; i++) {
+        measurements[i] = measurements[0];
+        measurements[i].sequence = 1 + i;
+        measurements[i].timestamp = measurements[0].timestamp + i * TEST_MEASUREMENT_RATE;
+    }
+    struct sensor_data_t records[AGGREGATOR_RECORDS];
+    struct aggregator_t aggregator;
+    aggregator_reset(&aggregator);
+    for (size_t i = 0; i < TEST_RECORDS; i++) {
+        aggregator_add(&aggregator, &measurements[i], UINT16_MAX);
+    }
+    aggregator_finish(&aggregator, records);
+    bool constant = true;
+    for (uint8_t reading = 0; reading < SENSORS_READINGS; reading++) {
+        constant = constant && aggregator_reading_get(&records[0], reading) == aggregator_reading_get(&measurements[0], reading)
+            && aggregator_reading_get(&records[3], reading) == 0;
+    }
+    failures += test_check("constant readings, zero deviation", constant);
+
+    free(measurements);
+    free(gaps);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_HAS_TSC 1
+#endif
+
+#include "bme280.h"
+
+#define BENCH_ROUNDS 10000000
+
+/**
+ * Compensation example of the datasheet (BST-BMP280-DS001, 3.12). The
+ * temperature and pressure trimming of the BME280 is the same.
+*/
+#define BENCH_ADC_T 519888
+#define BENCH_ADC_P 415148
+#define BENCH_T_FINE 128422
+#define BENCH_T 2508
+#define BENCH_P 100653
+
+static const uint8_t bench_calibration_t_p[BME280_CALIBRATION_T_P_SZ] = {
+    0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC, 0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B, 0x27, 0x0B,
+    0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6, 0x70, 0x17, 0x00, 0x4B
+};
+
+/**
+ * Humidity trimming of a production part, the datasheet has no example
+*/
+static const uint8_t bench_calibration_h[BME280_CALIBRATION_H_SZ] = {
+    0x6A, 0x01, 0x00, 0x13, 0x29, 0x03, 0x1E
+};
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long bench_cycles(void)
+{
+#ifdef BENCH_HAS_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Floating point compensation of the datasheet (8.1), the references for the
+ * whole input range
+*/
+static double bench_pressure_double(const struct bme280_calibration_t* c, int32_t adc_p, int32_t t_fine)
+{
+    double var1 = ((double) t_fine / 2.0) - 64000.0;
+    double var2 = var1 * var1 * ((double) c->dig_P6) / 32768.0;
+    var2 = var2 + var1 * ((double) c->dig_P5) * 2.0;
+    var2 = (var2 / 4.0) + (((double) c->dig_P4) * 65536.0);
+    var1 = (((double) c->dig_P3) * var1 * var1 / 524288.0 + ((double) c->dig_P2) * var1) / 524288.0;
+    var1 = (1.0 + var1 / 32768.0) * ((double) c->dig_P1);
+
+    double p = 1048576.0 - (double) adc_p;
+    p = (p - (var2 / 4096.0)) * 6250.0 / var1;
+    var1 = ((double) c->dig_P9) * p * p / 2147483648.0;
+    var2 = p * ((double) c->dig_P8) / 32768.0;
+
+    return p + (var1 + var2 + ((double) c->dig_P7)) / 16.0;
+}
+
+static double bench_humidity_double(const struct bme280_calibration_t* c, int32_t adc_h, int32_t t_fine)
+{
+    double var_h = ((double) t_fine) - 76800.0;
+    var_h = (adc_h - (((double) c->dig_H4) * 64.0 + ((double) c->dig_H5) / 16384.0 * var_h))
+        * (((double) c->dig_H2) / 65536.0 * (1.0 + ((double) c->dig_H6) / 67108864.0 * var_h * (1.0 + ((double) c->dig_H3) / 67108864.0 * var_h)));
+    var_h = var_h * (1.0 - ((double) c->dig_H1) * var_h / 524288.0);
+
+    if (var_h > 100.0) return 100.0;
+    if (var_h < 0.0) return 0.0;
+    return var_h;
+}
+
+static int bench_check(const char* name, long long actual, long long expected)
+{
+    printf("%-12s %12lld  expected %12lld  %s\n", name, actual, expected, actual == expected ? "ok" : "MISMATCH");
+    return actual == expected ? 0 : 1;
+}
+
+int main(void)
+{
+    struct bme280_calibration_t calibration;
+    int failures = 0;
+    int32_t t_fine = 0;
+
+    bme280_parse_calibration(bench_calibration_t_p, bench_calibration_h, &calibration);
+
+    // Datasheet vectors
+    failures += bench_check("dig_T1", calibration.dig_T1, 27504);
+    failures += bench_check("dig_P2", calibration.dig_P2, -10685);
+    failures += bench_check("dig_P9", calibration.dig_P9, 6000);
+    failures += bench_check("temperature", bme280_compensate_temperature(&calibration, BENCH_ADC_T, &t_fine), BENCH_T);
+    failures += bench_check("t_fine", t_fine, BENCH_T_FINE);
+    failures += bench_check("pressure", bme280_compensate_pressure(&calibration, BENCH_ADC_P, t_fine) / 256, BENCH_P);
+
+    // Maximum measurement times (datasheet 9.1): weather monitoring, all 16x
+    // and temperature alone
+    failures += bench_check("t_meas 1x", bme280_measurement_time_us(BME280_OVERSAMPLING_1X, BME280_OVERSAMPLING_1X, BME280_OVERSAMPLING_1X), 9300);
+    failures += bench_check("t_meas 16x", bme280_measurement_time_us(BME280_OVERSAMPLING_16X, BME280_OVERSAMPLING_16X, BME280_OVERSAMPLING_16X), 112800);
+    failures += bench_check("t_meas T", bme280_measurement_time_us(BME280_OVERSAMPLING_1X, BME280_OVERSAMPLING_SKIPPED, BME280_OVERSAMPLING_SKIPPED), 3550);
+
+    // Pressure against the floating point reference from 300 to 1100 hPa
+    double pressure_error_max = 0;
+    for (int32_t adc_p = 200000; adc_p <= 700000; adc_p += 97) {
+        for (int32_t t = -4000; t <= 8500; t += 500) {
+            int32_t pressure_t_fine = (t * 256 - 128) / 5;
+            double expected = bench_pressure_double(&calibration, adc_p, pressure_t_fine);
+            if (expected < 30000 || expected > 110000) continue;
+            double actual = bme280_compensate_pressure(&calibration, adc_p, pressure_t_fine) / 256.0;
+            double error = actual > expected ? actual - expected : expected - actual;
+            if (error > pressure_error_max) pressure_error_max = error;
+        }
+    }
+    printf("%-12s max deviation from floating point %.4f Pa  %s\n", "pressure", pressure_error_max, pressure_error_max < 1.0 ? "ok" : "MISMATCH");
+    failures += pressure_error_max < 1.0 ? 0 : 1;
+
+    // Humidity against the floating point reference over the whole range
+    double humidity_error_max = 0;
+    for (int32_t adc_h = 0; adc_h <= 0xFFFF; adc_h += 7) {
+        for (int32_t t = -4000; t <= 8500; t += 500) {
+            int32_t humidity_t_fine = (t * 256 - 128) / 5;
+            double expected = bench_humidity_double(&calibration, adc_h, humidity_t_fine);
+            double actual = bme280_compensate_humidity(&calibration, adc_h, humidity_t_fine) / 1024.0;
+            double error = actual > expected ? actual - expected : expected - actual;
+            if (error > humidity_error_max) humidity_error_max = error;
+        }
+    }
+    printf("%-12s max deviation from floating point %.4f %%RH  %s\n", "humidity", humidity_error_max, humidity_error_max < 0.01 ? "ok" : "MISMATCH");
+    failures += humidity_error_max < 0.01 ? 0 : 1;
+
+    // Cost of one compensation of all three readings
+    volatile int32_t adc_t = BENCH_ADC_T;
+    volatile int32_t adc_p = BENCH_ADC_P;
+    volatile int32_t adc_h = 30000;
+    uint64_t sink = 0;
+    double started_ns = bench_now_ns();
+    unsigned long long started_cycles = bench_cycles();
+
+    for (int i = 0; i < BENCH_ROUNDS; i++) {
+        int32_t fine;
+        sink += bme280_compensate_temperature(&calibration, adc_t + (i & 0xFF), &fine);
+        sink += bme280_compensate_pressure(&calibration, adc_p + (i & 0xFF), fine);
+        sink += bme280_compensate_humidity(&calibration, adc_h + (i & 0xFF), fine);
+    }
+
+    double elapsed_ns = bench_now_ns() - started_ns;
+    unsigned long long elapsed_cycles = bench_cycles() - started_cycles;
+    printf("compensation %.1f ns", elapsed_ns / BENCH_ROUNDS);
+    if (elapsed_cycles) {
+        printf(", %.0f cycles", (double) elapsed_cycles / BENCH_ROUNDS);
+    }
+    printf(" per reading (checksum %llu)\n", (unsigned long long) sink);
+
+    return failures ? 1 : 0;
+}
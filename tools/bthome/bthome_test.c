@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <openssl/evp.h>
+
+#include "bthome.h"
+
+#define TEST_SEED 1
+#define TEST_RANDOM_MEASUREMENTS 100000
+
+#define TEST_OBJECTS 8
+
+/**
+ * Object ids and value sizes of the BTHome v2 spec, independent of bthome.c
+*/
+static const struct {
+    uint8_t id;
+    uint8_t size;
+    bool is_signed;
+    double factor;
+} test_objects[TEST_OBJECTS] = {
+    { 0x00, 1, false, 1 },      // packet id
+    { 0x01, 1, false, 1 },      // battery %
+    { 0x02, 2, true, 100 },     // temperature 0.01 °C
+    { 0x03, 2, false, 100 },    // humidity 0.01 %
+    { 0x04, 3, false, 100 },    // pressure 0.01 hPa
+    { 0x05, 3, false, 100 },    // illuminance 0.01 lux
+    { 0x0C, 2, false, 1000 },   // voltage mV
+    { 0x46, 1, false, 10 },     // uv index 0.1
+};
+
+static const uint8_t test_key[BTHOME_KEY_SZ] = {
+    0x23, 0x1d, 0x39, 0xc1, 0xd7, 0xcc, 0x1a, 0xb1, 0xae, 0xe2, 0x24, 0xcd, 0x09, 0x6d, 0xb9, 0x32
+};
+static const uint8_t test_mac[BTHOME_MAC_SZ] = { 0x54, 0x48, 0xE6, 0x8F, 0x80, 0xA5 };
+
+/**
+ * Decrypts and authenticates BTHome objects with a nonce built as the spec
+ * describes: mac, uuid, device info and counter as sent
+*/
+static int test_decrypt(const uint8_t* mac, uint8_t device_info, const uint8_t* counter, const uint8_t* cipher, size_t cipher_length, const uint8_t* mic, uint8_t* plain)
+{
+    uint8_t nonce[13];
+    int length = 0;
+    int ok;
+
+    memcpy(&nonce[0], mac, BTHOME_MAC_SZ);
+    nonce[6] = 0xD2;
+    nonce[7] = 0xFC;
+    nonce[8] = device_info;
+    memcpy(&nonce[9], counter, BTHOME_COUNTER_SZ);
+
+    EVP_CIPHER_CTX* evp = EVP_CIPHER_CTX_new();
+    ok = EVP_DecryptInit_ex(evp, EVP_aes_128_ccm(), NULL, NULL, NULL);
+    ok = ok && EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_SET_IVLEN, sizeof(nonce), NULL);
+    ok = ok && EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_SET_TAG, BTHOME_MIC_SZ, (void*) mic);
+    ok = ok && EVP_DecryptInit_ex(evp, NULL, NULL, test_key, nonce);
+    ok = ok && EVP_DecryptUpdate(evp, NULL, &length, NULL, cipher_length);
+    ok = ok && EVP_DecryptUpdate(evp, plain, &length, cipher, cipher_length) > 0;
+    EVP_CIPHER_CTX_free(evp);
+
+    return ok ? 0 : -1;
+}
+
+/**
+ * Expected value of an object, NAN if the reading has to be left out
+*/
+static double test_expected(const struct sensor_data_t* m, uint8_t object)
+{
+    double value;
+    double min = 0, max;
+
+    switch (object) {
+    case 0: return m->sequence & 0xFF;
+    case 1: value = m->battery_charge; max = 100; break;
+    case 2: value = m->temperature; min = INT16_MIN; max = INT16_MAX; break;
+    case 3: value = m->humidity; max = UINT16_MAX; break;
+    case 4: value = m->pressure; max = 0xFFFFFF; break;
+    case 5: value = m->daylight; max = 0xFFFFFF; break;
+    case 6: value = m->battery_voltage; max = UINT16_MAX; break;
+    default: value = m->uv; max = UINT8_MAX; break;
+    }
+
+    if (isnan(value)) {
+        return NAN;
+    }
+
+    value = round(value * test_objects[object].factor);
+    return value < min ? min : (value > max ? max : value);
+}
+
+/**
+ * Encodes [m] and checks the packet: size, header, counter and mic,
+ * objects in ascending id order with their spec sizes, the objects chosen
+ * by priority and their values. Returns the advertisement length, 0 on a
+ * mismatch.
+*/
+static size_t test_packet(const struct sensor_data_t* m, bool encrypted)
+{
+    uint8_t buffer[64];
+    uint8_t plain[BTHOME_SERVICE_DATA_MAX_SZ];
+    size_t written = 0;
+
+    memset(buffer, 0xEE, sizeof(buffer));
+    if (bthome_encode_service_data(buffer, BTHOME_SERVICE_DATA_MAX_SZ, m, encrypted ? test_key : NULL, test_mac, &written) != ESP_OK) {
+        return 0;
+    }
+
+    size_t advertisement_length = bthome_advertisement_length(written);
+    if (written > BTHOME_SERVICE_DATA_MAX_SZ || advertisement_length > BTHOME_ADV_MAX_SZ || buffer[BTHOME_SERVICE_DATA_MAX_SZ] != 0xEE) {
+        return 0;
+    }
+
+    if (buffer[0] != 0xD2 || buffer[1] != 0xFC || buffer[2] != (encrypted ? 0x41 : 0x40)) {
+        return 0;
+    }
+
+    const uint8_t* objects = &buffer[3];
+    size_t objects_length = written - 3;
+    if (encrypted) {
+        if (written < 3 + BTHOME_COUNTER_SZ + BTHOME_MIC_SZ) {
+            return 0;
+        }
+        objects_length -= BTHOME_COUNTER_SZ + BTHOME_MIC_SZ;
+        const uint8_t* counter = &buffer[3 + objects_length];
+        const uint8_t* mic = counter + BTHOME_COUNTER_SZ;
+        uint32_t sequence = counter[0] | (counter[1] << 8) | (counter[2] << 16) | ((uint32_t) counter[3] << 24);
+        if (sequence != m->sequence || test_decrypt(test_mac, buffer[2], counter, objects, objects_length, mic, plain) != 0) {
+            return 0;
+        }
+        objects = plain;
+    }
+
+    // Objects in ascending id order with the sizes of the spec
+    bool seen[TEST_OBJECTS] = { false };
+    int last_id = -1;
+    for (size_t i = 0; i < objects_length;) {
+        uint8_t id = objects[i++];
+        int object = -1;
+        for (int o = 0; o < TEST_OBJECTS; o++) {
+            if (test_objects[o].id == id) object = o;
+        }
+        if (object < 0 || id <= last_id || i + test_objects[object].size > objects_length) {
+            return 0;
+        }
+        last_id = id;
+        seen[object] = true;
+
+        int64_t value = 0;
+        for (uint8_t b = 0; b < test_objects[object].size; b++) {
+            value |= (int64_t) objects[i++] << (8 * b);
+        }
+        if (test_objects[object].is_signed && (value & ((int64_t) 1 << (8 * test_objects[object].size - 1)))) {
+            value -= (int64_t) 1 << (8 * test_objects[object].size);
+        }
+
+        // Rounding of the float product may differ by one
+        double expected = test_expected(m, object);
+        if (isnan(expected) || fabs(value - expected) > 1) {
+            return 0;
+        }
+    }
+
+    // Priority: packet id, temperature, humidity, battery, pressure, then illuminance, uv and voltage if unencrypted
+    const uint8_t priorities[TEST_OBJECTS] = { 0, 3, 1, 2, 4, 5, 7, 6 };
+    size_t budget = encrypted ? 15 : 23;
+    size_t used = 0;
+    for (uint8_t p = 0; p < TEST_OBJECTS; p++) {
+        for (int o = 0; o < TEST_OBJECTS; o++) {
+            if (priorities[o] != p) continue;
+            bool fits = !isnan(test_expected(m, o)) && used + 1 + test_objects[o].size <= budget;
+            if (fits != seen[o]) {
+                return 0;
+            }
+            if (fits) used += 1 + test_objects[o].size;
+        }
+    }
+
+    return advertisement_length;
+}
+
+static float test_uniform(float min, float max)
+{
+    return min + (max - min) * ((float) rand() / RAND_MAX);
+}
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+int main(void)
+{
+    int failures = 0;
+    srand(TEST_SEED);
+
+    // The CCM backing the test against the example of the BTHome spec
+    const uint8_t example_plain[] = { 0x02, 0xCA, 0x09, 0x03, 0xBF, 0x13 };
+    const uint8_t example_cipher[] = { 0xA4, 0x72, 0x66, 0xC9, 0x5F, 0x73 };
+    const uint8_t example_counter[] = { 0x00, 0x11, 0x22, 0x33 };
+    const uint8_t example_mic[] = { 0x78, 0x23, 0x72, 0x14 };
+    uint8_t decrypted[sizeof(example_plain)];
+    failures += test_check("spec example decrypts",
+        test_decrypt(test_mac, 0x41, example_counter, example_cipher, sizeof(example_cipher), example_mic, decrypted) == 0
+        && memcmp(decrypted, example_plain, sizeof(example_plain)) == 0);
+
+    // Typical measurements fill the packet exactly
+    struct sensor_data_t typical = { .sequence = 1234, .temperature = 21.37f, .humidity = 48.2f, .pressure = 1013.25f, .daylight = 5400, .uv = 3, .battery_voltage = 3.91f, .battery_charge = 87.5f };
+    failures += test_check("typical, plain: 31 bytes, all 8 objects", test_packet(&typical, false) == BTHOME_ADV_MAX_SZ);
+    failures += test_check("typical, encrypted: 30 bytes, 5 objects", test_packet(&typical, true) == BTHOME_ADV_MAX_SZ - 1);
+
+    // Too small buffers are refused
+    uint8_t small[BTHOME_SERVICE_DATA_MAX_SZ - 1];
+    size_t written = 1;
+    failures += test_check("small buffer refused", bthome_encode_service_data(small, sizeof(small), &typical, NULL, test_mac, &written) != ESP_OK && written == 0);
+
+    // Extremes of every reading, one reading at a time and all at once
+    const float extremes[] = { 0, -0.0f, FLT_MAX, -FLT_MAX, INFINITY, -INFINITY, NAN, FLT_MIN, 1e9f, -1e9f };
+    int extreme_failures = 0;
+    for (size_t e = 0; e < sizeof(extremes) / sizeof(extremes[0]); e++) {
+        for (int field = -1; field < 5; field++) {
+            struct sensor_data_t m = typical;
+            float* fields[] = { &m.temperature, &m.humidity, &m.pressure, &m.battery_voltage, &m.battery_charge };
+            for (int f = 0; f < 5; f++) {
+                if (field < 0 || field == f) *fields[f] = extremes[e];
+            }
+            m.sequence = e % 2 ? UINT32_MAX : 0;
+            m.daylight = e % 2 ? UINT32_MAX : 0;
+            m.uv = e % 2 ? UINT16_MAX : 0;
+            extreme_failures += test_packet(&m, false) == 0;
+            extreme_failures += test_packet(&m, true) == 0;
+        }
+    }
+    failures += test_check("extremes, plain and encrypted", extreme_failures == 0);
+
+    // Random measurements over and beyond the sensor ranges
+    size_t longest[2] = { 0, 0 };
+    int random_failures = 0;
+    for (int i = 0; i < TEST_RANDOM_MEASUREMENTS; i++) {
+        struct sensor_data_t m = {
+            .sequence = (uint32_t) rand() * 2654435761u,
+            .temperature = test_uniform(-400, 400),
+            .humidity = test_uniform(-10, 110),
+            .pressure = test_uniform(0, 200000),
+            .daylight = (uint32_t) rand() * 7,
+            .uv = rand() % 300,
+            .battery_voltage = test_uniform(-1, 70),
+            .battery_charge = test_uniform(-10, 300),
+        };
+
+        for (int encrypted = 0; encrypted < 2; encrypted++) {
+            size_t length = test_packet(&m, encrypted);
+            random_failures += length == 0;
+            if (length > longest[encrypted]) longest[encrypted] = length;
+        }
+    }
+    char label[64];
+    snprintf(label, sizeof(label), "%d random, longest %zu/%zu bytes plain/encrypted", TEST_RANDOM_MEASUREMENTS, longest[0], longest[1]);
+    failures += test_check(label, random_failures == 0 && longest[0] <= BTHOME_ADV_MAX_SZ && longest[1] <= BTHOME_ADV_MAX_SZ);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,211 @@
+#include "cbor_decoder.h"
+
+#define CBOR_MAJOR_UINT 0
+#define CBOR_MAJOR_NEGATIVE_INT 1
+#define CBOR_MAJOR_ARRAY 4
+#define CBOR_MAJOR_MAP 5
+#define CBOR_MAJOR_SIMPLE 7
+
+#define CBOR_SIMPLE_NULL 22
+
+struct cbor_reader_t {
+    const uint8_t* buffer;
+    size_t length;
+    size_t offset;
+};
+
+/**
+ * Reads a data item head (RFC 8949): major type and argument. Indefinite
+ * lengths and floats are not part of the format and rejected.
+*/
+static int cbor_read_head(struct cbor_reader_t* reader, uint8_t* major_type, uint64_t* argument)
+{
+    if (reader->offset >= reader->length) {
+        return -1;
+    }
+
+    uint8_t initial = reader->buffer[reader->offset++];
+    uint8_t additional = initial & 0x1F;
+    size_t argument_length;
+
+    *major_type = initial >> 5;
+
+    if (additional < 24) {
+        *argument = additional;
+        return 0;
+    }
+
+    switch (additional) {
+    case 24: argument_length = 1; break;
+    case 25: argument_length = 2; break;
+    case 26: argument_length = 4; break;
+    case 27: argument_length = 8; break;
+    default: return -1;
+    }
+
+    if (*major_type == CBOR_MAJOR_SIMPLE || reader->length - reader->offset < argument_length) {
+        return -1;
+    }
+
+    *argument = 0;
+    for (size_t i = 0; i < argument_length; i++) {
+        *argument = (*argument << 8) | reader->buffer[reader->offset++];
+    }
+
+    return 0;
+}
+
+/**
+ * Reads an unsigned integer no larger than [max]
+*/
+static int cbor_read_uint(struct cbor_reader_t* reader, uint64_t max, uint64_t* value)
+{
+    uint8_t major_type;
+
+    if (cbor_read_head(reader, &major_type, value) != 0 || major_type != CBOR_MAJOR_UINT || *value > max) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads the head of an array of [length] items
+*/
+static int cbor_read_array(struct cbor_reader_t* reader, uint64_t* length)
+{
+    uint8_t major_type;
+
+    if (cbor_read_head(reader, &major_type, length) != 0 || major_type != CBOR_MAJOR_ARRAY) {
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Reads an integer or null. Integers beyond int64_t are rejected.
+*/
+static int cbor_read_value(struct cbor_reader_t* reader, int64_t* value, bool* present)
+{
+    uint8_t major_type;
+    uint64_t argument;
+
+    if (cbor_read_head(reader, &major_type, &argument) != 0) {
+        return -1;
+    }
+
+    switch (major_type) {
+    case CBOR_MAJOR_UINT:
+        if (argument > INT64_MAX) return -1;
+        *value = (int64_t) argument;
+        *present = true;
+        return 0;
+    case CBOR_MAJOR_NEGATIVE_INT:
+        if (argument > INT64_MAX) return -1;
+        *value = -1 - (int64_t) argument;
+        *present = true;
+        return 0;
+    case CBOR_MAJOR_SIMPLE:
+        if (argument != CBOR_SIMPLE_NULL) return -1;
+        *value = 0;
+        *present = false;
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+/**
+ * Reference decoder for FORMATTER_FORMAT_CBOR. Decodes [buffer] into one
+ * array of [columns_capacity] integers per field id, values are in the units
+ * documented at the FORMATTER_FIELD_* ids. [present] is false where a record
+ * holds null, for readings of skipped devices.
+ *
+ * Records may list the fields in any order, the field ids have to come
+ * before the records. Fields a record does not list are absent.
+ *
+ * An empty buffer holds no records. Returns 0 on success, -1 if the buffer
+ * is malformed, truncated, of another schema version or holds more than
+ * [columns_capacity] records.
+*/
+int cbor_decode(const uint8_t* buffer, size_t buffer_length, int64_t* columns[FORMATTER_FIELDS], bool* present[FORMATTER_FIELDS], size_t columns_capacity, size_t* records_length)
+{
+    struct cbor_reader_t reader = { buffer, buffer_length, 0 };
+    uint8_t major_type;
+    uint64_t map_length;
+    uint8_t fields[FORMATTER_FIELDS];
+    uint64_t fields_length = 0;
+    bool has_version = false, has_fields = false, has_records = false;
+
+    *records_length = 0;
+
+    if (buffer_length == 0) {
+        return 0;
+    }
+
+    if (cbor_read_head(&reader, &major_type, &map_length) != 0 || major_type != CBOR_MAJOR_MAP) {
+        return -1;
+    }
+
+    for (uint64_t entry = 0; entry < map_length; entry++) {
+        uint64_t key;
+
+        if (cbor_read_uint(&reader, UINT8_MAX, &key) != 0) {
+            return -1;
+        }
+
+        if (key == 0 && !has_version) {
+            uint64_t version;
+            if (cbor_read_uint(&reader, UINT32_MAX, &version) != 0 || version != FORMATTER_CBOR_SCHEMA_VERSION) {
+                return -1;
+            }
+            has_version = true;
+        } else if (key == 1 && !has_fields) {
+            bool listed[FORMATTER_FIELDS] = { false };
+            if (cbor_read_array(&reader, &fields_length) != 0 || fields_length > FORMATTER_FIELDS) {
+                return -1;
+            }
+            for (uint64_t i = 0; i < fields_length; i++) {
+                uint64_t field;
+                if (cbor_read_uint(&reader, FORMATTER_FIELDS - 1, &field) != 0 || listed[field]) {
+                    return -1;
+                }
+                listed[field] = true;
+                fields[i] = field;
+            }
+            has_fields = true;
+        } else if (key == 2 && has_fields && !has_records) {
+            uint64_t count;
+            if (cbor_read_array(&reader, &count) != 0 || count > columns_capacity) {
+                return -1;
+            }
+            for (uint64_t i = 0; i < count; i++) {
+                uint64_t record_length;
+                if (cbor_read_array(&reader, &record_length) != 0 || record_length != fields_length) {
+                    return -1;
+                }
+                for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+                    columns[field][i] = 0;
+                    present[field][i] = false;
+                }
+                for (uint64_t column = 0; column < fields_length; column++) {
+                    if (cbor_read_value(&reader, &columns[fields[column]][i], &present[fields[column]][i]) != 0) {
+                        return -1;
+                    }
+                }
+            }
+            *records_length = count;
+            has_records = true;
+        } else {
+            return -1;
+        }
+    }
+
+    if (!has_version || !has_records || reader.offset != reader.length) {
+        *records_length = 0;
+        return -1;
+    }
+
+    return 0;
+}
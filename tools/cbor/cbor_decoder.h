@@ -0,0 +1,11 @@
+#ifndef __WEATHER_STATION__CBOR_DECODER_H__
+#define __WEATHER_STATION__CBOR_DECODER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "formatter.h"
+
+int cbor_decode(const uint8_t* buffer, size_t buffer_length, int64_t* columns[FORMATTER_FIELDS], bool* present[FORMATTER_FIELDS], size_t columns_capacity, size_t* records_length);
+
+#endif
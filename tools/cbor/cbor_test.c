@@ -0,0 +1,195 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "formatter.h"
+#include "samples.h"
+#include "cbor_decoder.h"
+
+#define TEST_RECORDS 10080         /*!< One week at the default measurement rate */
+#define TEST_MEASUREMENT_RATE 60
+#define TEST_SEED 1
+#define TEST_BUFFER_SZ (1 << 20)
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+/**
+ * Device of every field id, -1 for fields every record holds. Kept apart
+ * from the formatter's table so the nulls are checked independently.
+*/
+static const int test_field_devices[FORMATTER_FIELDS] = {
+    -1, -1,
+    SENSORS_DEVICE_SHT30, SENSORS_DEVICE_BME280, SENSORS_DEVICE_SHT30, SENSORS_DEVICE_BME280,
+    SENSORS_DEVICE_LTR390, SENSORS_DEVICE_LTR390,
+    SENSORS_DEVICE_MAX17048, SENSORS_DEVICE_MAX17048, SENSORS_DEVICE_MAX17048,
+    -1, -1,
+};
+
+/**
+ * Encodes [measurements] in batches of [batch_length], decodes them again
+ * and compares every field with the formatter's scaled value, and every null
+ * with the skipped devices
+*/
+static int test_round_trip(struct sensor_data_t* measurements, size_t measurements_length, size_t batch_length, uint8_t* buffer, int64_t* columns[FORMATTER_FIELDS], bool* present[FORMATTER_FIELDS])
+{
+    const struct formatter_t* formatter = formatter_get(FORMATTER_FORMAT_CBOR);
+    struct formatter_options_t options = { false, "weather", "" };
+
+    for (size_t offset = 0; offset < measurements_length; offset += batch_length) {
+        size_t length = measurements_length - offset < batch_length ? measurements_length - offset : batch_length;
+        struct sensor_data_t* batch = &measurements[offset];
+        size_t written;
+        size_t decoded;
+
+        if (formatter_format(formatter, &options, buffer, TEST_BUFFER_SZ, batch, length, &written) != ESP_OK
+            || written > formatter->estimate(&options, length)
+            || cbor_decode(buffer, written, columns, present, measurements_length, &decoded) != 0
+            || decoded != length) {
+            fprintf(stderr, "Batch at %zu failed to encode or decode\n", offset);
+            return -1;
+        }
+
+        for (size_t i = 0; i < length; i++) {
+            for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+                int device = test_field_devices[field];
+                bool expected_present = device < 0 || !(batch[i].skipped_devices & (1 << device));
+                int64_t expected = expected_present ? formatter_field_value(&batch[i], field) : 0;
+                if (present[field][i] != expected_present || columns[field][i] != expected) {
+                    fprintf(stderr, "Mismatch in record %zu field %u: %lld, expected %lld\n", offset + i, field, (long long) columns[field][i], (long long) expected);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static float test_uniform(float min, float max)
+{
+    return min + (max - min) * ((float) rand() / RAND_MAX);
+}
+
+int main(void)
+{
+    int failures = 0;
+    size_t written;
+    size_t decoded;
+    struct formatter_options_t options = { false, "weather", "" };
+    const struct formatter_t* formatter = formatter_get(FORMATTER_FORMAT_CBOR);
+
+    struct sensor_data_t* measurements = (struct sensor_data_t*) calloc(TEST_RECORDS, sizeof(struct sensor_data_t));
+    uint8_t* buffer = (uint8_t*) malloc(TEST_BUFFER_SZ);
+    int64_t* columns[FORMATTER_FIELDS];
+    bool* present[FORMATTER_FIELDS];
+    for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+        columns[field] = (int64_t*) malloc(TEST_RECORDS * sizeof(int64_t));
+        present[field] = (bool*) malloc(TEST_RECORDS * sizeof(bool));
+        if (!columns[field] || !present[field]) return 1;
+    }
+    if (!measurements || !buffer) return 1;
+
+    srand(TEST_SEED);
+
+    // One record encoded by hand per RFC 8949: a mean with the LTR390
+    // skipped, a negative temperature and every head size
+    struct sensor_data_t single = {
+        .sequence = 1, .timestamp = 1717200000, .temperature = -0.25f, .temperature_inside = 21.5f,
+        .humidity = 48.5f, .pressure = 1013.25f, .daylight = 5400, .uv = 3,
+        .kind = SENSORS_KIND_MEAN, .skipped_devices = 1 << SENSORS_DEVICE_LTR390,
+        .battery_voltage = 3.9f, .battery_charge = 87.5f, .battery_charge_rate = -1.5f,
+    };
+    const uint8_t single_expected[] = {
+        0xA3,
+        0x00, 0x02,
+        0x01, 0x8D, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C,
+        0x02, 0x81, 0x8D,
+        0x01,                               // seq
+        0x1A, 0x66, 0x5A, 0x64, 0x80,       // time
+        0x38, 0x18,                         // temp -25
+        0x19, 0x08, 0x66,                   // temp_in 2150
+        0x19, 0x12, 0xF2,                   // humd 4850
+        0x1A, 0x00, 0x01, 0x8B, 0xCD,       // pres 101325
+        0xF6, 0xF6,                         // dayl, uv skipped
+        0x19, 0x0F, 0x3C,                   // volt 3900
+        0x19, 0x22, 0x2E,                   // chrg 8750
+        0x38, 0x95,                         // chrt -150
+        0x01,                               // kind
+        0x04,                               // skipped devices
+    };
+    failures += test_check("single record matches the hand encoding",
+        formatter_format(formatter, &options, buffer, TEST_BUFFER_SZ, &single, 1, &written) == ESP_OK
+        && written == sizeof(single_expected)
+        && memcmp(buffer, single_expected, written) == 0);
+    failures += test_check("single record decodes",
+        cbor_decode(single_expected, sizeof(single_expected), columns, present, 1, &decoded) == 0
+        && decoded == 1
+        && columns[FORMATTER_FIELD_TEMPERATURE][0] == -25 && columns[FORMATTER_FIELD_PRESSURE][0] == 101325
+        && !present[FORMATTER_FIELD_DAYLIGHT][0] && !present[FORMATTER_FIELD_UV][0]
+        && columns[FORMATTER_FIELD_KIND][0] == SENSORS_KIND_MEAN
+        && columns[FORMATTER_FIELD_SKIPPED_DEVICES][0] == 1 << SENSORS_DEVICE_LTR390);
+
+    // Empty batches are sent without a body
+    failures += test_check("empty batch",
+        formatter_format(formatter, &options, buffer, TEST_BUFFER_SZ, measurements, 0, &written) == ESP_OK
+        && written == 0
+        && cbor_decode(buffer, written, columns, present, TEST_RECORDS, &decoded) == 0
+        && decoded == 0);
+
+    // A synthetic week, every kind and every combination of skipped devices
+    samples_generate(measurements, TEST_RECORDS, TEST_MEASUREMENT_RATE, TEST_SEED);
+    for (size_t i = 0; i < TEST_RECORDS; i++) {
+        measurements[i].kind = i % 3 ? SENSORS_KIND_SAMPLE : rand() % SENSORS_KINDS;
+        measurements[i].skipped_devices = i % 2 ? 0 : rand() & SENSORS_DEVICES_ALL;
+    }
+    const size_t batch_lengths[] = { 1, 25, 100, 1000, TEST_RECORDS };
+    for (size_t b = 0; b < sizeof(batch_lengths) / sizeof(batch_lengths[0]); b++) {
+        char label[64];
+        snprintf(label, sizeof(label), "synthetic week, batches of %zu", batch_lengths[b]);
+        failures += test_check(label, test_round_trip(measurements, TEST_RECORDS, batch_lengths[b], buffer, columns, present) == 0);
+    }
+
+    // Random values over every head size and sign, and the extremes
+    const float extremes[] = { 0, -0.0f, 0.23f, -0.24f, -0.25f, 2.55f, -2.56f, 655.35f, -655.36f, FLT_MAX, -FLT_MAX, INFINITY, -INFINITY, NAN, FLT_TRUE_MIN };
+    for (size_t i = 0; i < TEST_RECORDS; i++) {
+        struct sensor_data_t* m = &measurements[i];
+        float* fields[] = { &m->temperature, &m->temperature_inside, &m->humidity, &m->pressure, &m->battery_voltage, &m->battery_charge, &m->battery_charge_rate };
+        for (size_t f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+            *fields[f] = rand() % 4 ? test_uniform(-1, 1) * powf(10, rand() % 8) : extremes[rand() % (sizeof(extremes) / sizeof(extremes[0]))];
+        }
+        m->sequence = rand() % 2 ? UINT32_MAX - i : (uint32_t) rand();
+        m->timestamp = rand() % 2 ? UINT32_MAX : (uint32_t) rand();
+        m->daylight = (uint32_t) rand() >> (rand() % 31);
+        m->uv = rand() % 2 ? UINT16_MAX : rand() % 300;
+        m->kind = rand() % SENSORS_KINDS;
+        m->skipped_devices = rand() & SENSORS_DEVICES_ALL;
+    }
+    failures += test_check("random and extreme values", test_round_trip(measurements, TEST_RECORDS, 100, buffer, columns, present) == 0);
+
+    // Truncated, padded and foreign batches are rejected
+    int rejected = 1;
+    if (formatter_format(formatter, &options, buffer, TEST_BUFFER_SZ, measurements, 25, &written) != ESP_OK) return 1;
+    for (size_t length = 1; length < written; length++) {
+        rejected &= cbor_decode(buffer, length, columns, present, TEST_RECORDS, &decoded) != 0;
+    }
+    rejected &= cbor_decode(buffer, written + 1, columns, present, TEST_RECORDS, &decoded) != 0;
+    rejected &= cbor_decode(buffer, written, columns, present, 24, &decoded) != 0;
+    buffer[2] = FORMATTER_CBOR_SCHEMA_VERSION + 1;
+    rejected &= cbor_decode(buffer, written, columns, present, TEST_RECORDS, &decoded) != 0;
+    failures += test_check("truncated, padded, too long and v3 batches rejected", rejected);
+
+    for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+        free(columns[field]);
+        free(present[field]);
+    }
+    free(measurements);
+    free(buffer);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,319 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coap_message.h"
+#include "formatter.h"
+#include "samples.h"
+
+#define TEST_BUFFER_SZ (COAP_MESSAGE_BLOCK_SZ + 256)
+#define TEST_OPTIONS_MAX 16
+#define TEST_BATCH_MEASUREMENTS 50
+#define TEST_PATH "/stations/garden/measurements"
+
+/**
+ * A message as read back by an independent decoder (RFC 7252 3)
+*/
+struct test_option_t {
+    uint16_t number;
+    const uint8_t* value;
+    size_t value_length;
+};
+
+struct test_message_t {
+    uint8_t version;
+    uint8_t type;
+    uint8_t code;
+    uint16_t message_id;
+    uint8_t token_length;
+    const uint8_t* token;
+    struct test_option_t options[TEST_OPTIONS_MAX];
+    size_t options_length;
+    const uint8_t* payload;
+    size_t payload_length;
+};
+
+/**
+ * Reads an extended option delta or length. Returns -1 on a malformed value.
+*/
+static long test_read_extended(uint8_t nibble, const uint8_t** cursor, const uint8_t* end)
+{
+    if (nibble < 13) {
+        return nibble;
+    }
+    if (nibble == 13) {
+        if (*cursor + 1 > end) return -1;
+        return 13 + *(*cursor)++;
+    }
+    if (nibble == 14) {
+        if (*cursor + 2 > end) return -1;
+        long value = 269 + (((*cursor)[0] << 8) | (*cursor)[1]);
+        *cursor += 2;
+        return value;
+    }
+    return -1;
+}
+
+static int test_decode(const uint8_t* message, size_t message_length, struct test_message_t* decoded)
+{
+    const uint8_t* cursor = message + 4;
+    const uint8_t* end = message + message_length;
+    uint16_t number = 0;
+
+    memset(decoded, 0, sizeof(*decoded));
+    if (message_length < 4) {
+        return -1;
+    }
+
+    decoded->version = message[0] >> 6;
+    decoded->type = (message[0] >> 4) & 0x03;
+    decoded->token_length = message[0] & 0x0F;
+    decoded->code = message[1];
+    decoded->message_id = (message[2] << 8) | message[3];
+    decoded->token = cursor;
+    if (decoded->token_length > 8 || cursor + decoded->token_length > end) {
+        return -1;
+    }
+    cursor += decoded->token_length;
+
+    while (cursor < end && *cursor != COAP_MESSAGE_PAYLOAD_MARKER) {
+        uint8_t first = *cursor++;
+        long delta = test_read_extended(first >> 4, &cursor, end);
+        long length = test_read_extended(first & 0x0F, &cursor, end);
+
+        if (delta < 0 || length < 0 || cursor + length > end || decoded->options_length == TEST_OPTIONS_MAX) {
+            return -1;
+        }
+
+        number += delta;
+        decoded->options[decoded->options_length++] = (struct test_option_t) { number, cursor, (size_t) length };
+        cursor += length;
+    }
+
+    // A payload marker has to be followed by payload
+    if (cursor < end) {
+        cursor++;
+        if (cursor == end) {
+            return -1;
+        }
+        decoded->payload = cursor;
+        decoded->payload_length = end - cursor;
+    }
+
+    return 0;
+}
+
+static const struct test_option_t* test_find_option(const struct test_message_t* decoded, uint16_t number)
+{
+    for (size_t i = 0; i < decoded->options_length; i++) {
+        if (decoded->options[i].number == number) {
+            return &decoded->options[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t test_option_uint(const struct test_option_t* option)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < option->value_length; i++) {
+        value = (value << 8) | option->value[i];
+    }
+    return value;
+}
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-44s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+/**
+ * Encodes options with every delta and length form and compares the bytes
+*/
+static int test_options(void)
+{
+    uint8_t buffer[2048];
+    uint8_t value[1024];
+    int failures = 0;
+
+    memset(value, 'v', sizeof(value));
+
+    // Uri-Path "temp", then Content-Format 42 with delta 1, then Block1 with delta 15
+    uint16_t last_number = 0;
+    size_t length = coap_message_put_option(buffer, 0, sizeof(buffer), &last_number, COAP_MESSAGE_OPTION_URI_PATH, (const uint8_t*) "temp", 4);
+    uint8_t format = COAP_MESSAGE_CONTENT_FORMAT_OCTET_STREAM;
+    length = coap_message_put_option(buffer, length, sizeof(buffer), &last_number, COAP_MESSAGE_OPTION_CONTENT_FORMAT, &format, 1);
+    uint8_t block = 0x0D;
+    length = coap_message_put_option(buffer, length, sizeof(buffer), &last_number, COAP_MESSAGE_OPTION_BLOCK1, &block, 1);
+    const uint8_t expected[] = { 0xB4, 't', 'e', 'm', 'p', 0x11, 0x2A, 0xD1, 0x02, 0x0D };
+    failures += test_check("options: uri-path, content-format, block1", length == sizeof(expected) && memcmp(buffer, expected, length) == 0);
+
+    // Deltas and lengths at the boundaries of the 4 bit, 1 byte and 2 byte forms
+    const uint16_t deltas[] = { 0, 12, 13, 268, 269, 1000 };
+    const size_t lengths[] = { 0, 12, 13, 268, 269, 1000 };
+    const size_t header_lengths[] = { 1, 1, 2, 2, 3, 3 };
+    int form_failures = 0;
+    for (size_t d = 0; d < sizeof(deltas) / sizeof(deltas[0]); d++) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            struct test_message_t decoded;
+            uint8_t message[2048] = { 0x40, COAP_MESSAGE_CODE_POST, 0, 0 };
+
+            last_number = 100;
+            length = coap_message_put_option(message, 4, sizeof(message), &last_number, 100 + deltas[d], value, lengths[l]);
+            size_t expected_length = 4 + header_lengths[d] + header_lengths[l] - 1 + lengths[l];
+
+            if (length != expected_length || last_number != 100 + deltas[d]) {
+                form_failures++;
+                continue;
+            }
+
+            // The decoder starts at number 0, so it reads the delta back
+            if (test_decode(message, length, &decoded) != 0 || decoded.options_length != 1
+                || decoded.options[0].number != deltas[d] || decoded.options[0].value_length != lengths[l]) {
+                form_failures++;
+            }
+        }
+    }
+    failures += test_check("options: every delta and length form", form_failures == 0);
+
+    last_number = COAP_MESSAGE_OPTION_BLOCK1;
+    failures += test_check("options: descending number rejected", coap_message_put_option(buffer, 0, sizeof(buffer), &last_number, COAP_MESSAGE_OPTION_URI_PATH, value, 1) == 0 && last_number == COAP_MESSAGE_OPTION_BLOCK1);
+
+    last_number = 0;
+    failures += test_check("options: overflowing capacity rejected", coap_message_put_option(buffer, 8, 20, &last_number, COAP_MESSAGE_OPTION_URI_PATH, value, 12) == 0 && last_number == 0);
+
+    return failures;
+}
+
+/**
+ * Sends [payload] block by block as the pusher does, decodes every message
+ * and checks header, options, the Block1 sequence and the reassembled payload
+*/
+static int test_blocks(const char* name, const uint8_t* payload, size_t payload_length)
+{
+    uint8_t buffer[TEST_BUFFER_SZ];
+    uint8_t* reassembled = malloc(payload_length + 1);
+    const uint8_t token[COAP_MESSAGE_TOKEN_SZ] = { 0x5A, 0xA5 };
+    struct coap_message_block_t block;
+    size_t reassembled_length = 0;
+    uint32_t blocks = 0;
+    bool last_more = true;
+    int failed = 0;
+
+    for (uint32_t number = 0; coap_message_next_block(payload_length, number, &block) && !failed; number++) {
+        struct test_message_t decoded;
+        uint16_t message_id = 0xFFFE + number;
+        size_t length = coap_message_build_post(buffer, sizeof(buffer), message_id, token, TEST_PATH, &block, payload);
+
+        if (length == 0 || length > sizeof(buffer) || test_decode(buffer, length, &decoded) != 0) {
+            failed = 1;
+            break;
+        }
+
+        // Header, token and the path as one option per segment
+        const char* segments[] = { "stations", "garden", "measurements" };
+        failed |= decoded.version != 1 || decoded.type != COAP_MESSAGE_TYPE_CON || decoded.code != COAP_MESSAGE_CODE_POST;
+        failed |= decoded.message_id != message_id || decoded.token_length != COAP_MESSAGE_TOKEN_SZ || memcmp(decoded.token, token, COAP_MESSAGE_TOKEN_SZ) != 0;
+        failed |= decoded.options_length < 4;
+        for (size_t i = 0; i < 3 && !failed; i++) {
+            failed |= decoded.options[i].number != COAP_MESSAGE_OPTION_URI_PATH
+                || decoded.options[i].value_length != strlen(segments[i])
+                || memcmp(decoded.options[i].value, segments[i], strlen(segments[i])) != 0;
+        }
+        const struct test_option_t* format = test_find_option(&decoded, COAP_MESSAGE_OPTION_CONTENT_FORMAT);
+        failed |= !format || test_option_uint(format) != COAP_MESSAGE_CONTENT_FORMAT_OCTET_STREAM;
+
+        // Block1 only for payloads beyond one block, numbered in order, M on all but the last
+        const struct test_option_t* block1 = test_find_option(&decoded, COAP_MESSAGE_OPTION_BLOCK1);
+        if (payload_length > COAP_MESSAGE_BLOCK_SZ) {
+            uint32_t value = block1 ? test_option_uint(block1) : 0;
+            failed |= !block1 || block1->value_length > 3 || (value >> 4) != number || (value & 0x07) != COAP_MESSAGE_BLOCK_SZX;
+            last_more = (value & 0x08) != 0;
+            // Every block but the last one is full
+            failed |= last_more && decoded.payload_length != COAP_MESSAGE_BLOCK_SZ;
+        } else {
+            failed |= block1 != NULL;
+            last_more = false;
+        }
+
+        if (!failed && decoded.payload_length) {
+            memcpy(reassembled + reassembled_length, decoded.payload, decoded.payload_length);
+            reassembled_length += decoded.payload_length;
+        }
+        blocks++;
+    }
+
+    failed |= last_more || reassembled_length != payload_length || memcmp(reassembled, payload, payload_length) != 0;
+    failed |= blocks != (payload_length == 0 ? 1 : (payload_length + COAP_MESSAGE_BLOCK_SZ - 1) / COAP_MESSAGE_BLOCK_SZ);
+
+    char label[64];
+    snprintf(label, sizeof(label), "blocks: %s, %zu bytes in %u", name, payload_length, blocks);
+    free(reassembled);
+    return test_check(label, !failed);
+}
+
+/**
+ * The Block1 value takes 1, 2 or 3 bytes depending on the block number
+*/
+static int test_block_numbers(void)
+{
+    const uint32_t numbers[] = { 0, 15, 16, 4095, 4096, 0xFFFFF };
+    const size_t value_lengths[] = { 1, 1, 2, 2, 3, 3 };
+    const uint8_t token[COAP_MESSAGE_TOKEN_SZ] = { 0, 0 };
+    uint8_t payload[COAP_MESSAGE_BLOCK_SZ] = { 0 };
+    uint8_t buffer[TEST_BUFFER_SZ];
+    int failed = 0;
+
+    for (size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); i++) {
+        struct coap_message_block_t block = { numbers[i], 0, sizeof(payload), true, true };
+        struct test_message_t decoded;
+        size_t length = coap_message_build_post(buffer, sizeof(buffer), 1, token, "m", &block, payload);
+        const struct test_option_t* block1 = length && test_decode(buffer, length, &decoded) == 0 ? test_find_option(&decoded, COAP_MESSAGE_OPTION_BLOCK1) : NULL;
+
+        failed |= !block1 || block1->value_length != value_lengths[i]
+            || test_option_uint(block1) != ((numbers[i] << 4) | 0x08 | COAP_MESSAGE_BLOCK_SZX);
+    }
+
+    return test_check("blocks: block1 value forms", !failed);
+}
+
+int main(void)
+{
+    struct sensor_data_t measurements[TEST_BATCH_MEASUREMENTS];
+    uint8_t* payload = malloc(FORMATTER_BINARY_HEADER_SZ + TEST_BATCH_MEASUREMENTS * FORMATTER_BINARY_RECORD_SZ);
+    size_t payload_length = 0;
+    int failures = 0;
+
+    failures += test_options();
+    failures += test_block_numbers();
+
+    // Payloads around the block size, filled with payload markers and option bytes
+    const size_t lengths[] = { 0, 1, COAP_MESSAGE_BLOCK_SZ - 1, COAP_MESSAGE_BLOCK_SZ, COAP_MESSAGE_BLOCK_SZ + 1, 2 * COAP_MESSAGE_BLOCK_SZ, 2 * COAP_MESSAGE_BLOCK_SZ + 1 };
+    uint8_t* random = malloc(2 * COAP_MESSAGE_BLOCK_SZ + 1);
+    srand(1);
+    for (size_t i = 0; i < 2 * COAP_MESSAGE_BLOCK_SZ + 1; i++) {
+        random[i] = rand() % 3 == 0 ? COAP_MESSAGE_PAYLOAD_MARKER : rand() & 0xFF;
+    }
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        failures += test_blocks("random", random, lengths[i]);
+    }
+    free(random);
+
+    // A full batch as the pusher sends it
+    samples_generate(measurements, TEST_BATCH_MEASUREMENTS, 60, 1);
+    if (formatter_format_measurements_as_binary(payload, FORMATTER_BINARY_HEADER_SZ + TEST_BATCH_MEASUREMENTS * FORMATTER_BINARY_RECORD_SZ, measurements, TEST_BATCH_MEASUREMENTS, &payload_length) != ESP_OK) {
+        failures += test_check("blocks: binary batch formatted", 0);
+    } else {
+        failures += test_blocks("binary batch", payload, payload_length);
+    }
+    free(payload);
+
+    // The path has to fit next to the block
+    uint8_t buffer[64];
+    uint8_t token[COAP_MESSAGE_TOKEN_SZ] = { 0, 0 };
+    struct coap_message_block_t block = { 0, 0, 16, false, false };
+    failures += test_check("build: overflowing capacity rejected", coap_message_build_post(buffer, sizeof(buffer), 1, token, "/a/much/longer/path/than/the/buffer/holds/next/to/the/payload", &block, buffer) == 0);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,675 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "samples.h"
+#include "esp_timer.h"
+#include "coap_message.h"
+
+#include "pusher.h"
+
+#define TEST_SEED 1
+#define TEST_MEASUREMENT_RATE 60
+#define TEST_LOSSY_RECORDS 100
+#define TEST_BACKLOG_RECORDS 1440
+#define TEST_DATAGRAM_SZ 1500
+#define TEST_PAYLOAD_SZ 4096
+#define TEST_RECORDS_MAX 256
+#define TEST_HTTP_BUFFER_SZ 16384
+#define TEST_REPLY_SZ 32
+#define TEST_SENDS_MAX 8
+#define TEST_SEPARATE_DELAY_US 20000
+
+/**
+ * Response codes (RFC 7252 12.1.2, RFC 7959 2.9)
+*/
+#define TEST_CODE_CHANGED 0x44
+#define TEST_CODE_CONTINUE 0x5F
+#define TEST_CODE_BAD_REQUEST 0x80
+#define TEST_CODE_INCOMPLETE 0x88
+
+/**
+ * What the stand-in does with an exchange
+*/
+#define TEST_PIGGYBACKED 0          /*!< Answers in the ACK */
+#define TEST_DROP_REQUEST 1         /*!< Loses the first request, answers the retransmission */
+#define TEST_DROP_RESPONSE 2        /*!< Loses the ACK, sends it again for the retransmission */
+#define TEST_SEPARATE 3             /*!< Empty ACK, then a confirmable response */
+#define TEST_FOREIGN_TOKEN 4        /*!< A response with another token, an empty ACK, then a non-confirmable response */
+#define TEST_REPEAT_SEPARATE 5      /*!< Loses the request and repeats the last confirmable response instead */
+
+RTC_DATA_ATTR struct configuration_t configuration;
+struct energy_t energy;
+
+esp_err_t cfg_write(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t pusher_mqtt_push(const char* url, const struct formatter_t* formatter, const struct formatter_options_t* formatter_options, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+/**
+ * The parts of a message the stand-in looks at (RFC 7252 3, RFC 7959 2.2)
+*/
+struct test_message_t {
+    uint8_t type;
+    uint8_t code;
+    uint16_t message_id;
+    uint8_t token_length;
+    uint8_t token[8];
+    bool has_block;
+    uint32_t block_number;
+    bool block_more;
+    const uint8_t* payload;
+    size_t payload_length;
+};
+
+/**
+ * Reads an extended option delta or length. Returns -1 on a malformed value.
+*/
+static long test_read_extended(uint8_t nibble, const uint8_t** cursor, const uint8_t* end)
+{
+    if (nibble < 13) {
+        return nibble;
+    }
+    if (nibble == 13) {
+        if (*cursor + 1 > end) return -1;
+        return 13 + *(*cursor)++;
+    }
+    if (nibble == 14) {
+        if (*cursor + 2 > end) return -1;
+        long value = 269 + (((*cursor)[0] << 8) | (*cursor)[1]);
+        *cursor += 2;
+        return value;
+    }
+    return -1;
+}
+
+static bool test_parse(const uint8_t* datagram, size_t length, struct test_message_t* message)
+{
+    const uint8_t* cursor = datagram + 4;
+    const uint8_t* end = datagram + length;
+    uint16_t number = 0;
+
+    memset(message, 0, sizeof(*message));
+    if (length < 4 || (datagram[0] >> 6) != COAP_MESSAGE_VERSION) {
+        return false;
+    }
+
+    message->type = (datagram[0] >> 4) & 0x03;
+    message->token_length = datagram[0] & 0x0F;
+    message->code = datagram[1];
+    message->message_id = (datagram[2] << 8) | datagram[3];
+    if (message->token_length > sizeof(message->token) || cursor + message->token_length > end) {
+        return false;
+    }
+    memcpy(message->token, cursor, message->token_length);
+    cursor += message->token_length;
+
+    while (cursor < end && *cursor != COAP_MESSAGE_PAYLOAD_MARKER) {
+        uint8_t first = *cursor++;
+        long delta = test_read_extended(first >> 4, &cursor, end);
+        long value_length = test_read_extended(first & 0x0F, &cursor, end);
+        if (delta < 0 || value_length < 0 || cursor + value_length > end) {
+            return false;
+        }
+
+        number += delta;
+        if (number == COAP_MESSAGE_OPTION_BLOCK1) {
+            uint32_t value = 0;
+            for (long i = 0; i < value_length; i++) {
+                value = (value << 8) | cursor[i];
+            }
+            message->has_block = true;
+            message->block_number = value >> 4;
+            message->block_more = value & 0x08;
+        }
+        cursor += value_length;
+    }
+
+    if (cursor < end) {
+        message->payload = cursor + 1;
+        message->payload_length = end - cursor - 1;
+        return message->payload_length > 0;
+    }
+
+    return true;
+}
+
+static size_t test_build(uint8_t* datagram, uint8_t type, uint8_t code, uint16_t message_id, const uint8_t* token, uint8_t token_length)
+{
+    datagram[0] = (COAP_MESSAGE_VERSION << 6) | (type << 4) | token_length;
+    datagram[1] = code;
+    datagram[2] = message_id >> 8;
+    datagram[3] = message_id & 0xFF;
+    if (token_length > 0) {
+        memcpy(&datagram[4], token, token_length);
+    }
+    return 4 + token_length;
+}
+
+/**
+ * A datagram of the stand-in, sent once it is due
+*/
+struct test_send_t {
+    int64_t due_us;
+    size_t length;
+    uint8_t data[TEST_REPLY_SZ];
+};
+
+/**
+ * CoAP data sink stand-in on loopback. It deduplicates requests by message
+ * id like a real server, sending its last answer again for a retransmission,
+ * and behaves per exchange as the script says: it loses requests and ACKs,
+ * answers separately, confirmable or not, and repeats a confirmable response
+ * the station already acknowledged, as a server does whose ACK got lost.
+ *
+ * Block1 payloads are reassembled per token, the last block of a batch is
+ * decoded and its sequence numbers must continue the ones received so far.
+*/
+struct test_sink_t {
+    int fd;
+    uint16_t port;
+    volatile bool stop;
+
+    /**
+     * Behaviour by exchange, TEST_PIGGYBACKED beyond the script
+    */
+    const uint8_t* script;
+    size_t script_length;
+
+    struct sockaddr_in station;
+    uint16_t message_id;
+
+    /**
+     * The exchange in progress and the last confirmable separate response
+    */
+    bool has_request;
+    uint16_t request_id;
+    bool request_dropped;
+    uint8_t reply[TEST_REPLY_SZ];
+    size_t reply_length;
+    uint8_t separate[TEST_REPLY_SZ];
+    size_t separate_length;
+    uint16_t separate_id;
+
+    struct test_send_t sends[TEST_SENDS_MAX];
+    size_t sends_length;
+
+    uint8_t token[COAP_MESSAGE_TOKEN_SZ];
+    uint8_t payload[TEST_PAYLOAD_SZ];
+    size_t payload_length;
+    uint32_t next_block;
+
+    /**
+     * What the sink saw during the last upload
+    */
+    size_t exchanges;
+    size_t retransmissions;
+    size_t datagrams;
+    size_t bytes_received;
+    size_t bytes_sent;
+    size_t separate_acks;
+    size_t resets;
+    size_t records;
+    uint32_t last_sequence;
+    bool in_order;
+};
+
+static void test_sink_send(struct test_sink_t* sink, const uint8_t* data, size_t length, int64_t delay_us)
+{
+    if (sink->sends_length == TEST_SENDS_MAX) {
+        sink->in_order = false;
+        return;
+    }
+
+    struct test_send_t* send = &sink->sends[sink->sends_length++];
+    send->due_us = esp_timer_get_time() + delay_us;
+    send->length = length;
+    memcpy(send->data, data, length);
+}
+
+/**
+ * Adds the block of [request] to the payload of its token. Returns the
+ * response code, 2.04 once the last block completed a batch.
+*/
+static uint8_t test_sink_assemble(struct test_sink_t* sink, const struct test_message_t* request)
+{
+    uint32_t number = request->has_block ? request->block_number : 0;
+    bool more = request->has_block && request->block_more;
+
+    if (number == 0) {
+        memcpy(sink->token, request->token, sizeof(sink->token));
+        sink->payload_length = 0;
+        sink->next_block = 0;
+    }
+
+    if (number != sink->next_block || request->token_length != sizeof(sink->token)
+        || memcmp(request->token, sink->token, sizeof(sink->token)) != 0
+        || sink->payload_length + request->payload_length > sizeof(sink->payload)) {
+        fprintf(stderr, "Block %" PRIu32 " out of order, expected %" PRIu32 "\n", number, sink->next_block);
+        sink->in_order = false;
+        return TEST_CODE_INCOMPLETE;
+    }
+
+    memcpy(&sink->payload[sink->payload_length], request->payload, request->payload_length);
+    sink->payload_length += request->payload_length;
+    sink->next_block += 1;
+    if (more) {
+        return TEST_CODE_CONTINUE;
+    }
+
+    struct sensor_data_t records[TEST_RECORDS_MAX];
+    size_t records_length;
+    if (formatter_parse_measurements_from_binary(sink->payload, sink->payload_length, records, TEST_RECORDS_MAX, &records_length) != ESP_OK
+        || sink->payload_length != FORMATTER_BINARY_HEADER_SZ + records_length * FORMATTER_BINARY_RECORD_SZ) {
+        sink->in_order = false;
+        return TEST_CODE_BAD_REQUEST;
+    }
+
+    for (size_t i = 0; i < records_length; i++) {
+        if (sink->records > 0 && records[i].sequence != sink->last_sequence + 1) {
+            sink->in_order = false;
+        }
+        sink->last_sequence = records[i].sequence;
+        sink->records += 1;
+    }
+
+    return TEST_CODE_CHANGED;
+}
+
+static void test_sink_answer(struct test_sink_t* sink, const struct test_message_t* request, uint8_t behaviour)
+{
+    uint8_t code = test_sink_assemble(sink, request);
+    uint8_t response[TEST_REPLY_SZ];
+    size_t response_length;
+
+    if (behaviour != TEST_SEPARATE && behaviour != TEST_FOREIGN_TOKEN) {
+        sink->reply_length = test_build(sink->reply, COAP_MESSAGE_TYPE_ACK, code, request->message_id, request->token, request->token_length);
+        if (behaviour != TEST_DROP_RESPONSE) {
+            test_sink_send(sink, sink->reply, sink->reply_length, 0);
+        }
+        return;
+    }
+
+    if (behaviour == TEST_FOREIGN_TOKEN) {
+        uint8_t foreign[COAP_MESSAGE_TOKEN_SZ] = { request->token[0] ^ 0xFF, request->token[1] };
+        sink->message_id += 1;
+        response_length = test_build(response, COAP_MESSAGE_TYPE_CON, code, sink->message_id, foreign, sizeof(foreign));
+        test_sink_send(sink, response, response_length, 0);
+    }
+
+    sink->reply_length = test_build(sink->reply, COAP_MESSAGE_TYPE_ACK, 0, request->message_id, NULL, 0);
+    test_sink_send(sink, sink->reply, sink->reply_length, 0);
+
+    sink->message_id += 1;
+    if (behaviour == TEST_SEPARATE) {
+        response_length = test_build(response, COAP_MESSAGE_TYPE_CON, code, sink->message_id, request->token, request->token_length);
+        memcpy(sink->separate, response, response_length);
+        sink->separate_length = response_length;
+        sink->separate_id = sink->message_id;
+    } else {
+        response_length = test_build(response, COAP_MESSAGE_TYPE_NON, code, sink->message_id, request->token, request->token_length);
+    }
+    test_sink_send(sink, response, response_length, TEST_SEPARATE_DELAY_US);
+}
+
+static void test_sink_receive(struct test_sink_t* sink, const uint8_t* datagram, size_t length)
+{
+    struct test_message_t message;
+
+    if (!test_parse(datagram, length, &message)) {
+        sink->in_order = false;
+        return;
+    }
+
+    if (message.type == COAP_MESSAGE_TYPE_ACK) {
+        if (sink->separate_length > 0 && message.message_id == sink->separate_id) {
+            sink->separate_acks += 1;
+        }
+        return;
+    }
+    if (message.type == COAP_MESSAGE_TYPE_RST) {
+        sink->resets += 1;
+        return;
+    }
+    if (message.type != COAP_MESSAGE_TYPE_CON || message.code != COAP_MESSAGE_CODE_POST) {
+        sink->in_order = false;
+        return;
+    }
+
+    if (sink->has_request && message.message_id == sink->request_id) {
+        sink->retransmissions += 1;
+        if (sink->request_dropped) {
+            sink->request_dropped = false;
+            test_sink_answer(sink, &message, TEST_PIGGYBACKED);
+        } else if (sink->reply_length > 0) {
+            test_sink_send(sink, sink->reply, sink->reply_length, 0);
+        }
+        return;
+    }
+
+    uint8_t behaviour = sink->exchanges < sink->script_length ? sink->script[sink->exchanges] : TEST_PIGGYBACKED;
+    sink->exchanges += 1;
+    sink->has_request = true;
+    sink->request_id = message.message_id;
+    sink->request_dropped = behaviour == TEST_DROP_REQUEST || behaviour == TEST_REPEAT_SEPARATE;
+    sink->reply_length = 0;
+
+    if (behaviour == TEST_REPEAT_SEPARATE && sink->separate_length > 0) {
+        test_sink_send(sink, sink->separate, sink->separate_length, 0);
+    }
+    if (!sink->request_dropped) {
+        test_sink_answer(sink, &message, behaviour);
+    }
+}
+
+static void* test_sink_run(void* argument)
+{
+    struct test_sink_t* sink = argument;
+    uint8_t datagram[TEST_DATAGRAM_SZ];
+
+    while (!sink->stop) {
+        int timeout_ms = 50;
+        for (size_t i = 0; i < sink->sends_length; i++) {
+            int64_t wait_us = sink->sends[i].due_us - esp_timer_get_time();
+            int wait_ms = wait_us > 0 ? (int) ((wait_us + 999) / 1000) : 0;
+            if (wait_ms < timeout_ms) timeout_ms = wait_ms;
+        }
+
+        struct pollfd socket = { sink->fd, POLLIN, 0 };
+        if (poll(&socket, 1, timeout_ms) > 0 && (socket.revents & POLLIN)) {
+            socklen_t address_length = sizeof(sink->station);
+            ssize_t received = recvfrom(sink->fd, datagram, sizeof(datagram), 0, (struct sockaddr*) &sink->station, &address_length);
+            if (received > 0) {
+                sink->datagrams += 1;
+                sink->bytes_received += received;
+                test_sink_receive(sink, datagram, received);
+            }
+        }
+
+        // Due datagrams go out in the order they were queued
+        size_t kept = 0;
+        for (size_t i = 0; i < sink->sends_length; i++) {
+            struct test_send_t* send = &sink->sends[i];
+            if (send->due_us > esp_timer_get_time()) {
+                sink->sends[kept++] = *send;
+                continue;
+            }
+            if (sendto(sink->fd, send->data, send->length, 0, (struct sockaddr*) &sink->station, sizeof(sink->station)) > 0) {
+                sink->datagrams += 1;
+                sink->bytes_sent += send->length;
+            }
+        }
+        sink->sends_length = kept;
+    }
+
+    return NULL;
+}
+
+static int test_sink_start(struct test_sink_t* sink, pthread_t* thread)
+{
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = 0 };
+    socklen_t address_length = sizeof(address);
+
+    sink->fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (bind(sink->fd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || getsockname(sink->fd, (struct sockaddr*) &address, &address_length) != 0) {
+        perror("coap sink");
+        return -1;
+    }
+    sink->port = ntohs(address.sin_port);
+    sink->message_id = 0x4000;
+
+    return pthread_create(thread, NULL, test_sink_run, sink);
+}
+
+static void test_sink_reset(struct test_sink_t* sink, const uint8_t* script, size_t script_length)
+{
+    sink->script = script;
+    sink->script_length = script_length;
+    sink->has_request = false;
+    sink->separate_length = 0;
+    sink->payload_length = 0;
+    sink->next_block = 0;
+    sink->exchanges = 0;
+    sink->retransmissions = 0;
+    sink->datagrams = 0;
+    sink->bytes_received = 0;
+    sink->bytes_sent = 0;
+    sink->separate_acks = 0;
+    sink->resets = 0;
+    sink->records = 0;
+    sink->last_sequence = 0;
+    sink->in_order = true;
+}
+
+/**
+ * HTTP/1.1 data sink stand-in to compare with. Acknowledges every CSV batch
+ * with the sequence number of its last row.
+*/
+struct test_http_sink_t {
+    int listen_fd;
+    uint16_t port;
+    volatile bool stop;
+
+    /**
+     * What the sink saw during the last upload
+    */
+    size_t requests;
+    size_t bytes_received;
+    size_t bytes_sent;
+    size_t records;
+    uint32_t last_sequence;
+    bool in_order;
+};
+
+/**
+ * Handles the request at the start of [buffer] if it is complete. Returns
+ * its length, 0 if more is to be read.
+*/
+static size_t test_http_request(struct test_http_sink_t* sink, int fd, char* buffer, size_t length)
+{
+    char* head_end = memmem(buffer, length, "\r\n\r\n", 4);
+    if (!head_end) {
+        return 0;
+    }
+
+    *head_end = '\0';
+    const char* content_length = strcasestr(buffer, "\r\nContent-Length:");
+    size_t head_length = head_end + 4 - buffer;
+    size_t body_length = content_length ? strtoul(content_length + 17, NULL, 10) : 0;
+    *head_end = '\r';
+    if (length < head_length + body_length) {
+        return 0;
+    }
+
+    // The first line of the body is the header
+    const char* end = &buffer[head_length + body_length];
+    const char* line = memchr(&buffer[head_length], '\n', body_length);
+    while (line && line + 1 < end) {
+        uint32_t sequence = strtoul(line + 1, NULL, 10);
+        if (sink->records > 0 && sequence != sink->last_sequence + 1) {
+            sink->in_order = false;
+        }
+        sink->last_sequence = sequence;
+        sink->records += 1;
+        line = memchr(line + 1, '\n', end - line - 1);
+    }
+    sink->requests += 1;
+
+    char answer[32];
+    char reply[96];
+    int answer_length = snprintf(answer, sizeof(answer), "{\"ack\":%lu}", (unsigned long) sink->last_sequence);
+    int reply_length = snprintf(reply, sizeof(reply), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s", answer_length, answer);
+    if (send(fd, reply, reply_length, MSG_NOSIGNAL) > 0) {
+        sink->bytes_sent += reply_length;
+    }
+
+    return head_length + body_length;
+}
+
+static void test_http_serve(struct test_http_sink_t* sink, int fd)
+{
+    char* buffer = malloc(TEST_HTTP_BUFFER_SZ);
+    size_t length = 0;
+
+    while (buffer && !sink->stop) {
+        struct pollfd connection = { fd, POLLIN, 0 };
+        if (poll(&connection, 1, 50) <= 0) {
+            continue;
+        }
+
+        ssize_t received = read(fd, &buffer[length], TEST_HTTP_BUFFER_SZ - length);
+        if (received <= 0) {
+            break;
+        }
+        length += received;
+        sink->bytes_received += received;
+
+        size_t consumed;
+        while (length > 0 && (consumed = test_http_request(sink, fd, buffer, length)) > 0) {
+            length -= consumed;
+            memmove(buffer, &buffer[consumed], length);
+        }
+    }
+
+    free(buffer);
+    close(fd);
+}
+
+static void* test_http_run(void* argument)
+{
+    struct test_http_sink_t* sink = argument;
+    struct pollfd listening = { sink->listen_fd, POLLIN, 0 };
+
+    while (!sink->stop) {
+        if (poll(&listening, 1, 50) <= 0) {
+            continue;
+        }
+
+        int fd = accept(sink->listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            test_http_serve(sink, fd);
+        }
+    }
+
+    return NULL;
+}
+
+static int test_http_start(struct test_http_sink_t* sink, pthread_t* thread)
+{
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = 0 };
+    socklen_t address_length = sizeof(address);
+
+    sink->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bind(sink->listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(sink->listen_fd, 16) != 0
+        || getsockname(sink->listen_fd, (struct sockaddr*) &address, &address_length) != 0) {
+        perror("http sink");
+        return -1;
+    }
+    sink->port = ntohs(address.sin_port);
+
+    return pthread_create(thread, NULL, test_http_run, sink);
+}
+
+/**
+ * Uploads [measurements] to the data sink at [url] like main.c does after a
+ * wake. Returns whether the upload succeeded and acknowledged the last one.
+*/
+static bool test_upload(const char* url, struct sensor_data_t* measurements, size_t measurements_length)
+{
+    uint32_t acknowledged_sequences[CONFIGURATION_DATA_SINKS_MAX] = {0};
+
+    snprintf(configuration.data_sink, sizeof(configuration.data_sink), "%s", url);
+    esp_err_t err = pusher_push(measurements, measurements_length, acknowledged_sequences);
+
+    // The station's last ACK may still be on its way
+    usleep(100000);
+
+    return err == ESP_OK && acknowledged_sequences[0] == measurements[measurements_length - 1].sequence;
+}
+
+int main(void)
+{
+    int failures = 0;
+    char label[64];
+    char url[64];
+    struct test_sink_t coap = {0};
+    struct test_http_sink_t http = {0};
+    pthread_t coap_thread;
+    pthread_t http_thread;
+    struct sensor_data_t* measurements = calloc(TEST_BACKLOG_RECORDS, sizeof(struct sensor_data_t));
+
+    if (!measurements || test_sink_start(&coap, &coap_thread) != 0 || test_http_start(&http, &http_thread) != 0) {
+        return 1;
+    }
+
+    srand(TEST_SEED);
+    samples_generate(measurements, TEST_BACKLOG_RECORDS, TEST_MEASUREMENT_RATE, TEST_SEED);
+    configuration.data_sink_push_format = FORMATTER_FORMAT_CSV;
+    configuration.uplink = CONFIGURATION_UPLINK_WIFI;
+    configuration.config_version = 1;
+    snprintf(url, sizeof(url), "coap://127.0.0.1:%u/measurements", coap.port);
+
+    // Two batches of three blocks over a lossy uplink. The repeated response
+    // of the fourth exchange arrives while the station waits for the fifth,
+    // with the same token and an earlier message id.
+    static const uint8_t script[] = {
+        TEST_DROP_REQUEST, TEST_DROP_RESPONSE, TEST_FOREIGN_TOKEN,
+        TEST_SEPARATE, TEST_REPEAT_SEPARATE, TEST_PIGGYBACKED,
+    };
+    test_sink_reset(&coap, script, sizeof(script));
+    bool delivered = test_upload(url, measurements, TEST_LOSSY_RECORDS);
+    snprintf(label, sizeof(label), "lossy uplink, %zu records in %zu exchanges", coap.records, coap.exchanges);
+    failures += test_check(label, delivered && coap.in_order && coap.records == TEST_LOSSY_RECORDS
+        && coap.last_sequence == measurements[TEST_LOSSY_RECORDS - 1].sequence && coap.exchanges == sizeof(script));
+    snprintf(label, sizeof(label), "lossy uplink, %zu retransmissions", coap.retransmissions);
+    failures += test_check(label, coap.retransmissions == 3);
+    failures += test_check("separate response acknowledged, also repeated", coap.separate_acks == 2);
+    failures += test_check("foreign token reset, not taken as response", coap.resets == 1);
+
+    // A day's backlog without losses, against the same records over HTTP
+    test_sink_reset(&coap, NULL, 0);
+    bool coap_delivered = test_upload(url, measurements, TEST_BACKLOG_RECORDS)
+        && coap.in_order && coap.records == TEST_BACKLOG_RECORDS && coap.retransmissions == 0;
+    size_t coap_bytes = coap.bytes_received + coap.bytes_sent;
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%u/measurements", http.port);
+    http.in_order = true;
+    bool http_delivered = test_upload(url, measurements, TEST_BACKLOG_RECORDS)
+        && http.in_order && http.records == TEST_BACKLOG_RECORDS;
+    size_t http_bytes = http.bytes_received + http.bytes_sent;
+
+    printf("  %-8s %10s %10s %10s\n", "sink", "exchanges", "datagrams", "bytes");
+    printf("  %-8s %10zu %10zu %10zu\n", "coap", coap.exchanges, coap.datagrams, coap_bytes);
+    printf("  %-8s %10zu %10s %10zu\n", "http csv", http.requests, "-", http_bytes);
+
+    snprintf(label, sizeof(label), "%d records, coap %zu exchanges, http %zu", TEST_BACKLOG_RECORDS, coap.exchanges, http.requests);
+    failures += test_check(label, coap_delivered && http_delivered);
+    snprintf(label, sizeof(label), "coap %zu bytes, %.0f%% of http", coap_bytes, 100.0 * coap_bytes / http_bytes);
+    failures += test_check(label, coap_bytes < http_bytes);
+
+    coap.stop = true;
+    http.stop = true;
+    pthread_join(coap_thread, NULL);
+    pthread_join(http_thread, NULL);
+    free(measurements);
+
+    return failures ? 1 : 0;
+}
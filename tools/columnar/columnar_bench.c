@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "formatter.h"
+#include "samples.h"
+#include "columnar_decoder.h"
+
+#define BENCH_DEFAULT_RECORDS 10080         /*!< One week at the default measurement rate */
+#define BENCH_MEASUREMENT_RATE 60
+#define BENCH_SEED 1
+#define BENCH_ROUNDS 20
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Encodes [measurements] in batches of [batch_length] with every format and
+ * prints bytes/record, columnar encode/decode speed and whether the columnar
+ * round trip is exact
+*/
+static int bench_batch(struct sensor_data_t* measurements, size_t measurements_length, size_t batch_length, uint8_t* buffer, size_t buffer_length, int64_t* columns[FORMATTER_FIELDS])
+{
+    struct formatter_options_t options = { false, "weather", "" };
+    size_t json_bytes = 0, csv_bytes = 0, cbor_bytes = 0, columnar_bytes = 0;
+    double encode_ns = 0, decode_ns = 0;
+
+    for (size_t offset = 0; offset < measurements_length; offset += batch_length) {
+        size_t length = measurements_length - offset < batch_length ? measurements_length - offset : batch_length;
+        struct sensor_data_t* batch = &measurements[offset];
+        size_t written;
+        size_t decoded;
+
+        if (formatter_format(formatter_get(FORMATTER_FORMAT_JSON), &options, buffer, buffer_length, batch, length, &written) != ESP_OK) return -1;
+        json_bytes += written;
+        if (formatter_format(formatter_get(FORMATTER_FORMAT_CSV), &options, buffer, buffer_length, batch, length, &written) != ESP_OK) return -1;
+        csv_bytes += written;
+        if (formatter_format(formatter_get(FORMATTER_FORMAT_CBOR), &options, buffer, buffer_length, batch, length, &written) != ESP_OK) return -1;
+        cbor_bytes += written;
+
+        double start = bench_now_ns();
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            if (formatter_format(formatter_get(FORMATTER_FORMAT_COLUMNAR), &options, buffer, buffer_length, batch, length, &written) != ESP_OK) return -1;
+        }
+        encode_ns += (bench_now_ns() - start) / BENCH_ROUNDS;
+        columnar_bytes += written;
+
+        start = bench_now_ns();
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            if (columnar_decode(buffer, written, columns, measurements_length, &decoded) != 0) return -1;
+        }
+        decode_ns += (bench_now_ns() - start) / BENCH_ROUNDS;
+
+        // Every value has to come back exactly
+        if (decoded != length) return -1;
+        for (size_t i = 0; i < length; i++) {
+            for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+                if (columns[field][i] != formatter_field_value(&batch[i], field)) {
+                    fprintf(stderr, "Mismatch in record %zu field %u\n", offset + i, field);
+                    return -1;
+                }
+            }
+        }
+    }
+
+    double records = measurements_length;
+    printf("batch %5zu: json %6.1f  csv %6.1f  cbor %6.1f  columnar %5.2f B/record (%4.1fx smaller than json)  encode %6.1f ns/record  decode %5.1f ns/record %7.1f MB/s\n",
+        batch_length,
+        json_bytes / records, csv_bytes / records, cbor_bytes / records, columnar_bytes / records,
+        (double) json_bytes / columnar_bytes,
+        encode_ns / records,
+        decode_ns / records,
+        columnar_bytes / (decode_ns / 1e9) / 1e6);
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    size_t records = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_RECORDS;
+    size_t batch_lengths[] = { 25, 500, records };
+    size_t buffer_length = 512 + records * 256;
+
+    struct sensor_data_t* measurements = calloc(records, sizeof(*measurements));
+    uint8_t* buffer = malloc(buffer_length);
+    int64_t* columns[FORMATTER_FIELDS];
+    for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+        columns[field] = malloc(records * sizeof(int64_t));
+    }
+
+    samples_generate(measurements, records, BENCH_MEASUREMENT_RATE, BENCH_SEED);
+    printf("%zu synthetic records, one every %d s\n", records, BENCH_MEASUREMENT_RATE);
+
+    for (size_t i = 0; i < sizeof(batch_lengths) / sizeof(batch_lengths[0]); i++) {
+        if (batch_lengths[i] > records) {
+            continue;
+        }
+        if (bench_batch(measurements, records, batch_lengths[i], buffer, buffer_length, columns) != 0) {
+            fprintf(stderr, "Batch of %zu failed\n", batch_lengths[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "columnar_decoder.h"
+
+struct columnar_reader_t {
+    const uint8_t* buffer;
+    size_t length;
+    size_t offset;
+};
+
+static int columnar_read_varint(struct columnar_reader_t* reader, uint64_t* value)
+{
+    *value = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (reader->offset >= reader->length) {
+            return -1;
+        }
+
+        uint8_t byte = reader->buffer[reader->offset++];
+        *value |= (uint64_t) (byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+static int columnar_read_zigzag(struct columnar_reader_t* reader, int64_t* value)
+{
+    uint64_t zigzag;
+
+    if (columnar_read_varint(reader, &zigzag) != 0) {
+        return -1;
+    }
+
+    *value = (int64_t) (zigzag >> 1) ^ -(int64_t) (zigzag & 1);
+    return 0;
+}
+
+static int columnar_decode_column(struct columnar_reader_t* reader, uint8_t encoding, int64_t* column, size_t records_length)
+{
+    if (encoding == FORMATTER_COLUMNAR_ENCODING_RUN_LENGTH) {
+        size_t i = 0;
+        while (i < records_length) {
+            int64_t value;
+            uint64_t run_length;
+
+            if (columnar_read_zigzag(reader, &value) != 0
+                || columnar_read_varint(reader, &run_length) != 0
+                || run_length == 0
+                || run_length > records_length - i) {
+                return -1;
+            }
+
+            while (run_length-- > 0) {
+                column[i++] = value;
+            }
+        }
+        return 0;
+    }
+
+    if (encoding != FORMATTER_COLUMNAR_ENCODING_DELTA && encoding != FORMATTER_COLUMNAR_ENCODING_DELTA_OF_DELTA) {
+        return -1;
+    }
+
+    int64_t value = 0;
+    int64_t delta = 0;
+    for (size_t i = 0; i < records_length; i++) {
+        int64_t difference;
+
+        if (columnar_read_zigzag(reader, &difference) != 0) {
+            return -1;
+        }
+
+        if (encoding == FORMATTER_COLUMNAR_ENCODING_DELTA_OF_DELTA && i >= 2) {
+            delta += difference;
+        } else {
+            delta = difference;
+        }
+
+        value += delta;
+        column[i] = value;
+    }
+
+    return 0;
+}
+
+/**
+ * Reference decoder for FORMATTER_FORMAT_COLUMNAR. Decodes [buffer] into one
+ * array of [columns_capacity] integers per field id, values are in the units
+ * documented at the FORMATTER_FIELD_* ids.
+ *
+ * Returns 0 on success, -1 if the buffer is malformed, truncated, of another
+ * version or holds more than [columns_capacity] records.
+*/
+int columnar_decode(const uint8_t* buffer, size_t buffer_length, int64_t* columns[FORMATTER_FIELDS], size_t columns_capacity, size_t* records_length)
+{
+    struct columnar_reader_t reader = { buffer, buffer_length, 0 };
+    uint64_t count;
+
+    *records_length = 0;
+
+    if (buffer_length == 0) {
+        return 0;
+    }
+
+    if (buffer[reader.offset++] != FORMATTER_COLUMNAR_VERSION
+        || columnar_read_varint(&reader, &count) != 0
+        || count > columns_capacity) {
+        return -1;
+    }
+
+    for (uint8_t field = 0; field < FORMATTER_FIELDS; field++) {
+        if (reader.offset >= reader.length) {
+            return -1;
+        }
+
+        uint8_t encoding = reader.buffer[reader.offset++];
+        if (columnar_decode_column(&reader, encoding, columns[field], count) != 0) {
+            return -1;
+        }
+    }
+
+    if (reader.offset != reader.length) {
+        return -1;
+    }
+
+    *records_length = count;
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef __WEATHER_STATION__COLUMNAR_DECODER_H__
+#define __WEATHER_STATION__COLUMNAR_DECODER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "formatter.h"
+
+int columnar_decode(const uint8_t* buffer, size_t buffer_length, int64_t* columns[FORMATTER_FIELDS], size_t columns_capacity, size_t* records_length);
+
+#endif
@@ -0,0 +1,370 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "delta.h"
+
+#define TEST_ESC 0xA7
+#define TEST_MOD 0xA6
+#define TEST_INS 0xA5
+#define TEST_DEL 0xA4
+#define TEST_EQL 0xA3
+#define TEST_BKT 0xA2
+
+#define TEST_RANDOM_ROUNDS 2000
+#define TEST_RANDOM_SOURCE_SZ 4096
+#define TEST_LARGE_SOURCE_SZ (128 * 1024)
+#define TEST_TARGET_SZ (512 * 1024)
+#define TEST_PATCH_SZ (512 * 1024)
+
+/**
+ * Source image and target slot in memory, what ota.c reads from and writes
+ * to flash
+*/
+struct test_image_t {
+    const uint8_t* source;
+    size_t source_length;
+    uint8_t* target;
+    size_t target_length;
+};
+
+static esp_err_t test_read_source(void* context, size_t offset, uint8_t* buffer, size_t length)
+{
+    struct test_image_t* image = context;
+
+    if (offset > image->source_length || length > image->source_length - offset) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(buffer, image->source + offset, length);
+    return ESP_OK;
+}
+
+static esp_err_t test_write_target(void* context, const uint8_t* data, size_t length)
+{
+    struct test_image_t* image = context;
+
+    if (image->target_length + length > TEST_TARGET_SZ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(image->target + image->target_length, data, length);
+    image->target_length += length;
+    return ESP_OK;
+}
+
+/**
+ * Splits the patch into chunks: 0 feeds it in one piece, otherwise chunks of
+ * up to [chunk] bytes, random sized if [randomize] is set
+*/
+static esp_err_t test_apply(const uint8_t* source, size_t source_length, const uint8_t* patch, size_t patch_length, size_t chunk, int randomize, struct test_image_t* image)
+{
+    static struct delta_patcher_t patcher;
+    esp_err_t err = ESP_OK;
+
+    image->source = source;
+    image->source_length = source_length;
+    image->target_length = 0;
+    delta_patcher_init(&patcher, test_read_source, test_write_target, image);
+
+    for (size_t offset = 0; offset < patch_length && err == ESP_OK;) {
+        size_t length = chunk == 0 ? patch_length : (randomize ? 1 + (size_t) rand() % chunk : chunk);
+        if (length > patch_length - offset) {
+            length = patch_length - offset;
+        }
+        err = delta_patcher_feed(&patcher, patch + offset, length);
+        offset += length;
+    }
+
+    return err == ESP_OK ? delta_patcher_finish(&patcher) : err;
+}
+
+/**
+ * Applies [patch] fed whole, byte by byte and in random chunks, and compares
+ * every result with [expected]
+*/
+static int test_patch(const char* name, const uint8_t* source, size_t source_length, const uint8_t* patch, size_t patch_length, const uint8_t* expected, size_t expected_length, struct test_image_t* image, int verbose)
+{
+    const size_t chunks[] = { 0, 1, 7, 64 };
+
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        esp_err_t err = test_apply(source, source_length, patch, patch_length, chunks[i], i >= 2, image);
+        if (err != ESP_OK || image->target_length != expected_length || memcmp(image->target, expected, expected_length) != 0) {
+            printf("%-28s chunk %2zu  error 0x%x, %zu of %zu bytes  MISMATCH\n", name, chunks[i], err, image->target_length, expected_length);
+            return 1;
+        }
+    }
+
+    if (verbose) {
+        printf("%-28s %6zu bytes  ok\n", name, expected_length);
+    }
+    return 0;
+}
+
+/**
+ * Applies a malformed [patch] and expects it to fail
+*/
+static int test_reject(const char* name, const uint8_t* source, size_t source_length, const uint8_t* patch, size_t patch_length, struct test_image_t* image)
+{
+    const size_t chunks[] = { 0, 1 };
+
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+        esp_err_t err = test_apply(source, source_length, patch, patch_length, chunks[i], 0, image);
+        if (err == ESP_OK) {
+            printf("%-28s chunk %2zu  accepted  MISMATCH\n", name, chunks[i]);
+            return 1;
+        }
+    }
+
+    printf("%-28s rejected  ok\n", name);
+    return 0;
+}
+
+/**
+ * Writes patches the way jdiff does: every operation starts with ESC and its
+ * opcode, lengths take 1, 2, 3 or 5 bytes, and an ESC within MOD or INS data
+ * is doubled if the byte after it would read as an opcode or ESC
+*/
+struct test_writer_t {
+    uint8_t* patch;
+    size_t patch_length;
+    uint8_t pending_operation;
+    uint8_t* pending_data;
+    size_t pending_length;
+};
+
+static void test_write_byte(struct test_writer_t* writer, uint8_t value)
+{
+    writer->patch[writer->patch_length++] = value;
+}
+
+static int test_is_opcode(int value)
+{
+    return value >= TEST_BKT && value <= TEST_ESC;
+}
+
+/**
+ * Writes the held back data, [next] is the patch byte that follows it or -1
+ * at the end of the patch
+*/
+static void test_write_pending(struct test_writer_t* writer, int next)
+{
+    if (writer->pending_length == 0) {
+        return;
+    }
+
+    test_write_byte(writer, TEST_ESC);
+    test_write_byte(writer, writer->pending_operation);
+
+    for (size_t i = 0; i < writer->pending_length; i++) {
+        uint8_t value = writer->pending_data[i];
+        int following = i + 1 < writer->pending_length ? writer->pending_data[i + 1] : next;
+
+        test_write_byte(writer, value);
+        if (value == TEST_ESC && test_is_opcode(following)) {
+            test_write_byte(writer, TEST_ESC);
+        }
+    }
+
+    writer->pending_length = 0;
+}
+
+static void test_write_data(struct test_writer_t* writer, uint8_t operation, const uint8_t* data, size_t length)
+{
+    if (writer->pending_length && writer->pending_operation != operation) {
+        test_write_pending(writer, TEST_ESC);
+    }
+
+    writer->pending_operation = operation;
+    memcpy(writer->pending_data + writer->pending_length, data, length);
+    writer->pending_length += length;
+}
+
+static void test_write_length(struct test_writer_t* writer, uint8_t operation, size_t length)
+{
+    test_write_pending(writer, TEST_ESC);
+    test_write_byte(writer, TEST_ESC);
+    test_write_byte(writer, operation);
+
+    if (length <= 252) {
+        test_write_byte(writer, length - 1);
+    } else if (length <= 508) {
+        test_write_byte(writer, 252);
+        test_write_byte(writer, length - 253);
+    } else if (length <= 0xFFFF) {
+        test_write_byte(writer, 253);
+        test_write_byte(writer, length >> 8);
+        test_write_byte(writer, length & 0xFF);
+    } else {
+        test_write_byte(writer, 254);
+        test_write_byte(writer, length >> 24);
+        test_write_byte(writer, (length >> 16) & 0xFF);
+        test_write_byte(writer, (length >> 8) & 0xFF);
+        test_write_byte(writer, length & 0xFF);
+    }
+}
+
+/**
+ * Random bytes with plenty of ESC and opcodes to exercise the escaping
+*/
+static uint8_t test_random_byte(void)
+{
+    return rand() % 4 == 0 ? TEST_BKT + rand() % 6 : rand() & 0xFF;
+}
+
+/**
+ * Edits a random source with random operations, writes the patch and checks
+ * that applying it reproduces the edited image
+*/
+static int test_random(uint8_t* source, uint8_t* expected, uint8_t* data, struct test_writer_t* writer, struct test_image_t* image)
+{
+    size_t source_length = 1 + rand() % TEST_RANDOM_SOURCE_SZ;
+    size_t source_offset = 0;
+    size_t expected_length = 0;
+
+    for (size_t i = 0; i < source_length; i++) {
+        source[i] = test_random_byte();
+    }
+
+    writer->patch_length = 0;
+    writer->pending_length = 0;
+
+    for (int operations = 1 + rand() % 40; operations > 0; operations--) {
+        size_t length = 1 + rand() % (rand() % 4 == 0 ? 600 : 8);
+        size_t remaining = source_length - source_offset;
+
+        switch (rand() % 5) {
+        case 0:
+            // MOD overwrites as far as the source goes
+            if (length > remaining) length = remaining;
+            if (length == 0) break;
+            for (size_t i = 0; i < length; i++) data[i] = test_random_byte();
+            test_write_data(writer, TEST_MOD, data, length);
+            memcpy(expected + expected_length, data, length);
+            expected_length += length;
+            source_offset += length;
+            break;
+        case 1:
+            for (size_t i = 0; i < length; i++) data[i] = test_random_byte();
+            test_write_data(writer, TEST_INS, data, length);
+            memcpy(expected + expected_length, data, length);
+            expected_length += length;
+            break;
+        case 2:
+            if (length > remaining) length = remaining;
+            if (length == 0) break;
+            test_write_length(writer, TEST_DEL, length);
+            source_offset += length;
+            break;
+        case 3:
+            if (length > remaining) length = remaining;
+            if (length == 0) break;
+            test_write_length(writer, TEST_EQL, length);
+            memcpy(expected + expected_length, source + source_offset, length);
+            expected_length += length;
+            source_offset += length;
+            break;
+        case 4:
+            if (length > source_offset) length = source_offset;
+            if (length == 0) break;
+            test_write_length(writer, TEST_BKT, length);
+            source_offset -= length;
+            break;
+        }
+    }
+    test_write_pending(writer, -1);
+
+    return test_patch("random", source, source_length, writer->patch, writer->patch_length, expected, expected_length, image, 0);
+}
+
+int main(void)
+{
+    struct test_image_t image = { .target = malloc(TEST_TARGET_SZ) };
+    uint8_t* source = malloc(TEST_LARGE_SOURCE_SZ);
+    uint8_t* expected = malloc(TEST_TARGET_SZ);
+    uint8_t* data = malloc(TEST_TARGET_SZ);
+    struct test_writer_t writer = { .patch = malloc(TEST_PATCH_SZ), .pending_data = malloc(TEST_TARGET_SZ) };
+    int failures = 0;
+
+    if (!image.target || !source || !expected || !data || !writer.patch || !writer.pending_data) {
+        return 1;
+    }
+    srand(1);
+
+    const uint8_t* abc = (const uint8_t*) "ABCDEFGH";
+
+    // Every operation once: EQL 2, MOD "xy", DEL 1, INS "z", EQL 2
+    const uint8_t operations[] = { TEST_ESC, TEST_EQL, 1, TEST_ESC, TEST_MOD, 'x', 'y', TEST_ESC, TEST_DEL, 0, TEST_ESC, TEST_INS, 'z', TEST_ESC, TEST_EQL, 1 };
+    failures += test_patch("operations", abc, 8, operations, sizeof(operations), (const uint8_t*) "ABxyzFG", 7, &image, 1);
+
+    // EQL 4, BKT 2, EQL 2
+    const uint8_t backtrace[] = { TEST_ESC, TEST_EQL, 3, TEST_ESC, TEST_BKT, 1, TEST_ESC, TEST_EQL, 1 };
+    failures += test_patch("backtrace", abc, 8, backtrace, sizeof(backtrace), (const uint8_t*) "ABCDCD", 6, &image, 1);
+
+    // Data before the first operation is an implicit MOD
+    const uint8_t implicit[] = { 'a', 'b', TEST_ESC, TEST_EQL, 0 };
+    failures += test_patch("implicit mod", abc, 8, implicit, sizeof(implicit), (const uint8_t*) "abC", 3, &image, 1);
+
+    // ESC ESC within data is one ESC, here followed by an opcode as data
+    const uint8_t esc_esc[] = { TEST_ESC, TEST_INS, TEST_ESC, TEST_ESC, TEST_EQL, 'q' };
+    const uint8_t esc_esc_expected[] = { TEST_ESC, TEST_EQL, 'q' };
+    failures += test_patch("esc esc", abc, 8, esc_esc, sizeof(esc_esc), esc_esc_expected, sizeof(esc_esc_expected), &image, 1);
+
+    // An ESC followed by anything but an opcode or ESC is data as it is
+    const uint8_t lone_esc[] = { TEST_ESC, TEST_MOD, 'a', TEST_ESC, 'b', TEST_ESC, 0x00, TEST_ESC, TEST_EQL, 0 };
+    const uint8_t lone_esc_expected[] = { 'a', TEST_ESC, 'b', TEST_ESC, 0x00, 'F' };
+    failures += test_patch("lone esc in data", abc, 8, lone_esc, sizeof(lone_esc), lone_esc_expected, sizeof(lone_esc_expected), &image, 1);
+
+    // A trailing ESC at the end of the patch is data
+    const uint8_t trailing_esc[] = { TEST_ESC, TEST_INS, 'a', TEST_ESC };
+    const uint8_t trailing_esc_expected[] = { 'a', TEST_ESC };
+    failures += test_patch("trailing esc", abc, 8, trailing_esc, sizeof(trailing_esc), trailing_esc_expected, sizeof(trailing_esc_expected), &image, 1);
+
+    // Length forms at their boundaries: 1 byte up to 252, 252 up to 508, 253 up to 65535, 254 beyond
+    for (size_t i = 0; i < TEST_LARGE_SOURCE_SZ; i++) {
+        source[i] = test_random_byte();
+    }
+    const size_t lengths[] = { 1, 252, 253, 508, 509, 65535, 65536, TEST_LARGE_SOURCE_SZ - 1 };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+        char name[32];
+        writer.patch_length = 0;
+        writer.pending_length = 0;
+        test_write_length(&writer, TEST_DEL, 1);
+        test_write_length(&writer, TEST_EQL, lengths[i]);
+        snprintf(name, sizeof(name), "eql %zu (form %u)", lengths[i], writer.patch[5]);
+        failures += test_patch(name, source, TEST_LARGE_SOURCE_SZ, writer.patch, writer.patch_length, source + 1, lengths[i], &image, 1);
+    }
+
+    // Malformed patches
+    const uint8_t unknown_operation[] = { TEST_ESC, 0x00 };
+    failures += test_reject("unknown operation", abc, 8, unknown_operation, sizeof(unknown_operation), &image);
+    const uint8_t esc_esc_operation[] = { TEST_ESC, TEST_ESC };
+    failures += test_reject("esc esc as operation", abc, 8, esc_esc_operation, sizeof(esc_esc_operation), &image);
+    const uint8_t reserved_length[] = { TEST_ESC, TEST_EQL, 255, 0, 0, 0, 0 };
+    failures += test_reject("reserved length form", abc, 8, reserved_length, sizeof(reserved_length), &image);
+    const uint8_t truncated_length[] = { TEST_ESC, TEST_EQL, 254, 0, 0 };
+    failures += test_reject("truncated length", abc, 8, truncated_length, sizeof(truncated_length), &image);
+    const uint8_t truncated_operation[] = { TEST_ESC, TEST_EQL, 0, TEST_ESC };
+    failures += test_reject("truncated operation", abc, 8, truncated_operation, sizeof(truncated_operation), &image);
+    const uint8_t backtrace_before_start[] = { TEST_ESC, TEST_EQL, 1, TEST_ESC, TEST_BKT, 2 };
+    failures += test_reject("backtrace before start", abc, 8, backtrace_before_start, sizeof(backtrace_before_start), &image);
+    const uint8_t beyond_source[] = { TEST_ESC, TEST_DEL, 5, TEST_ESC, TEST_EQL, 2 };
+    failures += test_reject("equal beyond source", abc, 8, beyond_source, sizeof(beyond_source), &image);
+
+    // Random edits with jdiff's escaping
+    int random_failures = 0;
+    for (int round = 0; round < TEST_RANDOM_ROUNDS && random_failures == 0; round++) {
+        random_failures += test_random(source, expected, data, &writer, &image);
+    }
+    printf("%-28s %6d patches  %s\n", "random", TEST_RANDOM_ROUNDS, random_failures ? "MISMATCH" : "ok");
+    failures += random_failures;
+
+    free(image.target);
+    free(source);
+    free(expected);
+    free(data);
+    free(writer.patch);
+    free(writer.pending_data);
+
+    return failures ? 1 : 0;
+}
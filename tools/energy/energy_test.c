@@ -0,0 +1,239 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "energy.h"
+
+/**
+ * Power model of the README (see Power Consumption)
+*/
+#define TEST_MEASURING_S 5
+#define TEST_SENDING_S 15
+#define TEST_ACTIVE_MA 500.0
+#define TEST_IDLE_MA 1.0
+#define TEST_CAPACITY_MAH 6600.0
+#define TEST_CHARGING_MA 900.0
+
+/**
+ * Rates of example 1
+*/
+#define TEST_MEASUREMENT_RATE 15
+#define TEST_UPLOAD_RATE 300
+#define TEST_AUTONOMY_HOURS 72
+
+#define TEST_HOUR_S 3600
+#define TEST_DAY_S (24 * TEST_HOUR_S)
+
+/**
+ * Time constant in seconds the fuel gauge averages its charge rate over
+*/
+#define TEST_CHARGE_RATE_AVERAGING_S 1800
+
+struct energy_t energy;
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+/**
+ * A station on the README's power model that wakes at the rates of the
+ * energy budget. The fuel gauge reports the charge and the net charge rate,
+ * averaged like the MAX17048 does, so the uploads between the measurements
+ * do not show up as spikes.
+*/
+struct test_station_t {
+    double charge_mah;
+    double charge_rate;
+    uint32_t time;
+    uint32_t last_upload;
+    uint32_t battery_rate;
+    uint32_t last_battery_read;
+
+    /**
+     * Charging current in mA over the day, 0 for a dark period
+    */
+    double sun_ma;
+
+    /**
+     * What the budget did since the start of the run
+    */
+    uint16_t scale_min;
+    uint16_t scale_max;
+    bool step_exceeded;
+    uint32_t reserve_reached;
+};
+
+static void test_station_init(struct test_station_t* station, double charge_percent, double sun_ma, uint32_t battery_rate)
+{
+    memset(station, 0, sizeof(struct test_station_t));
+    memset(&energy, 0, sizeof(struct energy_t));
+    station->charge_mah = charge_percent / 100.0 * TEST_CAPACITY_MAH;
+    station->sun_ma = sun_ma;
+    station->battery_rate = battery_rate;
+    station->scale_min = ENERGY_SCALE_MAX;
+    station->scale_max = 0;
+}
+
+static double test_charge_percent(const struct test_station_t* station)
+{
+    return station->charge_mah / TEST_CAPACITY_MAH * 100.0;
+}
+
+/**
+ * Charging current at [time], a sine from 6 to 18 o'clock peaking at sun_ma
+*/
+static double test_sun(const struct test_station_t* station, uint32_t time)
+{
+    double sun = sin(((double) (time % TEST_DAY_S) / TEST_DAY_S - 0.25) * 2.0 * M_PI);
+    return sun > 0 ? station->sun_ma * sun : 0;
+}
+
+/**
+ * Runs the station for [duration] seconds of wakes
+*/
+static void test_station_run(struct test_station_t* station, const struct energy_options_t* options, uint32_t duration)
+{
+    uint32_t end = station->time + duration;
+
+    while (station->time < end) {
+        // A wake measures, uploads once the upload rate passed, and sleeps
+        // until the next one
+        uint32_t interval = energy.measurement_rate ? energy.measurement_rate : options->measurement_rate;
+        uint32_t active_s = TEST_MEASURING_S;
+        if (station->time - station->last_upload >= (energy.upload_rate ? energy.upload_rate : options->upload_rate)) {
+            active_s += TEST_SENDING_S;
+            station->last_upload = station->time;
+        }
+        if (active_s > interval) {
+            interval = active_s;
+        }
+
+        double drawn_mah = (active_s * TEST_ACTIVE_MA + (interval - active_s) * TEST_IDLE_MA) / TEST_HOUR_S;
+        double charged_mah = test_sun(station, station->time) * interval / TEST_HOUR_S;
+        double charge_mah = station->charge_mah + charged_mah - drawn_mah;
+        if (charge_mah > TEST_CAPACITY_MAH) charge_mah = TEST_CAPACITY_MAH;
+        if (charge_mah < 0) charge_mah = 0;
+        double net_percent = (charge_mah - station->charge_mah) / TEST_CAPACITY_MAH * 100.0;
+
+        double weight = interval < TEST_CHARGE_RATE_AVERAGING_S ? (double) interval / TEST_CHARGE_RATE_AVERAGING_S : 1.0;
+        station->charge_rate += weight * (net_percent * TEST_HOUR_S / interval - station->charge_rate);
+        station->charge_mah = charge_mah;
+        station->time += interval;
+
+        struct sensor_data_t sample = {0};
+        sample.timestamp = station->time;
+        if (station->battery_rate == 0 || station->time - station->last_battery_read >= station->battery_rate) {
+            sample.battery_charge = (float) test_charge_percent(station);
+            sample.battery_charge_rate = (float) station->charge_rate;
+            station->last_battery_read = station->time;
+        } else {
+            sample.skipped_devices = 1 << SENSORS_DEVICE_MAX17048;
+        }
+
+        uint16_t previous_scale = energy.scale ? energy.scale : ENERGY_SCALE_NOMINAL;
+        energy_update(&energy, options, &sample);
+
+        if (energy.scale > 2 * previous_scale || energy.scale < previous_scale / 2) {
+            station->step_exceeded = true;
+        }
+        if (energy.scale < station->scale_min) station->scale_min = energy.scale;
+        if (energy.scale > station->scale_max) station->scale_max = energy.scale;
+        if (!station->reserve_reached && test_charge_percent(station) <= ENERGY_RESERVE_PERCENT) {
+            station->reserve_reached = station->time;
+        }
+    }
+}
+
+int main(void)
+{
+    int failures = 0;
+    char label[64];
+    struct test_station_t station;
+    struct energy_options_t options = { TEST_MEASUREMENT_RATE, TEST_UPLOAD_RATE, TEST_AUTONOMY_HOURS };
+    struct energy_options_t fixed = { TEST_MEASUREMENT_RATE, TEST_UPLOAD_RATE, 0 };
+
+    // Without the budget a dark week reaches the reserve within hours
+    test_station_init(&station, 90, 0, 0);
+    test_station_run(&station, &fixed, 7 * TEST_DAY_S);
+    snprintf(label, sizeof(label), "without budget, reserve after %.0f hours", (double) station.reserve_reached / TEST_HOUR_S);
+    failures += test_check(label,
+        station.reserve_reached > 20 * TEST_HOUR_S && station.reserve_reached < 34 * TEST_HOUR_S
+        && energy.state == ENERGY_STATE_OFF && station.scale_min == ENERGY_SCALE_NOMINAL && station.scale_max == ENERGY_SCALE_NOMINAL);
+
+    // With the budget the same week stays above the reserve. The discharging
+    // scale converges on spreading the charge over the autonomy within the
+    // first hour: from then on the hourly drain follows the allowed one,
+    // until the scale hits its maximum.
+    test_station_init(&station, 90, 0, 0);
+    double ratio_min = INFINITY;
+    double ratio_max = 0;
+    for (uint32_t hour = 0; hour < 7 * 24; hour++) {
+        double charge = test_charge_percent(&station);
+        test_station_run(&station, &options, TEST_HOUR_S);
+        double ratio = (charge - test_charge_percent(&station)) / ((charge - ENERGY_RESERVE_PERCENT) / TEST_AUTONOMY_HOURS);
+        if (hour > 0 && energy.scale < ENERGY_SCALE_MAX) {
+            if (ratio < ratio_min) ratio_min = ratio;
+            if (ratio > ratio_max) ratio_max = ratio;
+        }
+    }
+    snprintf(label, sizeof(label), "discharging converges, %.2f to %.2f of the budget", ratio_min, ratio_max);
+    failures += test_check(label, ratio_min > 0.8 && ratio_max < 1.25 && !station.step_exceeded);
+    snprintf(label, sizeof(label), "with budget, a dark week ends at %.1f%%", test_charge_percent(&station));
+    failures += test_check(label,
+        energy.state == ENERGY_STATE_DISCHARGING && !station.reserve_reached
+        && test_charge_percent(&station) > 12 && test_charge_percent(&station) < 20);
+
+    // Below the reserve the rates go to the maximum in steps of at most 2x
+    test_station_init(&station, ENERGY_RESERVE_PERCENT - 1, 0, 0);
+    test_station_run(&station, &options, TEST_MEASUREMENT_RATE);
+    uint16_t first_scale = energy.scale;
+    test_station_run(&station, &options, TEST_HOUR_S);
+    failures += test_check("reserve stretches to the maximum stepwise",
+        first_scale == 2 * ENERGY_SCALE_NOMINAL && energy.scale == ENERGY_SCALE_MAX
+        && energy.state == ENERGY_STATE_RESERVE && !station.step_exceeded
+        && energy.measurement_rate == TEST_MEASUREMENT_RATE * ENERGY_SCALE_MAX / ENERGY_SCALE_NOMINAL
+        && energy.upload_rate == TEST_UPLOAD_RATE * ENERGY_SCALE_MAX / ENERGY_SCALE_NOMINAL);
+
+    // Sunny days take the rates back to the configured ones while charging
+    // and tighten them once the battery is full
+    test_station_init(&station, 30, TEST_CHARGING_MA, 0);
+    energy.scale = ENERGY_SCALE_MAX;
+    test_station_run(&station, &options, 10 * TEST_HOUR_S);
+    failures += test_check("charging restores the configured rates",
+        energy.state == ENERGY_STATE_CHARGING && energy.scale == ENERGY_SCALE_NOMINAL
+        && energy.measurement_rate == TEST_MEASUREMENT_RATE && !station.step_exceeded);
+    test_station_run(&station, &options, 3 * TEST_DAY_S);
+    test_station_run(&station, &options, 12 * TEST_HOUR_S - station.time % TEST_DAY_S);
+    failures += test_check("full battery tightens the rates to half",
+        energy.state == ENERGY_STATE_FULL && energy.scale == ENERGY_SCALE_MIN
+        && energy.measurement_rate == TEST_MEASUREMENT_RATE * ENERGY_SCALE_MIN / ENERGY_SCALE_NOMINAL
+        && station.scale_min == ENERGY_SCALE_MIN && !station.step_exceeded);
+
+    // Weeks of changing weather never step by more than 2x or leave the bounds
+    test_station_init(&station, 50, 0, 0);
+    bool bounded = true;
+    for (int day = 0; day < 28; day++) {
+        station.sun_ma = (day * 7 % 5) * TEST_CHARGING_MA / 4;
+        test_station_run(&station, &options, TEST_DAY_S);
+        bounded = bounded && station.scale_min >= ENERGY_SCALE_MIN && station.scale_max <= ENERGY_SCALE_MAX;
+    }
+    snprintf(label, sizeof(label), "changing weather, scale %u to %u", station.scale_min, station.scale_max);
+    failures += test_check(label, bounded && !station.step_exceeded && !station.reserve_reached);
+
+    // Only fresh battery readings move the scale, e.g. every 10 minutes with
+    // the default sensor rates
+    test_station_init(&station, 90, 0, 600);
+    test_station_run(&station, &options, 2 * TEST_DAY_S);
+    uint16_t scale = energy.scale;
+    struct sensor_data_t skipped = { .skipped_devices = 1 << SENSORS_DEVICE_MAX17048 };
+    energy_update(&energy, &options, &skipped);
+    failures += test_check("skipped battery readings keep the scale",
+        energy.scale == scale && energy.state == ENERGY_STATE_DISCHARGING
+        && !station.step_exceeded && !station.reserve_reached);
+
+    return failures ? 1 : 0;
+}
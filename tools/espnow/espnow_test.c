@@ -0,0 +1,594 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "espnow_frame.h"
+
+#define TEST_SEED 1
+#define TEST_RANDOM_MESSAGES 2000
+#define TEST_THROUGHPUT_MESSAGES 2000
+
+/**
+ * Same as the station's pusher
+*/
+#define TEST_ROUNDS_MAX 5
+#define TEST_ACK_TIMEOUT_US 100000
+
+/**
+ * Airtime of one frame at the 1 Mbit/s ESP-NOW default rate: long preamble
+ * plus the 802.11 action frame around the payload (header, vendor element,
+ * FCS) plus the mac layer ack
+*/
+#define TEST_PREAMBLE_US 192
+#define TEST_ACTION_FRAME_OVERHEAD 43
+#define TEST_MAC_ACK_US 304
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-48s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+static void test_fill(uint8_t* message, size_t message_length)
+{
+    for (size_t i = 0; i < message_length; i++) {
+        message[i] = rand() & 0xFF;
+    }
+}
+
+/**
+ * Decodes [frame] and feeds it into [reassembly]
+*/
+static esp_err_t test_feed(struct espnow_reassembly_t* reassembly, const uint8_t* frame, size_t frame_length)
+{
+    struct espnow_frame_header_t header;
+    const uint8_t* payload;
+
+    esp_err_t err = espnow_frame_decode(frame, frame_length, &header, &payload);
+    return err == ESP_OK ? espnow_reassembly_feed(reassembly, &header, payload) : err;
+}
+
+/**
+ * Writes fragment [index] of [message] the way the sender does
+*/
+static size_t test_fragment(uint8_t* frame, uint16_t message_id, const uint8_t* message, size_t message_length, uint8_t index)
+{
+    size_t offset = (size_t) index * ESPNOW_FRAME_PAYLOAD_MAX_SZ;
+    size_t length = message_length - offset > ESPNOW_FRAME_PAYLOAD_MAX_SZ ? ESPNOW_FRAME_PAYLOAD_MAX_SZ : message_length - offset;
+    struct espnow_frame_header_t header = {
+        .type = ESPNOW_FRAME_TYPE_DATA,
+        .message_id = message_id,
+        .fragment_index = index,
+        .fragment_count = espnow_frame_fragment_count(message_length),
+        .payload_length = length,
+    };
+
+    return espnow_frame_encode(frame, ESPNOW_FRAME_MAX_SZ, &header, &message[offset]);
+}
+
+static int test_is_reassembled(const struct espnow_reassembly_t* reassembly, const uint8_t* message, size_t message_length)
+{
+    return espnow_reassembly_is_complete(reassembly)
+        && reassembly->message_length == message_length
+        && memcmp(reassembly->message, message, message_length) == 0;
+}
+
+static int test_codec(void)
+{
+    uint8_t frame[ESPNOW_FRAME_MAX_SZ + 16];
+    uint8_t payload[ESPNOW_FRAME_PAYLOAD_MAX_SZ];
+    struct espnow_frame_header_t header = {
+        .type = ESPNOW_FRAME_TYPE_DATA,
+        .flags = ESPNOW_FRAME_FLAG_ACK_REQUEST,
+        .message_id = 0xBEEF,
+        .fragment_index = 3,
+        .fragment_count = 7,
+        .payload_length = sizeof(payload),
+    };
+    struct espnow_frame_header_t decoded;
+    const uint8_t* decoded_payload;
+    int failures = 0;
+
+    test_fill(payload, sizeof(payload));
+
+    // Round trip of a full frame, byte for byte
+    size_t length = espnow_frame_encode(frame, sizeof(frame), &header, payload);
+    failures += test_check("codec: full frame round trip",
+        length == ESPNOW_FRAME_MAX_SZ
+        && frame[0] == ESPNOW_FRAME_MAGIC && frame[1] == ((ESPNOW_FRAME_VERSION << 4) | ESPNOW_FRAME_TYPE_DATA)
+        && frame[2] == 0xEF && frame[3] == 0xBE
+        && espnow_frame_decode(frame, length, &decoded, &decoded_payload) == ESP_OK
+        && decoded.type == header.type && decoded.flags == header.flags && decoded.message_id == header.message_id
+        && decoded.fragment_index == header.fragment_index && decoded.fragment_count == header.fragment_count
+        && decoded.payload_length == header.payload_length && memcmp(decoded_payload, payload, sizeof(payload)) == 0);
+
+    header.payload_length = ESPNOW_FRAME_PAYLOAD_MAX_SZ + 1;
+    failures += test_check("codec: oversized payload not encoded", espnow_frame_encode(frame, sizeof(frame), &header, payload) == 0);
+    header.payload_length = sizeof(payload);
+    failures += test_check("codec: small buffer not encoded", espnow_frame_encode(frame, ESPNOW_FRAME_MAX_SZ - 1, &header, payload) == 0);
+
+    // Ack round trip
+    uint32_t received = 0;
+    uint8_t status = 0xFF;
+    length = espnow_frame_encode_ack(frame, sizeof(frame), 0x1234, 32, 0x80000001, ESPNOW_ACK_STATUS_BUSY);
+    failures += test_check("codec: ack round trip",
+        length == ESPNOW_FRAME_HEADER_SZ + ESPNOW_ACK_PAYLOAD_SZ
+        && espnow_frame_decode(frame, length, &decoded, &decoded_payload) == ESP_OK
+        && decoded.message_id == 0x1234
+        && espnow_frame_decode_ack(&decoded, decoded_payload, &received, &status) == ESP_OK
+        && received == 0x80000001 && status == ESPNOW_ACK_STATUS_BUSY);
+
+    // Fragment counts at the boundaries
+    failures += test_check("codec: fragment counts",
+        espnow_frame_fragment_count(0) == 0
+        && espnow_frame_fragment_count(1) == 1
+        && espnow_frame_fragment_count(ESPNOW_FRAME_PAYLOAD_MAX_SZ) == 1
+        && espnow_frame_fragment_count(ESPNOW_FRAME_PAYLOAD_MAX_SZ + 1) == 2
+        && espnow_frame_fragment_count(ESPNOW_MESSAGE_MAX_SZ) == ESPNOW_FRAGMENTS_MAX
+        && espnow_frame_fragment_count(ESPNOW_MESSAGE_MAX_SZ + 1) == 0);
+
+    return failures;
+}
+
+/**
+ * Every way a frame can be malformed has to be rejected by the decoder or
+ * the reassembly, without touching memory beyond the message
+*/
+static int test_malformed(void)
+{
+    uint8_t valid[ESPNOW_FRAME_MAX_SZ + 16];
+    uint8_t frame[ESPNOW_FRAME_MAX_SZ + 16];
+    uint8_t payload[ESPNOW_FRAME_PAYLOAD_MAX_SZ] = { 0 };
+    struct espnow_frame_header_t header = {
+        .type = ESPNOW_FRAME_TYPE_DATA,
+        .message_id = 1,
+        .fragment_index = 0,
+        .fragment_count = 2,
+        .payload_length = ESPNOW_FRAME_PAYLOAD_MAX_SZ,
+    };
+    static struct espnow_reassembly_t reassembly;
+    struct espnow_frame_header_t decoded;
+    const uint8_t* decoded_payload;
+    int rejected = 1;
+
+    size_t length = espnow_frame_encode(valid, sizeof(valid), &header, payload);
+
+    // Shorter than a header, truncated and padded frames
+    rejected &= espnow_frame_decode(valid, ESPNOW_FRAME_HEADER_SZ - 1, &decoded, &decoded_payload) != ESP_OK;
+    rejected &= espnow_frame_decode(valid, length - 1, &decoded, &decoded_payload) != ESP_OK;
+    rejected &= espnow_frame_decode(valid, length + 1, &decoded, &decoded_payload) != ESP_OK;
+
+    // Wrong magic and version
+    memcpy(frame, valid, length);
+    frame[0] ^= 0xFF;
+    rejected &= espnow_frame_decode(frame, length, &decoded, &decoded_payload) != ESP_OK;
+    memcpy(frame, valid, length);
+    frame[1] = ((ESPNOW_FRAME_VERSION + 1) << 4) | ESPNOW_FRAME_TYPE_DATA;
+    rejected &= espnow_frame_decode(frame, length, &decoded, &decoded_payload) != ESP_OK;
+
+    // Fragment index beyond the count, no fragments, more fragments than an ack can hold
+    memcpy(frame, valid, length);
+    frame[4] = 2;
+    rejected &= espnow_frame_decode(frame, length, &decoded, &decoded_payload) != ESP_OK;
+    frame[4] = 0;
+    frame[5] = 0;
+    rejected &= espnow_frame_decode(frame, length, &decoded, &decoded_payload) != ESP_OK;
+    frame[5] = ESPNOW_FRAGMENTS_MAX + 1;
+    rejected &= espnow_frame_decode(frame, length, &decoded, &decoded_payload) != ESP_OK;
+
+    // A last fragment longer than a fragment would write past the message
+    memcpy(frame, valid, length);
+    frame[4] = ESPNOW_FRAGMENTS_MAX - 1;
+    frame[5] = ESPNOW_FRAGMENTS_MAX;
+    frame[6] = 255;
+    espnow_reassembly_init(&reassembly);
+    rejected &= test_feed(&reassembly, frame, ESPNOW_FRAME_HEADER_SZ + 255) != ESP_OK;
+
+    // Empty and short non-last fragments
+    memcpy(frame, valid, length);
+    frame[6] = 0;
+    rejected &= test_feed(&reassembly, frame, ESPNOW_FRAME_HEADER_SZ) != ESP_OK;
+    frame[6] = ESPNOW_FRAME_PAYLOAD_MAX_SZ - 1;
+    rejected &= test_feed(&reassembly, frame, ESPNOW_FRAME_HEADER_SZ + ESPNOW_FRAME_PAYLOAD_MAX_SZ - 1) != ESP_OK;
+
+    // An ack fed as data, data decoded as ack
+    length = espnow_frame_encode_ack(frame, sizeof(frame), 1, 2, 3, ESPNOW_ACK_STATUS_OK);
+    rejected &= test_feed(&reassembly, frame, length) != ESP_OK;
+    uint32_t received;
+    uint8_t status;
+    espnow_frame_decode(valid, ESPNOW_FRAME_MAX_SZ, &decoded, &decoded_payload);
+    rejected &= espnow_frame_decode_ack(&decoded, decoded_payload, &received, &status) != ESP_OK;
+
+    // The same message id with another fragment count
+    espnow_reassembly_init(&reassembly);
+    rejected &= test_feed(&reassembly, valid, ESPNOW_FRAME_MAX_SZ) == ESP_OK;
+    memcpy(frame, valid, ESPNOW_FRAME_MAX_SZ);
+    frame[4] = 1;
+    frame[5] = 3;
+    rejected &= test_feed(&reassembly, frame, ESPNOW_FRAME_MAX_SZ) != ESP_OK;
+
+    return test_check("malformed: every malformed frame rejected", rejected);
+}
+
+/**
+ * Fragments of random messages fed shuffled, with duplicates
+*/
+static int test_reassembly(uint8_t* message, uint8_t frames[][ESPNOW_FRAME_MAX_SZ])
+{
+    static struct espnow_reassembly_t reassembly;
+    size_t frame_lengths[3 * ESPNOW_FRAGMENTS_MAX];
+    int out_of_order = 1;
+
+    for (int round = 0; round < TEST_RANDOM_MESSAGES && out_of_order; round++) {
+        size_t message_length = 1 + rand() % ESPNOW_MESSAGE_MAX_SZ;
+        uint8_t count = espnow_frame_fragment_count(message_length);
+        size_t frames_length = 0;
+
+        test_fill(message, message_length);
+        for (uint8_t i = 0; i < count; i++) {
+            frame_lengths[frames_length] = test_fragment(frames[frames_length], round, message, message_length, i);
+            frames_length++;
+            // Every third fragment twice
+            if (rand() % 3 == 0) {
+                frame_lengths[frames_length] = test_fragment(frames[frames_length], round, message, message_length, i);
+                frames_length++;
+            }
+        }
+
+        for (size_t i = frames_length - 1; i > 0; i--) {
+            size_t j = rand() % (i + 1);
+            uint8_t swap[ESPNOW_FRAME_MAX_SZ];
+            size_t swap_length = frame_lengths[i];
+            memcpy(swap, frames[i], ESPNOW_FRAME_MAX_SZ);
+            memcpy(frames[i], frames[j], ESPNOW_FRAME_MAX_SZ);
+            memcpy(frames[j], swap, ESPNOW_FRAME_MAX_SZ);
+            frame_lengths[i] = frame_lengths[j];
+            frame_lengths[j] = swap_length;
+        }
+
+        espnow_reassembly_init(&reassembly);
+        for (size_t i = 0; i < frames_length && out_of_order; i++) {
+            out_of_order &= test_feed(&reassembly, frames[i], frame_lengths[i]) == ESP_OK;
+            // Complete only with the last missing fragment
+            out_of_order &= espnow_reassembly_is_complete(&reassembly) == (__builtin_popcount(reassembly.received) == count);
+        }
+        out_of_order &= test_is_reassembled(&reassembly, message, message_length);
+    }
+
+    return test_check("reassembly: out of order and duplicate fragments", out_of_order);
+}
+
+/**
+ * A frame of a new message id discards the partial message, e.g. after the
+ * station gave up on a message or lost its rtc memory
+*/
+static int test_message_id_reset(uint8_t* message, uint8_t* other)
+{
+    static struct espnow_reassembly_t reassembly;
+    uint8_t frame[ESPNOW_FRAME_MAX_SZ];
+    size_t message_length = 5 * ESPNOW_FRAME_PAYLOAD_MAX_SZ;
+    size_t other_length = 2 * ESPNOW_FRAME_PAYLOAD_MAX_SZ + 17;
+    int passed = 1;
+
+    test_fill(message, message_length);
+    test_fill(other, other_length);
+    espnow_reassembly_init(&reassembly);
+
+    // Message 7 gets three of five fragments
+    for (uint8_t i = 0; i < 3; i++) {
+        passed &= test_feed(&reassembly, frame, test_fragment(frame, 7, message, message_length, i)) == ESP_OK;
+    }
+    passed &= reassembly.received == 0x07;
+
+    // Message 8 starts over, its fragments must not mix with those of 7
+    passed &= test_feed(&reassembly, frame, test_fragment(frame, 8, other, other_length, 2)) == ESP_OK;
+    passed &= reassembly.message_id == 8 && reassembly.received == 0x04 && reassembly.fragment_count == 3;
+    passed &= !espnow_reassembly_is_complete(&reassembly);
+    for (uint8_t i = 0; i < 2; i++) {
+        passed &= test_feed(&reassembly, frame, test_fragment(frame, 8, other, other_length, i)) == ESP_OK;
+    }
+    passed &= test_is_reassembled(&reassembly, other, other_length);
+
+    // A late fragment of 7 resets again, message 7 then completes on its own
+    passed &= test_feed(&reassembly, frame, test_fragment(frame, 7, message, message_length, 4)) == ESP_OK;
+    passed &= reassembly.message_id == 7 && reassembly.received == 0x10;
+    for (uint8_t i = 0; i < 4; i++) {
+        passed &= test_feed(&reassembly, frame, test_fragment(frame, 7, message, message_length, i)) == ESP_OK;
+    }
+    passed &= test_is_reassembled(&reassembly, message, message_length);
+
+    // Message ids wrap around
+    espnow_reassembly_init(&reassembly);
+    passed &= test_feed(&reassembly, frame, test_fragment(frame, 0xFFFF, other, 1, 0)) == ESP_OK;
+    passed &= test_feed(&reassembly, frame, test_fragment(frame, 0, other, 2, 0)) == ESP_OK;
+    passed &= reassembly.message_id == 0 && test_is_reassembled(&reassembly, other, 2);
+
+    return test_check("reassembly: new message id resets", passed);
+}
+
+/**
+ * The ack bitmap drives which fragments the sender repeats: only the
+ * unacknowledged ones, the last of the round requesting an ack
+*/
+static int test_ack_bitmap(uint8_t* message)
+{
+    struct espnow_sender_t sender;
+    uint8_t frame[ESPNOW_FRAME_MAX_SZ];
+    struct espnow_frame_header_t header;
+    const uint8_t* payload;
+    size_t message_length = ESPNOW_MESSAGE_MAX_SZ;
+    int passed = 1;
+
+    test_fill(message, message_length);
+    passed &= espnow_sender_init(&sender, 42, message, 0) != ESP_OK;
+    passed &= espnow_sender_init(&sender, 42, message, ESPNOW_MESSAGE_MAX_SZ + 1) != ESP_OK;
+    passed &= espnow_sender_init(&sender, 42, message, message_length) == ESP_OK;
+
+    // The first round sends every fragment, only the last one requests an ack
+    for (uint8_t i = 0; i < ESPNOW_FRAGMENTS_MAX; i++) {
+        size_t length = espnow_sender_next_frame(&sender, frame, sizeof(frame));
+        passed &= length > 0 && espnow_frame_decode(frame, length, &header, &payload) == ESP_OK;
+        passed &= header.fragment_index == i && header.message_id == 42;
+        passed &= ((header.flags & ESPNOW_FRAME_FLAG_ACK_REQUEST) != 0) == (i == ESPNOW_FRAGMENTS_MAX - 1);
+    }
+    passed &= espnow_sender_next_frame(&sender, frame, sizeof(frame)) == 0;
+
+    // Bits beyond the fragment count are ignored, bit 31 counts
+    uint32_t received = 0x55555555;
+    espnow_sender_on_ack(&sender, received);
+    passed &= !espnow_sender_is_complete(&sender);
+
+    espnow_sender_rewind(&sender);
+    uint32_t repeated = 0;
+    uint8_t last_index = 0;
+    size_t length;
+    while ((length = espnow_sender_next_frame(&sender, frame, sizeof(frame))) > 0) {
+        espnow_frame_decode(frame, length, &header, &payload);
+        repeated |= (uint32_t) 1 << header.fragment_index;
+        passed &= ((header.flags & ESPNOW_FRAME_FLAG_ACK_REQUEST) != 0) == (header.fragment_index == 31);
+        last_index = header.fragment_index;
+    }
+    passed &= repeated == ~received && last_index == 31;
+
+    // Acknowledging the last fragment moves the ack request to the new last one
+    espnow_sender_on_ack(&sender, 0x80000000);
+    espnow_sender_rewind(&sender);
+    while ((length = espnow_sender_next_frame(&sender, frame, sizeof(frame))) > 0) {
+        espnow_frame_decode(frame, length, &header, &payload);
+        passed &= ((header.flags & ESPNOW_FRAME_FLAG_ACK_REQUEST) != 0) == (header.fragment_index == 29);
+    }
+
+    espnow_sender_on_ack(&sender, ~received);
+    passed &= espnow_sender_is_complete(&sender);
+    espnow_sender_rewind(&sender);
+    passed &= espnow_sender_next_frame(&sender, frame, sizeof(frame)) == 0;
+
+    // A message of a few fragments ignores bits of fragments it does not have
+    passed &= espnow_sender_init(&sender, 43, message, 3 * ESPNOW_FRAME_PAYLOAD_MAX_SZ) == ESP_OK;
+    espnow_sender_on_ack(&sender, 0xFFFFFFF8);
+    passed &= !espnow_sender_is_complete(&sender) && sender.acknowledged == 0;
+    espnow_sender_on_ack(&sender, 0xFFFFFFFF);
+    passed &= espnow_sender_is_complete(&sender);
+
+    return test_check("sender: ack bitmap selects the repeated fragments", passed);
+}
+
+/**
+ * A minimal gateway as in gateway.c: reassembles, takes complete messages
+ * over while it has room, answers busy and forgets the message otherwise
+*/
+struct test_gateway_t {
+    struct espnow_reassembly_t reassembly;
+    size_t capacity;
+    size_t taken_over;
+};
+
+static size_t test_gateway_handle(struct test_gateway_t* gateway, const uint8_t* frame, size_t frame_length, uint8_t* ack)
+{
+    struct espnow_frame_header_t header;
+    const uint8_t* payload;
+    uint8_t status = ESPNOW_ACK_STATUS_OK;
+
+    if (espnow_frame_decode(frame, frame_length, &header, &payload) != ESP_OK || header.type != ESPNOW_FRAME_TYPE_DATA) {
+        return 0;
+    }
+
+    bool was_complete = espnow_reassembly_is_complete(&gateway->reassembly) && header.message_id == gateway->reassembly.message_id;
+    if (espnow_reassembly_feed(&gateway->reassembly, &header, payload) != ESP_OK) {
+        return 0;
+    }
+
+    bool is_complete = espnow_reassembly_is_complete(&gateway->reassembly);
+    if (is_complete && !was_complete) {
+        if (gateway->taken_over < gateway->capacity) {
+            gateway->taken_over += 1;
+        } else {
+            status = ESPNOW_ACK_STATUS_BUSY;
+            espnow_reassembly_init(&gateway->reassembly);
+        }
+    }
+
+    if ((header.flags & ESPNOW_FRAME_FLAG_ACK_REQUEST) || (is_complete && !was_complete)) {
+        return espnow_frame_encode_ack(ack, ESPNOW_FRAME_MAX_SZ, header.message_id, header.fragment_count, gateway->reassembly.received, status);
+    }
+
+    return 0;
+}
+
+static int test_busy(uint8_t* message)
+{
+    static struct test_gateway_t gateway;
+    struct espnow_sender_t sender;
+    uint8_t frame[ESPNOW_FRAME_MAX_SZ];
+    uint8_t ack[ESPNOW_FRAME_MAX_SZ];
+    struct espnow_frame_header_t header;
+    const uint8_t* payload;
+    uint32_t received = 0;
+    uint8_t status = 0xFF;
+    size_t length, ack_length = 0;
+    int passed = 1;
+
+    espnow_reassembly_init(&gateway.reassembly);
+    gateway.capacity = 0;
+    gateway.taken_over = 0;
+    test_fill(message, 4 * ESPNOW_FRAME_PAYLOAD_MAX_SZ);
+
+    // A full gateway answers the completing fragment with busy and an empty bitmap
+    espnow_sender_init(&sender, 100, message, 4 * ESPNOW_FRAME_PAYLOAD_MAX_SZ);
+    while ((length = espnow_sender_next_frame(&sender, frame, sizeof(frame))) > 0) {
+        size_t answer = test_gateway_handle(&gateway, frame, length, ack);
+        if (answer) ack_length = answer;
+    }
+    passed &= ack_length > 0 && espnow_frame_decode(ack, ack_length, &header, &payload) == ESP_OK;
+    passed &= espnow_frame_decode_ack(&header, payload, &received, &status) == ESP_OK;
+    passed &= status == ESPNOW_ACK_STATUS_BUSY && received == 0 && header.message_id == 100;
+    passed &= gateway.reassembly.fragment_count == 0;
+
+    // Repeated fragments of the refused message start over instead of being taken as complete
+    length = test_fragment(frame, 100, message, 4 * ESPNOW_FRAME_PAYLOAD_MAX_SZ, 3);
+    passed &= test_gateway_handle(&gateway, frame, length, ack) == 0 && gateway.reassembly.received == 0x08;
+
+    // Once there is room again the next message id is taken over
+    gateway.capacity = 1;
+    ack_length = 0;
+    espnow_sender_init(&sender, 101, message, 4 * ESPNOW_FRAME_PAYLOAD_MAX_SZ);
+    while ((length = espnow_sender_next_frame(&sender, frame, sizeof(frame))) > 0) {
+        size_t answer = test_gateway_handle(&gateway, frame, length, ack);
+        if (answer) ack_length = answer;
+    }
+    passed &= ack_length > 0 && espnow_frame_decode(ack, ack_length, &header, &payload) == ESP_OK;
+    passed &= espnow_frame_decode_ack(&header, payload, &received, &status) == ESP_OK;
+    passed &= status == ESPNOW_ACK_STATUS_OK && received == 0x0F && gateway.taken_over == 1;
+
+    // A duplicate of a taken over message is acked again but not taken over twice
+    length = test_fragment(frame, 101, message, 4 * ESPNOW_FRAME_PAYLOAD_MAX_SZ, 3);
+    frame[7] = ESPNOW_FRAME_FLAG_ACK_REQUEST;
+    ack_length = test_gateway_handle(&gateway, frame, length, ack);
+    passed &= ack_length > 0 && espnow_frame_decode(ack, ack_length, &header, &payload) == ESP_OK;
+    passed &= espnow_frame_decode_ack(&header, payload, &received, &status) == ESP_OK;
+    passed &= status == ESPNOW_ACK_STATUS_OK && received == 0x0F && gateway.taken_over == 1;
+
+    return test_check("gateway: busy refuses and forgets, duplicates ack", passed);
+}
+
+static double test_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double test_airtime_us(size_t frame_length)
+{
+    return TEST_PREAMBLE_US + (frame_length + TEST_ACTION_FRAME_OVERHEAD) * 8 + TEST_MAC_ACK_US;
+}
+
+/**
+ * Sends full messages over a channel that drops every frame, data and ack,
+ * with probability [loss] and reports delivery, frames on air per fragment
+ * and the goodput at 1 Mbit/s including ack timeouts
+*/
+static int test_throughput(uint8_t* message, double loss)
+{
+    static struct test_gateway_t gateway;
+    uint8_t frame[ESPNOW_FRAME_MAX_SZ];
+    uint8_t ack[ESPNOW_FRAME_MAX_SZ];
+    size_t delivered = 0, frames = 0, fragments = 0, bytes = 0;
+    double airtime_us = 0, codec_ns = 0;
+    int corrupted = 0;
+
+    espnow_reassembly_init(&gateway.reassembly);
+    gateway.capacity = TEST_THROUGHPUT_MESSAGES;
+    gateway.taken_over = 0;
+
+    for (int m = 0; m < TEST_THROUGHPUT_MESSAGES; m++) {
+        struct espnow_sender_t sender;
+        size_t message_length = ESPNOW_MESSAGE_MAX_SZ / 2 + rand() % (ESPNOW_MESSAGE_MAX_SZ / 2 + 1);
+        test_fill(message, message_length);
+        espnow_sender_init(&sender, m, message, message_length);
+        fragments += sender.fragment_count;
+
+        for (int round = 0; round < TEST_ROUNDS_MAX && !espnow_sender_is_complete(&sender); round++) {
+            size_t length, ack_length = 0;
+            espnow_sender_rewind(&sender);
+
+            double start = test_now_ns();
+            while ((length = espnow_sender_next_frame(&sender, frame, sizeof(frame))) > 0) {
+                frames++;
+                airtime_us += test_airtime_us(length);
+                if ((double) rand() / RAND_MAX >= loss) {
+                    size_t answer = test_gateway_handle(&gateway, frame, length, ack);
+                    if (answer) ack_length = answer;
+                }
+            }
+
+            // The ack may get lost as well, the sender then waits for its timeout
+            struct espnow_frame_header_t header;
+            const uint8_t* payload;
+            uint32_t received;
+            uint8_t status;
+            if (ack_length && (double) rand() / RAND_MAX >= loss
+                && espnow_frame_decode(ack, ack_length, &header, &payload) == ESP_OK
+                && espnow_frame_decode_ack(&header, payload, &received, &status) == ESP_OK
+                && header.message_id == sender.message_id) {
+                espnow_sender_on_ack(&sender, received);
+                airtime_us += test_airtime_us(ack_length);
+            } else {
+                airtime_us += TEST_ACK_TIMEOUT_US;
+            }
+            codec_ns += test_now_ns() - start;
+        }
+
+        if (espnow_sender_is_complete(&sender)) {
+            delivered++;
+            bytes += message_length;
+            corrupted |= !test_is_reassembled(&gateway.reassembly, message, message_length);
+        }
+    }
+
+    printf("loss %4.0f%%: %5.1f%% delivered, %4.2f frames per fragment, %6.1f kB/s goodput, codec %5.0f ns/frame  %s\n",
+        loss * 100,
+        100.0 * delivered / TEST_THROUGHPUT_MESSAGES,
+        (double) frames / fragments,
+        bytes / (airtime_us / 1e6) / 1000,
+        codec_ns / frames,
+        corrupted ? "MISMATCH" : "ok");
+
+    // Without loss every message has to arrive in one round
+    if (loss == 0 && (delivered != TEST_THROUGHPUT_MESSAGES || frames != fragments)) {
+        return 1;
+    }
+    return corrupted;
+}
+
+int main(void)
+{
+    uint8_t* message = malloc(ESPNOW_MESSAGE_MAX_SZ);
+    uint8_t* other = malloc(ESPNOW_MESSAGE_MAX_SZ);
+    uint8_t (*frames)[ESPNOW_FRAME_MAX_SZ] = malloc(3 * ESPNOW_FRAGMENTS_MAX * ESPNOW_FRAME_MAX_SZ);
+    const double losses[] = { 0, 0.05, 0.2, 0.5 };
+    int failures = 0;
+
+    if (!message || !other || !frames) {
+        return 1;
+    }
+    srand(TEST_SEED);
+
+    failures += test_codec();
+    failures += test_malformed();
+    failures += test_reassembly(message, frames);
+    failures += test_message_id_reset(message, other);
+    failures += test_ack_bitmap(message);
+    failures += test_busy(message);
+
+    for (size_t i = 0; i < sizeof(losses) / sizeof(losses[0]); i++) {
+        failures += test_throughput(message, losses[i]);
+    }
+
+    free(message);
+    free(other);
+    free(frames);
+
+    return failures ? 1 : 0;
+}
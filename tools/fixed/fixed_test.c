@@ -0,0 +1,171 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+
+// The emitters are static, the test is built as part of the formatter
+#include "formatter.c"
+
+#define TEST_SEED 1
+#define TEST_RANDOM_BITS 2000000
+#define TEST_RANDOM_READINGS 2000000
+#define TEST_RANDOM_BOUNDARIES 500000
+
+#define TEST_DECIMALS_MAX 3
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+static uint32_t test_random32(void)
+{
+    return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+/**
+ * Output of snprintf("%.Nf") where the emitter promises to match it. Values
+ * whose scaled magnitude does not fit into 32 bits are clamped to
+ * UINT32_MAX, not a number and infinity become zero, both keep the sign.
+*/
+static void test_expected(float value, uint8_t decimals, char* buffer, size_t capacity)
+{
+    // Bounds the output length for the compiler, decimals is at most 3
+    decimals &= TEST_DECIMALS_MAX;
+
+    double factor = formatter_decimal_factors[decimals];
+    const char* sign = signbit(value) ? "-" : "";
+
+    if (!isfinite(value)) {
+        snprintf(buffer, capacity, "%s%.*f", sign, decimals, 0.0);
+    } else if (fabs((double) value) * factor >= (double) UINT32_MAX) {
+        snprintf(buffer, capacity, "%s%.*f", sign, decimals, UINT32_MAX / factor);
+    } else {
+        snprintf(buffer, capacity, "%.*f", decimals, (double) value);
+    }
+}
+
+/**
+ * Compares formatter_emit_fixed with the expected output, prints the first
+ * few mismatches
+*/
+static int test_value(float value, uint8_t decimals)
+{
+    static int reported = 0;
+    char expected[64];
+    char emitted[64];
+    struct formatter_cursor_t cursor = { emitted, sizeof(emitted) - 1, 0, false };
+
+    test_expected(value, decimals, expected, sizeof(expected));
+    formatter_emit_fixed(&cursor, value, decimals);
+    emitted[cursor.offset] = '\0';
+
+    if (!cursor.overflow && strcmp(emitted, expected) == 0) {
+        return 0;
+    }
+
+    if (reported < 10) {
+        printf("  %a with %u decimals: emitted %s, expected %s\n", value, decimals, emitted, expected);
+        reported += 1;
+    }
+    return 1;
+}
+
+static int test_all_decimals(float value)
+{
+    int mismatches = 0;
+
+    for (uint8_t decimals = 0; decimals <= TEST_DECIMALS_MAX; decimals++) {
+        mismatches += test_value(value, decimals);
+    }
+
+    return mismatches;
+}
+
+static float test_uniform(float min, float max)
+{
+    return min + (max - min) * ((float) rand() / RAND_MAX);
+}
+
+int main(void)
+{
+    int failures = 0;
+    int mismatches;
+    srand(TEST_SEED);
+
+    // Zero, signs, subnormals, limits and the values that are not a number
+    const float edges[] = {
+        0, -0.0f, FLT_MIN, -FLT_MIN, FLT_TRUE_MIN, -FLT_TRUE_MIN, FLT_MAX, -FLT_MAX,
+        INFINITY, -INFINITY, NAN, 1, -1, 0.5f, -0.5f, 1.5f, 2.5f, -2.5f,
+        0.005f, -0.005f, 0.0005f, -0.0004f, 9.995f, 99.995f, 4294967295.0f, 4294967.5f, 429496.7f
+    };
+    mismatches = 0;
+    for (size_t i = 0; i < sizeof(edges) / sizeof(edges[0]); i++) {
+        mismatches += test_all_decimals(edges[i]);
+    }
+    failures += test_check("edge cases", mismatches == 0);
+
+    // Exact ties are rounded half to even, like printf
+    mismatches = 0;
+    for (int n = -20000; n <= 20000; n++) {
+        for (int k = 1; k <= 5; k++) {
+            mismatches += test_all_decimals(ldexpf((float) n, -k));
+        }
+    }
+    failures += test_check("ties n/2^k", mismatches == 0);
+
+    // Floats next to the rounding boundaries, where the float printf path
+    // and naive value * 10^N + 0.5 disagree
+    mismatches = 0;
+    for (int i = 0; i < TEST_RANDOM_BOUNDARIES; i++) {
+        uint8_t decimals = rand() % (TEST_DECIMALS_MAX + 1);
+        double factor = formatter_decimal_factors[decimals];
+        int32_t n = (int32_t) (test_random32() % 20000000) - 10000000;
+        float boundary = (float) ((n + 0.5) / factor);
+
+        mismatches += test_value(boundary, decimals);
+        mismatches += test_value(nextafterf(boundary, INFINITY), decimals);
+        mismatches += test_value(nextafterf(boundary, -INFINITY), decimals);
+    }
+    failures += test_check("neighbours of the rounding boundaries", mismatches == 0);
+
+    // Largest magnitudes that still fit and the first ones that are clamped
+    mismatches = 0;
+    for (uint8_t decimals = 0; decimals <= TEST_DECIMALS_MAX; decimals++) {
+        float limit = (float) ((double) UINT32_MAX / formatter_decimal_factors[decimals]);
+        float value = limit;
+        for (int i = 0; i < 64; i++) {
+            value = nextafterf(value, 0);
+        }
+        for (int i = 0; i < 128; i++) {
+            mismatches += test_value(value, decimals);
+            mismatches += test_value(-value, decimals);
+            value = nextafterf(value, INFINITY);
+        }
+    }
+    failures += test_check("clamp limit", mismatches == 0);
+
+    // Readings in and around the sensor ranges
+    mismatches = 0;
+    for (int i = 0; i < TEST_RANDOM_READINGS; i++) {
+        mismatches += test_all_decimals(test_uniform(-50, 150));
+        mismatches += test_value(test_uniform(0, 5), 3);
+        mismatches += test_value(test_uniform(300, 1100), 2);
+    }
+    failures += test_check("random readings", mismatches == 0);
+
+    // Random bit patterns cover every exponent
+    mismatches = 0;
+    for (int i = 0; i < TEST_RANDOM_BITS; i++) {
+        uint32_t bits = test_random32();
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        mismatches += test_all_decimals(value);
+    }
+    failures += test_check("random bit patterns", mismatches == 0);
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#include "formatter.h"
+#include "compressor.h"
+#include "samples.h"
+
+#define BENCH_SYNTHETIC_RECORDS 10080       /*!< One week at the default measurement rate */
+#define BENCH_MEASUREMENT_RATE 60
+#define BENCH_SEED 1
+#define BENCH_ROUNDS 20
+
+/**
+ * Same batching as the pusher
+*/
+#define BENCH_BATCH_MAX_MEASUREMENTS 25
+#define BENCH_BATCH_BUFFER_SZ 4608
+
+static double bench_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/**
+ * Columns of the station's CSV format, see formatter_csv_record
+*/
+#define BENCH_CSV_COLUMNS 11
+#define BENCH_CSV_COLUMN_KIND 11
+
+/**
+ * Device whose reading a column holds, -1 for the columns every row fills
+*/
+static const int bench_csv_devices[BENCH_CSV_COLUMNS] = {
+    -1, -1,
+    SENSORS_DEVICE_SHT30, SENSORS_DEVICE_BME280, SENSORS_DEVICE_SHT30, SENSORS_DEVICE_BME280,
+    SENSORS_DEVICE_LTR390, SENSORS_DEVICE_LTR390,
+    SENSORS_DEVICE_MAX17048, SENSORS_DEVICE_MAX17048, SENSORS_DEVICE_MAX17048,
+};
+
+static const char* const bench_kind_names[SENSORS_KINDS] = {"sample", "mean", "min", "max", "stddev"};
+
+/**
+ * Splits [line] at the commas in place. Returns the number of cells, more
+ * than [cells_capacity] if they did not fit.
+*/
+static size_t bench_split_csv(char* line, char* cells[], size_t cells_capacity)
+{
+    size_t length = 0;
+
+    line[strcspn(line, "\r\n")] = '\0';
+    for (char* cell = line; cell; length++) {
+        char* comma = strchr(cell, ',');
+        if (comma) *comma = '\0';
+        if (length < cells_capacity) cells[length] = cell;
+        cell = comma ? comma + 1 : NULL;
+    }
+
+    return length;
+}
+
+static bool bench_parse_long(const char* cell, long* value)
+{
+    char* end;
+    *value = strtol(cell, &end, 10);
+    return *cell != '\0' && *end == '\0';
+}
+
+static bool bench_parse_float(const char* cell, float* value)
+{
+    char* end;
+    *value = strtof(cell, &end);
+    return *cell != '\0' && *end == '\0';
+}
+
+/**
+ * Parses one row into [m], which has to be zeroed. The formatter leaves
+ * the cells of skipped devices empty, those devices are marked in
+ * skipped_devices. The kind column is only there if the batch holds
+ * statistics.
+*/
+static bool bench_parse_row(char* line, bool has_kind, struct sensor_data_t* m)
+{
+    char* cells[BENCH_CSV_COLUMNS + 1];
+    size_t columns = has_kind ? BENCH_CSV_COLUMNS + 1 : BENCH_CSV_COLUMNS;
+    long sequence = 0, timestamp = 0, daylight = 0, uv = 0;
+
+    if (bench_split_csv(line, cells, BENCH_CSV_COLUMNS + 1) != columns) {
+        return false;
+    }
+
+    // A device is skipped if all of its cells are empty
+    uint8_t filled_devices = 0;
+    for (size_t column = 0; column < BENCH_CSV_COLUMNS; column++) {
+        bool empty = cells[column][0] == '\0';
+        if (bench_csv_devices[column] < 0) {
+            if (empty) return false;
+        } else if (empty) {
+            m->skipped_devices |= 1 << bench_csv_devices[column];
+        } else {
+            filled_devices |= 1 << bench_csv_devices[column];
+        }
+    }
+    if (m->skipped_devices & filled_devices) {
+        return false;
+    }
+
+    // Cells of skipped devices stay empty, their fields zero
+    bool parsed = bench_parse_long(cells[0], &sequence) && bench_parse_long(cells[1], &timestamp);
+    if (!(m->skipped_devices & (1 << SENSORS_DEVICE_SHT30))) {
+        parsed = parsed && bench_parse_float(cells[2], &m->temperature) && bench_parse_float(cells[4], &m->humidity);
+    }
+    if (!(m->skipped_devices & (1 << SENSORS_DEVICE_BME280))) {
+        parsed = parsed && bench_parse_float(cells[3], &m->temperature_inside) && bench_parse_float(cells[5], &m->pressure);
+    }
+    if (!(m->skipped_devices & (1 << SENSORS_DEVICE_LTR390))) {
+        parsed = parsed && bench_parse_long(cells[6], &daylight) && bench_parse_long(cells[7], &uv);
+        m->daylight = daylight;
+        m->uv = uv;
+    }
+    if (!(m->skipped_devices & (1 << SENSORS_DEVICE_MAX17048))) {
+        parsed = parsed && bench_parse_float(cells[8], &m->battery_voltage)
+            && bench_parse_float(cells[9], &m->battery_charge)
+            && bench_parse_float(cells[10], &m->battery_charge_rate);
+    }
+    if (!parsed) {
+        return false;
+    }
+
+    m->sequence = sequence;
+    m->timestamp = timestamp;
+
+    if (has_kind) {
+        uint8_t kind = 0;
+        while (kind < SENSORS_KINDS && strcmp(cells[BENCH_CSV_COLUMN_KIND], bench_kind_names[kind]) != 0) {
+            kind += 1;
+        }
+        if (kind == SENSORS_KINDS) {
+            return false;
+        }
+        m->kind = kind;
+    }
+
+    return true;
+}
+
+/**
+ * Loads a recording in the station's CSV format, e.g. as stored by a data
+ * sink. Rows may come from several batches, repeated header lines are
+ * skipped and "dtime" columns are made absolute again. Rows that do not
+ * parse are skipped.
+*/
+static struct sensor_data_t* bench_load_csv(const char* path, size_t* measurements_length)
+{
+    FILE* file = fopen(path, "r");
+    size_t capacity = 1024;
+    size_t length = 0;
+    struct sensor_data_t* measurements = malloc(capacity * sizeof(*measurements));
+    char line[512];
+    bool delta_timestamps = false;
+    bool has_kind = false;
+    bool has_time_base = false;
+    uint32_t time_base = 0;
+
+    if (!file || !measurements) {
+        free(measurements);
+        if (file) fclose(file);
+        return NULL;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        struct sensor_data_t m = {0};
+
+        if (strncmp(line, "seq,", 4) == 0) {
+            delta_timestamps = strncmp(line, "seq,dtime,", 10) == 0;
+            has_kind = strstr(line, ",kind") != NULL;
+            has_time_base = false;
+            continue;
+        }
+
+        if (!bench_parse_row(line, has_kind, &m)) {
+            continue;
+        }
+
+        // The first row of a batch holds the absolute timestamp
+        if (delta_timestamps && !has_time_base) {
+            time_base = m.timestamp;
+            has_time_base = true;
+        } else if (delta_timestamps) {
+            m.timestamp += time_base;
+        }
+
+        if (length == capacity) {
+            capacity *= 2;
+            struct sensor_data_t* grown = realloc(measurements, capacity * sizeof(*measurements));
+            if (!grown) {
+                break;
+            }
+            measurements = grown;
+        }
+        measurements[length++] = m;
+    }
+
+    fclose(file);
+    *measurements_length = length;
+    return measurements;
+}
+
+/**
+ * The JSON formatter as it was before the integer emitters: one snprintf
+ * with "%.2f" and the like per record. Kept as the reference the emitters
+ * are measured against, its output has to match formatter_json byte for
+ * byte. Returns the length written, -1 if it did not fit.
+*/
+static int bench_json_printf(char* buffer, size_t buffer_length, const struct sensor_data_t* measurements, size_t measurements_length)
+{
+    size_t offset = 0;
+    int written;
+
+#define BENCH_APPEND(...) \
+    written = snprintf(&buffer[offset], buffer_length - offset, __VA_ARGS__); \
+    if (written < 0 || (size_t) written >= buffer_length - offset) return -1; \
+    offset += written
+
+    BENCH_APPEND("{\"measurements\":[");
+    for (size_t i = 0; i < measurements_length; i++) {
+        const struct sensor_data_t* m = &measurements[i];
+
+        BENCH_APPEND("%s{\"seq\":%" PRIu32, i > 0 ? "," : "", m->sequence);
+        if (m->kind != SENSORS_KIND_SAMPLE) {
+            BENCH_APPEND(",\"kind\":\"%s\"", bench_kind_names[m->kind < SENSORS_KINDS ? m->kind : SENSORS_KIND_SAMPLE]);
+        }
+        BENCH_APPEND(",\"time\":%" PRId32, (int32_t) m->timestamp);
+        if (!(m->skipped_devices & (1 << SENSORS_DEVICE_SHT30))) {
+            BENCH_APPEND(",\"temp\":%.2f", m->temperature);
+        }
+        if (!(m->skipped_devices & (1 << SENSORS_DEVICE_BME280))) {
+            BENCH_APPEND(",\"temp_in\":%.2f", m->temperature_inside);
+        }
+        if (!(m->skipped_devices & (1 << SENSORS_DEVICE_SHT30))) {
+            BENCH_APPEND(",\"humd\":%.0f", m->humidity);
+        }
+        if (!(m->skipped_devices & (1 << SENSORS_DEVICE_BME280))) {
+            BENCH_APPEND(",\"pres\":%.2f", m->pressure);
+        }
+        if (!(m->skipped_devices & (1 << SENSORS_DEVICE_LTR390))) {
+            BENCH_APPEND(",\"dayl\":%" PRId32 ",\"uv\":%u", (int32_t) m->daylight, (unsigned) m->uv);
+        }
+        if (!(m->skipped_devices & (1 << SENSORS_DEVICE_MAX17048))) {
+            BENCH_APPEND(",\"batt\":{\"volt\":%.3f,\"chrg\":%.2f,\"chrt\":%.2f}", m->battery_voltage, m->battery_charge, m->battery_charge_rate);
+        }
+        BENCH_APPEND("}");
+    }
+    BENCH_APPEND("]}");
+
+#undef BENCH_APPEND
+
+    return offset;
+}
+
+/**
+ * Runs the printf reference over the JSON formatter's batches and prints
+ * its bytes/record and ns/record below them. Fails if the output differs.
+*/
+static int bench_json_reference(struct sensor_data_t* measurements, size_t measurements_length, char* buffer, char* reference)
+{
+    struct formatter_options_t options = { false, "weather", "station" };
+    const struct formatter_t* formatter = formatter_get(FORMATTER_FORMAT_JSON);
+    size_t batch_max_length = formatter_fitting_length(formatter, &options, BENCH_BATCH_BUFFER_SZ, BENCH_BATCH_MAX_MEASUREMENTS);
+    size_t total_bytes = 0;
+    double elapsed_ns = 0;
+
+    for (size_t offset = 0; offset < measurements_length; offset += batch_max_length) {
+        size_t length = measurements_length - offset < batch_max_length ? measurements_length - offset : batch_max_length;
+        size_t written = 0;
+        int reference_length = 0;
+
+        double start = bench_now_ns();
+        for (int round = 0; round < BENCH_ROUNDS; round++) {
+            reference_length = bench_json_printf(reference, BENCH_BATCH_BUFFER_SZ, &measurements[offset], length);
+        }
+        elapsed_ns += (bench_now_ns() - start) / BENCH_ROUNDS;
+
+        if (formatter_format(formatter, &options, buffer, BENCH_BATCH_BUFFER_SZ, &measurements[offset], length, &written) != ESP_OK
+            || reference_length < 0 || (size_t) reference_length != written || memcmp(buffer, reference, written) != 0) {
+            fprintf(stderr, "json (printf): batch at %zu differs from the formatter\n", offset);
+            return -1;
+        }
+        total_bytes += reference_length;
+    }
+
+    printf("  %-14s %8.1f %10.1f\n", "json (printf)", (double) total_bytes / measurements_length, elapsed_ns / measurements_length);
+    return 0;
+}
+
+/**
+ * Runs every registered formatter over [measurements] in pusher sized
+ * batches and prints bytes/record, ns/record and the peak buffer use next to
+ * the estimate the pusher sizes its batches by. The deflate columns show what
+ * data_sink_compression makes of every batch: bytes/record, the ratio to the
+ * uncompressed batch and the time per batch. The JSON formatter's printf
+ * predecessor follows as the reference for the integer emitters.
+*/
+static int bench_set(const char* name, struct sensor_data_t* measurements, size_t measurements_length)
+{
+    struct formatter_options_t options = { false, "weather", "station" };
+    uint8_t* buffer = malloc(BENCH_BATCH_BUFFER_SZ);
+    uint8_t* compressed = malloc(COMPRESSOR_DEFLATE_BOUND(BENCH_BATCH_BUFFER_SZ));
+
+    if (!buffer || !compressed || measurements_length == 0) {
+        free(buffer);
+        free(compressed);
+        return -1;
+    }
+
+    printf("%s: %zu records\n", name, measurements_length);
+    printf("  %-14s %8s %10s %10s %10s %6s %10s %7s %10s\n", "format", "B/record", "ns/record", "peak B", "estimate B", "batch", "deflate B", "ratio", "ns/batch");
+
+    for (size_t f = 0; f < FORMATTER_FORMATS; f++) {
+        const struct formatter_t* formatter = formatter_formats[f];
+        size_t batch_max_length = formatter_fitting_length(formatter, &options, BENCH_BATCH_BUFFER_SZ, BENCH_BATCH_MAX_MEASUREMENTS);
+        size_t total_bytes = 0;
+        size_t peak = 0;
+        double elapsed_ns = 0;
+        size_t compressed_bytes = 0;
+        double compress_ns = 0;
+        size_t batches = 0;
+
+        for (size_t offset = 0; offset < measurements_length; offset += batch_max_length) {
+            size_t length = measurements_length - offset < batch_max_length ? measurements_length - offset : batch_max_length;
+            size_t written = 0;
+
+            double start = bench_now_ns();
+            for (int round = 0; round < BENCH_ROUNDS; round++) {
+                if (formatter_format(formatter, &options, buffer, BENCH_BATCH_BUFFER_SZ, &measurements[offset], length, &written) != ESP_OK) {
+                    fprintf(stderr, "%s: %zu records do not fit\n", formatter->name, length);
+                    free(buffer);
+                    free(compressed);
+                    return -1;
+                }
+            }
+            elapsed_ns += (bench_now_ns() - start) / BENCH_ROUNDS;
+
+            size_t compressed_length = 0;
+            start = bench_now_ns();
+            for (int round = 0; round < BENCH_ROUNDS; round++) {
+                if (compressor_deflate(buffer, written, compressed, COMPRESSOR_DEFLATE_BOUND(BENCH_BATCH_BUFFER_SZ), &compressed_length) != ESP_OK) {
+                    fprintf(stderr, "%s: deflate failed\n", formatter->name);
+                    free(buffer);
+                    free(compressed);
+                    return -1;
+                }
+            }
+            compress_ns += (bench_now_ns() - start) / BENCH_ROUNDS;
+            compressed_bytes += compressed_length;
+            batches++;
+
+            // Text formats also need their terminator
+            size_t used = written + (formatter->text ? 1 : 0);
+            if (used > peak) {
+                peak = used;
+            }
+            total_bytes += written;
+        }
+
+        printf("  %-14s %8.1f %10.1f %10zu %10zu %6zu %10.1f %6.2fx %10.0f\n",
+            formatter->name,
+            (double) total_bytes / measurements_length,
+            elapsed_ns / measurements_length,
+            peak,
+            formatter->estimate(&options, batch_max_length),
+            batch_max_length,
+            (double) compressed_bytes / measurements_length,
+            (double) total_bytes / compressed_bytes,
+            compress_ns / batches);
+    }
+
+    int ret = bench_json_reference(measurements, measurements_length, (char*) buffer, (char*) compressed);
+
+    free(buffer);
+    free(compressed);
+    return ret;
+}
+
+int main(int argc, char** argv)
+{
+    struct sensor_data_t* measurements = calloc(BENCH_SYNTHETIC_RECORDS, sizeof(*measurements));
+    int ret = 0;
+
+    if (!measurements) {
+        return 1;
+    }
+
+    samples_generate(measurements, BENCH_SYNTHETIC_RECORDS, BENCH_MEASUREMENT_RATE, BENCH_SEED);
+    if (bench_set("synthetic", measurements, BENCH_SYNTHETIC_RECORDS) != 0) {
+        ret = 1;
+    }
+    free(measurements);
+
+    // Recordings given on the command line
+    for (int i = 1; i < argc; i++) {
+        size_t measurements_length = 0;
+        measurements = bench_load_csv(argv[i], &measurements_length);
+        if (!measurements || bench_set(argv[i], measurements, measurements_length) != 0) {
+            fprintf(stderr, "Failed to benchmark %s\n", argv[i]);
+            ret = 1;
+        }
+        free(measurements);
+    }
+
+    return ret;
+}
@@ -0,0 +1,317 @@
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#include "cJSON.h"
+
+#define CJSON_NESTING_MAX 64
+
+struct cjson_reader_t {
+    const char* text;
+    int depth;
+};
+
+static cJSON* cjson_parse_value(struct cjson_reader_t* reader);
+
+static void cjson_skip_whitespace(struct cjson_reader_t* reader)
+{
+    while (*reader->text == ' ' || *reader->text == '\t' || *reader->text == '\n' || *reader->text == '\r') {
+        reader->text += 1;
+    }
+}
+
+static bool cjson_consume(struct cjson_reader_t* reader, const char* literal)
+{
+    size_t length = strlen(literal);
+
+    if (strncmp(reader->text, literal, length) != 0) {
+        return false;
+    }
+
+    reader->text += length;
+    return true;
+}
+
+static int cjson_hex(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+/**
+ * Reads a string after its opening quote. \u escapes are written as UTF-8,
+ * surrogate pairs are not combined.
+*/
+static char* cjson_parse_string(struct cjson_reader_t* reader)
+{
+    const char* start = reader->text;
+    size_t length = 0;
+
+    while (*reader->text != '"') {
+        if (*reader->text == '\0' || (unsigned char) *reader->text < 0x20) {
+            return NULL;
+        }
+        reader->text += *reader->text == '\\' && reader->text[1] != '\0' ? 2 : 1;
+    }
+
+    char* value = malloc(reader->text - start + 1);
+    if (!value) {
+        return NULL;
+    }
+
+    for (const char* c = start; c < reader->text; c++) {
+        if (*c != '\\') {
+            value[length++] = *c;
+            continue;
+        }
+
+        c += 1;
+        switch (*c) {
+        case 'b': value[length++] = '\b'; break;
+        case 'f': value[length++] = '\f'; break;
+        case 'n': value[length++] = '\n'; break;
+        case 'r': value[length++] = '\r'; break;
+        case 't': value[length++] = '\t'; break;
+        case '"': case '\\': case '/': value[length++] = *c; break;
+        case 'u': {
+            unsigned int codepoint = 0;
+            for (int i = 1; i <= 4; i++) {
+                int digit = c + i < reader->text ? cjson_hex(c[i]) : -1;
+                if (digit < 0) {
+                    free(value);
+                    return NULL;
+                }
+                codepoint = codepoint << 4 | digit;
+            }
+            c += 4;
+            if (codepoint < 0x80) {
+                value[length++] = codepoint;
+            } else if (codepoint < 0x800) {
+                value[length++] = 0xC0 | codepoint >> 6;
+                value[length++] = 0x80 | (codepoint & 0x3F);
+            } else {
+                value[length++] = 0xE0 | codepoint >> 12;
+                value[length++] = 0x80 | ((codepoint >> 6) & 0x3F);
+                value[length++] = 0x80 | (codepoint & 0x3F);
+            }
+            break;
+        }
+        default:
+            free(value);
+            return NULL;
+        }
+    }
+
+    value[length] = '\0';
+    reader->text += 1;
+    return value;
+}
+
+static bool cjson_parse_number(struct cjson_reader_t* reader, cJSON* item)
+{
+    char* end;
+
+    if (*reader->text != '-' && (*reader->text < '0' || *reader->text > '9')) {
+        return false;
+    }
+
+    item->valuedouble = strtod(reader->text, &end);
+    if (end == reader->text) {
+        return false;
+    }
+    reader->text = end;
+
+    // Saturated like cJSON
+    if (item->valuedouble >= INT_MAX) {
+        item->valueint = INT_MAX;
+    } else if (item->valuedouble <= (double) INT_MIN) {
+        item->valueint = INT_MIN;
+    } else {
+        item->valueint = (int) item->valuedouble;
+    }
+
+    item->type = cJSON_Number;
+    return true;
+}
+
+/**
+ * Reads the elements of an array or the members of an object after the
+ * opening bracket
+*/
+static bool cjson_parse_children(struct cjson_reader_t* reader, cJSON* parent, char close, bool named)
+{
+    cJSON* last = NULL;
+
+    cjson_skip_whitespace(reader);
+    if (*reader->text == close) {
+        reader->text += 1;
+        return true;
+    }
+
+    while (true) {
+        char* name = NULL;
+
+        cjson_skip_whitespace(reader);
+        if (named) {
+            if (*reader->text != '"') {
+                return false;
+            }
+            reader->text += 1;
+            name = cjson_parse_string(reader);
+            cjson_skip_whitespace(reader);
+            if (!name || *reader->text != ':') {
+                free(name);
+                return false;
+            }
+            reader->text += 1;
+        }
+
+        cJSON* child = cjson_parse_value(reader);
+        if (!child) {
+            free(name);
+            return false;
+        }
+        child->string = name;
+
+        if (last) {
+            last->next = child;
+            child->prev = last;
+        } else {
+            parent->child = child;
+        }
+        last = child;
+
+        cjson_skip_whitespace(reader);
+        if (*reader->text == ',') {
+            reader->text += 1;
+        } else if (*reader->text == close) {
+            reader->text += 1;
+            return true;
+        } else {
+            return false;
+        }
+    }
+}
+
+static cJSON* cjson_parse_value(struct cjson_reader_t* reader)
+{
+    cJSON* item = calloc(1, sizeof(cJSON));
+    bool parsed = false;
+
+    if (!item) {
+        return NULL;
+    }
+
+    cjson_skip_whitespace(reader);
+    if (cjson_consume(reader, "null")) {
+        item->type = cJSON_NULL;
+        parsed = true;
+    } else if (cjson_consume(reader, "true")) {
+        item->type = cJSON_True;
+        item->valueint = 1;
+        parsed = true;
+    } else if (cjson_consume(reader, "false")) {
+        item->type = cJSON_False;
+        parsed = true;
+    } else if (*reader->text == '"') {
+        reader->text += 1;
+        item->type = cJSON_String;
+        item->valuestring = cjson_parse_string(reader);
+        parsed = item->valuestring != NULL;
+    } else if ((*reader->text == '[' || *reader->text == '{') && reader->depth < CJSON_NESTING_MAX) {
+        bool named = *reader->text == '{';
+        reader->text += 1;
+        reader->depth += 1;
+        item->type = named ? cJSON_Object : cJSON_Array;
+        parsed = cjson_parse_children(reader, item, named ? '}' : ']', named);
+        reader->depth -= 1;
+    } else {
+        parsed = cjson_parse_number(reader, item);
+    }
+
+    if (!parsed) {
+        cJSON_Delete(item);
+        return NULL;
+    }
+
+    return item;
+}
+
+cJSON* cJSON_Parse(const char* value)
+{
+    struct cjson_reader_t reader = { value, 0 };
+
+    if (!value) {
+        return NULL;
+    }
+
+    cJSON* root = cjson_parse_value(&reader);
+    cjson_skip_whitespace(&reader);
+    if (root && *reader.text != '\0') {
+        cJSON_Delete(root);
+        return NULL;
+    }
+
+    return root;
+}
+
+void cJSON_Delete(cJSON* item)
+{
+    while (item) {
+        cJSON* next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+int cJSON_GetArraySize(const cJSON* array)
+{
+    int size = 0;
+
+    for (cJSON* child = array ? array->child : NULL; child; child = child->next) {
+        size += 1;
+    }
+
+    return size;
+}
+
+cJSON* cJSON_GetArrayItem(const cJSON* array, int index)
+{
+    cJSON* child = array && index >= 0 ? array->child : NULL;
+
+    while (child && index > 0) {
+        child = child->next;
+        index -= 1;
+    }
+
+    return child;
+}
+
+cJSON* cJSON_GetObjectItemCaseSensitive(const cJSON* object, const char* string)
+{
+    if (!object || !string) {
+        return NULL;
+    }
+
+    for (cJSON* child = object->child; child; child = child->next) {
+        if (child->string && strcmp(child->string, string) == 0) {
+            return child;
+        }
+    }
+
+    return NULL;
+}
+
+bool cJSON_IsBool(const cJSON* item) { return item && (item->type & (cJSON_True | cJSON_False)); }
+bool cJSON_IsTrue(const cJSON* item) { return item && (item->type & cJSON_True); }
+bool cJSON_IsFalse(const cJSON* item) { return item && (item->type & cJSON_False); }
+bool cJSON_IsNull(const cJSON* item) { return item && (item->type & cJSON_NULL); }
+bool cJSON_IsNumber(const cJSON* item) { return item && (item->type & cJSON_Number); }
+bool cJSON_IsString(const cJSON* item) { return item && (item->type & cJSON_String); }
+bool cJSON_IsArray(const cJSON* item) { return item && (item->type & cJSON_Array); }
+bool cJSON_IsObject(const cJSON* item) { return item && (item->type & cJSON_Object); }
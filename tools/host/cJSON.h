@@ -0,0 +1,47 @@
+#ifndef __WEATHER_STATION__HOST_CJSON_H__
+#define __WEATHER_STATION__HOST_CJSON_H__
+
+/**
+ * The reading half of cJSON's API as the firmware uses it, on a small
+ * recursive descent parser (cJSON.c). Enough for the response bodies of the
+ * data sink, not a full replacement.
+*/
+
+#include <stdbool.h>
+
+#define cJSON_Invalid 0
+#define cJSON_False (1 << 0)
+#define cJSON_True (1 << 1)
+#define cJSON_NULL (1 << 2)
+#define cJSON_Number (1 << 3)
+#define cJSON_String (1 << 4)
+#define cJSON_Array (1 << 5)
+#define cJSON_Object (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON* next;
+    struct cJSON* prev;
+    struct cJSON* child;
+    int type;
+    char* valuestring;
+    int valueint;
+    double valuedouble;
+    char* string;
+} cJSON;
+
+cJSON* cJSON_Parse(const char* value);
+void cJSON_Delete(cJSON* item);
+int cJSON_GetArraySize(const cJSON* array);
+cJSON* cJSON_GetArrayItem(const cJSON* array, int index);
+cJSON* cJSON_GetObjectItemCaseSensitive(const cJSON* object, const char* string);
+
+bool cJSON_IsBool(const cJSON* item);
+bool cJSON_IsTrue(const cJSON* item);
+bool cJSON_IsFalse(const cJSON* item);
+bool cJSON_IsNull(const cJSON* item);
+bool cJSON_IsNumber(const cJSON* item);
+bool cJSON_IsString(const cJSON* item);
+bool cJSON_IsArray(const cJSON* item);
+bool cJSON_IsObject(const cJSON* item);
+
+#endif
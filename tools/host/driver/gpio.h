@@ -0,0 +1,12 @@
+#ifndef __WEATHER_STATION__HOST_GPIO_H__
+#define __WEATHER_STATION__HOST_GPIO_H__
+
+/**
+ * The pins referenced by sensors.h
+*/
+typedef enum {
+    GPIO_NUM_21 = 21,
+    GPIO_NUM_22 = 22,
+} gpio_num_t;
+
+#endif
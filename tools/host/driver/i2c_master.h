@@ -0,0 +1,88 @@
+#ifndef __WEATHER_STATION__HOST_I2C_MASTER_H__
+#define __WEATHER_STATION__HOST_I2C_MASTER_H__
+
+/**
+ * ESP-IDF's i2c master driver on a fake bus (i2c_master.c). Devices are
+ * simulated by the caller and attached with host_i2c_attach. The bus counts
+ * transactions, bytes and the bus time they take at the device's clock.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+
+typedef enum {
+    I2C_ADDR_BIT_LEN_7 = 0,
+} i2c_addr_bit_len_t;
+
+typedef enum {
+    I2C_CLK_SRC_DEFAULT = 0,
+} i2c_clock_source_t;
+
+typedef int i2c_port_num_t;
+
+typedef struct {
+    i2c_clock_source_t clk_source;
+    i2c_port_num_t i2c_port;
+    int scl_io_num;
+    int sda_io_num;
+    uint8_t glitch_ignore_cnt;
+    struct {
+        uint32_t enable_internal_pullup : 1;
+    } flags;
+} i2c_master_bus_config_t;
+
+typedef struct {
+    i2c_addr_bit_len_t dev_addr_length;
+    uint16_t device_address;
+    uint32_t scl_speed_hz;
+} i2c_device_config_t;
+
+typedef struct host_i2c_bus_t* i2c_master_bus_handle_t;
+typedef struct host_i2c_handle_t* i2c_master_dev_handle_t;
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t* bus_config, i2c_master_bus_handle_t* ret_bus_handle);
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle);
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t* dev_config, i2c_master_dev_handle_t* ret_handle);
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle);
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms);
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size, int xfer_timeout_ms);
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms);
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms);
+
+/**
+ * Host only: a simulated device. [transfer] gets what the master writes and
+ * fills what it reads, either may be empty. Transfers at a clock above
+ * [scl_speed_max_hz] are not acknowledged, like with weak pull-ups.
+*/
+struct host_i2c_device_t {
+    uint16_t address;
+    uint32_t scl_speed_max_hz;
+    esp_err_t (*transfer)(struct host_i2c_device_t* device, const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size);
+};
+
+/**
+ * Host only: what went over the bus since the last host_i2c_reset_stats.
+ * Bus time counts 9 bit times per byte, including the address bytes, plus
+ * start, repeated start and stop conditions, without clock stretching.
+*/
+struct host_i2c_stats_t {
+    size_t transactions;
+    size_t probes;
+    size_t bytes;
+    double bus_us;
+};
+
+void host_i2c_attach(struct host_i2c_device_t* device);
+void host_i2c_detach_all(void);
+void host_i2c_reset_stats(void);
+const struct host_i2c_stats_t* host_i2c_stats(void);
+
+/**
+ * Host only: the next [count] transfers to [address] fail, e.g. to make a
+ * driver probe the device again
+*/
+void host_i2c_fail(uint16_t address, size_t count);
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef __WEATHER_STATION__HOST_ESP_APP_DESC_H__
+#define __WEATHER_STATION__HOST_ESP_APP_DESC_H__
+
+#include <stddef.h>
+
+typedef struct {
+    char version[32];
+    char project_name[32];
+} esp_app_desc_t;
+
+const esp_app_desc_t* esp_app_get_description(void);
+int esp_app_get_elf_sha256(char* dst, size_t size);
+
+/**
+ * Host only: what esp_app_get_elf_sha256 reports, 64 hex characters
+*/
+extern const char* host_app_elf_sha256;
+
+#endif
@@ -0,0 +1,12 @@
+#ifndef __WEATHER_STATION__HOST_ESP_ATTR_H__
+#define __WEATHER_STATION__HOST_ESP_ATTR_H__
+
+/**
+ * RTC memory is ordinary memory on the host, it keeps its contents across
+ * the simulated restarts
+*/
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
+#define IRAM_ATTR
+
+#endif
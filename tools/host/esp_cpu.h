@@ -0,0 +1,15 @@
+#ifndef __WEATHER_STATION__HOST_ESP_CPU_H__
+#define __WEATHER_STATION__HOST_ESP_CPU_H__
+
+#include <stdint.h>
+#include "esp_timer.h"
+
+/**
+ * Microseconds stand in for cpu cycles on the host
+*/
+static inline uint32_t esp_cpu_get_cycle_count(void)
+{
+    return (uint32_t) esp_timer_get_time();
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef __WEATHER_STATION__HOST_ESP_CRT_BUNDLE_H__
+#define __WEATHER_STATION__HOST_ESP_CRT_BUNDLE_H__
+
+#include "esp_err.h"
+
+/**
+ * There are no certificates to check without TLS
+*/
+static inline esp_err_t esp_crt_bundle_attach(void* conf)
+{
+    return ESP_OK;
+}
+
+#endif
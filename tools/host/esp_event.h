@@ -0,0 +1,16 @@
+#ifndef __WEATHER_STATION__HOST_ESP_EVENT_H__
+#define __WEATHER_STATION__HOST_ESP_EVENT_H__
+
+#include <stdint.h>
+
+/**
+ * Included by the firmware modules built on the host. Only the handler
+ * types of the mqtt client are used, there is no event loop.
+*/
+
+typedef const char* esp_event_base_t;
+typedef void (*esp_event_handler_t)(void* event_handler_arg, esp_event_base_t event_base, int32_t event_id, void* event_data);
+
+#define ESP_EVENT_ANY_ID -1
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef __WEATHER_STATION__HOST_ESP_LOG_H__
+#define __WEATHER_STATION__HOST_ESP_LOG_H__
+
+/**
+ * ESP-IDF's log macros, printed to stderr. Only warnings and errors unless
+ * built with -DHOST_LOG_LEVEL=3. The format is not checked, the firmware
+ * logs size_t with %d like ESP-IDF does on the 32 bit target.
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#ifndef HOST_LOG_LEVEL
+#define HOST_LOG_LEVEL 2
+#endif
+
+static inline void host_log(int level, char letter, const char* tag, const char* format, ...)
+{
+    va_list arguments;
+
+    if (level > HOST_LOG_LEVEL) {
+        return;
+    }
+
+    va_start(arguments, format);
+    fprintf(stderr, "%c (%s) ", letter, tag);
+    vfprintf(stderr, format, arguments);
+    fputc('\n', stderr);
+    va_end(arguments);
+}
+
+#define ESP_LOGE(tag, format, ...) host_log(1, 'E', tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) host_log(2, 'W', tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) host_log(3, 'I', tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) host_log(4, 'D', tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) host_log(5, 'V', tag, format, ##__VA_ARGS__)
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef __WEATHER_STATION__HOST_ESP_MAC_H__
+#define __WEATHER_STATION__HOST_ESP_MAC_H__
+
+#include <stdint.h>
+#include <string.h>
+#include "esp_err.h"
+
+/**
+ * A fixed, locally administered mac
+*/
+static inline esp_err_t esp_efuse_mac_get_default(uint8_t* mac)
+{
+    static const uint8_t host_mac[6] = {0x02, 0x00, 0x00, 0x12, 0x34, 0x56};
+
+    memcpy(mac, host_mac, sizeof(host_mac));
+    return ESP_OK;
+}
+
+#endif
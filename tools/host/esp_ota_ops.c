@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_ota_ops.h"
+#include "esp_system.h"
+#include "esp_app_desc.h"
+
+static const esp_partition_t host_ota_slots[HOST_OTA_SLOTS] = {
+    { 0x10000, HOST_OTA_SLOT_SZ, "ota_0" },
+    { 0x10000 + HOST_OTA_SLOT_SZ, HOST_OTA_SLOT_SZ, "ota_1" },
+};
+
+static uint8_t host_ota_data[HOST_OTA_SLOTS][HOST_OTA_SLOT_SZ];
+static size_t host_ota_lengths[HOST_OTA_SLOTS];
+static esp_ota_img_states_t host_ota_states[HOST_OTA_SLOTS] = { ESP_OTA_IMG_VALID, ESP_OTA_IMG_UNDEFINED };
+static size_t host_ota_running = 0;
+static size_t host_ota_boot_index = 0;
+
+/**
+ * Slot being written, 0 if none. Handles are the slot index plus one.
+*/
+static esp_ota_handle_t host_ota_handle = 0;
+
+esp_reset_reason_t host_reset_reason = ESP_RST_POWERON;
+jmp_buf* host_restart_point = NULL;
+const char* host_app_elf_sha256 = "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855";
+
+static int host_ota_index(const esp_partition_t* partition)
+{
+    for (size_t i = 0; i < HOST_OTA_SLOTS; i++) {
+        if (partition == &host_ota_slots[i]) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+const esp_partition_t* host_ota_slot(size_t index)
+{
+    return &host_ota_slots[index];
+}
+
+uint8_t* host_ota_slot_data(const esp_partition_t* partition)
+{
+    return host_ota_data[host_ota_index(partition)];
+}
+
+size_t host_ota_slot_length(const esp_partition_t* partition)
+{
+    return host_ota_lengths[host_ota_index(partition)];
+}
+
+const esp_partition_t* host_ota_boot_partition(void)
+{
+    return &host_ota_slots[host_ota_boot_index];
+}
+
+void host_ota_install(const uint8_t* data, size_t length)
+{
+    memcpy(host_ota_data[host_ota_running], data, length);
+    host_ota_lengths[host_ota_running] = length;
+    host_ota_states[host_ota_running] = ESP_OTA_IMG_VALID;
+}
+
+void host_ota_boot(void)
+{
+    size_t previous = (host_ota_boot_index + 1) % HOST_OTA_SLOTS;
+
+    if (host_ota_states[host_ota_boot_index] == ESP_OTA_IMG_PENDING_VERIFY) {
+        host_ota_states[host_ota_boot_index] = ESP_OTA_IMG_ABORTED;
+        host_ota_boot_index = previous;
+    } else if (host_ota_states[host_ota_boot_index] == ESP_OTA_IMG_NEW) {
+        host_ota_states[host_ota_boot_index] = ESP_OTA_IMG_PENDING_VERIFY;
+    }
+
+    host_ota_running = host_ota_boot_index;
+    host_ota_handle = 0;
+}
+
+const esp_partition_t* esp_ota_get_running_partition(void)
+{
+    return &host_ota_slots[host_ota_running];
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from)
+{
+    return &host_ota_slots[(host_ota_running + 1) % HOST_OTA_SLOTS];
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle)
+{
+    int index = host_ota_index(partition);
+
+    if (index < 0 || host_ota_handle != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((size_t) index == host_ota_running) {
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+
+    host_ota_lengths[index] = 0;
+    host_ota_states[index] = ESP_OTA_IMG_UNDEFINED;
+    host_ota_handle = index + 1;
+    *out_handle = host_ota_handle;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size)
+{
+    if (handle == 0 || handle != host_ota_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    size_t index = handle - 1;
+    if (size > HOST_OTA_SLOT_SZ - host_ota_lengths[index]) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    memcpy(&host_ota_data[index][host_ota_lengths[index]], data, size);
+    host_ota_lengths[index] += size;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    if (handle == 0 || handle != host_ota_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_ota_handle = 0;
+    return host_ota_lengths[handle - 1] > 0 ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    if (handle == 0 || handle != host_ota_handle) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    host_ota_handle = 0;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition)
+{
+    int index = host_ota_index(partition);
+
+    if (index < 0 || host_ota_lengths[index] == 0) {
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+
+    if ((size_t) index != host_ota_running) {
+        host_ota_states[index] = ESP_OTA_IMG_NEW;
+    }
+    host_ota_boot_index = index;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state)
+{
+    int index = host_ota_index(partition);
+
+    if (index < 0 || host_ota_states[index] == ESP_OTA_IMG_UNDEFINED) {
+        return ESP_ERR_NOT_FOUND;
+    }
+
+    *ota_state = host_ota_states[index];
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    host_ota_states[host_ota_running] = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void)
+{
+    size_t previous = (host_ota_running + 1) % HOST_OTA_SLOTS;
+
+    if (host_ota_states[previous] != ESP_OTA_IMG_VALID) {
+        return ESP_ERR_OTA_ROLLBACK_FAILED;
+    }
+
+    host_ota_states[host_ota_running] = ESP_OTA_IMG_INVALID;
+    host_ota_boot_index = previous;
+    esp_restart();
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* partition, size_t src_offset, void* dst, size_t size)
+{
+    int index = host_ota_index(partition);
+
+    if (index < 0 || src_offset > partition->size || size > partition->size - src_offset) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    memcpy(dst, &host_ota_data[index][src_offset], size);
+    return ESP_OK;
+}
+
+esp_reset_reason_t esp_reset_reason(void)
+{
+    return host_reset_reason;
+}
+
+void esp_restart(void)
+{
+    host_reset_reason = ESP_RST_SW;
+
+    if (host_restart_point) {
+        longjmp(*host_restart_point, 1);
+    }
+
+    exit(0);
+}
+
+const esp_app_desc_t* esp_app_get_description(void)
+{
+    static const esp_app_desc_t description = { "host", "weather_station" };
+
+    return &description;
+}
+
+int esp_app_get_elf_sha256(char* dst, size_t size)
+{
+    if (size == 0) {
+        return 0;
+    }
+
+    snprintf(dst, size, "%s", host_app_elf_sha256);
+    return strlen(dst);
+}
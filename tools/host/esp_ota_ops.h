@@ -0,0 +1,66 @@
+#ifndef __WEATHER_STATION__HOST_ESP_OTA_OPS_H__
+#define __WEATHER_STATION__HOST_ESP_OTA_OPS_H__
+
+/**
+ * ESP-IDF's app update API on two ota slots in memory (esp_ota_ops.c),
+ * with the bootloader's rollback handling in host_ota_boot. The image in a
+ * slot is not validated.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "esp_err.h"
+#include "esp_partition.h"
+
+#define OTA_SIZE_UNKNOWN 0xFFFFFFFF
+#define OTA_WITH_SEQUENTIAL_WRITES 0xFFFFFFFE
+
+#define HOST_OTA_SLOTS 2
+#define HOST_OTA_SLOT_SZ (256 * 1024)
+
+typedef uint32_t esp_ota_handle_t;
+
+typedef enum {
+    ESP_OTA_IMG_NEW = 0x0,
+    ESP_OTA_IMG_PENDING_VERIFY = 0x1,
+    ESP_OTA_IMG_VALID = 0x2,
+    ESP_OTA_IMG_INVALID = 0x3,
+    ESP_OTA_IMG_ABORTED = 0x4,
+    ESP_OTA_IMG_UNDEFINED = 0xFFFFFFFF,
+} esp_ota_img_states_t;
+
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start_from);
+esp_err_t esp_ota_begin(const esp_partition_t* partition, size_t image_size, esp_ota_handle_t* out_handle);
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void* data, size_t size);
+esp_err_t esp_ota_end(esp_ota_handle_t handle);
+esp_err_t esp_ota_abort(esp_ota_handle_t handle);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* partition);
+esp_err_t esp_ota_get_state_partition(const esp_partition_t* partition, esp_ota_img_states_t* ota_state);
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void);
+esp_err_t esp_ota_mark_app_invalid_rollback_and_reboot(void);
+
+/**
+ * Host only: the slots, what got written into them and the slot the next
+ * boot starts
+*/
+const esp_partition_t* host_ota_slot(size_t index);
+uint8_t* host_ota_slot_data(const esp_partition_t* partition);
+size_t host_ota_slot_length(const esp_partition_t* partition);
+const esp_partition_t* host_ota_boot_partition(void);
+
+/**
+ * Host only: puts [length] bytes of [data] into the running slot as a
+ * confirmed image
+*/
+void host_ota_install(const uint8_t* data, size_t length);
+
+/**
+ * Host only: boots like the bootloader with rollback enabled. A new image
+ * becomes pending verification, one still pending is aborted and the
+ * previous valid one booted instead.
+*/
+void host_ota_boot(void);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef __WEATHER_STATION__HOST_ESP_RANDOM_H__
+#define __WEATHER_STATION__HOST_ESP_RANDOM_H__
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/**
+ * rand() instead of the hardware generator, so a seeded run repeats
+*/
+static inline uint32_t esp_random(void)
+{
+    return ((uint32_t) rand() << 16) ^ (uint32_t) rand();
+}
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __WEATHER_STATION__HOST_ESP_SYSTEM_H__
+#define __WEATHER_STATION__HOST_ESP_SYSTEM_H__
+
+#include <setjmp.h>
+#include "esp_err.h"
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO,
+} esp_reset_reason_t;
+
+esp_reset_reason_t esp_reset_reason(void);
+
+/**
+ * Jumps to host_restart_point, or exits if it is not set
+*/
+void esp_restart(void) __attribute__((noreturn));
+
+/**
+ * Host only: the reason esp_reset_reason reports and where esp_restart
+ * continues, set with setjmp
+*/
+extern esp_reset_reason_t host_reset_reason;
+extern jmp_buf* host_restart_point;
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __WEATHER_STATION__HOST_ESP_TIMER_H__
+#define __WEATHER_STATION__HOST_ESP_TIMER_H__
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * Microseconds on the monotonic clock
+*/
+static inline int64_t esp_timer_get_time(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+#endif
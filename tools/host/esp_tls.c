@@ -0,0 +1,90 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "esp_tls.h"
+#include "http_parser.h"
+
+esp_tls_t* esp_tls_init(void)
+{
+    esp_tls_t* tls = malloc(sizeof(esp_tls_t));
+
+    if (tls) {
+        tls->sockfd = -1;
+    }
+
+    return tls;
+}
+
+/**
+ * Connects to the host and port of [url]. Returns 1 once connected, -1 on
+ * failure.
+*/
+int esp_tls_conn_http_new_sync(const char* url, const esp_tls_cfg_t* cfg, esp_tls_t* tls)
+{
+    struct http_parser_url u;
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* result;
+    char host[128];
+    char port[8];
+
+    if (http_parser_parse_url(url, strlen(url), 0, &u) != 0 || u.field_data[UF_HOST].len >= sizeof(host)) {
+        return -1;
+    }
+
+    memcpy(host, &url[u.field_data[UF_HOST].off], u.field_data[UF_HOST].len);
+    host[u.field_data[UF_HOST].len] = '\0';
+    if (u.field_set & (1 << UF_PORT)) {
+        snprintf(port, sizeof(port), "%u", u.port);
+    } else {
+        snprintf(port, sizeof(port), "%s", strncmp(url, "https:", 6) == 0 ? "443" : "80");
+    }
+
+    if (getaddrinfo(host, port, &hints, &result) != 0) {
+        return -1;
+    }
+
+    tls->sockfd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (tls->sockfd >= 0 && connect(tls->sockfd, result->ai_addr, result->ai_addrlen) != 0) {
+        close(tls->sockfd);
+        tls->sockfd = -1;
+    }
+    freeaddrinfo(result);
+
+    if (tls->sockfd < 0) {
+        return -1;
+    }
+
+    struct timeval timeout = { cfg->timeout_ms / 1000, (cfg->timeout_ms % 1000) * 1000 };
+    int nodelay = 1;
+    setsockopt(tls->sockfd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(tls->sockfd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    return 1;
+}
+
+ssize_t esp_tls_conn_read(esp_tls_t* tls, void* data, size_t datalen)
+{
+    return read(tls->sockfd, data, datalen);
+}
+
+ssize_t esp_tls_conn_write(esp_tls_t* tls, const void* data, size_t datalen)
+{
+    return send(tls->sockfd, data, datalen, MSG_NOSIGNAL);
+}
+
+int esp_tls_conn_destroy(esp_tls_t* tls)
+{
+    if (tls->sockfd >= 0) {
+        close(tls->sockfd);
+    }
+    free(tls);
+
+    return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef __WEATHER_STATION__HOST_ESP_TLS_H__
+#define __WEATHER_STATION__HOST_ESP_TLS_H__
+
+/**
+ * The part of esp-tls the firmware uses, backed by plain TCP sockets
+ * (esp_tls.c). https urls connect without TLS, so host stand-ins can read
+ * what the station sends.
+*/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include "esp_err.h"
+
+#define ESP_TLS_ERR_SSL_WANT_READ -0x6900
+#define ESP_TLS_ERR_SSL_WANT_WRITE -0x6880
+
+typedef struct esp_tls_cfg {
+    esp_err_t (*crt_bundle_attach)(void* conf);
+    int timeout_ms;
+} esp_tls_cfg_t;
+
+typedef struct esp_tls {
+    int sockfd;
+} esp_tls_t;
+
+esp_tls_t* esp_tls_init(void);
+int esp_tls_conn_http_new_sync(const char* url, const esp_tls_cfg_t* cfg, esp_tls_t* tls);
+ssize_t esp_tls_conn_read(esp_tls_t* tls, void* data, size_t datalen);
+ssize_t esp_tls_conn_write(esp_tls_t* tls, const void* data, size_t datalen);
+int esp_tls_conn_destroy(esp_tls_t* tls);
+
+#endif
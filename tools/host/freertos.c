@@ -0,0 +1,240 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+
+struct host_semaphore_t {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned int count;
+};
+
+struct host_queue_t {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned int length;
+    unsigned int item_size;
+    unsigned int head;
+    unsigned int count;
+    uint8_t items[];
+};
+
+struct host_task_start_t {
+    TaskFunction_t function;
+    void* parameters;
+};
+
+static void* host_task_run(void* argument)
+{
+    struct host_task_start_t start = *(struct host_task_start_t*) argument;
+
+    free(argument);
+    start.function(start.parameters);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters, UBaseType_t priority, TaskHandle_t* created)
+{
+    struct host_task_start_t* start = malloc(sizeof(struct host_task_start_t));
+    pthread_t thread;
+
+    if (!start) {
+        return pdFAIL;
+    }
+    start->function = function;
+    start->parameters = parameters;
+
+    if (pthread_create(&thread, NULL, host_task_run, start) != 0) {
+        free(start);
+        return pdFAIL;
+    }
+    pthread_detach(thread);
+
+    if (created) {
+        *created = NULL;
+    }
+    return pdPASS;
+}
+
+/**
+ * Only deleting the calling task is supported
+*/
+void vTaskDelete(TaskHandle_t task)
+{
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec delay = { ticks / 1000, (long) (ticks % 1000) * 1000000 };
+
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR) {
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (TickType_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+static SemaphoreHandle_t host_semaphore_create(unsigned int count)
+{
+    struct host_semaphore_t* semaphore = malloc(sizeof(struct host_semaphore_t));
+
+    if (semaphore) {
+        pthread_mutex_init(&semaphore->mutex, NULL);
+        pthread_cond_init(&semaphore->cond, NULL);
+        semaphore->count = count;
+    }
+
+    return semaphore;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_semaphore_create(0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_semaphore_create(1);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore)
+{
+    BaseType_t given = pdFALSE;
+
+    pthread_mutex_lock(&semaphore->mutex);
+    if (semaphore->count == 0) {
+        semaphore->count = 1;
+        given = pdTRUE;
+        pthread_cond_signal(&semaphore->cond);
+    }
+    pthread_mutex_unlock(&semaphore->mutex);
+
+    return given;
+}
+
+/**
+ * The time [ticks] from now, for pthread_cond_timedwait
+*/
+static struct timespec host_deadline(TickType_t ticks)
+{
+    struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += ticks / 1000;
+    deadline.tv_nsec += (long) (ticks % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    return deadline;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    int err = 0;
+
+    pthread_mutex_lock(&semaphore->mutex);
+    while (semaphore->count == 0 && err != ETIMEDOUT) {
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&semaphore->cond, &semaphore->mutex);
+        } else {
+            err = pthread_cond_timedwait(&semaphore->cond, &semaphore->mutex, &deadline);
+        }
+    }
+    BaseType_t taken = semaphore->count > 0;
+    if (taken) {
+        semaphore->count = 0;
+    }
+    pthread_mutex_unlock(&semaphore->mutex);
+
+    return taken ? pdTRUE : pdFALSE;
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t semaphore)
+{
+    pthread_cond_destroy(&semaphore->cond);
+    pthread_mutex_destroy(&semaphore->mutex);
+    free(semaphore);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct host_queue_t* queue = malloc(sizeof(struct host_queue_t) + length * item_size);
+
+    if (queue) {
+        pthread_mutex_init(&queue->mutex, NULL);
+        pthread_cond_init(&queue->cond, NULL);
+        queue->length = length;
+        queue->item_size = item_size;
+        queue->head = 0;
+        queue->count = 0;
+    }
+
+    return queue;
+}
+
+/**
+ * Sending does not block, a full queue fails right away whatever [ticks]
+ * says
+*/
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    BaseType_t sent = pdFALSE;
+
+    pthread_mutex_lock(&queue->mutex);
+    if (queue->count < queue->length) {
+        unsigned int tail = (queue->head + queue->count) % queue->length;
+        memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+        queue->count += 1;
+        sent = pdTRUE;
+        pthread_cond_signal(&queue->cond);
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return sent;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks)
+{
+    struct timespec deadline = host_deadline(ticks);
+    int err = 0;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0 && err != ETIMEDOUT) {
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        } else {
+            err = pthread_cond_timedwait(&queue->cond, &queue->mutex, &deadline);
+        }
+    }
+    BaseType_t received = queue->count > 0;
+    if (received) {
+        memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count -= 1;
+    }
+    pthread_mutex_unlock(&queue->mutex);
+
+    return received ? pdTRUE : pdFALSE;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_cond_destroy(&queue->cond);
+    pthread_mutex_destroy(&queue->mutex);
+    free(queue);
+}
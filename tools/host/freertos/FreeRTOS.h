@@ -0,0 +1,26 @@
+#ifndef __WEATHER_STATION__HOST_FREERTOS_H__
+#define __WEATHER_STATION__HOST_FREERTOS_H__
+
+/**
+ * The part of FreeRTOS the firmware uses, backed by POSIX threads
+ * (freertos.c, link with -lpthread). A tick is a millisecond.
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define portMAX_DELAY ((TickType_t) 0xFFFFFFFF)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+
+#endif
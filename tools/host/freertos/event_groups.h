@@ -0,0 +1,6 @@
+#ifndef __WEATHER_STATION__HOST_FREERTOS_EVENT_GROUPS_H__
+#define __WEATHER_STATION__HOST_FREERTOS_EVENT_GROUPS_H__
+
+#include "freertos/FreeRTOS.h"
+
+#endif
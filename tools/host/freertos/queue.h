@@ -0,0 +1,13 @@
+#ifndef __WEATHER_STATION__HOST_FREERTOS_QUEUE_H__
+#define __WEATHER_STATION__HOST_FREERTOS_QUEUE_H__
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_queue_t* QueueHandle_t;
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks);
+void vQueueDelete(QueueHandle_t queue);
+
+#endif
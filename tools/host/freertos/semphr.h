@@ -0,0 +1,14 @@
+#ifndef __WEATHER_STATION__HOST_FREERTOS_SEMPHR_H__
+#define __WEATHER_STATION__HOST_FREERTOS_SEMPHR_H__
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_semaphore_t* SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t ticks);
+void vSemaphoreDelete(SemaphoreHandle_t semaphore);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef __WEATHER_STATION__HOST_FREERTOS_TASK_H__
+#define __WEATHER_STATION__HOST_FREERTOS_TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void* parameters);
+typedef struct host_task_t* TaskHandle_t;
+
+/**
+ * Tasks run as detached threads, the stack depth and priority are ignored
+*/
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* parameters, UBaseType_t priority, TaskHandle_t* created);
+void vTaskDelete(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+
+#endif
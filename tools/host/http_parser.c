@@ -0,0 +1,93 @@
+#include <string.h>
+#include <stdlib.h>
+
+#include "http_parser.h"
+
+static void http_parser_set_field(struct http_parser_url* u, enum http_parser_url_fields field, size_t off, size_t len)
+{
+    u->field_set |= 1 << field;
+    u->field_data[field].off = off;
+    u->field_data[field].len = len;
+}
+
+void http_parser_url_init(struct http_parser_url* u)
+{
+    memset(u, 0, sizeof(struct http_parser_url));
+}
+
+/**
+ * Parses absolute urls: schema://[userinfo@]host[:port][/path][?query][#fragment].
+ * Returns non-zero if [buf] is none.
+*/
+int http_parser_parse_url(const char* buf, size_t buflen, int is_connect, struct http_parser_url* u)
+{
+    const char* schema_end = memchr(buf, ':', buflen);
+    size_t offset;
+    size_t end;
+
+    http_parser_url_init(u);
+
+    if (is_connect || !schema_end || schema_end == buf || buflen - (schema_end - buf) < 3 || strncmp(schema_end, "://", 3) != 0) {
+        return 1;
+    }
+    http_parser_set_field(u, UF_SCHEMA, 0, schema_end - buf);
+    offset = schema_end - buf + 3;
+
+    // Authority up to the path, query or fragment
+    end = offset;
+    while (end < buflen && buf[end] != '/' && buf[end] != '?' && buf[end] != '#') {
+        end += 1;
+    }
+
+    const char* at = memchr(&buf[offset], '@', end - offset);
+    if (at) {
+        http_parser_set_field(u, UF_USERINFO, offset, at - &buf[offset]);
+        offset = at - buf + 1;
+    }
+
+    const char* colon = memchr(&buf[offset], ':', end - offset);
+    size_t host_end = colon ? (size_t) (colon - buf) : end;
+    if (host_end == offset) {
+        return 1;
+    }
+    http_parser_set_field(u, UF_HOST, offset, host_end - offset);
+
+    if (colon) {
+        char port[8] = {0};
+        size_t port_length = end - host_end - 1;
+        if (port_length == 0 || port_length >= sizeof(port) || strspn(colon + 1, "0123456789") < port_length) {
+            return 1;
+        }
+        memcpy(port, colon + 1, port_length);
+        if (atol(port) > 0xFFFF) {
+            return 1;
+        }
+        http_parser_set_field(u, UF_PORT, host_end + 1, port_length);
+        u->port = atol(port);
+    }
+    offset = end;
+
+    if (offset < buflen && buf[offset] == '/') {
+        end = offset;
+        while (end < buflen && buf[end] != '?' && buf[end] != '#') {
+            end += 1;
+        }
+        http_parser_set_field(u, UF_PATH, offset, end - offset);
+        offset = end;
+    }
+
+    if (offset < buflen && buf[offset] == '?') {
+        end = offset + 1;
+        while (end < buflen && buf[end] != '#') {
+            end += 1;
+        }
+        http_parser_set_field(u, UF_QUERY, offset + 1, end - offset - 1);
+        offset = end;
+    }
+
+    if (offset < buflen && buf[offset] == '#') {
+        http_parser_set_field(u, UF_FRAGMENT, offset + 1, buflen - offset - 1);
+    }
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+#ifndef __WEATHER_STATION__HOST_HTTP_PARSER_H__
+#define __WEATHER_STATION__HOST_HTTP_PARSER_H__
+
+/**
+ * The url parser of nodejs' http_parser as shipped with ESP-IDF
+ * (http_parser.c). Like the original, the query and the fragment exclude
+ * their '?' and '#'.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+enum http_parser_url_fields {
+    UF_SCHEMA = 0,
+    UF_HOST = 1,
+    UF_PORT = 2,
+    UF_PATH = 3,
+    UF_QUERY = 4,
+    UF_FRAGMENT = 5,
+    UF_USERINFO = 6,
+    UF_MAX = 7,
+};
+
+struct http_parser_url {
+    uint16_t field_set;
+    uint16_t port;
+
+    struct {
+        uint16_t off;
+        uint16_t len;
+    } field_data[UF_MAX];
+};
+
+void http_parser_url_init(struct http_parser_url* u);
+int http_parser_parse_url(const char* buf, size_t buflen, int is_connect, struct http_parser_url* u);
+
+#endif
@@ -0,0 +1,156 @@
+#include <stdlib.h>
+
+#include "driver/i2c_master.h"
+
+#define HOST_I2C_DEVICES_MAX 8
+
+struct host_i2c_bus_t {
+    int unused;
+};
+
+struct host_i2c_handle_t {
+    uint16_t address;
+    uint32_t scl_speed_hz;
+};
+
+static struct host_i2c_bus_t host_i2c_bus;
+static bool host_i2c_bus_open = false;
+static struct host_i2c_device_t* host_i2c_devices[HOST_I2C_DEVICES_MAX];
+static size_t host_i2c_devices_length = 0;
+static struct host_i2c_stats_t host_i2c_counters;
+static uint16_t host_i2c_failing_address;
+static size_t host_i2c_failing_count = 0;
+
+void host_i2c_attach(struct host_i2c_device_t* device)
+{
+    if (host_i2c_devices_length < HOST_I2C_DEVICES_MAX) {
+        host_i2c_devices[host_i2c_devices_length++] = device;
+    }
+}
+
+void host_i2c_detach_all(void)
+{
+    host_i2c_devices_length = 0;
+}
+
+void host_i2c_reset_stats(void)
+{
+    host_i2c_counters = (struct host_i2c_stats_t) {0};
+}
+
+const struct host_i2c_stats_t* host_i2c_stats(void)
+{
+    return &host_i2c_counters;
+}
+
+void host_i2c_fail(uint16_t address, size_t count)
+{
+    host_i2c_failing_address = address;
+    host_i2c_failing_count = count;
+}
+
+static struct host_i2c_device_t* host_i2c_find(uint16_t address)
+{
+    for (size_t i = 0; i < host_i2c_devices_length; i++) {
+        if (host_i2c_devices[i]->address == address) {
+            return host_i2c_devices[i];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Counts one transaction: start, address and write bytes, then a repeated
+ * start, address and read bytes if both are there, and the stop
+*/
+static void host_i2c_count(uint32_t scl_speed_hz, size_t write_size, size_t read_size)
+{
+    size_t phases = (write_size > 0 || read_size == 0 ? 1 : 0) + (read_size > 0 ? 1 : 0);
+    size_t bytes = phases + write_size + read_size;
+    size_t bit_times = 9 * bytes + phases + 1;
+
+    host_i2c_counters.transactions += 1;
+    host_i2c_counters.bytes += bytes;
+    host_i2c_counters.bus_us += bit_times * 1e6 / scl_speed_hz;
+}
+
+static esp_err_t host_i2c_transfer(i2c_master_dev_handle_t handle, const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size)
+{
+    struct host_i2c_device_t* device = host_i2c_find(handle->address);
+
+    host_i2c_count(handle->scl_speed_hz, write_size, read_size);
+
+    if (!device || handle->scl_speed_hz > device->scl_speed_max_hz) {
+        return ESP_FAIL;
+    }
+    if (host_i2c_failing_count > 0 && host_i2c_failing_address == handle->address) {
+        host_i2c_failing_count -= 1;
+        return ESP_FAIL;
+    }
+
+    return device->transfer(device, write_buffer, write_size, read_buffer, read_size);
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t* bus_config, i2c_master_bus_handle_t* ret_bus_handle)
+{
+    if (host_i2c_bus_open) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    host_i2c_bus_open = true;
+    *ret_bus_handle = &host_i2c_bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_del_master_bus(i2c_master_bus_handle_t bus_handle)
+{
+    host_i2c_bus_open = false;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t* dev_config, i2c_master_dev_handle_t* ret_handle)
+{
+    struct host_i2c_handle_t* handle = malloc(sizeof(struct host_i2c_handle_t));
+
+    if (!handle) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    handle->address = dev_config->device_address;
+    handle->scl_speed_hz = dev_config->scl_speed_hz;
+    *ret_handle = handle;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle)
+{
+    free(handle);
+    return ESP_OK;
+}
+
+/**
+ * An address-only write at standard mode, like the driver does
+*/
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms)
+{
+    host_i2c_count(100000, 0, 0);
+    host_i2c_counters.probes += 1;
+
+    return host_i2c_find(address) ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size, int xfer_timeout_ms)
+{
+    return host_i2c_transfer(i2c_dev, write_buffer, write_size, NULL, 0);
+}
+
+esp_err_t i2c_master_receive(i2c_master_dev_handle_t i2c_dev, uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+    return host_i2c_transfer(i2c_dev, NULL, 0, read_buffer, read_size);
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size, int xfer_timeout_ms)
+{
+    return host_i2c_transfer(i2c_dev, write_buffer, write_size, read_buffer, read_size);
+}
@@ -0,0 +1,6 @@
+#ifndef __WEATHER_STATION__HOST_LWIP_NETDB_H__
+#define __WEATHER_STATION__HOST_LWIP_NETDB_H__
+
+#include <netdb.h>
+
+#endif
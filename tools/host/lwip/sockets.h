@@ -0,0 +1,16 @@
+#ifndef __WEATHER_STATION__HOST_LWIP_SOCKETS_H__
+#define __WEATHER_STATION__HOST_LWIP_SOCKETS_H__
+
+/**
+ * lwIP implements the BSD socket API, the host's one is used instead
+*/
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#endif
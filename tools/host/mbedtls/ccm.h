@@ -0,0 +1,24 @@
+#ifndef __WEATHER_STATION__HOST_MBEDTLS_CCM_H__
+#define __WEATHER_STATION__HOST_MBEDTLS_CCM_H__
+
+/**
+ * Just enough of mbedtls' ccm.h to build bthome.c on the host, backed by
+ * OpenSSL's AES-CCM (mbedtls_ccm.c, link with -lcrypto)
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_CIPHER_ID_AES 2
+
+typedef struct {
+    unsigned char key[32];
+    unsigned int key_bits;
+} mbedtls_ccm_context;
+
+void mbedtls_ccm_init(mbedtls_ccm_context* ctx);
+int mbedtls_ccm_setkey(mbedtls_ccm_context* ctx, int cipher, const unsigned char* key, unsigned int keybits);
+int mbedtls_ccm_encrypt_and_tag(mbedtls_ccm_context* ctx, size_t length, const unsigned char* iv, size_t iv_len, const unsigned char* ad, size_t ad_len, const unsigned char* input, unsigned char* output, unsigned char* tag, size_t tag_len);
+void mbedtls_ccm_free(mbedtls_ccm_context* ctx);
+
+#endif
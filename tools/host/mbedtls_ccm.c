@@ -0,0 +1,47 @@
+#include <string.h>
+#include <openssl/evp.h>
+
+#include "mbedtls/ccm.h"
+
+void mbedtls_ccm_init(mbedtls_ccm_context* ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_ccm_context));
+}
+
+int mbedtls_ccm_setkey(mbedtls_ccm_context* ctx, int cipher, const unsigned char* key, unsigned int keybits)
+{
+    if (cipher != MBEDTLS_CIPHER_ID_AES || (keybits != 128 && keybits != 256)) {
+        return -1;
+    }
+
+    memcpy(ctx->key, key, keybits / 8);
+    ctx->key_bits = keybits;
+    return 0;
+}
+
+int mbedtls_ccm_encrypt_and_tag(mbedtls_ccm_context* ctx, size_t length, const unsigned char* iv, size_t iv_len, const unsigned char* ad, size_t ad_len, const unsigned char* input, unsigned char* output, unsigned char* tag, size_t tag_len)
+{
+    EVP_CIPHER_CTX* evp = EVP_CIPHER_CTX_new();
+    int out_length = 0;
+    int ok = evp != NULL;
+
+    ok = ok && EVP_EncryptInit_ex(evp, ctx->key_bits == 256 ? EVP_aes_256_ccm() : EVP_aes_128_ccm(), NULL, NULL, NULL);
+    ok = ok && EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_SET_IVLEN, iv_len, NULL);
+    ok = ok && EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_SET_TAG, tag_len, NULL);
+    ok = ok && EVP_EncryptInit_ex(evp, NULL, NULL, ctx->key, iv);
+    ok = ok && EVP_EncryptUpdate(evp, NULL, &out_length, NULL, length);
+    if (ad_len > 0) {
+        ok = ok && EVP_EncryptUpdate(evp, NULL, &out_length, ad, ad_len);
+    }
+    ok = ok && EVP_EncryptUpdate(evp, output, &out_length, input, length);
+    ok = ok && EVP_EncryptFinal_ex(evp, output + out_length, &out_length);
+    ok = ok && EVP_CIPHER_CTX_ctrl(evp, EVP_CTRL_CCM_GET_TAG, tag_len, tag);
+
+    EVP_CIPHER_CTX_free(evp);
+    return ok ? 0 : -1;
+}
+
+void mbedtls_ccm_free(mbedtls_ccm_context* ctx)
+{
+    memset(ctx, 0, sizeof(mbedtls_ccm_context));
+}
@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "mqtt_client.h"
+
+#define HOST_MQTT_KEEPALIVE_S 120
+#define HOST_MQTT_PACKET_MAX_SZ 8192
+
+#define HOST_MQTT_CONNECT    0x10
+#define HOST_MQTT_CONNACK    0x20
+#define HOST_MQTT_PUBLISH    0x30
+#define HOST_MQTT_PUBACK     0x40
+#define HOST_MQTT_DISCONNECT 0xE0
+
+static const char* HOST_MQTT_EVENTS = "MQTT_EVENTS";
+
+struct esp_mqtt_client {
+    char* hostname;
+    char* client_id;
+    uint32_t port;
+    bool clean_session;
+    int keepalive;
+
+    esp_event_handler_t handler;
+    void* handler_arg;
+
+    int fd;
+    pthread_t thread;
+    bool started;
+    volatile bool connected;
+    volatile bool stopping;
+    pthread_mutex_t send_lock;
+    uint16_t next_msg_id;
+};
+
+static void host_mqtt_dispatch(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event_id, int msg_id, int session_present)
+{
+    esp_mqtt_event_t event = { event_id, client, msg_id, session_present };
+
+    if (client->handler) {
+        client->handler(client->handler_arg, HOST_MQTT_EVENTS, event_id, &event);
+    }
+}
+
+/**
+ * Writes the remaining length of a fixed header, returns its size
+*/
+static size_t host_mqtt_write_length(uint8_t* buffer, size_t length)
+{
+    size_t written = 0;
+
+    do {
+        uint8_t digit = length % 128;
+        length /= 128;
+        buffer[written++] = digit | (length > 0 ? 0x80 : 0);
+    } while (length > 0);
+
+    return written;
+}
+
+static size_t host_mqtt_write_string(uint8_t* buffer, const char* string, size_t length)
+{
+    buffer[0] = length >> 8;
+    buffer[1] = length & 0xFF;
+    memcpy(&buffer[2], string, length);
+    return 2 + length;
+}
+
+static int host_mqtt_send(esp_mqtt_client_handle_t client, const uint8_t* data, size_t length)
+{
+    int err = 0;
+
+    pthread_mutex_lock(&client->send_lock);
+    while (length > 0 && err == 0) {
+        ssize_t written = send(client->fd, data, length, MSG_NOSIGNAL);
+        if (written <= 0) {
+            err = -1;
+        } else {
+            data += written;
+            length -= written;
+        }
+    }
+    pthread_mutex_unlock(&client->send_lock);
+
+    return err;
+}
+
+static int host_mqtt_connect(esp_mqtt_client_handle_t client)
+{
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* result;
+    char port[8];
+    int nodelay = 1;
+
+    snprintf(port, sizeof(port), "%u", (unsigned int) client->port);
+    if (getaddrinfo(client->hostname, port, &hints, &result) != 0) {
+        return -1;
+    }
+
+    int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (fd >= 0 && connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(result);
+    if (fd < 0) {
+        return -1;
+    }
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    client->fd = fd;
+
+    uint8_t packet[512];
+    size_t client_id_length = strlen(client->client_id);
+    size_t remaining = 10 + 2 + client_id_length;
+    size_t length = 0;
+
+    if (remaining + 5 > sizeof(packet)) {
+        return -1;
+    }
+
+    packet[length++] = HOST_MQTT_CONNECT;
+    length += host_mqtt_write_length(&packet[length], remaining);
+    length += host_mqtt_write_string(&packet[length], "MQTT", 4);
+    packet[length++] = 4;
+    packet[length++] = client->clean_session ? 0x02 : 0x00;
+    packet[length++] = client->keepalive >> 8;
+    packet[length++] = client->keepalive & 0xFF;
+    length += host_mqtt_write_string(&packet[length], client->client_id, client_id_length);
+
+    return host_mqtt_send(client, packet, length);
+}
+
+/**
+ * Handles one packet from the broker. Returns -1 if the connection is to be
+ * dropped.
+*/
+static int host_mqtt_handle(esp_mqtt_client_handle_t client, uint8_t type, const uint8_t* body, size_t body_length)
+{
+    switch (type & 0xF0) {
+        case HOST_MQTT_CONNACK:
+            if (body_length != 2 || body[1] != 0) {
+                host_mqtt_dispatch(client, MQTT_EVENT_ERROR, 0, 0);
+                return -1;
+            }
+            client->connected = true;
+            host_mqtt_dispatch(client, MQTT_EVENT_CONNECTED, 0, body[0] & 0x01);
+            return 0;
+        case HOST_MQTT_PUBACK:
+            if (body_length != 2) {
+                return -1;
+            }
+            host_mqtt_dispatch(client, MQTT_EVENT_PUBLISHED, (body[0] << 8) | body[1], 0);
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * The mqtt task: connects and dispatches what the broker sends until the
+ * connection closes
+*/
+static void* host_mqtt_run(void* argument)
+{
+    esp_mqtt_client_handle_t client = argument;
+    uint8_t* buffer = malloc(HOST_MQTT_PACKET_MAX_SZ);
+    size_t length = 0;
+    ssize_t received = 0;
+
+    if (!buffer || host_mqtt_connect(client) != 0) {
+        free(buffer);
+        if (!client->stopping) {
+            host_mqtt_dispatch(client, MQTT_EVENT_ERROR, 0, 0);
+        }
+        return NULL;
+    }
+
+    while ((received = recv(client->fd, &buffer[length], HOST_MQTT_PACKET_MAX_SZ - length, 0)) > 0) {
+        length += received;
+
+        // Whole packets: type, remaining length and body
+        bool dropped = false;
+        while (length >= 2 && !dropped) {
+            size_t body_length = 0;
+            size_t header_length = 1;
+            unsigned int shift = 0;
+            while (header_length < length && header_length < 5) {
+                uint8_t digit = buffer[header_length++];
+                body_length |= (size_t) (digit & 0x7F) << shift;
+                shift += 7;
+                if (!(digit & 0x80)) break;
+            }
+            if (header_length + body_length > HOST_MQTT_PACKET_MAX_SZ) {
+                dropped = true;
+                break;
+            }
+            if (length < header_length + body_length) {
+                break;
+            }
+
+            dropped = host_mqtt_handle(client, buffer[0], &buffer[header_length], body_length) != 0;
+            length -= header_length + body_length;
+            memmove(buffer, &buffer[header_length + body_length], length);
+        }
+        if (dropped) {
+            break;
+        }
+    }
+
+    client->connected = false;
+    free(buffer);
+    if (!client->stopping) {
+        host_mqtt_dispatch(client, MQTT_EVENT_DISCONNECTED, 0, 0);
+    }
+    return NULL;
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config)
+{
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(struct esp_mqtt_client));
+
+    if (!client || !config->broker.address.hostname) {
+        free(client);
+        return NULL;
+    }
+
+    client->hostname = strdup(config->broker.address.hostname);
+    client->client_id = strdup(config->credentials.client_id ? config->credentials.client_id : "esp32");
+    client->port = config->broker.address.port ? config->broker.address.port : 1883;
+    client->clean_session = !config->session.disable_clean_session;
+    client->keepalive = config->session.keepalive ? config->session.keepalive : HOST_MQTT_KEEPALIVE_S;
+    client->fd = -1;
+    client->next_msg_id = 1;
+    pthread_mutex_init(&client->send_lock, NULL);
+
+    if (!client->hostname || !client->client_id) {
+        esp_mqtt_client_destroy(client);
+        return NULL;
+    }
+
+    return client;
+}
+
+/**
+ * One handler for all events is supported
+*/
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler, void* event_handler_arg)
+{
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client->started) {
+        return ESP_FAIL;
+    }
+
+    client->started = pthread_create(&client->thread, NULL, host_mqtt_run, client) == 0;
+    return client->started ? ESP_OK : ESP_FAIL;
+}
+
+/**
+ * Returns the message id, 0 for QoS 0, or -1 if not connected
+*/
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len, int qos, int retain)
+{
+    size_t topic_length = strlen(topic);
+    size_t data_length = len > 0 ? (size_t) len : strlen(data);
+    size_t remaining = 2 + topic_length + (qos > 0 ? 2 : 0) + data_length;
+    uint8_t* packet = malloc(5 + remaining);
+    size_t length = 0;
+    int msg_id = 0;
+
+    if (!packet || !client->connected || qos > 1) {
+        free(packet);
+        return -1;
+    }
+
+    packet[length++] = HOST_MQTT_PUBLISH | (qos << 1) | (retain ? 1 : 0);
+    length += host_mqtt_write_length(&packet[length], remaining);
+    length += host_mqtt_write_string(&packet[length], topic, topic_length);
+    if (qos > 0) {
+        msg_id = client->next_msg_id;
+        client->next_msg_id = client->next_msg_id == UINT16_MAX ? 1 : client->next_msg_id + 1;
+        packet[length++] = msg_id >> 8;
+        packet[length++] = msg_id & 0xFF;
+    }
+    memcpy(&packet[length], data, data_length);
+    length += data_length;
+
+    int err = host_mqtt_send(client, packet, length);
+    free(packet);
+
+    return err == 0 ? msg_id : -1;
+}
+
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client)
+{
+    static const uint8_t disconnect[2] = {HOST_MQTT_DISCONNECT, 0};
+
+    client->stopping = true;
+    if (client->fd >= 0) {
+        if (client->connected) {
+            host_mqtt_send(client, disconnect, sizeof(disconnect));
+        }
+        shutdown(client->fd, SHUT_RDWR);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
+{
+    client->stopping = true;
+    if (client->started) {
+        if (client->fd >= 0) {
+            shutdown(client->fd, SHUT_RDWR);
+        }
+        pthread_join(client->thread, NULL);
+    }
+    if (client->fd >= 0) {
+        close(client->fd);
+    }
+
+    pthread_mutex_destroy(&client->send_lock);
+    free(client->hostname);
+    free(client->client_id);
+    free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,76 @@
+#ifndef __WEATHER_STATION__HOST_MQTT_CLIENT_H__
+#define __WEATHER_STATION__HOST_MQTT_CLIENT_H__
+
+/**
+ * The part of esp-mqtt the firmware uses, an MQTT 3.1.1 client over plain
+ * TCP sockets (mqtt_client.c). mqtts connects without TLS, like esp_tls.c.
+ * Publishes QoS 0 and 1, receives nothing but CONNACK and PUBACK.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "esp_event.h"
+
+typedef enum {
+    MQTT_EVENT_ANY = -1,
+    MQTT_EVENT_ERROR = 0,
+    MQTT_EVENT_CONNECTED,
+    MQTT_EVENT_DISCONNECTED,
+    MQTT_EVENT_SUBSCRIBED,
+    MQTT_EVENT_UNSUBSCRIBED,
+    MQTT_EVENT_PUBLISHED,
+    MQTT_EVENT_DATA,
+    MQTT_EVENT_BEFORE_CONNECT,
+    MQTT_EVENT_DELETED,
+} esp_mqtt_event_id_t;
+
+typedef enum {
+    MQTT_TRANSPORT_UNKNOWN = 0,
+    MQTT_TRANSPORT_OVER_TCP,
+    MQTT_TRANSPORT_OVER_SSL,
+} esp_mqtt_transport_t;
+
+typedef struct esp_mqtt_client* esp_mqtt_client_handle_t;
+
+typedef struct esp_mqtt_event_t {
+    esp_mqtt_event_id_t event_id;
+    esp_mqtt_client_handle_t client;
+    int msg_id;
+    int session_present;
+} esp_mqtt_event_t;
+
+typedef esp_mqtt_event_t* esp_mqtt_event_handle_t;
+
+typedef struct esp_mqtt_client_config_t {
+    struct {
+        struct {
+            const char* hostname;
+            esp_mqtt_transport_t transport;
+            uint32_t port;
+        } address;
+        struct {
+            esp_err_t (*crt_bundle_attach)(void* conf);
+        } verification;
+    } broker;
+    struct {
+        const char* client_id;
+    } credentials;
+    struct {
+        bool disable_clean_session;
+        int keepalive;
+    } session;
+    struct {
+        bool disable_auto_reconnect;
+        int timeout_ms;
+    } network;
+} esp_mqtt_client_config_t;
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* config);
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event, esp_event_handler_t event_handler, void* event_handler_arg);
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char* topic, const char* data, int len, int qos, int retain);
+esp_err_t esp_mqtt_client_disconnect(esp_mqtt_client_handle_t client);
+esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
+
+#endif
@@ -0,0 +1,8 @@
+#ifndef __WEATHER_STATION__HOST_NVS_FLASH_H__
+#define __WEATHER_STATION__HOST_NVS_FLASH_H__
+
+/**
+ * Included by the firmware modules built on the host, nothing of it is used
+*/
+
+#endif
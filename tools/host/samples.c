@@ -0,0 +1,61 @@
+#include <math.h>
+#include <stdlib.h>
+
+#include "samples.h"
+
+#define SAMPLES_START_TIMESTAMP 1717200000
+#define SAMPLES_DAY_S 86400.0
+
+static float samples_noise(float amplitude)
+{
+    return amplitude * ((float) rand() / RAND_MAX * 2.0f - 1.0f);
+}
+
+/**
+ * Rounds [value] to the resolution the station reports it with
+*/
+static float samples_quantize(float value, float resolution)
+{
+    return roundf(value / resolution) * resolution;
+}
+
+/**
+ * Fills [measurements] with a synthetic backlog taken every
+ * [measurement_rate] seconds: a day/night cycle for temperature, humidity,
+ * daylight and uv, a slow pressure drift and a battery that charges during
+ * the day. Values are quantized like the sensors deliver them.
+*/
+void samples_generate(struct sensor_data_t* measurements, size_t measurements_length, uint32_t measurement_rate, unsigned int seed)
+{
+    float pressure = 1013.25f;
+    float battery_charge = 70.0f;
+
+    srand(seed);
+
+    for (size_t i = 0; i < measurements_length; i++) {
+        struct sensor_data_t* m = &measurements[i];
+        uint32_t timestamp = SAMPLES_START_TIMESTAMP + i * measurement_rate;
+        double day = fmod(timestamp, SAMPLES_DAY_S) / SAMPLES_DAY_S;
+
+        // Sun is up from 6 to 18 o'clock
+        float sun = (float) sin((day - 0.25) * 2.0 * M_PI);
+        float daylight = sun > 0.0f ? sun : 0.0f;
+
+        pressure += samples_noise(0.05f);
+        battery_charge += (daylight > 0.0f ? 0.4f : -0.1f) * measurement_rate / 3600.0f;
+        if (battery_charge > 100.0f) battery_charge = 100.0f;
+        if (battery_charge < 0.0f) battery_charge = 0.0f;
+
+        m->sequence = 1 + i;
+        m->timestamp = timestamp;
+        m->temperature = samples_quantize(12.0f + 8.0f * sun + samples_noise(0.1f), 0.01f);
+        m->temperature_inside = samples_quantize(m->temperature + 3.0f + samples_noise(0.1f), 0.01f);
+        m->humidity = samples_quantize(65.0f - 20.0f * sun + samples_noise(0.5f), 0.01f);
+        m->pressure = samples_quantize(pressure, 0.01f);
+        m->daylight = (uint32_t) (daylight * 60000.0f);
+        m->uv = (uint16_t) (daylight * 8.0f);
+        m->battery_voltage = samples_quantize(3.5f + battery_charge / 100.0f * 0.7f, 0.001f);
+        m->battery_charge = samples_quantize(battery_charge, 0.01f);
+        m->battery_charge_rate = samples_quantize(daylight > 0.0f ? 0.4f : -0.1f, 0.01f);
+    }
+}
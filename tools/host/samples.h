@@ -0,0 +1,10 @@
+#ifndef __WEATHER_STATION__HOST_SAMPLES_H__
+#define __WEATHER_STATION__HOST_SAMPLES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include "sensors.h"
+
+void samples_generate(struct sensor_data_t* measurements, size_t measurements_length, uint32_t measurement_rate, unsigned int seed);
+
+#endif
@@ -0,0 +1,683 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "formatter.h"
+#include "http.h"
+#include "compressor.h"
+#include "pusher_request.h"
+#include "samples.h"
+
+/**
+ * Station behaviour, see main.c and the configuration defaults
+*/
+#define LOADGEN_MEASUREMENTS_MAX 100
+#define LOADGEN_MEASUREMENT_RATE 60
+#define LOADGEN_UPLOAD_RATE 600
+#define LOADGEN_START_TIMESTAMP 1717200000
+
+#define LOADGEN_RESPONSE_BODY_SZ 256
+#define LOADGEN_RECEIVER_BUFFER_SZ 16384
+#define LOADGEN_EVENTS_MAX 256
+
+enum loadgen_station_state_t {
+    LOADGEN_STATION_IDLE,
+    LOADGEN_STATION_CONNECTING,
+    LOADGEN_STATION_SENDING,
+    LOADGEN_STATION_RECEIVING,
+};
+
+/**
+ * A simulated station. Measures every LOADGEN_MEASUREMENT_RATE seconds and
+ * uploads its backlog every LOADGEN_UPLOAD_RATE seconds (with jitter), one
+ * batch per request over one keep-alive connection, like pusher_http_push.
+*/
+struct loadgen_station_t {
+    uint32_t id;
+    enum loadgen_station_state_t state;
+    int fd;
+
+    /**
+     * Simulated time of the next upload and of the last acknowledged
+     * measurement, the backlog is everything measured since
+    */
+    double next_upload;
+    double acknowledged_until;
+    uint32_t next_sequence;
+    uint32_t uploads;
+
+    struct sensor_data_t* backlog;
+    size_t backlog_length;
+    size_t sent_count;
+    size_t batch_length;
+
+    struct pusher_request_t request;
+    char* out;
+    size_t out_length;
+    size_t out_offset;
+
+    struct http_response_t response;
+    char response_body[LOADGEN_RESPONSE_BODY_SZ];
+    double request_started_ns;
+};
+
+struct loadgen_options_t {
+    size_t stations;
+    double duration_s;
+    double speedup;
+    uint8_t push_format;
+    bool deflate;
+    double outage_probability;
+    double jitter;
+    const char* target;
+};
+
+struct loadgen_stats_t {
+    size_t uploads;
+    size_t uploads_skipped;
+    size_t uploads_failed;
+    size_t requests;
+    size_t measurements;
+    size_t bytes;
+    size_t backlog_max;
+
+    double* latencies_ms;
+    size_t latencies_length;
+    size_t latencies_capacity;
+};
+
+struct loadgen_receiver_t {
+    int listen_fd;
+    volatile bool stop;
+    size_t requests;
+    size_t bytes;
+};
+
+static struct loadgen_options_t options = { 1000, 10.0, 60.0, FORMATTER_FORMAT_JSON, false, 0.05, 0.1, NULL };
+static struct formatter_options_t formatter_options = { false, "weather", "" };
+static struct loadgen_stats_t stats;
+static char extra_headers[PUSHER_EXTRA_HEADERS_BUFFER_SZ];
+static struct sockaddr_storage target_address;
+static socklen_t target_address_length;
+static char target_host[128] = "ingest";
+
+static double loadgen_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double loadgen_random(void)
+{
+    return (double) rand() / RAND_MAX;
+}
+
+static void loadgen_set_nonblocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+/**
+ * Minimal HTTP/1.1 ingest stand-in: answers every request with an empty 200
+ * (which acknowledges the whole batch) and keeps the connection open
+*/
+struct loadgen_connection_t {
+    int fd;
+    char buffer[LOADGEN_RECEIVER_BUFFER_SZ];
+    size_t length;
+};
+
+static void loadgen_receiver_close(int epoll_fd, struct loadgen_connection_t* connection)
+{
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    free(connection);
+}
+
+/**
+ * Answers the complete requests in the buffer. Returns -1 on malformed
+ * requests.
+*/
+static int loadgen_receiver_process(struct loadgen_receiver_t* receiver, struct loadgen_connection_t* connection)
+{
+    static const char response[] = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+
+    while (true) {
+        char* head_end = memmem(connection->buffer, connection->length, "\r\n\r\n", 4);
+        if (!head_end) {
+            return connection->length == sizeof(connection->buffer) ? -1 : 0;
+        }
+
+        size_t head_length = head_end + 4 - connection->buffer;
+        size_t content_length = 0;
+        *head_end = '\0';
+        char* header = strcasestr(connection->buffer, "\r\nContent-Length:");
+        if (header) {
+            content_length = strtoul(header + 17, NULL, 10);
+        }
+        *head_end = '\r';
+
+        if (head_length + content_length > sizeof(connection->buffer)) {
+            return -1;
+        }
+        if (connection->length < head_length + content_length) {
+            return 0;
+        }
+
+        if (write(connection->fd, response, sizeof(response) - 1) != sizeof(response) - 1) {
+            return -1;
+        }
+
+        __atomic_add_fetch(&receiver->requests, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&receiver->bytes, head_length + content_length, __ATOMIC_RELAXED);
+
+        connection->length -= head_length + content_length;
+        memmove(connection->buffer, &connection->buffer[head_length + content_length], connection->length);
+    }
+}
+
+static void* loadgen_receiver_run(void* argument)
+{
+    struct loadgen_receiver_t* receiver = argument;
+    struct epoll_event events[LOADGEN_EVENTS_MAX];
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, receiver->listen_fd, &event);
+
+    while (!receiver->stop) {
+        int ready = epoll_wait(epoll_fd, events, LOADGEN_EVENTS_MAX, 100);
+
+        for (int i = 0; i < ready; i++) {
+            struct loadgen_connection_t* connection = events[i].data.ptr;
+
+            // New connections
+            if (connection == NULL) {
+                int fd;
+                while ((fd = accept(receiver->listen_fd, NULL, NULL)) >= 0) {
+                    struct loadgen_connection_t* accepted = calloc(1, sizeof(*accepted));
+                    struct epoll_event connection_event = { .events = EPOLLIN, .data.ptr = accepted };
+                    accepted->fd = fd;
+                    loadgen_set_nonblocking(fd);
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &connection_event);
+                }
+                continue;
+            }
+
+            ssize_t received;
+            while ((received = read(connection->fd, &connection->buffer[connection->length], sizeof(connection->buffer) - connection->length)) > 0) {
+                connection->length += received;
+                if (loadgen_receiver_process(receiver, connection) != 0) {
+                    received = 0;
+                    break;
+                }
+            }
+            if (received == 0 || (received < 0 && errno != EAGAIN)) {
+                loadgen_receiver_close(epoll_fd, connection);
+            }
+        }
+    }
+
+    close(epoll_fd);
+    return NULL;
+}
+
+static int loadgen_receiver_start(struct loadgen_receiver_t* receiver, pthread_t* thread)
+{
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = 0 };
+    int reuse = 1;
+
+    receiver->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(receiver->listen_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (bind(receiver->listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(receiver->listen_fd, 4096) != 0) {
+        perror("receiver");
+        return -1;
+    }
+    loadgen_set_nonblocking(receiver->listen_fd);
+
+    target_address_length = sizeof(target_address);
+    getsockname(receiver->listen_fd, (struct sockaddr*) &target_address, &target_address_length);
+
+    return pthread_create(thread, NULL, loadgen_receiver_run, receiver);
+}
+
+static int loadgen_resolve_target(const char* target)
+{
+    char host[128];
+    const char* port = strrchr(target, ':');
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* result;
+
+    if (!port || (size_t) (port - target) >= sizeof(host)) {
+        return -1;
+    }
+    memcpy(host, target, port - target);
+    host[port - target] = '\0';
+
+    if (getaddrinfo(host, port + 1, &hints, &result) != 0) {
+        return -1;
+    }
+    memcpy(&target_address, result->ai_addr, result->ai_addrlen);
+    target_address_length = result->ai_addrlen;
+    freeaddrinfo(result);
+
+    snprintf(target_host, sizeof(target_host), "%s", host);
+    return 0;
+}
+
+static void loadgen_record_latency(double latency_ms)
+{
+    if (stats.latencies_length == stats.latencies_capacity) {
+        stats.latencies_capacity = stats.latencies_capacity ? stats.latencies_capacity * 2 : 4096;
+        stats.latencies_ms = realloc(stats.latencies_ms, stats.latencies_capacity * sizeof(double));
+    }
+    stats.latencies_ms[stats.latencies_length++] = latency_ms;
+}
+
+/**
+ * Min-heap of the idle stations ordered by their next upload
+*/
+static struct loadgen_station_t** heap;
+static size_t heap_length;
+
+static void loadgen_heap_push(struct loadgen_station_t* station)
+{
+    size_t i = heap_length++;
+    heap[i] = station;
+
+    while (i > 0 && heap[(i - 1) / 2]->next_upload > heap[i]->next_upload) {
+        struct loadgen_station_t* parent = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = heap[i];
+        heap[i] = parent;
+        i = (i - 1) / 2;
+    }
+}
+
+static struct loadgen_station_t* loadgen_heap_pop(void)
+{
+    struct loadgen_station_t* top = heap[0];
+    size_t i = 0;
+
+    heap[0] = heap[--heap_length];
+    while (true) {
+        size_t smallest = i;
+        size_t left = 2 * i + 1;
+        size_t right = 2 * i + 2;
+
+        if (left < heap_length && heap[left]->next_upload < heap[smallest]->next_upload) smallest = left;
+        if (right < heap_length && heap[right]->next_upload < heap[smallest]->next_upload) smallest = right;
+        if (smallest == i) break;
+
+        struct loadgen_station_t* swap = heap[i];
+        heap[i] = heap[smallest];
+        heap[smallest] = swap;
+        i = smallest;
+    }
+
+    return top;
+}
+
+static void loadgen_schedule(struct loadgen_station_t* station)
+{
+    double jitter = (loadgen_random() * 2.0 - 1.0) * options.jitter;
+
+    station->state = LOADGEN_STATION_IDLE;
+    station->next_upload += LOADGEN_UPLOAD_RATE * (1.0 + jitter);
+    loadgen_heap_push(station);
+}
+
+static void loadgen_finish_upload(int epoll_fd, struct loadgen_station_t* station, bool failed)
+{
+    if (station->fd >= 0) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, station->fd, NULL);
+        close(station->fd);
+        station->fd = -1;
+    }
+
+    if (failed) {
+        stats.uploads_failed += 1;
+    } else {
+        station->acknowledged_until = station->next_upload;
+    }
+
+    free(station->backlog);
+    free(station->out);
+    free(station->request.formatted);
+    free(station->request.compressed);
+    free(station->request.head);
+    station->backlog = NULL;
+    station->out = NULL;
+    station->request.formatted = NULL;
+    station->request.compressed = NULL;
+    station->request.head = NULL;
+
+    loadgen_schedule(station);
+}
+
+/**
+ * Builds the next request of the upload with the firmware's request code
+*/
+static int loadgen_send_next_batch(int epoll_fd, struct loadgen_station_t* station)
+{
+    struct pusher_request_t* request = &station->request;
+
+    station->batch_length = pusher_request_batch_length(request, station->backlog_length - station->sent_count);
+    if (pusher_request_build(request, &station->backlog[station->sent_count], station->batch_length) != ESP_OK) {
+        return -1;
+    }
+
+    memcpy(station->out, request->head, request->head_length);
+    memcpy(&station->out[request->head_length], request->body, request->body_length);
+    station->out_length = request->head_length + request->body_length;
+    station->out_offset = 0;
+
+    http_response_init(&station->response, station->response_body, sizeof(station->response_body));
+    station->request_started_ns = loadgen_now_ns();
+    station->state = LOADGEN_STATION_SENDING;
+
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = station };
+    return epoll_ctl(epoll_fd, EPOLL_CTL_MOD, station->fd, &event);
+}
+
+/**
+ * Starts the upload of everything measured since the last acknowledged
+ * upload, capped like the station's RTC buffer
+*/
+static void loadgen_start_upload(int epoll_fd, struct loadgen_station_t* station)
+{
+    size_t backlog_length = (station->next_upload - station->acknowledged_until) / LOADGEN_MEASUREMENT_RATE;
+    uint32_t first_sequence;
+
+    if (backlog_length == 0) {
+        loadgen_schedule(station);
+        return;
+    }
+
+    // WiFi or data sink unreachable, the backlog keeps growing
+    if (loadgen_random() < options.outage_probability) {
+        stats.uploads_skipped += 1;
+        loadgen_schedule(station);
+        return;
+    }
+
+    // The station drops its oldest measurements once the buffer is full
+    first_sequence = station->next_sequence;
+    station->next_sequence += backlog_length;
+    if (backlog_length > LOADGEN_MEASUREMENTS_MAX) {
+        first_sequence += backlog_length - LOADGEN_MEASUREMENTS_MAX;
+        backlog_length = LOADGEN_MEASUREMENTS_MAX;
+    }
+    if (backlog_length > stats.backlog_max) {
+        stats.backlog_max = backlog_length;
+    }
+
+    station->backlog = malloc(backlog_length * sizeof(struct sensor_data_t));
+    samples_generate(station->backlog, backlog_length, LOADGEN_MEASUREMENT_RATE, station->id * 7919 + station->uploads);
+    for (size_t i = 0; i < backlog_length; i++) {
+        station->backlog[i].sequence = first_sequence + i;
+        station->backlog[i].timestamp = LOADGEN_START_TIMESTAMP + (uint32_t) station->next_upload - (backlog_length - i) * LOADGEN_MEASUREMENT_RATE;
+    }
+    station->backlog_length = backlog_length;
+    station->sent_count = 0;
+    station->uploads += 1;
+    stats.uploads += 1;
+
+    station->request.head = malloc(PUSHER_REQUEST_HEAD_BUFFER_SZ);
+    station->request.formatted = malloc(PUSHER_BATCH_BUFFER_SZ);
+    if (options.deflate) {
+        station->request.compressed = malloc(COMPRESSOR_DEFLATE_BOUND(PUSHER_BATCH_BUFFER_SZ));
+    }
+    station->out = malloc(PUSHER_REQUEST_HEAD_BUFFER_SZ + COMPRESSOR_DEFLATE_BOUND(PUSHER_BATCH_BUFFER_SZ));
+
+    station->fd = socket(target_address.ss_family, SOCK_STREAM, 0);
+    if (station->fd < 0) {
+        loadgen_finish_upload(epoll_fd, station, true);
+        return;
+    }
+    loadgen_set_nonblocking(station->fd);
+    int nodelay = 1;
+    setsockopt(station->fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    if (connect(station->fd, (struct sockaddr*) &target_address, target_address_length) != 0 && errno != EINPROGRESS) {
+        loadgen_finish_upload(epoll_fd, station, true);
+        return;
+    }
+
+    station->state = LOADGEN_STATION_CONNECTING;
+    struct epoll_event event = { .events = EPOLLOUT, .data.ptr = station };
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, station->fd, &event);
+}
+
+static void loadgen_on_event(int epoll_fd, struct loadgen_station_t* station, uint32_t events)
+{
+    if (events & (EPOLLERR | EPOLLHUP) && station->state != LOADGEN_STATION_RECEIVING) {
+        loadgen_finish_upload(epoll_fd, station, true);
+        return;
+    }
+
+    if (station->state == LOADGEN_STATION_CONNECTING) {
+        if (loadgen_send_next_batch(epoll_fd, station) != 0) {
+            loadgen_finish_upload(epoll_fd, station, true);
+        }
+        return;
+    }
+
+    if (station->state == LOADGEN_STATION_SENDING) {
+        ssize_t written = write(station->fd, &station->out[station->out_offset], station->out_length - station->out_offset);
+        if (written < 0) {
+            if (errno != EAGAIN) {
+                loadgen_finish_upload(epoll_fd, station, true);
+            }
+            return;
+        }
+
+        station->out_offset += written;
+        if (station->out_offset == station->out_length) {
+            station->state = LOADGEN_STATION_RECEIVING;
+            struct epoll_event event = { .events = EPOLLIN, .data.ptr = station };
+            epoll_ctl(epoll_fd, EPOLL_CTL_MOD, station->fd, &event);
+        }
+        return;
+    }
+
+    if (station->state == LOADGEN_STATION_RECEIVING) {
+        char buffer[512];
+        ssize_t received = read(station->fd, buffer, sizeof(buffer));
+        if (received <= 0) {
+            if (received == 0 || errno != EAGAIN) {
+                loadgen_finish_upload(epoll_fd, station, true);
+            }
+            return;
+        }
+
+        size_t consumed = 0;
+        if (http_response_feed(&station->response, buffer, received, &consumed) != ESP_OK) {
+            loadgen_finish_upload(epoll_fd, station, true);
+            return;
+        }
+        if (!http_response_is_complete(&station->response)) {
+            return;
+        }
+
+        loadgen_record_latency((loadgen_now_ns() - station->request_started_ns) / 1e6);
+        stats.requests += 1;
+        stats.measurements += station->batch_length;
+        stats.bytes += station->out_length;
+
+        if (station->response.status < 200 || station->response.status >= 300) {
+            loadgen_finish_upload(epoll_fd, station, true);
+            return;
+        }
+
+        station->sent_count += station->batch_length;
+        if (station->sent_count == station->backlog_length) {
+            loadgen_finish_upload(epoll_fd, station, false);
+        } else if (loadgen_send_next_batch(epoll_fd, station) != 0) {
+            loadgen_finish_upload(epoll_fd, station, true);
+        }
+    }
+}
+
+static int loadgen_compare_double(const void* a, const void* b)
+{
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x > y) - (x < y);
+}
+
+static double loadgen_percentile(double percentile)
+{
+    if (stats.latencies_length == 0) {
+        return 0;
+    }
+
+    size_t index = (size_t) ceil(percentile / 100.0 * stats.latencies_length);
+    return stats.latencies_ms[index > 0 ? index - 1 : 0];
+}
+
+static void loadgen_usage(const char* name)
+{
+    fprintf(stderr,
+        "Usage: %s [-n stations] [-d seconds] [-s speedup] [-f push_format] [-z] [-o outage] [-j jitter] [-t host:port]\n"
+        "  -n  simulated stations (1000)\n"
+        "  -d  wall clock duration in seconds (10)\n"
+        "  -s  simulated seconds per wall clock second (60)\n"
+        "  -f  data_sink_push_format (0)\n"
+        "  -z  deflate the bodies (data_sink_compression 1)\n"
+        "  -o  probability an upload fails and builds a backlog (0.05)\n"
+        "  -j  jitter of the upload interval as fraction (0.1)\n"
+        "  -t  ingest server to load instead of the built-in receiver\n",
+        name);
+}
+
+int main(int argc, char** argv)
+{
+    int option;
+
+    while ((option = getopt(argc, argv, "n:d:s:f:zo:j:t:h")) != -1) {
+        switch (option) {
+        case 'n': options.stations = strtoul(optarg, NULL, 10); break;
+        case 'd': options.duration_s = atof(optarg); break;
+        case 's': options.speedup = atof(optarg); break;
+        case 'f': options.push_format = atoi(optarg); break;
+        case 'z': options.deflate = true; break;
+        case 'o': options.outage_probability = atof(optarg); break;
+        case 'j': options.jitter = atof(optarg); break;
+        case 't': options.target = optarg; break;
+        default: loadgen_usage(argv[0]); return 1;
+        }
+    }
+
+    if (options.stations == 0 || options.speedup <= 0) {
+        loadgen_usage(argv[0]);
+        return 1;
+    }
+
+    // Every station holds a socket while it uploads
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    struct loadgen_receiver_t receiver = {0};
+    pthread_t receiver_thread;
+    if (options.target) {
+        if (loadgen_resolve_target(options.target) != 0) {
+            fprintf(stderr, "Failed to resolve %s\n", options.target);
+            return 1;
+        }
+    } else if (loadgen_receiver_start(&receiver, &receiver_thread) != 0) {
+        return 1;
+    }
+
+    pusher_request_build_extra_headers(extra_headers, sizeof(extra_headers), 1, "loadgen", "0000000000000000000000000000000000000000000000000000000000000000");
+
+    struct loadgen_station_t* stations = calloc(options.stations, sizeof(struct loadgen_station_t));
+    heap = calloc(options.stations, sizeof(struct loadgen_station_t*));
+    srand(1);
+
+    // Stations woke up at random times, so their uploads are spread evenly
+    for (size_t i = 0; i < options.stations; i++) {
+        struct loadgen_station_t* station = &stations[i];
+
+        station->id = i;
+        station->fd = -1;
+        station->next_upload = loadgen_random() * LOADGEN_UPLOAD_RATE;
+        station->acknowledged_until = station->next_upload - LOADGEN_UPLOAD_RATE;
+        station->next_sequence = 1;
+        station->request.formatter = formatter_get(options.push_format);
+        station->request.formatter_options = &formatter_options;
+        station->request.host = target_host;
+        station->request.path = "/measurements";
+        station->request.extra_headers = extra_headers;
+        station->request.head_capacity = PUSHER_REQUEST_HEAD_BUFFER_SZ;
+        station->request.formatted_capacity = PUSHER_BATCH_BUFFER_SZ;
+        station->request.compressed_capacity = COMPRESSOR_DEFLATE_BOUND(PUSHER_BATCH_BUFFER_SZ);
+        loadgen_heap_push(station);
+    }
+
+    int epoll_fd = epoll_create1(0);
+    struct epoll_event events[LOADGEN_EVENTS_MAX];
+    double started_ns = loadgen_now_ns();
+    double elapsed_s = 0;
+
+    while (elapsed_s < options.duration_s) {
+        double simulated_s = elapsed_s * options.speedup;
+
+        while (heap_length > 0 && heap[0]->next_upload <= simulated_s) {
+            loadgen_start_upload(epoll_fd, loadgen_heap_pop());
+        }
+
+        int ready = epoll_wait(epoll_fd, events, LOADGEN_EVENTS_MAX, 1);
+        for (int i = 0; i < ready; i++) {
+            loadgen_on_event(epoll_fd, events[i].data.ptr, events[i].events);
+        }
+
+        elapsed_s = (loadgen_now_ns() - started_ns) / 1e9;
+    }
+
+    qsort(stats.latencies_ms, stats.latencies_length, sizeof(double), loadgen_compare_double);
+
+    printf("%zu stations, %s%s, %.0f s simulated in %.1f s\n",
+        options.stations,
+        formatter_get(options.push_format)->name,
+        options.deflate ? " + deflate" : "",
+        elapsed_s * options.speedup,
+        elapsed_s);
+    printf("uploads:      %zu (%zu skipped by outages, %zu failed, largest backlog %zu measurements)\n",
+        stats.uploads, stats.uploads_skipped, stats.uploads_failed, stats.backlog_max);
+    printf("requests:     %zu, %.1f requests/s\n", stats.requests, stats.requests / elapsed_s);
+    printf("measurements: %zu, %.1f measurements/s\n", stats.measurements, stats.measurements / elapsed_s);
+    printf("bytes:        %zu, %.1f kB/s, %.0f B/request\n",
+        stats.bytes, stats.bytes / elapsed_s / 1000.0, stats.requests ? (double) stats.bytes / stats.requests : 0.0);
+    printf("latency ms:   p50 %.2f  p90 %.2f  p99 %.2f  p99.9 %.2f  max %.2f\n",
+        loadgen_percentile(50), loadgen_percentile(90), loadgen_percentile(99), loadgen_percentile(99.9),
+        stats.latencies_length ? stats.latencies_ms[stats.latencies_length - 1] : 0.0);
+
+    // Per real station: the fleet is scaled up by the speedup
+    printf("fleet equivalent at real time: %.0f stations\n", options.stations * options.speedup);
+
+    if (!options.target) {
+        receiver.stop = true;
+        pthread_join(receiver_thread, NULL);
+        printf("receiver:     %zu requests, %zu bytes\n", receiver.requests, receiver.bytes);
+    }
+
+    return 0;
+}
@@ -0,0 +1,427 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+
+#include "samples.h"
+#include "esp_timer.h"
+
+#include "pusher.h"
+
+#define BENCH_SEED 1
+#define BENCH_MEASUREMENT_RATE 60
+#define BENCH_BUFFER_SZ 16384
+#define BENCH_REPLIES_MAX 64
+#define BENCH_REPLY_SZ 64
+#define BENCH_TOPIC "stations/bench"
+
+#define BENCH_HTTP 0
+#define BENCH_MQTT 1
+
+RTC_DATA_ATTR struct configuration_t configuration;
+struct energy_t energy;
+
+esp_err_t cfg_write(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t pusher_coap_push(const char* url, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/**
+ * A reply of the stand-in, sent once the round trip time passed
+*/
+struct bench_reply_t {
+    int64_t due_us;
+    size_t length;
+    char data[BENCH_REPLY_SZ];
+};
+
+/**
+ * Data sink stand-in speaking HTTP/1.1 or MQTT 3.1.1 on loopback. Every
+ * reply is held back by the round trip time of a real uplink. The first
+ * replies of a connection are held back one round trip more, which stands
+ * in for the TCP handshake the loopback connection completes at once.
+ *
+ * The HTTP sink acknowledges every CSV batch with its last sequence
+ * number, the broker answers CONNECT with CONNACK, resuming the session of
+ * a known client id, and every QoS 1 PUBLISH with PUBACK.
+*/
+struct bench_sink_t {
+    int protocol;
+    int listen_fd;
+    uint16_t port;
+    volatile bool stop;
+    int64_t rtt_us;
+
+    /**
+     * Client id of the persistent session the broker keeps
+    */
+    char session[64];
+
+    /**
+     * What the sink saw during the last upload
+    */
+    size_t connections;
+    size_t requests;
+    size_t bytes_received;
+    size_t bytes_sent;
+    size_t records;
+    uint32_t last_sequence;
+    bool in_order;
+    bool session_present;
+};
+
+/**
+ * Checks the rows of a CSV batch continue the sequence numbers received so
+ * far, the first line is the header
+*/
+static void bench_count_records(struct bench_sink_t* sink, const char* body, size_t body_length)
+{
+    const char* end = body + body_length;
+    const char* line = memchr(body, '\n', body_length);
+
+    while (line && line + 1 < end) {
+        uint32_t sequence = strtoul(line + 1, NULL, 10);
+        if (sink->records > 0 && sequence != sink->last_sequence + 1) {
+            sink->in_order = false;
+        }
+        sink->last_sequence = sequence;
+        sink->records += 1;
+        line = memchr(line + 1, '\n', end - line - 1);
+    }
+}
+
+static size_t bench_http_request(struct bench_sink_t* sink, char* buffer, size_t length, struct bench_reply_t* reply)
+{
+    char* head_end = memmem(buffer, length, "\r\n\r\n", 4);
+    if (!head_end) {
+        return 0;
+    }
+
+    *head_end = '\0';
+    const char* content_length = strcasestr(buffer, "\r\nContent-Length:");
+    size_t head_length = head_end + 4 - buffer;
+    size_t body_length = content_length ? strtoul(content_length + 17, NULL, 10) : 0;
+    *head_end = '\r';
+    if (length < head_length + body_length) {
+        return 0;
+    }
+
+    bench_count_records(sink, &buffer[head_length], body_length);
+    sink->requests += 1;
+
+    char answer[32];
+    int answer_length = snprintf(answer, sizeof(answer), "{\"ack\":%lu}", (unsigned long) sink->last_sequence);
+    reply->length = snprintf(reply->data, sizeof(reply->data), "HTTP/1.1 200 OK\r\nContent-Length: %d\r\n\r\n%s", answer_length, answer);
+    return head_length + body_length;
+}
+
+static size_t bench_mqtt_request(struct bench_sink_t* sink, const uint8_t* buffer, size_t length, struct bench_reply_t* reply, bool* closing)
+{
+    size_t body_length = 0;
+    size_t header_length = 1;
+    unsigned int shift = 0;
+
+    while (header_length < length && header_length < 5) {
+        uint8_t digit = buffer[header_length++];
+        body_length |= (size_t) (digit & 0x7F) << shift;
+        shift += 7;
+        if (!(digit & 0x80)) break;
+    }
+    if (length < 2 || length < header_length + body_length) {
+        return 0;
+    }
+
+    const uint8_t* body = &buffer[header_length];
+    reply->length = 0;
+
+    switch (buffer[0] & 0xF0) {
+        case 0x10: {
+            // Protocol name, level, flags, keep alive, then the client id
+            bool clean_session = body[7] & 0x02;
+            size_t client_id_length = (body[10] << 8) | body[11];
+            char client_id[64] = "";
+            if (client_id_length < sizeof(client_id)) {
+                memcpy(client_id, &body[12], client_id_length);
+            }
+
+            sink->session_present = !clean_session && sink->session[0] && strcmp(sink->session, client_id) == 0;
+            snprintf(sink->session, sizeof(sink->session), "%s", clean_session ? "" : client_id);
+
+            const char connack[4] = {0x20, 0x02, sink->session_present ? 0x01 : 0x00, 0x00};
+            memcpy(reply->data, connack, sizeof(connack));
+            reply->length = sizeof(connack);
+            break;
+        }
+        case 0x30: {
+            size_t topic_length = (body[0] << 8) | body[1];
+            const uint8_t* packet_id = &body[2 + topic_length];
+            size_t payload_offset = 2 + topic_length + 2;
+
+            if (strncmp((const char*) &body[2], BENCH_TOPIC, topic_length) != 0 || ((buffer[0] >> 1) & 0x03) != 1) {
+                sink->in_order = false;
+            }
+            bench_count_records(sink, (const char*) &body[payload_offset], body_length - payload_offset);
+            sink->requests += 1;
+
+            const char puback[4] = {0x40, 0x02, packet_id[0], packet_id[1]};
+            memcpy(reply->data, puback, sizeof(puback));
+            reply->length = sizeof(puback);
+            break;
+        }
+        case 0xE0:
+            *closing = true;
+            break;
+        default:
+            sink->in_order = false;
+            *closing = true;
+            break;
+    }
+
+    return header_length + body_length;
+}
+
+/**
+ * Serves one connection until the station closes it, sending every reply
+ * when it is due
+*/
+static void bench_sink_serve(struct bench_sink_t* sink, int fd)
+{
+    char* buffer = malloc(BENCH_BUFFER_SZ);
+    struct bench_reply_t* replies = malloc(BENCH_REPLIES_MAX * sizeof(struct bench_reply_t));
+    size_t replies_head = 0;
+    size_t replies_length = 0;
+    size_t length = 0;
+    bool closing = false;
+    int nodelay = 1;
+    int64_t handshake_done_us = esp_timer_get_time() + sink->rtt_us;
+
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+
+    while (buffer && replies && !sink->stop) {
+        int timeout_ms = 100;
+        if (replies_length > 0) {
+            int64_t wait_us = replies[replies_head].due_us - esp_timer_get_time();
+            timeout_ms = wait_us > 0 ? (int) ((wait_us + 999) / 1000) : 0;
+        }
+
+        struct pollfd connection = { fd, closing ? 0 : POLLIN, 0 };
+        if (poll(&connection, 1, timeout_ms) > 0 && (connection.revents & POLLIN)) {
+            ssize_t received = read(fd, &buffer[length], BENCH_BUFFER_SZ - length);
+            if (received <= 0) {
+                break;
+            }
+            length += received;
+            sink->bytes_received += received;
+
+            size_t consumed;
+            do {
+                struct bench_reply_t* reply = &replies[(replies_head + replies_length) % BENCH_REPLIES_MAX];
+                reply->length = 0;
+                consumed = sink->protocol == BENCH_HTTP
+                    ? bench_http_request(sink, buffer, length, reply)
+                    : bench_mqtt_request(sink, (const uint8_t*) buffer, length, reply, &closing);
+
+                int64_t now_us = esp_timer_get_time();
+                reply->due_us = (now_us > handshake_done_us ? now_us : handshake_done_us) + sink->rtt_us;
+                if (consumed > 0 && reply->length > 0 && replies_length < BENCH_REPLIES_MAX) {
+                    replies_length += 1;
+                }
+
+                length -= consumed;
+                memmove(buffer, &buffer[consumed], length);
+            } while (consumed > 0 && length > 0);
+        } else if (connection.revents & (POLLHUP | POLLERR)) {
+            break;
+        }
+
+        while (replies_length > 0 && replies[replies_head].due_us <= esp_timer_get_time()) {
+            struct bench_reply_t* reply = &replies[replies_head];
+            if (send(fd, reply->data, reply->length, MSG_NOSIGNAL) > 0) {
+                sink->bytes_sent += reply->length;
+            }
+            replies_head = (replies_head + 1) % BENCH_REPLIES_MAX;
+            replies_length -= 1;
+        }
+
+        if (closing && replies_length == 0) {
+            break;
+        }
+    }
+
+    free(buffer);
+    free(replies);
+    close(fd);
+}
+
+static void* bench_sink_run(void* argument)
+{
+    struct bench_sink_t* sink = argument;
+    struct pollfd listening = { sink->listen_fd, POLLIN, 0 };
+
+    while (!sink->stop) {
+        if (poll(&listening, 1, 50) <= 0) {
+            continue;
+        }
+
+        int fd = accept(sink->listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            sink->connections += 1;
+            bench_sink_serve(sink, fd);
+        }
+    }
+
+    return NULL;
+}
+
+static int bench_sink_start(struct bench_sink_t* sink, int protocol, pthread_t* thread)
+{
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = 0 };
+    socklen_t address_length = sizeof(address);
+
+    sink->protocol = protocol;
+    sink->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bind(sink->listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(sink->listen_fd, 16) != 0
+        || getsockname(sink->listen_fd, (struct sockaddr*) &address, &address_length) != 0) {
+        perror("sink");
+        return -1;
+    }
+    sink->port = ntohs(address.sin_port);
+
+    return pthread_create(thread, NULL, bench_sink_run, sink);
+}
+
+/**
+ * Time until every measurement was acknowledged and what went over the wire
+*/
+struct bench_result_t {
+    esp_err_t err;
+    bool delivered;
+    double elapsed_ms;
+    size_t requests;
+    size_t bytes;
+    bool session_present;
+};
+
+/**
+ * Uploads [measurements] to [sink] like main.c does after a wake
+*/
+static void bench_upload(struct bench_sink_t* sink, int64_t rtt_us, struct sensor_data_t* measurements, size_t measurements_length, struct bench_result_t* result)
+{
+    uint32_t acknowledged_sequences[CONFIGURATION_DATA_SINKS_MAX] = {0};
+
+    if (sink->protocol == BENCH_HTTP) {
+        snprintf(configuration.data_sink, sizeof(configuration.data_sink), "http://127.0.0.1:%u/measurements", sink->port);
+    } else {
+        snprintf(configuration.data_sink, sizeof(configuration.data_sink), "mqtt://127.0.0.1:%u/" BENCH_TOPIC, sink->port);
+    }
+
+    sink->rtt_us = rtt_us;
+    sink->connections = 0;
+    sink->requests = 0;
+    sink->bytes_received = 0;
+    sink->bytes_sent = 0;
+    sink->records = 0;
+    sink->last_sequence = 0;
+    sink->in_order = true;
+    sink->session_present = false;
+
+    int64_t started_us = esp_timer_get_time();
+    result->err = pusher_push(measurements, measurements_length, acknowledged_sequences);
+    result->elapsed_ms = (esp_timer_get_time() - started_us) / 1000.0;
+
+    // The broker may still be reading the DISCONNECT
+    for (int i = 0; i < 100 && sink->records < measurements_length; i++) {
+        usleep(1000);
+    }
+
+    result->delivered = result->err == ESP_OK
+        && acknowledged_sequences[0] == measurements[measurements_length - 1].sequence
+        && sink->records == measurements_length && sink->in_order
+        && sink->last_sequence == measurements[measurements_length - 1].sequence
+        && sink->connections == 1;
+    result->requests = sink->requests;
+    result->bytes = sink->bytes_received + sink->bytes_sent;
+    result->session_present = sink->session_present;
+}
+
+static int bench_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+int main(void)
+{
+    static const int64_t rtts_ms[] = { 0, 50 };
+    static const size_t backlogs[] = { 5, 25, 100, 1440 };
+    const size_t backlogs_length = sizeof(backlogs) / sizeof(backlogs[0]);
+
+    int failures = 0;
+    char label[64];
+    struct bench_sink_t http = {0};
+    struct bench_sink_t mqtt = {0};
+    pthread_t http_thread;
+    pthread_t mqtt_thread;
+    struct bench_result_t http_results[sizeof(backlogs) / sizeof(backlogs[0])];
+    struct bench_result_t mqtt_results[sizeof(backlogs) / sizeof(backlogs[0])];
+    struct sensor_data_t* measurements = calloc(backlogs[backlogs_length - 1], sizeof(struct sensor_data_t));
+
+    if (!measurements || bench_sink_start(&http, BENCH_HTTP, &http_thread) != 0 || bench_sink_start(&mqtt, BENCH_MQTT, &mqtt_thread) != 0) {
+        return 1;
+    }
+
+    samples_generate(measurements, backlogs[backlogs_length - 1], BENCH_MEASUREMENT_RATE, BENCH_SEED);
+    configuration.data_sink_push_format = FORMATTER_FORMAT_CSV;
+    configuration.uplink = CONFIGURATION_UPLINK_WIFI;
+    configuration.config_version = 1;
+
+    bool delivered = true;
+    bool resumed = true;
+    for (size_t r = 0; r < sizeof(rtts_ms) / sizeof(rtts_ms[0]); r++) {
+        printf("round trip %lld ms\n", (long long) rtts_ms[r]);
+        printf("  %-8s %8s %8s %8s %10s %10s\n", "records", "http ms", "mqtt ms", "requests", "http B", "mqtt B");
+
+        for (size_t b = 0; b < backlogs_length; b++) {
+            bench_upload(&http, rtts_ms[r] * 1000, measurements, backlogs[b], &http_results[b]);
+            bench_upload(&mqtt, rtts_ms[r] * 1000, measurements, backlogs[b], &mqtt_results[b]);
+
+            printf("  %-8zu %8.1f %8.1f %8zu %10zu %10zu\n", backlogs[b], http_results[b].elapsed_ms, mqtt_results[b].elapsed_ms,
+                http_results[b].requests, http_results[b].bytes, mqtt_results[b].bytes);
+            delivered = delivered && http_results[b].delivered && mqtt_results[b].delivered
+                && http_results[b].requests == mqtt_results[b].requests;
+            resumed = resumed && (r == 0 && b == 0 ? !mqtt_results[b].session_present : mqtt_results[b].session_present);
+        }
+    }
+
+    failures += bench_check("every record delivered once and in order", delivered);
+    failures += bench_check("broker resumes the persistent session", resumed);
+
+    // At a real round trip time, a single batch takes one round trip more
+    // over MQTT for CONNACK. From four batches on the publishes in flight
+    // win over HTTP's one request per round trip.
+    double small_ms = mqtt_results[0].elapsed_ms - http_results[0].elapsed_ms;
+    snprintf(label, sizeof(label), "%zu records, mqtt %+.0f ms", backlogs[0], small_ms);
+    failures += bench_check(label, small_ms > 0.5 * rtts_ms[1] && small_ms < 1.5 * rtts_ms[1]);
+    for (size_t b = 2; b < backlogs_length; b++) {
+        snprintf(label, sizeof(label), "%zu records, mqtt %.0f ms of http's %.0f ms", backlogs[b], mqtt_results[b].elapsed_ms, http_results[b].elapsed_ms);
+        failures += bench_check(label, mqtt_results[b].elapsed_ms < http_results[b].elapsed_ms);
+    }
+
+    http.stop = true;
+    mqtt.stop = true;
+    pthread_join(http_thread, NULL);
+    pthread_join(mqtt_thread, NULL);
+    free(measurements);
+
+    return failures ? 1 : 0;
+}
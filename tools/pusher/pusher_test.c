@@ -0,0 +1,641 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <setjmp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "samples.h"
+#include "esp_system.h"
+
+// The session helpers are static, the test is built as part of the pusher
+#include "pusher.h"
+
+#define TEST_SEED 1
+#define TEST_MEASUREMENTS 60
+#define TEST_MEASUREMENT_RATE 60
+#define TEST_IMAGE_SZ (200 * 1024)
+#define TEST_SINK_BUFFER_SZ 16384
+#define TEST_ANSWER_SZ 8192
+#define TEST_FIRMWARE_CHUNK_SZ 1000
+#define TEST_FIRMWARE_PATH "/fw/next.jdiff"
+#define TEST_GRACE_MARGIN_MS 1000
+
+#define TEST_ESC 0xA7
+#define TEST_MOD 0xA6
+#define TEST_INS 0xA5
+#define TEST_DEL 0xA4
+#define TEST_EQL 0xA3
+
+RTC_DATA_ATTR struct configuration_t configuration;
+struct energy_t energy;
+
+static size_t test_config_writes = 0;
+
+esp_err_t cfg_write(void)
+{
+    test_config_writes += 1;
+    return ESP_OK;
+}
+
+esp_err_t pusher_mqtt_push(const char* url, const struct formatter_t* formatter, const struct formatter_options_t* formatter_options, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t pusher_coap_push(const char* url, struct sensor_data_t* measurements, size_t measurements_length, uint32_t* acknowledged_sequence)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+/**
+ * HTTP/1.1 data sink stand-in. Acknowledges every CSV batch with the
+ * sequence number of its last row, optionally requests a firmware update
+ * and serves it chunked in small writes. A stalled sink holds uploads
+ * until it is released and closes the connection then.
+*/
+struct test_sink_t {
+    int listen_fd;
+    uint16_t port;
+    volatile bool stop;
+
+    /**
+     * Behaviour, set before the upload
+    */
+    bool request_firmware;
+    const char* answer_members;
+    const uint8_t* firmware;
+    size_t firmware_length;
+    volatile bool stall;
+
+    /**
+     * What the sink saw during the last upload
+    */
+    size_t connections;
+    size_t posts;
+    size_t gets;
+    size_t get_connection;
+    char post_path[128];
+    char get_path[64];
+    char firmware_sha256[80];
+};
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+static int test_write_all(int fd, const char* data, size_t length)
+{
+    while (length > 0) {
+        ssize_t written = send(fd, data, length, MSG_NOSIGNAL);
+        if (written <= 0) {
+            return -1;
+        }
+        data += written;
+        length -= written;
+    }
+
+    return 0;
+}
+
+/**
+ * Copies the value of header [name] into [value], empty if it is missing
+*/
+static void test_header(const char* head, const char* name, char* value, size_t capacity)
+{
+    const char* line = strcasestr(head, name);
+    size_t length = 0;
+
+    if (line) {
+        line += strlen(name);
+        while (*line == ' ') line += 1;
+        length = strcspn(line, "\r\n");
+    }
+    if (length >= capacity) {
+        length = capacity - 1;
+    }
+
+    memcpy(value, line, length);
+    value[length] = '\0';
+}
+
+static int test_sink_respond(struct test_sink_t* sink, int fd, char* head, const char* body, size_t body_length)
+{
+    char response[512];
+
+    if (strncmp(head, "POST ", 5) == 0 && sink->stall) {
+        sink->posts += 1;
+        while (sink->stall && !sink->stop) {
+            usleep(10000);
+        }
+        shutdown(fd, SHUT_RDWR);
+        return -1;
+    }
+
+    if (strncmp(head, "POST ", 5) == 0) {
+        // The last row of the CSV batch starts with its sequence number
+        const char* last_row = body;
+        for (size_t i = 0; i + 1 < body_length; i++) {
+            if (body[i] == '\n') {
+                last_row = &body[i + 1];
+            }
+        }
+
+        sink->posts += 1;
+        sscanf(head, "POST %127s", sink->post_path);
+        test_header(head, "\r\nX-Firmware-Sha256:", sink->firmware_sha256, sizeof(sink->firmware_sha256));
+
+        char* answer = malloc(TEST_ANSWER_SZ);
+        if (!answer) {
+            return -1;
+        }
+        int answer_length = snprintf(answer, TEST_ANSWER_SZ, "{\"ack\":%lu%s%s}", strtoul(last_row, NULL, 10),
+            sink->request_firmware ? ",\"firmware\":{\"path\":\"" TEST_FIRMWARE_PATH "\",\"delta\":true}" : "",
+            sink->answer_members ? sink->answer_members : "");
+        int response_length = snprintf(response, sizeof(response), "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Length: %d\r\n\r\n", answer_length);
+        int err = test_write_all(fd, response, response_length) | test_write_all(fd, answer, answer_length);
+        free(answer);
+        return err;
+    }
+
+    sink->gets += 1;
+    sink->get_connection = sink->connections;
+    sscanf(head, "GET %63s", sink->get_path);
+
+    if (!sink->firmware || strcmp(sink->get_path, TEST_FIRMWARE_PATH) != 0) {
+        static const char not_found[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        return test_write_all(fd, not_found, sizeof(not_found) - 1);
+    }
+
+    // Small chunks in separate writes, so the patch arrives in pieces
+    static const char chunked[] = "HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\nTransfer-Encoding: chunked\r\nConnection: close\r\n\r\n";
+    if (test_write_all(fd, chunked, sizeof(chunked) - 1) != 0) {
+        return -1;
+    }
+    for (size_t offset = 0; offset < sink->firmware_length; offset += TEST_FIRMWARE_CHUNK_SZ) {
+        size_t length = sink->firmware_length - offset < TEST_FIRMWARE_CHUNK_SZ ? sink->firmware_length - offset : TEST_FIRMWARE_CHUNK_SZ;
+        int size_length = snprintf(response, sizeof(response), "%zx\r\n", length);
+        if (test_write_all(fd, response, size_length) != 0
+            || test_write_all(fd, (const char*) &sink->firmware[offset], length) != 0
+            || test_write_all(fd, "\r\n", 2) != 0) {
+            return -1;
+        }
+    }
+    return test_write_all(fd, "0\r\n\r\n", 5);
+}
+
+/**
+ * Serves one connection until the station closes it
+*/
+static void test_sink_serve(struct test_sink_t* sink, int fd)
+{
+    char* buffer = malloc(TEST_SINK_BUFFER_SZ);
+    size_t length = 0;
+    ssize_t received;
+
+    while (buffer && (received = read(fd, &buffer[length], TEST_SINK_BUFFER_SZ - 1 - length)) > 0) {
+        length += received;
+        buffer[length] = '\0';
+
+        char* head_end;
+        while ((head_end = strstr(buffer, "\r\n\r\n")) != NULL) {
+            char content_length[16];
+            size_t head_length = head_end + 4 - buffer;
+
+            *head_end = '\0';
+            test_header(buffer, "\r\nContent-Length:", content_length, sizeof(content_length));
+            size_t body_length = strtoul(content_length, NULL, 10);
+            *head_end = '\r';
+
+            if (length < head_length + body_length) {
+                break;
+            }
+
+            *head_end = '\0';
+            if (test_sink_respond(sink, fd, buffer, &buffer[head_length], body_length) != 0) {
+                length = 0;
+                break;
+            }
+
+            length -= head_length + body_length;
+            memmove(buffer, &buffer[head_length + body_length], length);
+            buffer[length] = '\0';
+        }
+    }
+
+    free(buffer);
+    close(fd);
+}
+
+static void* test_sink_run(void* argument)
+{
+    struct test_sink_t* sink = argument;
+    struct pollfd listening = { sink->listen_fd, POLLIN, 0 };
+
+    while (!sink->stop) {
+        if (poll(&listening, 1, 50) <= 0) {
+            continue;
+        }
+
+        int fd = accept(sink->listen_fd, NULL, NULL);
+        if (fd >= 0) {
+            sink->connections += 1;
+            test_sink_serve(sink, fd);
+        }
+    }
+
+    return NULL;
+}
+
+static int test_sink_start(struct test_sink_t* sink, pthread_t* thread)
+{
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK), .sin_port = 0 };
+    socklen_t address_length = sizeof(address);
+
+    sink->listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (bind(sink->listen_fd, (struct sockaddr*) &address, sizeof(address)) != 0
+        || listen(sink->listen_fd, 16) != 0
+        || getsockname(sink->listen_fd, (struct sockaddr*) &address, &address_length) != 0) {
+        perror("sink");
+        return -1;
+    }
+    sink->port = ntohs(address.sin_port);
+
+    return pthread_create(thread, NULL, test_sink_run, sink);
+}
+
+/**
+ * Uploads [measurements] to the stand-in like main.c does after a wake
+*/
+static esp_err_t test_upload(struct test_sink_t* sink, struct sensor_data_t* measurements, uint32_t* acknowledged_sequences)
+{
+    sink->connections = 0;
+    sink->posts = 0;
+    sink->gets = 0;
+    sink->get_connection = 0;
+    sink->post_path[0] = '\0';
+    sink->get_path[0] = '\0';
+    sink->firmware_sha256[0] = '\0';
+
+    memset(acknowledged_sequences, 0, CONFIGURATION_DATA_SINKS_MAX * sizeof(uint32_t));
+    return pusher_push(measurements, TEST_MEASUREMENTS, acknowledged_sequences);
+}
+
+/**
+ * Answer members holding a configuration with every value at its longest
+*/
+static size_t test_largest_configuration(char* members, const char* data_sink, const char* additional_data_sink)
+{
+    char tolerances[256] = "";
+
+    for (int i = 0; i < SENSORS_READINGS; i++) {
+        strcat(tolerances, i ? ",1.7976931348623157e+308" : "1.7976931348623157e+308");
+    }
+
+    return snprintf(members, TEST_ANSWER_SZ,
+        ",\"config\":{\"version\":4294967295,\"data_sink\":\"%s\",\"data_sink_push_format\":1,"
+        "\"data_sink_compression\":0,\"csv_delta_timestamps\":false,"
+        "\"line_protocol_measurement\":\"%031d\",\"line_protocol_station\":\"%031d\","
+        "\"bme280_oversampling\":[5,5,5],\"aggregation\":2,\"aggregation_window\":65535,"
+        "\"sample_filter\":2,\"sample_filter_tolerances\":[%s],\"sample_filter_max_interval\":65535,"
+        "\"sensor_rates\":[65535,65535,65535,65535],\"sensor_dark_rate\":65535,\"energy_autonomy_hours\":65535,"
+        "\"measurement_rate\":65535,\"upload_rate\":65535,\"subtract_measuring_time\":false,\"uplink\":0,"
+        "\"espnow_peer\":\"ff:ff:ff:ff:ff:ff\",\"espnow_channel\":14,\"broadcast_key\":\"%032d\","
+        "\"additional_data_sinks\":[{\"url\":\"%s\",\"push_format\":255},{\"url\":\"%s\",\"push_format\":255}]}",
+        data_sink, 0, 0, tolerances, 0, additional_data_sink, additional_data_sink);
+}
+
+/**
+ * Writes the length of an EQL or DEL operation in jdiff's 2 or 5 byte form
+*/
+static size_t test_write_operation(uint8_t* patch, uint8_t operation, size_t length)
+{
+    size_t patch_length = 0;
+
+    patch[patch_length++] = TEST_ESC;
+    patch[patch_length++] = operation;
+    if (length <= 0xFFFF) {
+        patch[patch_length++] = 253;
+        patch[patch_length++] = length >> 8;
+        patch[patch_length++] = length & 0xFF;
+    } else {
+        patch[patch_length++] = 254;
+        patch[patch_length++] = length >> 24;
+        patch[patch_length++] = (length >> 16) & 0xFF;
+        patch[patch_length++] = (length >> 8) & 0xFF;
+        patch[patch_length++] = length & 0xFF;
+    }
+
+    return patch_length;
+}
+
+/**
+ * Writes MOD or INS data, free of bytes that would need escaping
+*/
+static size_t test_write_data(uint8_t* patch, uint8_t operation, uint8_t* expected, size_t length)
+{
+    size_t patch_length = 0;
+
+    patch[patch_length++] = TEST_ESC;
+    patch[patch_length++] = operation;
+    for (size_t i = 0; i < length; i++) {
+        uint8_t value = rand() & 0x7F;
+        patch[patch_length++] = value;
+        expected[i] = value;
+    }
+
+    return patch_length;
+}
+
+/**
+ * The next image: the running one with an insert, a delete and a
+ * modification. Returns the patch length, [expected] receives the image.
+*/
+static size_t test_build_patch(const uint8_t* source, uint8_t* patch, uint8_t* expected, size_t* expected_length)
+{
+    size_t patch_length = 0;
+    size_t source_offset = 0;
+
+    *expected_length = 0;
+
+    patch_length += test_write_operation(&patch[patch_length], TEST_EQL, 100000);
+    memcpy(&expected[*expected_length], &source[source_offset], 100000);
+    *expected_length += 100000;
+    source_offset += 100000;
+
+    patch_length += test_write_data(&patch[patch_length], TEST_INS, &expected[*expected_length], 500);
+    *expected_length += 500;
+
+    patch_length += test_write_operation(&patch[patch_length], TEST_DEL, 2000);
+    source_offset += 2000;
+
+    patch_length += test_write_data(&patch[patch_length], TEST_MOD, &expected[*expected_length], 300);
+    *expected_length += 300;
+    source_offset += 300;
+
+    size_t rest = TEST_IMAGE_SZ - source_offset;
+    patch_length += test_write_operation(&patch[patch_length], TEST_EQL, rest);
+    memcpy(&expected[*expected_length], &source[source_offset], rest);
+    *expected_length += rest;
+
+    return patch_length;
+}
+
+/**
+ * Boots into the next image, reporting [reason] like the reset before it
+*/
+static void test_boot(esp_reset_reason_t reason)
+{
+    host_reset_reason = reason;
+    host_ota_boot();
+}
+
+/**
+ * One verification of the running image. Returns true if it rolled back,
+ * the station then boots the previous image.
+*/
+static bool test_verify(bool healthy)
+{
+    jmp_buf restart;
+
+    host_restart_point = &restart;
+    if (setjmp(restart) == 0) {
+        ota_confirm_running_image(healthy);
+        host_restart_point = NULL;
+        return false;
+    }
+
+    host_restart_point = NULL;
+    test_boot(ESP_RST_SW);
+    return true;
+}
+
+/**
+ * Boots after [reason] and runs the boot check of main.c. Returns true if
+ * the check rolled back.
+*/
+static bool test_boot_check(esp_reset_reason_t reason)
+{
+    jmp_buf restart;
+
+    test_boot(reason);
+    host_restart_point = &restart;
+    if (setjmp(restart) == 0) {
+        ota_check_boot();
+        host_restart_point = NULL;
+        return false;
+    }
+
+    host_restart_point = NULL;
+    test_boot(ESP_RST_SW);
+    return true;
+}
+
+static bool test_is_running(size_t slot)
+{
+    return esp_ota_get_running_partition() == host_ota_slot(slot);
+}
+
+int main(void)
+{
+    int failures = 0;
+    struct test_sink_t sink = {0};
+    pthread_t sink_thread;
+    uint32_t acknowledged_sequences[CONFIGURATION_DATA_SINKS_MAX];
+    struct sensor_data_t* measurements = calloc(TEST_MEASUREMENTS, sizeof(struct sensor_data_t));
+    uint8_t* source = malloc(TEST_IMAGE_SZ);
+    uint8_t* patch = malloc(2 * TEST_IMAGE_SZ);
+    uint8_t* expected = malloc(2 * TEST_IMAGE_SZ);
+    size_t expected_length;
+
+    if (!measurements || !source || !patch || !expected || test_sink_start(&sink, &sink_thread) != 0) {
+        return 1;
+    }
+    srand(TEST_SEED);
+
+    samples_generate(measurements, TEST_MEASUREMENTS, TEST_MEASUREMENT_RATE, TEST_SEED);
+    for (size_t i = 0; i < TEST_IMAGE_SZ; i++) {
+        source[i] = rand() & 0xFF;
+    }
+    host_ota_install(source, TEST_IMAGE_SZ);
+    size_t patch_length = test_build_patch(source, patch, expected, &expected_length);
+
+    configuration.data_sink_push_format = FORMATTER_FORMAT_CSV;
+    configuration.uplink = CONFIGURATION_UPLINK_WIFI;
+    configuration.config_version = 1;
+    snprintf(configuration.data_sink, sizeof(configuration.data_sink), "http://127.0.0.1:%u/measurements", sink.port);
+
+    // Without an update the upload is all there is
+    failures += test_check("upload without firmware",
+        test_upload(&sink, measurements, acknowledged_sequences) == ESP_OK
+        && acknowledged_sequences[0] == TEST_MEASUREMENTS
+        && sink.posts > 1 && sink.gets == 0 && sink.connections == 1
+        && strcmp(sink.firmware_sha256, host_app_elf_sha256) == 0);
+
+    // The query is part of the request path, e.g. for InfluxDB's write
+    // endpoint, the fragment is not
+    snprintf(configuration.data_sink, sizeof(configuration.data_sink), "http://127.0.0.1:%u/write?db=weather&precision=s#station", sink.port);
+    failures += test_check("query string kept in the request path",
+        test_upload(&sink, measurements, acknowledged_sequences) == ESP_OK
+        && strcmp(sink.post_path, "/write?db=weather&precision=s") == 0);
+    snprintf(configuration.data_sink, sizeof(configuration.data_sink), "http://127.0.0.1:%u", sink.port);
+    failures += test_check("empty path sent as /",
+        test_upload(&sink, measurements, acknowledged_sequences) == ESP_OK
+        && strcmp(sink.post_path, "/") == 0);
+    snprintf(configuration.data_sink, sizeof(configuration.data_sink), "http://127.0.0.1:%u/measurements", sink.port);
+
+    // The largest configuration fits into the response buffer. A longer
+    // body fails the upload instead of acknowledging the batch and losing
+    // the configuration.
+    struct configuration_t saved_configuration = configuration;
+    char* members = malloc(TEST_ANSWER_SZ);
+    char data_sink[sizeof(configuration.data_sink)];
+    char additional_data_sink[sizeof(configuration.additional_data_sinks[0])];
+    if (!members) {
+        return 1;
+    }
+    memset(data_sink, 'x', sizeof(data_sink) - 1);
+    data_sink[sizeof(data_sink) - 1] = '\0';
+    memcpy(data_sink, configuration.data_sink, strlen(configuration.data_sink));
+    memcpy(&data_sink[strlen(configuration.data_sink)], "?pad=", 5);
+    memset(additional_data_sink, 'x', sizeof(additional_data_sink) - 1);
+    additional_data_sink[sizeof(additional_data_sink) - 1] = '\0';
+    memcpy(additional_data_sink, "coap://archive/", 15);
+
+    char label[64];
+    size_t members_length = test_largest_configuration(members, data_sink, additional_data_sink);
+    snprintf(label, sizeof(label), "largest configuration (%zu bytes) applied", members_length + 16);
+    sink.answer_members = members;
+    test_config_writes = 0;
+    failures += test_check(label,
+        test_upload(&sink, measurements, acknowledged_sequences) == ESP_OK
+        && acknowledged_sequences[0] == TEST_MEASUREMENTS
+        && test_config_writes == 1 && configuration.config_version == UINT32_MAX
+        && strcmp(configuration.data_sink, data_sink) == 0
+        && strcmp(configuration.additional_data_sinks[1], additional_data_sink) == 0);
+    configuration = saved_configuration;
+
+    memset(members, 'x', TEST_ANSWER_SZ - 1);
+    members[TEST_ANSWER_SZ - 1] = '\0';
+    memcpy(members, ",\"padding\":\"", 12);
+    members[PUSHER_RESPONSE_BODY_BUFFER_SZ] = '"';
+    members[PUSHER_RESPONSE_BODY_BUFFER_SZ + 1] = '\0';
+    test_config_writes = 0;
+    failures += test_check("oversized response fails the upload",
+        test_upload(&sink, measurements, acknowledged_sequences) == ESP_ERR_INVALID_SIZE
+        && acknowledged_sequences[0] == 0 && test_config_writes == 0 && sink.posts == 1);
+    sink.answer_members = NULL;
+    free(members);
+
+    // A missing or broken update does not fail the upload and keeps the
+    // running image
+    sink.request_firmware = true;
+    failures += test_check("firmware not found",
+        test_upload(&sink, measurements, acknowledged_sequences) == ESP_OK
+        && acknowledged_sequences[0] == TEST_MEASUREMENTS
+        && sink.gets == 1 && !ota_is_restart_pending()
+        && host_ota_boot_partition() == host_ota_slot(0));
+
+    const uint8_t broken[] = { TEST_ESC, TEST_EQL, 0, TEST_ESC, 0x00 };
+    sink.firmware = broken;
+    sink.firmware_length = sizeof(broken);
+    failures += test_check("broken patch",
+        test_upload(&sink, measurements, acknowledged_sequences) == ESP_OK
+        && sink.gets == 1 && !ota_is_restart_pending()
+        && host_ota_boot_partition() == host_ota_slot(0));
+
+    // The update is fetched over the upload's connection and patched into
+    // the other slot while it streams in
+    sink.firmware = patch;
+    sink.firmware_length = patch_length;
+    failures += test_check("delta fetched over the upload session",
+        test_upload(&sink, measurements, acknowledged_sequences) == ESP_OK
+        && acknowledged_sequences[0] == TEST_MEASUREMENTS
+        && sink.connections == 1 && sink.get_connection == 1 && sink.gets == 1
+        && strcmp(sink.get_path, TEST_FIRMWARE_PATH) == 0);
+    failures += test_check("patched image in the update slot",
+        host_ota_slot_length(host_ota_slot(1)) == expected_length
+        && memcmp(host_ota_slot_data(host_ota_slot(1)), expected, expected_length) == 0);
+    failures += test_check("restart pending, update slot boots next",
+        ota_is_restart_pending() && host_ota_boot_partition() == host_ota_slot(1));
+
+    // Failed verifications are retried, the third rolls back
+    test_boot(ESP_RST_SW);
+    bool pending = test_is_running(1) && ota_is_pending_verify();
+    bool rolled_back = test_verify(false);
+    test_boot(ESP_RST_DEEPSLEEP);
+    bool kept = !rolled_back && test_is_running(1) && ota_is_pending_verify();
+    rolled_back = test_verify(false);
+    test_boot(ESP_RST_DEEPSLEEP);
+    kept = kept && !rolled_back && test_is_running(1) && ota_is_pending_verify();
+    rolled_back = test_verify(false);
+    failures += test_check("two failed verifications keep the update", pending && kept);
+    failures += test_check("third failed verification rolls back", rolled_back && test_is_running(0) && !ota_is_pending_verify());
+
+    // A panic while on trial rolls back right away
+    test_upload(&sink, measurements, acknowledged_sequences);
+    test_boot(ESP_RST_SW);
+    rolled_back = test_verify(false);
+    failures += test_check("panic after a failed verification rolls back",
+        !rolled_back && test_boot_check(ESP_RST_PANIC) && test_is_running(0) && !ota_is_pending_verify());
+
+    // A panic before the first verification is rolled back by the bootloader
+    test_upload(&sink, measurements, acknowledged_sequences);
+    test_boot(ESP_RST_SW);
+    pending = test_is_running(1) && ota_is_pending_verify();
+    failures += test_check("panic before the first verification rolls back",
+        pending && !test_boot_check(ESP_RST_PANIC) && test_is_running(0) && !ota_is_pending_verify());
+
+    // Reaching the network confirms the update, also after failures
+    test_upload(&sink, measurements, acknowledged_sequences);
+    test_boot(ESP_RST_SW);
+    rolled_back = test_verify(false);
+    rolled_back = rolled_back || test_verify(true);
+    failures += test_check("reaching the network confirms the update",
+        !rolled_back && !test_boot_check(ESP_RST_DEEPSLEEP) && !test_boot_check(ESP_RST_PANIC)
+        && test_is_running(1) && !ota_is_pending_verify());
+
+    // An additional data sink that does not answer is left behind once the
+    // primary one finished and its grace ran out. It keeps its acknowledged
+    // sequence number and gets the measurements with the next upload.
+    struct test_sink_t archive = { .stall = true };
+    pthread_t archive_thread;
+    if (test_sink_start(&archive, &archive_thread) != 0) {
+        return 1;
+    }
+    snprintf(configuration.additional_data_sinks[0], sizeof(configuration.additional_data_sinks[0]), "http://127.0.0.1:%u/archive", archive.port);
+    configuration.additional_data_sinks_push_format[0] = FORMATTER_FORMAT_CSV;
+    sink.request_firmware = false;
+    int64_t started_at = esp_timer_get_time();
+    esp_err_t err = test_upload(&sink, measurements, acknowledged_sequences);
+    int64_t elapsed_ms = (esp_timer_get_time() - started_at) / 1000;
+    failures += test_check("stalled additional sink left behind after the grace",
+        err == ESP_OK && archive.posts == 1
+        && elapsed_ms >= PUSHER_SINK_GRACE_MS && elapsed_ms < PUSHER_SINK_GRACE_MS + TEST_GRACE_MARGIN_MS
+        && acknowledged_sequences[0] == TEST_MEASUREMENTS && acknowledged_sequences[1] == 0);
+
+    archive.stall = false;
+    archive.posts = 0;
+    failures += test_check("left behind sink catches up with the next upload",
+        pusher_push(measurements, TEST_MEASUREMENTS, acknowledged_sequences) == ESP_OK
+        && archive.posts > 0 && strcmp(archive.post_path, "/archive") == 0
+        && acknowledged_sequences[0] == TEST_MEASUREMENTS && acknowledged_sequences[1] == TEST_MEASUREMENTS);
+    configuration.additional_data_sinks[0][0] = '\0';
+
+    sink.stop = true;
+    archive.stop = true;
+    pthread_join(sink_thread, NULL);
+    pthread_join(archive_thread, NULL);
+    close(sink.listen_fd);
+    close(archive.listen_fd);
+    free(measurements);
+    free(source);
+    free(patch);
+    free(expected);
+
+    return failures ? 1 : 0;
+}
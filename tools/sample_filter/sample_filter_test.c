@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <math.h>
+
+#include "sample_filter.h"
+#include "aggregator.h"
+#include "samples.h"
+
+#define TEST_RECORDS 10080         /*!< One week at the default measurement rate */
+#define TEST_MEASUREMENT_RATE 60
+#define TEST_SEED 1
+#define TEST_MAX_INTERVAL 1800
+
+/**
+ * Float rounding of the door's slopes, relative to the reading
+*/
+#define TEST_EPSILON 1e-5
+
+/**
+ * Default tolerances, see the README
+*/
+static const float test_tolerances[SENSORS_READINGS] = { 0.2f, 0.2f, 1, 0.1f, 100, 1, 0.01f, 0.5f, 0.5f };
+
+/**
+ * Default sensor rates in seconds, 0 reads a sensor on every wake
+*/
+static const uint16_t test_sensor_rates[SENSORS_DEVICES] = { 0, 300, 0, 600 };
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+/**
+ * Skips the devices that are not due like main_due_sensors does with the
+ * default sensor rates. Skipped fields keep the last reading.
+*/
+static void test_apply_sensor_rates(struct sensor_data_t* measurements, size_t measurements_length)
+{
+    for (size_t i = 1; i < measurements_length; i++) {
+        struct sensor_data_t* m = &measurements[i];
+        const struct sensor_data_t* previous = &measurements[i - 1];
+
+        for (uint8_t device = 0; device < SENSORS_DEVICES; device++) {
+            uint16_t rate = test_sensor_rates[device];
+            if (rate != 0 && (m->timestamp - measurements[0].timestamp) % rate != 0) {
+                m->skipped_devices |= 1 << device;
+            }
+        }
+
+        if (m->skipped_devices & (1 << SENSORS_DEVICE_BME280)) {
+            m->temperature_inside = previous->temperature_inside;
+            m->pressure = previous->pressure;
+        }
+        if (m->skipped_devices & (1 << SENSORS_DEVICE_MAX17048)) {
+            m->battery_voltage = previous->battery_voltage;
+            m->battery_charge = previous->battery_charge;
+            m->battery_charge_rate = previous->battery_charge_rate;
+        }
+    }
+}
+
+/**
+ * Runs [measurements] through the filter in [mode]. Returns the stored
+ * samples, the one still held back at the end is not part of them.
+*/
+static struct sensor_data_t* test_filter(const struct sensor_data_t* measurements, size_t measurements_length, uint8_t mode, size_t* stored_length)
+{
+    struct sample_filter_options_t options = { mode, test_tolerances, TEST_MAX_INTERVAL };
+    struct sample_filter_t filter;
+    struct sensor_data_t* stored = calloc(measurements_length, sizeof(struct sensor_data_t));
+
+    *stored_length = 0;
+    if (!stored) {
+        return NULL;
+    }
+
+    sample_filter_reset(&filter);
+    for (size_t i = 0; i < measurements_length; i++) {
+        struct sensor_data_t released[SAMPLE_FILTER_STORED_MAX];
+        size_t released_length = sample_filter_add(&filter, &options, &measurements[i], released);
+        memcpy(&stored[*stored_length], released, released_length * sizeof(struct sensor_data_t));
+        *stored_length += released_length;
+    }
+
+    return stored;
+}
+
+/**
+ * Checks that [stored] are samples of [measurements] in order, at most
+ * TEST_MAX_INTERVAL plus one wake apart, and that holding the last value
+ * (deadband) or interpolating linearly (swinging door) reconstructs every
+ * dropped sample up to the last stored one within its tolerance
+*/
+static int test_reconstruct(const struct sensor_data_t* measurements, size_t measurements_length, const struct sensor_data_t* stored, size_t stored_length, uint8_t mode)
+{
+    size_t next = 0;
+
+    for (size_t i = 0; i < measurements_length && next < stored_length; i++) {
+        const struct sensor_data_t* m = &measurements[i];
+
+        if (memcmp(m, &stored[next], sizeof(struct sensor_data_t)) == 0) {
+            if (next > 0 && stored[next].timestamp - stored[next - 1].timestamp > TEST_MAX_INTERVAL + TEST_MEASUREMENT_RATE) {
+                fprintf(stderr, "Stored samples %" PRIu32 " and %" PRIu32 " too far apart\n", stored[next - 1].sequence, stored[next].sequence);
+                return -1;
+            }
+            next += 1;
+            continue;
+        }
+
+        if (next == 0) {
+            fprintf(stderr, "Sample %" PRIu32 " dropped before the first stored one\n", m->sequence);
+            return -1;
+        }
+
+        const struct sensor_data_t* start = &stored[next - 1];
+        const struct sensor_data_t* end = &stored[next];
+        double position = (double) (m->timestamp - start->timestamp) / (end->timestamp - start->timestamp);
+
+        for (uint8_t reading = 0; reading < SENSORS_READINGS; reading++) {
+            double value = aggregator_reading_get(m, reading);
+            double from = aggregator_reading_get(start, reading);
+            double to = aggregator_reading_get(end, reading);
+            double reconstructed = mode == SAMPLE_FILTER_DEADBAND ? from : from + (to - from) * position;
+
+            if (fabs(reconstructed - value) > test_tolerances[reading] + TEST_EPSILON * fabs(value)) {
+                fprintf(stderr, "Sample %" PRIu32 " reading %u: %f reconstructed as %f\n", m->sequence, reading, value, reconstructed);
+                return -1;
+            }
+        }
+    }
+
+    if (next != stored_length) {
+        fprintf(stderr, "Stored sample %" PRIu32 " is not part of the series\n", stored[next].sequence);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * Whether every sample that reads a device the previous one skipped was
+ * stored. Counts them in [forced].
+*/
+static bool test_forced_stored(const struct sensor_data_t* measurements, size_t measurements_length, const struct sensor_data_t* stored, size_t stored_length, size_t* forced)
+{
+    size_t next = 0;
+
+    *forced = 0;
+    for (size_t i = 1; i < measurements_length; i++) {
+        while (next < stored_length && stored[next].sequence < measurements[i].sequence) {
+            next += 1;
+        }
+
+        if (measurements[i - 1].skipped_devices & ~measurements[i].skipped_devices) {
+            if (next == stored_length) {
+                // Only the held sample at the very end may be missing
+                return i == measurements_length - 1;
+            }
+            if (stored[next].sequence != measurements[i].sequence) {
+                fprintf(stderr, "Sample %" PRIu32 " reads a skipped device again and was dropped\n", measurements[i].sequence);
+                return false;
+            }
+            *forced += 1;
+        }
+    }
+
+    return *forced > 0;
+}
+
+static int test_week(const char* name, const struct sensor_data_t* measurements, uint8_t mode)
+{
+    char label[64];
+    size_t stored_length;
+    struct sensor_data_t* stored = test_filter(measurements, TEST_RECORDS, mode, &stored_length);
+
+    if (!stored) {
+        return 1;
+    }
+
+    snprintf(label, sizeof(label), "%s, %s stores 1 in %.1f", name, mode == SAMPLE_FILTER_DEADBAND ? "deadband" : "swinging door", (double) TEST_RECORDS / stored_length);
+    int failures = test_check(label, stored_length > 0 && test_reconstruct(measurements, TEST_RECORDS, stored, stored_length, mode) == 0);
+
+    bool has_skipped = false;
+    for (size_t i = 0; i < TEST_RECORDS; i++) {
+        has_skipped = has_skipped || measurements[i].skipped_devices;
+    }
+    if (has_skipped) {
+        size_t forced;
+        bool passed = test_forced_stored(measurements, TEST_RECORDS, stored, stored_length, &forced);
+        snprintf(label, sizeof(label), "%s, %s keeps %zu forced samples", name, mode == SAMPLE_FILTER_DEADBAND ? "deadband" : "swinging door", forced);
+        failures += test_check(label, passed);
+    }
+
+    free(stored);
+    return failures;
+}
+
+/**
+ * Feeds [length] samples in [from] mode so swinging door holds the last one,
+ * then one in [to] mode. Returns whether the held sample came out first and
+ * the new one was handled by [to].
+*/
+static bool test_mode_change(const struct sensor_data_t* measurements, uint8_t from, uint8_t to, size_t length)
+{
+    struct sample_filter_options_t options = { from, test_tolerances, TEST_MAX_INTERVAL };
+    struct sample_filter_t filter;
+    struct sensor_data_t released[SAMPLE_FILTER_STORED_MAX];
+    size_t released_length = 0;
+
+    sample_filter_reset(&filter);
+    for (size_t i = 0; i < length; i++) {
+        released_length = sample_filter_add(&filter, &options, &measurements[i], released);
+    }
+    bool was_held = filter.has_held;
+
+    options.mode = to;
+    released_length = sample_filter_add(&filter, &options, &measurements[length], released);
+
+    // A fresh deadband or swinging door filter stores its first sample
+    size_t expected_length = was_held ? 2 : 1;
+    return released_length == expected_length
+        && (!was_held || released[0].sequence == measurements[length - 1].sequence)
+        && released[expected_length - 1].sequence == measurements[length].sequence
+        && filter.mode == to
+        && !filter.has_held;
+}
+
+int main(void)
+{
+    int failures = 0;
+    struct sensor_data_t* measurements = calloc(TEST_RECORDS, sizeof(struct sensor_data_t));
+
+    if (!measurements) {
+        return 1;
+    }
+
+    // Every sensor read on every wake
+    samples_generate(measurements, TEST_RECORDS, TEST_MEASUREMENT_RATE, TEST_SEED);
+    failures += test_week("synthetic week", measurements, SAMPLE_FILTER_DEADBAND);
+    failures += test_week("synthetic week", measurements, SAMPLE_FILTER_SWINGING_DOOR);
+
+    // Pressure and battery read less often, their readings repeat in between
+    test_apply_sensor_rates(measurements, TEST_RECORDS);
+    failures += test_week("sensor rates", measurements, SAMPLE_FILTER_DEADBAND);
+    failures += test_week("sensor rates", measurements, SAMPLE_FILTER_SWINGING_DOOR);
+
+    // A held sample is released before the new mode takes over
+    samples_generate(measurements, TEST_RECORDS, TEST_MEASUREMENT_RATE, TEST_SEED);
+    failures += test_check("held sample released switching to deadband",
+        test_mode_change(measurements, SAMPLE_FILTER_SWINGING_DOOR, SAMPLE_FILTER_DEADBAND, 3));
+    failures += test_check("held sample released switching to none",
+        test_mode_change(measurements, SAMPLE_FILTER_SWINGING_DOOR, SAMPLE_FILTER_NONE, 3));
+    failures += test_check("switching from deadband releases only the sample",
+        test_mode_change(measurements, SAMPLE_FILTER_DEADBAND, SAMPLE_FILTER_SWINGING_DOOR, 3));
+
+    free(measurements);
+
+    return failures ? 1 : 0;
+}
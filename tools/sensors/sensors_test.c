@@ -0,0 +1,284 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The driver under test, built in so its rtc memory can be inspected.
+ * `make history` builds the drivers of earlier commits instead, which read
+ * every sensor and know neither the configuration nor the energy budget
+ * yet.
+*/
+#ifndef TEST_SENSORS_C
+#define TEST_SENSORS_C "sensors.c"
+#endif
+#include TEST_SENSORS_C
+
+#define TEST_SLOW_RATE 60          /*!< Default measurement rate, the LTR390 sleeps */
+#define TEST_FAST_RATE 10          /*!< The LTR390 keeps measuring UV in deep sleep */
+
+#ifdef __WEATHER_STATION__CONFIGURATION_H__
+struct configuration_t configuration;
+#define TEST_CONFIGURE(rate) (configuration.measurement_rate = (rate))
+#else
+#define TEST_CONFIGURE(rate)
+#endif
+
+#ifdef __WEATHER_STATION__ENERGY_H__
+struct energy_t energy;
+#endif
+
+#ifdef TEST_HISTORY
+#define TEST_READ(measurement) sensors_read(measurement)
+#else
+#define TEST_READ(measurement) ((measurement)->skipped_devices = SENSORS_DEVICES_ALL, sensors_read(measurement, SENSORS_DEVICES_ALL))
+#endif
+
+/**
+ * A part on the fake bus. The first byte written selects a register, further
+ * written bytes go to it and reads come from it, both with address
+ * auto-increment.
+*/
+struct test_device_t {
+    struct host_i2c_device_t device;
+    uint8_t registers[256];
+    uint8_t pointer;
+};
+
+static esp_err_t test_device_transfer(struct host_i2c_device_t* device, const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size)
+{
+    struct test_device_t* part = (struct test_device_t*) device;
+
+    if (write_size > 0) {
+        part->pointer = write_buffer[0];
+        for (size_t i = 1; i < write_size; i++) {
+            part->registers[part->pointer++] = write_buffer[i];
+        }
+    }
+
+    for (size_t i = 0; i < read_size; i++) {
+        read_buffer[i] = part->registers[part->pointer++];
+    }
+
+    return ESP_OK;
+}
+
+/**
+ * The SHT30 takes 16 bit commands instead of registers and answers a
+ * measurement with two words and their crc
+*/
+static esp_err_t test_sht30_transfer(struct host_i2c_device_t* device, const uint8_t* write_buffer, size_t write_size, uint8_t* read_buffer, size_t read_size)
+{
+    static const uint8_t measurement[6] = {0x66, 0x66, 0x00, 0x80, 0x00, 0x00};
+
+    if (write_size > 0 && write_size != 2) {
+        return ESP_FAIL;
+    }
+
+    if (read_size > 0) {
+        memcpy(read_buffer, measurement, read_size < sizeof(measurement) ? read_size : sizeof(measurement));
+    }
+    return ESP_OK;
+}
+
+static struct test_device_t test_sht30 = {
+    .device = { SHT30_ADDRESS, 1000000, test_sht30_transfer },
+};
+static struct test_device_t test_bme280 = {
+    .device = { BME280_ADDRESS, 3400000, test_device_transfer },
+};
+static struct test_device_t test_ltr390 = {
+    .device = { LTR390_ADDRESS, 400000, test_device_transfer },
+};
+static struct test_device_t test_max17048 = {
+    .device = { MAX17048_ADDRESS, 400000, test_device_transfer },
+};
+
+static void test_attach(void)
+{
+    // Calibration, chip id and a reading of the BME280 datasheet example
+    static const uint8_t bme280_calibration_t_p[26] = {
+        0x70, 0x6B, 0x43, 0x67, 0x18, 0xFC, 0x7D, 0x8E, 0x43, 0xD6, 0xD0, 0x0B, 0x27, 0x0B,
+        0x8C, 0x00, 0xF9, 0xFF, 0x8C, 0x3C, 0xF8, 0xC6, 0x70, 0x17, 0x00, 0x4B
+    };
+    static const uint8_t bme280_calibration_h[7] = {0x6A, 0x01, 0x00, 0x13, 0x29, 0x03, 0x1E};
+    static const uint8_t bme280_data[8] = {0x65, 0x5A, 0xC0, 0x7E, 0xED, 0x00, 0x80, 0x00};
+
+    memcpy(&test_bme280.registers[0x88], bme280_calibration_t_p, sizeof(bme280_calibration_t_p));
+    memcpy(&test_bme280.registers[0xE1], bme280_calibration_h, sizeof(bme280_calibration_h));
+    memcpy(&test_bme280.registers[0xF7], bme280_data, sizeof(bme280_data));
+    test_bme280.registers[0xD0] = 0x60;
+
+    // Part id, data always ready, some light and uv
+    test_ltr390.registers[LTR390_PART_ID] = 0xB2;
+    test_ltr390.registers[LTR390_MAIN_STATUS] = LTR390_MAIN_STATUS_DATA_READY;
+    test_ltr390.registers[LTR390_ALS_DATA_0 + 1] = 0x10;
+    test_ltr390.registers[LTR390_UVS_DATA_0 + 1] = 0x02;
+
+    // Version, 3.9 V, 87.5 % and -1.5 %/h
+    test_max17048.registers[MAX17048_VERSION_REG + 1] = 0x12;
+    test_max17048.registers[MAX17048_VCELL_REG] = 0xC3;
+    test_max17048.registers[MAX17048_VCELL_REG + 2] = 0x57;
+    test_max17048.registers[MAX17048_VCELL_REG + 3] = 0x80;
+    test_max17048.registers[MAX17048_CRATE_REG] = 0xFF;
+    test_max17048.registers[MAX17048_CRATE_REG + 1] = 0xF9;
+
+    host_i2c_attach(&test_sht30.device);
+    host_i2c_attach(&test_bme280.device);
+    host_i2c_attach(&test_ltr390.device);
+    host_i2c_attach(&test_max17048.device);
+}
+
+/**
+ * What a wake put on the bus
+*/
+struct test_wake_t {
+    struct host_i2c_stats_t stats;
+    int64_t duration_us;
+    struct sensor_data_t measurement;
+};
+
+/**
+ * One wake of the station: brings up the bus, reads every sensor and leaves
+ * them for deep sleep
+*/
+static void test_wake(struct test_wake_t* wake, uint16_t measurement_rate)
+{
+    TEST_CONFIGURE(measurement_rate);
+    host_i2c_reset_stats();
+    memset(&wake->measurement, 0, sizeof(struct sensor_data_t));
+
+    int64_t started_us = esp_timer_get_time();
+    sensors_init();
+    TEST_READ(&wake->measurement);
+    sensors_deinit();
+
+    wake->duration_us = esp_timer_get_time() - started_us;
+    wake->stats = *host_i2c_stats();
+}
+
+static void test_describe(char* label, size_t label_sz, const char* name, const struct test_wake_t* wake)
+{
+    snprintf(label, label_sz, "%s, %zu transactions, %zu B, %.2f ms", name,
+        wake->stats.transactions, wake->stats.bytes, wake->stats.bus_us / 1000.0);
+}
+
+#ifdef TEST_HISTORY
+
+/**
+ * Only reports a cold and a warm wake, the drivers of earlier commits lack
+ * most of what the checks look at
+*/
+int main(void)
+{
+    struct test_wake_t wake;
+    char label[64];
+
+    test_attach();
+    test_wake(&wake, TEST_SLOW_RATE);
+    test_describe(label, sizeof(label), "cold wake", &wake);
+    printf("%s\n", label);
+    test_wake(&wake, TEST_SLOW_RATE);
+    test_describe(label, sizeof(label), "warm wake at 60s", &wake);
+    printf("%s\n", label);
+    test_wake(&wake, TEST_FAST_RATE);
+    test_wake(&wake, TEST_FAST_RATE);
+    test_describe(label, sizeof(label), "warm wake at 10s", &wake);
+    printf("%s\n", label);
+
+    return 0;
+}
+
+#else
+
+static int test_check(const char* name, int passed)
+{
+    printf("%-52s %s\n", name, passed ? "ok" : "MISMATCH");
+    return passed ? 0 : 1;
+}
+
+int main(void)
+{
+    int failures = 0;
+    char label[64];
+    struct test_wake_t wake;
+
+    configuration.bme280_oversampling[0] = BME280_OVERSAMPLING_1X;
+    configuration.bme280_oversampling[1] = BME280_OVERSAMPLING_1X;
+    configuration.bme280_oversampling[2] = BME280_OVERSAMPLING_SKIPPED;
+    test_attach();
+
+    // A cold boot probes every device once and registers it at 400 kHz
+    test_wake(&wake, TEST_SLOW_RATE);
+    bool fast = true;
+    for (uint8_t i = 0; i < SENSORS_DEVICES; i++) {
+        fast = fast && sensors_devices[i].present && sensors_devices[i].scl_speed_hz == I2C_MASTER_FAST_FREQ_HZ;
+    }
+    snprintf(label, sizeof(label), "cold wake, %zu probes, all at 400 kHz", wake.stats.probes);
+    failures += test_check(label, wake.stats.probes == SENSORS_DEVICES && fast && wake.measurement.skipped_devices == 0);
+    failures += test_check("readings decoded",
+        wake.measurement.temperature > 24.9f && wake.measurement.temperature < 25.1f
+        && wake.measurement.temperature_inside > 25.0f && wake.measurement.temperature_inside < 25.2f
+        && wake.measurement.pressure > 1006.0f && wake.measurement.pressure < 1007.0f
+        && wake.measurement.battery_voltage > 3.89f && wake.measurement.battery_voltage < 3.91f
+        && wake.measurement.battery_charge == 87.5f
+        && wake.measurement.daylight > 0 && wake.measurement.uv > 0);
+
+    // Warm wakes at the default rate leave the LTR390 in standby, so it is
+    // switched to light and back on every wake and the UV conversion is
+    // waited for. Forced mode of the BME280 takes three transactions, the
+    // drivers before it made 11 (see `make history`).
+    test_wake(&wake, TEST_SLOW_RATE);
+    test_describe(label, sizeof(label), "warm wake at 60s", &wake);
+    failures += test_check(label,
+        wake.stats.probes == 0 && wake.stats.transactions == 14
+        && test_ltr390.registers[LTR390_MAIN_CTRL] == 0 && wake.duration_us > 2 * LTR390_CONVERSION_MS * 1000);
+
+    // Waking more often than every 32s leaves the LTR390 measuring UV in
+    // deep sleep. The first such wake switches it, from then on the UV
+    // result is waiting and only the light conversion is waited for.
+    test_wake(&wake, TEST_FAST_RATE);
+    test_wake(&wake, TEST_FAST_RATE);
+    test_describe(label, sizeof(label), "warm wake at 10s", &wake);
+    failures += test_check(label,
+        wake.stats.probes == 0 && wake.stats.transactions == 13
+        && test_ltr390.registers[LTR390_MAIN_CTRL] == LTR390_MAIN_CTRL_UVS && wake.duration_us < 2 * LTR390_CONVERSION_MS * 1000);
+
+    // A failed transfer makes the next wake probe the device again, once
+    host_i2c_fail(SHT30_ADDRESS, 1);
+    test_wake(&wake, TEST_SLOW_RATE);
+    bool skipped = wake.measurement.skipped_devices == 1 << SENSORS_DEVICE_SHT30 && wake.stats.probes == 0;
+    test_wake(&wake, TEST_SLOW_RATE);
+    size_t reprobes = wake.stats.probes;
+    test_wake(&wake, TEST_SLOW_RATE);
+    snprintf(label, sizeof(label), "failed read, %zu probe on the next wake", reprobes);
+    failures += test_check(label, skipped && reprobes == 1 && wake.stats.probes == 0 && wake.measurement.skipped_devices == 0);
+
+    // A device that does not answer at 400 kHz, e.g. with weak pull-ups, is
+    // probed again at 100 kHz and kept there
+    host_i2c_fail(LTR390_ADDRESS, 1);
+    test_wake(&wake, TEST_SLOW_RATE);
+    test_ltr390.device.scl_speed_max_hz = I2C_MASTER_FREQ_HZ;
+    test_wake(&wake, TEST_SLOW_RATE);
+    bool fallen_back = sensors_devices[SENSORS_DEVICE_LTR390].present && sensors_devices[SENSORS_DEVICE_LTR390].scl_speed_hz == I2C_MASTER_FREQ_HZ;
+    test_wake(&wake, TEST_SLOW_RATE);
+    test_describe(label, sizeof(label), "ltr390 at 100 kHz", &wake);
+    failures += test_check(label,
+        fallen_back && wake.stats.probes == 0 && wake.measurement.skipped_devices == 0
+        && sensors_devices[SENSORS_DEVICE_SHT30].scl_speed_hz == I2C_MASTER_FAST_FREQ_HZ);
+
+    // A part that is gone is left out without failing the others
+    host_i2c_detach_all();
+    test_ltr390.device.scl_speed_max_hz = I2C_MASTER_FAST_FREQ_HZ;
+    host_i2c_attach(&test_sht30.device);
+    host_i2c_attach(&test_bme280.device);
+    host_i2c_attach(&test_max17048.device);
+    test_wake(&wake, TEST_SLOW_RATE);
+    test_wake(&wake, TEST_SLOW_RATE);
+    failures += test_check("missing ltr390 skipped",
+        !sensors_devices[SENSORS_DEVICE_LTR390].present && sensors_devices[SENSORS_DEVICE_LTR390].probed
+        && wake.measurement.skipped_devices == 1 << SENSORS_DEVICE_LTR390);
+
+    return failures ? 1 : 0;
+}
+
+#endif